@@ -4,42 +4,120 @@
 #include "mem_util.h"
 #include "record_shmem.h"
 
-int create_record_ctrl(void){
-	int i;
+static int create_recorder_pool(u32 n_recorder){
+	u32 i, size;
+	int order;
+	struct RecorderPool *pool;
+
+	if (n_recorder == 0 || n_recorder > MAX_N_RECORDER || (n_recorder & (n_recorder - 1))){
+		printk("[DETER] n_recorder must be a power of 2 and at most %u\n", MAX_N_RECORDER);
+		return -1;
+	}
+	size = get_rec_pool_size(n_recorder);
+	order = get_page_order(size);
+	if (order >= MAX_ORDER){
+		printk("[DETER] %u recorders need %u Bytes, more than the largest contiguous allocation\n", n_recorder, size);
+		return -1;
+	}
+	printk("[DETER] %u recorders need %u Bytes, allocate %lu Bytes\n", n_recorder, size, (1<<order) * 4096lu);
+
+	pool = (struct RecorderPool*)__get_free_pages(GFP_KERNEL, order);
+	if (!pool)
+		return -1;
+	reserve_pages(virt_to_page(pool), 1<<order);
+	memset(pool, 0, size);
+	pool->n_recorder = n_recorder;
+	pool->size = size;
+	pool->rec_off = get_rec_pool_rec_off(n_recorder);
+
+	// init free slot ring, contain all slots
+	pool->h = 0;
+	pool->t = pool->t_mp = n_recorder;
+	for (i = 0; i < n_recorder; i++)
+		pool->v[i] = i;
+	shmem.pool = pool;
+	return 0;
+}
+
+static void delete_recorder_pool(void){
+	int order;
+	if (!shmem.pool)
+		return;
+	order = get_page_order(shmem.pool->size);
+	unreserve_pages(virt_to_page(shmem.pool), 1<<order);
+	free_pages((unsigned long)shmem.pool, order);
+	shmem.pool = NULL;
+}
+
+/* the most MemBlock that fit the largest contiguous allocation, with their rings */
+static u32 get_max_n_mem_block(void){
+	u64 max_size = 4096lu << (MAX_ORDER - 1);
+	u32 n = max_size / MEM_BLOCK_SIZE;
+	while (n > 0 && get_shmem_size(n) > max_size)
+		n--;
+	return n;
+}
+
+int create_record_ctrl(u32 n_recorder, u32 n_mem_block){
+	u32 i, max_n_mem_block = get_max_n_mem_block();
+	u64 size;
+	int order;
+	struct SharedMemLayout *l;
+
+	// by default, DETER_MB_PER_RECORDER per slot, as many as we can get
+	if (n_mem_block == 0){
+		n_mem_block = n_recorder * DETER_MB_PER_RECORDER;
+		if (n_mem_block < MIN_N_MEM_BLOCK)
+			n_mem_block = MIN_N_MEM_BLOCK;
+		if (n_mem_block > max_n_mem_block){
+			printk("[DETER] %u recorders want %u MemBlock, only %u fit\n", n_recorder, n_mem_block, max_n_mem_block);
+			n_mem_block = max_n_mem_block;
+		}
+	}
+	if (n_mem_block == 0 || n_mem_block > max_n_mem_block){
+		printk("[DETER] n_mem_block must be at most %u, the largest contiguous allocation\n", max_n_mem_block);
+		return -1;
+	}
 
 	// find the right number of pages 
-	int order = get_page_order(sizeof(struct SharedMemLayout));
-	printk("[DETER] need %lu Bytes, allocat %lu Bytes\n", (sizeof(struct SharedMemLayout)), (1<<order) * 4096lu);
+	size = get_shmem_size(n_mem_block);
+	order = get_page_order(size);
+	printk("[DETER] %u MemBlock need %llu Bytes, allocat %lu Bytes\n", n_mem_block, size, (1<<order) * 4096lu);
 
 	// allocate and reserve pages
-	shmem.addr = (struct SharedMemLayout*)__get_free_pages(GFP_KERNEL, order);
-	if (shmem.addr){
-		reserve_pages(virt_to_page(shmem.addr), 1<<order);
+	l = (struct SharedMemLayout*)__get_free_pages(GFP_KERNEL, order);
+	if (l){
+		reserve_pages(virt_to_page(l), 1<<order);
 	}else 
 		goto fail_addr;
-
-	// init free_rec_ring, contain all recorder
-	struct RecorderRing *rec_ring = &shmem.addr->free_rec_ring;
-	rec_ring->h = 0;
-	rec_ring->t = N_RECORDER;
-	for (i = 0; i < N_RECORDER; i++)
-		rec_ring->v[i] = i;
+	memset(l, 0, get_shmem_mb_off(n_mem_block));
+	l->n_mem_block = n_mem_block;
+	l->ring_size = get_mb_ring_size(n_mem_block);
+	l->size = size;
+	l->mb_off = get_shmem_mb_off(n_mem_block);
+	shmem.addr = l;
 
 	// init free_mb_ring, contain all MemBlock
-	struct FreeMemBlockRing *free_mb_ring = &shmem.addr->free_mb_ring;
-	free_mb_ring->h = 0;
-	free_mb_ring->t = N_MEM_BLOCK;
-	for (i = 0; i < N_MEM_BLOCK; i++)
-		free_mb_ring->v[i] = i;
+	l->free_mb_ring.h = 0;
+	l->free_mb_ring.t = n_mem_block;
+	for (i = 0; i < n_mem_block; i++)
+		get_free_mb_ring(l)[i] = i;
 
 	// init done_mb_ring, empty
-	struct DoneMemBlockRing *done_mb_ring = &shmem.addr->done_mb_ring;
-	done_mb_ring->h = 0;
-	done_mb_ring->t = 0;
-	done_mb_ring->t_mp = 0;
+	l->done_mb_ring.h = 0;
+	l->done_mb_ring.t = 0;
+	l->done_mb_ring.t_mp = 0;
+
+	// recorder slots
+	if (create_recorder_pool(n_recorder))
+		goto fail_pool;
 
 	return 0;
 
+fail_pool:
+	printk("[DETER] create_record_ctrl(): Fail to create recorder pool\n");
+	delete_record_ctrl();
+	return -1;
 fail_addr:
 	printk("[DETER] create_record_ctrl(): Fail to allocate shmem.addr\n");
 	return -1;
@@ -47,11 +125,12 @@ fail_addr:
 
 void delete_record_ctrl(void){
 	int order;
+	delete_recorder_pool();
 	if (!shmem.addr)
 		return;
 
 	// find the right number of pages 
-	order = get_page_order(sizeof(struct SharedMemLayout));
+	order = get_page_order(shmem.addr->size);
 
 	// free pages
 	unreserve_pages(virt_to_page(shmem.addr), 1<<order);
@@ -4,7 +4,7 @@
 #include <net/deter.h>
 #include <linux/spinlock.h>
 
-int create_record_ctrl(void);
+int create_record_ctrl(u32 n_recorder, u32 n_mem_block);
 void delete_record_ctrl(void);
 
 #endif /* _RECORD_CTRL_H */
@@ -0,0 +1,469 @@
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/string.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/capability.h>
+#include "record_filter.h"
+
+#define FILTER_PROC_NAME "deter_filter"
+
+struct RecordFilterStats filter_stats;
+
+// the table used by the SYN path. Only replaced (never modified) under filter_mutex
+static struct RecordFilter __rcu *live_filter = NULL;
+// the table being edited through the proc file. Protected by filter_mutex
+static struct RecordFilter *staging_filter = NULL;
+static DEFINE_MUTEX(filter_mutex);
+
+static inline u32 prefix_mask(u8 len){
+	return len == 0 ? 0 : ~0u << (32 - len);
+}
+static inline u32 net_hash_idx(u32 net, u8 len){
+	return hash_32(net ^ ((u32)len * 0x9e3779b9), FILTER_NET_HASH_BITS);
+}
+
+/* return the index of the net rule with exactly this prefix, or -1 */
+static int find_net_rule(struct RecordFilter *f, u32 net, u8 len){
+	u32 i, h = net_hash_idx(net, len);
+	for (i = 0; i < FILTER_NET_HASH_SIZE; i++, h = (h + 1) & (FILTER_NET_HASH_SIZE - 1)){
+		u16 x = f->net_hash[h];
+		if (x == 0)
+			return -1;
+		if (f->net_rule[x-1].net == net && f->net_rule[x-1].len == len)
+			return x - 1;
+	}
+	return -1;
+}
+
+static int find_port_rule(struct RecordFilter *f, u16 lo, u16 hi){
+	u32 i;
+	for (i = 0; i < f->n_port_rule; i++)
+		if (f->port_rule[i].lo == lo && f->port_rule[i].hi == hi)
+			return i;
+	return -1;
+}
+
+/* rebuild the lookup structures (bitmap, hash, len_mask) from the rule arrays */
+static void rebuild_filter(struct RecordFilter *f){
+	u32 i, p;
+	bitmap_zero(f->port_bitmap, 65536);
+	for (i = 0; i < f->n_port_rule; i++)
+		for (p = f->port_rule[i].lo; p <= f->port_rule[i].hi; p++)
+			set_bit(p, f->port_bitmap);
+
+	memset(f->net_hash, 0, sizeof(f->net_hash));
+	f->len_mask = 0;
+	f->n_include = 0;
+	for (i = 0; i < f->n_net_rule; i++){
+		struct FilterNetRule *r = &f->net_rule[i];
+		u32 h = net_hash_idx(r->net, r->len);
+		while (f->net_hash[h])
+			h = (h + 1) & (FILTER_NET_HASH_SIZE - 1);
+		f->net_hash[h] = i + 1;
+		f->len_mask |= 1ull << r->len;
+		if (!r->exclude)
+			f->n_include++;
+	}
+}
+
+static void reset_filter_hit(struct RecordFilter *f){
+	u32 i;
+	for (i = 0; i < f->n_port_rule; i++)
+		atomic_long_set(&f->port_rule[i].hit, 0);
+	for (i = 0; i < f->n_net_rule; i++)
+		atomic_long_set(&f->net_rule[i].hit, 0);
+}
+
+bool record_filter_match(u16 port, u32 dip){
+	struct RecordFilter *f;
+	u32 ip = ntohl(dip);
+	u64 mask;
+	int idx = -1;
+	bool ret = false;
+	u32 i;
+
+	rcu_read_lock();
+	f = rcu_dereference(live_filter);
+	if (!f)
+		goto out;
+
+	// O(1) port check first, since most connections on the host are not on a monitored port
+	if (!test_bit(port, f->port_bitmap)){
+		atomic_long_inc(&filter_stats.port_miss);
+		goto out;
+	}
+
+	// longest prefix match, from the longest prefix length that has rules
+	for (mask = f->len_mask; mask && idx < 0; ){
+		u8 len = fls64(mask) - 1;
+		mask &= ~(1ull << len);
+		idx = find_net_rule(f, ip & prefix_mask(len), len);
+	}
+	if (idx >= 0){
+		atomic_long_inc(&f->net_rule[idx].hit);
+		ret = !f->net_rule[idx].exclude;
+	}else
+		ret = (f->n_include == 0);
+	if (!ret){
+		atomic_long_inc(&filter_stats.net_miss);
+		goto out;
+	}
+
+	// count the port rule. Only matched connections get here, and there are few port rules
+	for (i = 0; i < f->n_port_rule; i++)
+		if (port >= f->port_rule[i].lo && port <= f->port_rule[i].hi){
+			atomic_long_inc(&f->port_rule[i].hit);
+			break;
+		}
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
+bool record_filter_sample(u32 sip, u32 dip, u16 sport, u16 dport){
+	struct RecordFilter *f;
+	u32 a_ip = ntohl(sip), b_ip = ntohl(dip), a_port = ntohs(sport), b_port = ntohs(dport), h;
+	bool ret = true;
+
+	rcu_read_lock();
+	f = rcu_dereference(live_filter);
+	if (!f || f->sample_ppm >= 1000000)
+		goto out;
+
+	// order the two endpoints, so that the client and server see the same hash input
+	if (a_ip > b_ip || (a_ip == b_ip && a_port > b_port)){
+		swap(a_ip, b_ip);
+		swap(a_port, b_port);
+	}
+	h = jhash_3words(a_ip, b_ip, (a_port << 16) | b_port, f->sample_key);
+	// select if h / 2^32 < sample_ppm / 10^6
+	ret = (u64)h * 1000000 < ((u64)f->sample_ppm << 32);
+	if (!ret)
+		atomic_long_inc(&filter_stats.sampled_out);
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
+u32 record_filter_eb_dense(void){
+	struct RecordFilter *f;
+	u32 ret = DETER_EFFECT_BOOL_ALL_DENSE;
+
+	rcu_read_lock();
+	f = rcu_dereference(live_filter);
+	if (f)
+		ret = f->eb_dense;
+	rcu_read_unlock();
+	return ret | DETER_EFFECT_BOOL_MUST_DENSE;
+}
+
+/******************************************
+ * rule editing. All called with filter_mutex held
+ *****************************************/
+static struct RecordFilter* get_staging_filter(void){
+	struct RecordFilter *live;
+	if (staging_filter)
+		return staging_filter;
+	staging_filter = kzalloc(sizeof(struct RecordFilter), GFP_KERNEL);
+	if (!staging_filter)
+		return NULL;
+	live = rcu_dereference_protected(live_filter, lockdep_is_held(&filter_mutex));
+	if (live){
+		memcpy(staging_filter, live, sizeof(struct RecordFilter));
+		reset_filter_hit(staging_filter);
+	}
+	return staging_filter;
+}
+
+static void commit_staging_filter(void){
+	struct RecordFilter *old;
+	if (!staging_filter)
+		return;
+	old = rcu_dereference_protected(live_filter, lockdep_is_held(&filter_mutex));
+	rcu_assign_pointer(live_filter, staging_filter);
+	staging_filter = NULL;
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
+static int filter_add_port(struct RecordFilter *f, u16 lo, u16 hi){
+	if (find_port_rule(f, lo, hi) >= 0)
+		return 0;
+	if (f->n_port_rule >= FILTER_N_PORT_RULE)
+		return -ENOSPC;
+	f->port_rule[f->n_port_rule].lo = lo;
+	f->port_rule[f->n_port_rule].hi = hi;
+	atomic_long_set(&f->port_rule[f->n_port_rule].hit, 0);
+	f->n_port_rule++;
+	rebuild_filter(f);
+	return 0;
+}
+
+static int filter_del_port(struct RecordFilter *f, u16 lo, u16 hi){
+	int i = find_port_rule(f, lo, hi);
+	if (i < 0)
+		return -ENOENT;
+	f->port_rule[i] = f->port_rule[--f->n_port_rule];
+	rebuild_filter(f);
+	return 0;
+}
+
+/* net is in host byte order */
+static int filter_add_net(struct RecordFilter *f, u32 net, u8 len, u8 exclude){
+	int i;
+	net &= prefix_mask(len);
+	i = find_net_rule(f, net, len);
+	if (i < 0){
+		if (f->n_net_rule >= FILTER_N_NET_RULE)
+			return -ENOSPC;
+		i = f->n_net_rule++;
+		f->net_rule[i].net = net;
+		f->net_rule[i].len = len;
+		atomic_long_set(&f->net_rule[i].hit, 0);
+	}
+	f->net_rule[i].exclude = exclude;
+	rebuild_filter(f);
+	return 0;
+}
+
+static int filter_del_net(struct RecordFilter *f, u32 net, u8 len){
+	int i = find_net_rule(f, net & prefix_mask(len), len);
+	if (i < 0)
+		return -ENOENT;
+	f->net_rule[i] = f->net_rule[--f->n_net_rule];
+	rebuild_filter(f);
+	return 0;
+}
+
+static int parse_port_range(const char *s, u16 *lo, u16 *hi){
+	u32 a, b;
+	int n = sscanf(s, "%u-%u", &a, &b);
+	if (n < 1)
+		return -EINVAL;
+	if (n == 1)
+		b = a;
+	if (a > b || b > 65535)
+		return -EINVAL;
+	*lo = a;
+	*hi = b;
+	return 0;
+}
+
+static int parse_prefix(const char *s, u32 *net, u8 *len){
+	u32 a[4], l = 32;
+	int n = sscanf(s, "%u.%u.%u.%u/%u", &a[0], &a[1], &a[2], &a[3], &l);
+	if (n < 4 || a[0] > 255 || a[1] > 255 || a[2] > 255 || a[3] > 255 || l > 32)
+		return -EINVAL;
+	*net = (a[0] << 24) | (a[1] << 16) | (a[2] << 8) | a[3];
+	*len = l;
+	return 0;
+}
+
+/*
+ * Commands (one per write):
+ *   port add <lo>[-<hi>]      port del <lo>[-<hi>]
+ *   net add <ip>[/<len>]      net exclude <ip>[/<len>]      net del <ip>[/<len>]
+ *   sample <ppm>              record this many per million matched connections
+ *   key <hex>                 key of the sampling hash
+ *   eb <hex>                  mask of effect_bool locations with their own stream (loc 0 is always included)
+ *   clear                     drop all rules in staging
+ *   commit                    atomically replace the live rules with staging
+ *   abort                     drop staging
+ * Edits go to a staging copy of the live rules, and take effect only on commit.
+ */
+static int filter_exec_cmd(char *cmd){
+	struct RecordFilter *f;
+	char obj[8], op[8], arg[32];
+	u16 lo, hi;
+	u32 net, val;
+	u8 len;
+	int n;
+
+	if (strcmp(cmd, "commit") == 0){
+		commit_staging_filter();
+		return 0;
+	}
+	if (strcmp(cmd, "abort") == 0){
+		kfree(staging_filter);
+		staging_filter = NULL;
+		return 0;
+	}
+
+	if (!(f = get_staging_filter()))
+		return -ENOMEM;
+	if (strcmp(cmd, "clear") == 0){
+		memset(f, 0, sizeof(struct RecordFilter));
+		f->sample_ppm = 1000000;
+		f->eb_dense = DETER_EFFECT_BOOL_MUST_DENSE;
+		return 0;
+	}
+	if (sscanf(cmd, "sample %u", &val) == 1){
+		if (val > 1000000)
+			return -EINVAL;
+		f->sample_ppm = val;
+		return 0;
+	}
+	if (sscanf(cmd, "key %x", &val) == 1){
+		f->sample_key = val;
+		return 0;
+	}
+	if (sscanf(cmd, "eb %x", &val) == 1){
+		if (val & ~DETER_EFFECT_BOOL_ALL_DENSE)
+			return -EINVAL;
+		f->eb_dense = val | DETER_EFFECT_BOOL_MUST_DENSE;
+		return 0;
+	}
+
+	n = sscanf(cmd, "%7s %7s %31s", obj, op, arg);
+	if (n != 3)
+		return -EINVAL;
+	if (strcmp(obj, "port") == 0){
+		if (parse_port_range(arg, &lo, &hi))
+			return -EINVAL;
+		if (strcmp(op, "add") == 0)
+			return filter_add_port(f, lo, hi);
+		if (strcmp(op, "del") == 0)
+			return filter_del_port(f, lo, hi);
+	}else if (strcmp(obj, "net") == 0){
+		if (parse_prefix(arg, &net, &len))
+			return -EINVAL;
+		if (strcmp(op, "add") == 0)
+			return filter_add_net(f, net, len, 0);
+		if (strcmp(op, "exclude") == 0)
+			return filter_add_net(f, net, len, 1);
+		if (strcmp(op, "del") == 0)
+			return filter_del_net(f, net, len);
+	}
+	return -EINVAL;
+}
+
+/******************************************
+ * proc file
+ *****************************************/
+static int filter_proc_show(struct seq_file *m, void *v){
+	struct RecordFilter *f;
+	u32 i;
+
+	mutex_lock(&filter_mutex);
+	f = rcu_dereference_protected(live_filter, lockdep_is_held(&filter_mutex));
+	if (f){
+		seq_printf(m, "ports: %u rules\n", f->n_port_rule);
+		for (i = 0; i < f->n_port_rule; i++)
+			seq_printf(m, "  %hu-%hu hit %ld\n", f->port_rule[i].lo, f->port_rule[i].hi, atomic_long_read(&f->port_rule[i].hit));
+		seq_printf(m, "nets: %u rules\n", f->n_net_rule);
+		for (i = 0; i < f->n_net_rule; i++){
+			struct FilterNetRule *r = &f->net_rule[i];
+			seq_printf(m, "  %s %u.%u.%u.%u/%hhu hit %ld\n", r->exclude ? "exclude" : "include",
+					r->net >> 24, (r->net >> 16) & 0xff, (r->net >> 8) & 0xff, r->net & 0xff, r->len, atomic_long_read(&r->hit));
+		}
+	}
+	seq_printf(m, "port_miss %ld\n", atomic_long_read(&filter_stats.port_miss));
+	seq_printf(m, "net_miss %ld\n", atomic_long_read(&filter_stats.net_miss));
+	if (f)
+		seq_printf(m, "sample: %u ppm key 0x%08x\n", f->sample_ppm, f->sample_key);
+	if (f)
+		seq_printf(m, "eb_dense: 0x%05x\n", f->eb_dense);
+	seq_printf(m, "sampled_out %ld\n", atomic_long_read(&filter_stats.sampled_out));
+	seq_printf(m, "slot_exhausted %ld\n", atomic_long_read(&filter_stats.slot_exhausted));
+	seq_printf(m, "mb_exhausted %ld\n", atomic_long_read(&filter_stats.mb_exhausted));
+	seq_printf(m, "staging: %s\n", staging_filter ? "uncommitted changes" : "none");
+	mutex_unlock(&filter_mutex);
+	return 0;
+}
+
+static int filter_proc_open(struct inode *inode, struct file *file){
+	return single_open(file, filter_proc_show, NULL);
+}
+
+static ssize_t filter_proc_write(struct file *file, const char __user *ubuf, size_t len, loff_t *ppos){
+	char buf[64];
+	int ret;
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+	if (len > sizeof(buf) - 1)
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, len))
+		return -EFAULT;
+	buf[len] = 0;
+
+	mutex_lock(&filter_mutex);
+	ret = filter_exec_cmd(strim(buf));
+	mutex_unlock(&filter_mutex);
+	if (ret)
+		printk("[DETER] deter_filter: command '%s' failed: %d\n", buf, ret);
+	return ret ? ret : len;
+}
+
+static const struct file_operations filter_proc_fops = {
+	.owner = THIS_MODULE,
+	.open = filter_proc_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = filter_proc_write,
+};
+
+static void free_filters(void){
+	struct RecordFilter *f;
+	mutex_lock(&filter_mutex);
+	f = rcu_dereference_protected(live_filter, lockdep_is_held(&filter_mutex));
+	RCU_INIT_POINTER(live_filter, NULL);
+	kfree(staging_filter);
+	staging_filter = NULL;
+	mutex_unlock(&filter_mutex);
+
+	// wait for SYN-path readers, and for pending kfree_rcu of older tables
+	synchronize_rcu();
+	rcu_barrier();
+	kfree(f);
+}
+
+int record_filter_init(u32 dstip, u32 ndstip, u32 sample_ppm, u32 sample_key, u32 eb_dense){
+	struct RecordFilter *f;
+
+	atomic_long_set(&filter_stats.port_miss, 0);
+	atomic_long_set(&filter_stats.net_miss, 0);
+	atomic_long_set(&filter_stats.sampled_out, 0);
+	atomic_long_set(&filter_stats.slot_exhausted, 0);
+	atomic_long_set(&filter_stats.mb_exhausted, 0);
+
+	// default rules: the ports we used to hardcode, plus the legacy dstip/ndstip module parameters
+	mutex_lock(&filter_mutex);
+	if (!(f = get_staging_filter()))
+		goto fail_alloc;
+	filter_add_port(f, 60000, 60003);
+	filter_add_port(f, 50010, 50010);
+	if (dstip)
+		filter_add_net(f, ntohl(dstip), 32, 0);
+	if (ndstip)
+		filter_add_net(f, ntohl(ndstip), 32, 1);
+	f->sample_ppm = sample_ppm > 1000000 ? 1000000 : sample_ppm;
+	f->sample_key = sample_key;
+	f->eb_dense = (eb_dense & DETER_EFFECT_BOOL_ALL_DENSE) | DETER_EFFECT_BOOL_MUST_DENSE;
+	commit_staging_filter();
+	mutex_unlock(&filter_mutex);
+
+	if (!proc_create(FILTER_PROC_NAME, 0644, NULL, &filter_proc_fops)){
+		printk("[DETER] record_filter_init: Fail to open proc file\n");
+		free_filters();
+		return -1;
+	}
+	return 0;
+
+fail_alloc:
+	mutex_unlock(&filter_mutex);
+	printk("[DETER] record_filter_init: Fail to allocate filter\n");
+	return -1;
+}
+
+/* must be called after the record ops are unbound */
+void record_filter_exit(void){
+	remove_proc_entry(FILTER_PROC_NAME, NULL);
+	free_filters();
+}
@@ -0,0 +1,75 @@
+#ifndef _KMOD__RECORD_FILTER_H
+#define _KMOD__RECORD_FILTER_H
+
+#include <linux/types.h>
+#include <linux/bitops.h>
+#include <linux/rcupdate.h>
+#include <asm/atomic.h>
+#include "deter_recorder.h"
+
+#define FILTER_N_PORT_RULE 64
+#define FILTER_N_NET_RULE 256
+#define FILTER_NET_HASH_BITS 10 // must hold FILTER_N_NET_RULE with a low load factor
+#define FILTER_NET_HASH_SIZE (1 << FILTER_NET_HASH_BITS)
+
+/* A range of local service ports [lo, hi].
+ * For server side the local port is sport, for client side it is dport */
+struct FilterPortRule{
+	u16 lo, hi;
+	atomic_long_t hit; // number of new connections matched by this rule
+};
+
+/* An IPv4 prefix of the remote (dst) address, in host byte order */
+struct FilterNetRule{
+	u32 net;
+	u8 len; // prefix length, 0 ~ 32
+	u8 exclude; // 0: include; 1: exclude
+	atomic_long_t hit;
+};
+
+/*
+ * The rule set used on the SYN path.
+ * A connection is recorded if its local port is in port_bitmap, and its dst ip passes the net rules:
+ *   the longest matching prefix decides include/exclude;
+ *   if no prefix matches, it is included only if there is no include rule.
+ * The live table is never modified. Updates go to a staging copy which is swapped in by RCU.
+ */
+struct RecordFilter{
+	struct rcu_head rcu; // keep first, for kfree_rcu
+	unsigned long port_bitmap[BITS_TO_LONGS(65536)];
+	u32 n_port_rule, n_net_rule;
+	u32 n_include; // number of include net rules
+	u64 len_mask; // bit i is set if there is a net rule with prefix length i
+	u32 sample_ppm; // fraction of matched connections to record, in parts per million
+	u32 sample_key; // key of the 4-tuple hash. Use the same key on both sides so client and server traces pair up
+	u32 eb_dense; // effect_bool locations that get their own stream in new recorders; the rest are multiplexed
+	struct FilterPortRule port_rule[FILTER_N_PORT_RULE];
+	struct FilterNetRule net_rule[FILTER_N_NET_RULE];
+	u16 net_hash[FILTER_NET_HASH_SIZE]; // open addressing; index+1 into net_rule, 0 means empty
+};
+
+/* counters of new connections that are not recorded, and of records dropped, since the module is loaded */
+struct RecordFilterStats{
+	atomic_long_t port_miss;
+	atomic_long_t net_miss;
+	atomic_long_t sampled_out; // matched, but not selected by sampling
+	atomic_long_t slot_exhausted; // selected, but no free recorder
+	atomic_long_t mb_exhausted; // records dropped for want of a free MemBlock; their connection is marked broken
+};
+extern struct RecordFilterStats filter_stats;
+
+/* dstip/ndstip are the legacy module parameters, in network byte order (0 means unset) */
+int record_filter_init(u32 dstip, u32 ndstip, u32 sample_ppm, u32 sample_key, u32 eb_dense);
+void record_filter_exit(void);
+
+/* called in the recorder_create hooks (bottom-half). port in host byte order, dip in network byte order */
+bool record_filter_match(u16 port, u32 dip);
+
+/* deterministic sampling of a matched connection by a keyed hash of its 4-tuple (network byte order).
+ * The hash is symmetric, so both ends of a connection make the same decision */
+bool record_filter_sample(u32 sip, u32 dip, u16 sport, u16 dport);
+
+/* the effect_bool dense mask for a new recorder. Always includes DETER_EFFECT_BOOL_MUST_DENSE */
+u32 record_filter_eb_dense(void);
+
+#endif /* _KMOD__RECORD_FILTER_H */
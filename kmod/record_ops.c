@@ -7,42 +7,52 @@
 #include "copy_from_sock_init_val.h"
 #include "logger.h"
 #include "record_shmem.h"
-
-u32 mon_dstip = 0;
-u32 mon_ndstip = 0;
+#include "record_filter.h"
+#include "record_prof.h"
 
 static inline int is_valid_recorder(struct DeterRecorder *rec){
-	int idx = rec - (struct DeterRecorder*) shmem.addr->recorder;
-	return idx >= 0 && idx < N_RECORDER;
+	long idx = rec - get_pool_recorder(shmem.pool, 0);
+	return idx >= 0 && idx < shmem.pool->n_recorder;
 }
 
 static inline u32 rec2idx(struct DeterRecorder* rec){
-	return (u32)(rec - shmem.addr->recorder);
+	return (u32)(rec - get_pool_recorder(shmem.pool, 0));
 }
 static inline u32 mb2idx(struct MemBlock *mb){
-	return (u32)(mb - shmem.addr->mem_block);
+	return (u32)(mb - get_mem_block(shmem.addr, 0));
 }
 
 // TODO: potential concurrency bug here: this is a multi-consumer queue
 //		 Do a test of h < t before the atomic add would help, because it solves 2 concurrent consumer case, which is already rare, and >2 concurrent consumer is super rare...
 static void* deter_alloc_recorder(void){
-	atomic_t *h = (atomic_t*)&shmem.addr->free_rec_ring.h;
+	struct RecorderPool *pool = shmem.pool;
+	atomic_t *h = (atomic_t*)&pool->h;
 	u32 ring_idx = atomic_add_return(1, h) - 1; // use atomic_add_return, so concurrent callers are guaranteed to get diff ring_idx
 	u32 rec_idx;
 	// if not enough free recorder, dec h back.
-	if (ring_idx >= (u32)shmem.addr->free_rec_ring.t){// it is fine to directly read t here (not atomic_read), because this won't cause error
+	if (ring_idx >= (u32)atomic_read((atomic_t*)&pool->t)){
 		atomic_dec(h);
 		return NULL;
 	}
-	// we know this slot (ring_idx) in the ring is valid (won't be written by user), because the ring is large enough to contain N_RECORDER recorder
-	rec_idx = shmem.addr->free_rec_ring.v[get_rec_ring_idx(ring_idx)];
-	return &shmem.addr->recorder[rec_idx];
+	// we know this slot (ring_idx) in the ring is valid, because the ring is large enough to contain all slots
+	rec_idx = pool->v[get_rec_ring_idx(pool, ring_idx)];
+	return get_pool_recorder(pool, rec_idx);
+}
+
+/* put back the slot of a done connection. Multi-producer, same scheme as put_done_mem_block */
+static void deter_free_recorder(struct DeterRecorder *rec){
+	struct RecorderPool *pool = shmem.pool;
+	u32 ring_idx = atomic_add_return(1, (atomic_t*)&pool->t_mp) - 1;
+	pool->v[get_rec_ring_idx(pool, ring_idx)] = rec2idx(rec);
+	while (atomic_read((atomic_t*)&pool->t) != ring_idx); // wait for concurrent putters that get lower ring_idx
+	atomic_inc((atomic_t*)&pool->t);
 }
 
 // TODO: potential concurrency bug here: this is a multi-consumer queue
 //		 Do a test of h < t before the atomic add would help, because it solves 2 concurrent consumer case, which is already rare, and >2 concurrent consumer is super rare...
 static inline struct MemBlock* get_free_mem_block(void){
-	struct FreeMemBlockRing *ring = &shmem.addr->free_mb_ring;
+	struct SharedMemLayout *l = shmem.addr;
+	struct FreeMemBlockRing *ring = &l->free_mb_ring;
 	atomic_t *h = (atomic_t*)&ring->h;
 	u32 ring_idx = atomic_add_return(1, h) - 1; // use atomic_add_return, so concurrent callers are guaranteed to get diff ring_idx
 	u32 mb_idx;
@@ -51,34 +61,47 @@ static inline struct MemBlock* get_free_mem_block(void){
 		atomic_dec(h);
 		return NULL;
 	}
-	// we know this slot (ring_idx) in the ring is valid (won't be written by user), because the ring is large enough to contain N_MEM_BLOCK mb
-	mb_idx = ring->v[get_free_mb_ring_idx(ring_idx)];
-	return &shmem.addr->mem_block[mb_idx];
+	// we know this slot (ring_idx) in the ring is valid (won't be written by user), because the ring is large enough to contain all mb
+	mb_idx = get_free_mb_ring(l)[get_mb_ring_idx(l, ring_idx)];
+	return get_mem_block(l, mb_idx);
 }
 
+/*
+ * get a MemBlock for rec. Never wait for one: we may be in softirq on the CPU user space needs to free one.
+ * If none is free, the caller drops its record and the connection is marked broken
+ */
 static inline struct MemBlock* get_and_init_mem_block(struct DeterRecorder* rec, u8 type){
 	struct MemBlock* mb = get_free_mem_block();
 	if (mb){
 		mb->len = 0;
 		mb->type = type;
-		mb->rec_id = rec2idx(rec);
+		mb->rec_id = rec->rec_id;
 		rec->used_mb++;
+	}else {
+		rec->broken = 1;
+		atomic_long_inc(&filter_stats.mb_exhausted);
 	}
 	return mb;
 }
 
 static inline void put_done_mem_block(struct MemBlock* mb){
-	struct DoneMemBlockRing *ring = &shmem.addr->done_mb_ring;
+	struct SharedMemLayout *l = shmem.addr;
+	struct DoneMemBlockRing *ring = &l->done_mb_ring;
 	atomic_t *t_mp = (atomic_t*)&ring->t_mp;
 	u32 ring_idx = atomic_add_return(1, t_mp) - 1;
 	// there is not need to check if the ring has enough space, because the ring is large enough
-	ring->v[get_done_mb_ring_idx(ring_idx)] = mb2idx(mb);
-	while (atomic_read((atomic_t*)&ring->t) != ring_idx); // if the condition is true, there are other concurrent putters that get lower ring_idx; wait for them to finish
+	get_done_mb_ring(l)[get_mb_ring_idx(l, ring_idx)] = mb2idx(mb);
+	if (atomic_read((atomic_t*)&ring->t) != ring_idx){
+		PROF_START(t0);
+		while (atomic_read((atomic_t*)&ring->t) != ring_idx); // if the condition is true, there are other concurrent putters that get lower ring_idx; wait for them to finish
+		PROF_END(PROF_HOOK_PUT_DONE_WAIT, t0);
+	}
 	atomic_inc((atomic_t*)&ring->t);
 }
 
 /* 
  * Set of push_* functions that first check mb space, put done and get a new mb if necessary, and push data to the mb.
+ * A stream gets its first mb on its first push, so a connection only holds MemBlock for the streams it uses.
  * Functions includes:
  *     push_bit(struct DeterRecorder*rec, struct MemBlock** cur, u8 type, u8 x)
  *     push_u8(struct DeterRecorder*rec, struct MemBlock** cur, u8 type, u8 x)
@@ -89,9 +112,14 @@ static inline void put_done_mem_block(struct MemBlock* mb){
  */
 #define DEFINE_PUSH_BLOCK_FUNC(name, tp)\
 static inline void push_##name(struct DeterRecorder* rec, struct MemBlock** cur, u8 type, tp x){\
-	if (!check_space_##name##_block(*cur)){ \
-		put_done_mem_block(*cur); \
-		while ((*cur = get_and_init_mem_block(rec, type)) == NULL); \
+	if (!*cur || !check_space_##name##_block(*cur)){ \
+		PROF_START(t0); \
+		if (*cur) \
+			put_done_mem_block(*cur); \
+		*cur = get_and_init_mem_block(rec, type); \
+		PROF_END(PROF_HOOK_BLOCK_ROLLOVER, t0); \
+		if (!*cur) \
+			return; \
 	} \
 	push_##name##_block((*cur), x); \
 }
@@ -103,65 +131,35 @@ DEFINE_PUSH_BLOCK_FUNC(u32, u32);
 DEFINE_PUSH_BLOCK_FUNC(u64, u64);
 
 static inline void push_nbyte(struct DeterRecorder *rec, struct MemBlock** cur, u8 type, u32 nbyte, void* addr){
-	if (!check_space_nbyte_block((*cur), nbyte)){
-		put_done_mem_block(*cur);
-		while ((*cur = get_and_init_mem_block(rec, type)) == NULL);
+	if (!*cur || !check_space_nbyte_block((*cur), nbyte)){
+		PROF_START(t0);
+		if (*cur)
+			put_done_mem_block(*cur);
+		*cur = get_and_init_mem_block(rec, type);
+		PROF_END(PROF_HOOK_BLOCK_ROLLOVER, t0);
+		if (!*cur)
+			return;
 	}
 	push_nbyte_block(*cur, nbyte, addr);
 }
 
-/* 
- * n: number of MemBlock to get
- * v: the return vector of free MemBlock (this vector memory should be allocated by the caller)
- * TODO: potential concurrency bug here, same as get_free_mem_block above
- */
-static inline bool get_n_free_mem_block(u32 n, struct MemBlock **v){
-	struct FreeMemBlockRing *mb_ring = &shmem.addr->free_mb_ring;
-	atomic_t *h = (atomic_t*)&mb_ring->h;
-	u32 ring_idx = atomic_add_return(n, h) - n; // use atomic_add_return, so concurrent callers are guaranteed to get diff ring_idx
-	u32 i;
-	// if not enough free MemBlock, subtract n from h.
-	if (ring_idx + n > (u32)atomic_read((atomic_t*)&mb_ring->t)){
-		atomic_sub(n, h);
-		return false;
-	}
-	// we know these slots (ring_idx to ring_idx+n) in the ring is valid (won't be written by user), because the ring is large enough to contain N_MEM_BLOCK mb
-	for (i = 0; i < n; i++){
-		u32 mb_idx = mb_ring->v[get_free_mb_ring_idx(ring_idx + i)];
-		v[i] = &shmem.addr->mem_block[mb_idx];
-	}
-	return true;
-}
-
-static inline bool init_recorder_mb(struct DeterRecorder* rec){
-	u32 i;
-	struct MemBlock* mbs[DETER_MEM_BLOCK_TYPE_TOTAL];
-	// get a mb for each type of data
-	if (!get_n_free_mem_block(DETER_MEM_BLOCK_TYPE_TOTAL, mbs))
-		return false;
-	// init each mb
-	for (i = 0; i < DETER_MEM_BLOCK_TYPE_TOTAL; i++){
-		mbs[i]->len = 0;
-		mbs[i]->rec_id = rec2idx(rec);
-		rec->used_mb++;
-	}
-	// assign mb to recorder
-	rec->evt.mb = mbs[0];		mbs[0]->type = DETER_MEM_BLOCK_TYPE_EVT;
-	rec->sockcall.mb = mbs[1];	mbs[1]->type = DETER_MEM_BLOCK_TYPE_SOCKCALL;
-	rec->ps.mb = mbs[2];		mbs[2]->type = DETER_MEM_BLOCK_TYPE_PS;
-	rec->jif.mb = mbs[3];		mbs[3]->type = DETER_MEM_BLOCK_TYPE_JIF;
-	rec->mp.mb = mbs[4];		mbs[4]->type = DETER_MEM_BLOCK_TYPE_MP;
-	rec->ma.mb = mbs[5];		mbs[5]->type = DETER_MEM_BLOCK_TYPE_MA;
-	rec->ms.mb = mbs[6];		mbs[6]->type = DETER_MEM_BLOCK_TYPE_MS;
-	rec->siq.mb = mbs[7];		mbs[7]->type = DETER_MEM_BLOCK_TYPE_SIQ;
-	rec->ts.mb = mbs[8];		mbs[8]->type = DETER_MEM_BLOCK_TYPE_TS;
-	for (i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++){
-		rec->eb[i].mb = mbs[9+i]; mbs[9+i]->type = DETER_MEM_BLOCK_TYPE_EB(i);
-	}
-	#if ADVANCED_EVENT_ENABLE
-	rec->ae.mb = mbs[9 + DETER_EFFECT_BOOL_N_LOC]; mbs[9 + DETER_EFFECT_BOOL_N_LOC]->type = DETER_MEM_BLOCK_TYPE_AE;
-	#endif
-	return true;
+/* put the INIT MemBlock of a new connection, so user space does not need to read the DeterRecorder. Return -1 if none is free */
+static int put_init_mem_block(struct DeterRecorder *rec){
+	struct MemBlock *mb;
+	struct DeterRecInit *init;
+	if ((mb = get_and_init_mem_block(rec, DETER_MEM_BLOCK_TYPE_INIT)) == NULL)
+		return -1;
+	init = (struct DeterRecInit*)mb->data;
+	init->mode = rec->mode;
+	init->sip = rec->sip;
+	init->dip = rec->dip;
+	init->sport = rec->sport;
+	init->dport = rec->dport;
+	init->eb_dense = rec->eb_dense;
+	memcpy(&init->init_data, &rec->init_data, sizeof(struct tcp_sock_init_data));
+	mb->len = 1;
+	put_done_mem_block(mb);
+	return 0;
 }
 
 /* get a DeterRecorder.
@@ -174,11 +172,14 @@ static void recorder_create(struct sock *sk, struct sk_buff *skb, int mode){
 	// create DeterRecorder
 	struct DeterRecorder *rec = deter_alloc_recorder();
 	if (!rec){
-		printk("[recorder_create] sport = %hu, dport = %hu, fail to create recorder. h=%u t=%u\n", ntohs(inet_sk(sk)->inet_sport), ntohs(inet_sk(sk)->inet_dport), shmem.addr->free_rec_ring.h, shmem.addr->free_rec_ring.t);
+		atomic_long_inc(&filter_stats.slot_exhausted);
+		printk("[recorder_create] sport = %hu, dport = %hu, fail to create recorder. h=%u t=%u\n", ntohs(inet_sk(sk)->inet_sport), ntohs(inet_sk(sk)->inet_dport), shmem.pool->h, shmem.pool->t);
 		goto out;
 	}
-	printk("[recorder_create] sport = %hu, dport = %hu, succeed to create recorder. h=%u t=%u\n", ntohs(inet_sk(sk)->inet_sport), ntohs(inet_sk(sk)->inet_dport), shmem.addr->free_rec_ring.h, shmem.addr->free_rec_ring.t);
+	printk("[recorder_create] sport = %hu, dport = %hu, succeed to create recorder. h=%u t=%u\n", ntohs(inet_sk(sk)->inet_sport), ntohs(inet_sk(sk)->inet_dport), shmem.pool->h, shmem.pool->t);
 	sk->recorder = (void*)rec;
+	rec->gen++;
+	rec->rec_id = make_rec_id(rec->gen, rec2idx(rec)); // only the low 16 bits of gen fit
 
 	// record 4 tuples
 	rec->sip = inet_sk(sk)->inet_saddr;
@@ -204,17 +205,27 @@ static void recorder_create(struct sock *sk, struct sk_buff *skb, int mode){
 
 	// init variables
 	rec->broken = rec->alert = 0;
-	rec->used_mb = rec->dump_mb = 0;
+	rec->used_mb = 0;
 	rec->seq = 0;
 	atomic_set(&rec->sockcall_id, 0);
 	atomic_set(&rec->sockcall_id_mp, 0);
-	// get and init MemBlock for each type of data
-	while (!init_recorder_mb(rec)); // ensure we get enough valid mb
+	rec->eb_dense = record_filter_eb_dense();
+	// no MemBlock yet; each stream gets one on its first push
+	rec->evt.mb = rec->sockcall.mb = rec->ps.mb = rec->jif.mb = rec->mp.mb = rec->ma.mb = rec->ms.mb = rec->siq.mb = NULL;
+	rec->ts.mb = NULL;
+	for (i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		rec->eb[i].mb = NULL;
+	rec->ebx.mb = NULL;
+	#if ADVANCED_EVENT_ENABLE
+	rec->ae.mb = NULL;
+	#endif
 
 	// init runtime states
 	rec->evt.n = rec->sockcall.n = rec->ps.n = rec->jif.n = rec->mp.n = rec->ma.n = rec->ms.n = rec->siq.n = 0;
 	for (i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
 		rec->eb[i].n = 0;
+	rec->ebx.n = 0;
+	rec->n_sockets_allocated = 0;
 	rec->ps.last = 0;
 	#if COLLECT_TX_STAMP
 	rec->ts.n = 0;
@@ -231,6 +242,12 @@ static void recorder_create(struct sock *sk, struct sk_buff *skb, int mode){
 	else 
 		copy_from_client_sock(sk);
 	rec->mode = mode;
+	// without its INIT block user space can't tell the connection, so it is not recorded
+	if (put_init_mem_block(rec)){
+		printk("[recorder_create] sport = %hu, dport = %hu, no free MemBlock, not recorded\n", ntohs(inet_sk(sk)->inet_sport), ntohs(inet_sk(sk)->inet_dport));
+		sk->recorder = NULL;
+		deter_free_recorder(rec);
+	}
 out:
 	return;
 }
@@ -238,7 +255,7 @@ out:
 static void server_recorder_create(struct sock *sk, struct sk_buff *skb){
 	uint16_t sport = ntohs(inet_sk(sk)->inet_sport);
 	u32 dip = inet_sk(sk)->inet_daddr;
-	if (dip != mon_ndstip && (mon_dstip == 0 || dip == mon_dstip) && ((sport >= 60000 && sport <= 60003) || sport == 50010)){
+	if (record_filter_match(sport, dip) && record_filter_sample(inet_sk(sk)->inet_saddr, dip, inet_sk(sk)->inet_sport, inet_sk(sk)->inet_dport)){
 		printk("server dip = %08x, sport = %hu, dport = %hu, creating recorder\n", ntohl(dip), ntohs(inet_sk(sk)->inet_sport), ntohs(inet_sk(sk)->inet_dport));
 		recorder_create(sk, skb, 0);
 	}
@@ -246,15 +263,14 @@ static void server_recorder_create(struct sock *sk, struct sk_buff *skb){
 static void client_recorder_create(struct sock *sk, struct sk_buff *skb){
 	uint16_t dport = ntohs(inet_sk(sk)->inet_dport);
 	u32 dip = inet_sk(sk)->inet_daddr;
-	if (dip != mon_ndstip && (mon_dstip == 0 || dip == mon_dstip) && ((dport >= 60000 && dport <= 60003) || dport == 50010)){
-	//if (inet_sk(sk)->inet_dport == 0x8913){ // port 5001
+	if (record_filter_match(dport, dip) && record_filter_sample(inet_sk(sk)->inet_saddr, dip, inet_sk(sk)->inet_sport, inet_sk(sk)->inet_dport)){
 		printk("client dip = %08x, sport = %hu, dport = %hu, creating recorder\n", ntohl(dip), ntohs(inet_sk(sk)->inet_sport), ntohs(inet_sk(sk)->inet_dport));
 		recorder_create(sk, skb, 1);
 	}
 }
 
 /* this function should be called in thread_safe environment */
-static inline void new_event(struct sock *sk, u32 type){
+static inline void _new_event(struct sock *sk, u32 type){
 	struct DeterRecorder *rec = (struct DeterRecorder*)sk->recorder;
 	u32 seq;
 	union{
@@ -272,11 +288,18 @@ static inline void new_event(struct sock *sk, u32 type){
 	push_u64(rec, &rec->evt.mb, DETER_MEM_BLOCK_TYPE_EVT, dt.u);
 	rec->evt.n++;
 }
+static inline void new_event(struct sock *sk, u32 type){
+	PROF_START(t0);
+	_new_event(sk, type);
+	PROF_END(PROF_HOOK_NEW_EVENT, t0);
+}
 
 /* destruct a DeterRecorder.
  */
 static void recorder_destruct(struct sock *sk){
 	struct DeterRecorder* rec = sk->recorder;
+	struct MemBlock *fin_mb;
+	struct DeterRecFin *fin;
 	int i;
 	if (!rec){
 		//printk("[recorder_destruct] sport = %hu, dport = %hu, recorder is NULL.\n", inet_sk(sk)->inet_sport, inet_sk(sk)->inet_dport);
@@ -316,24 +339,48 @@ static void recorder_destruct(struct sock *sk){
 		rec->ps.n++;
 	}
 
+	// get the FIN mb first, so used_mb counts it. Without one, user space dumps the connection as broken when its slot is reused
+	fin_mb = get_and_init_mem_block(rec, DETER_MEM_BLOCK_TYPE_FIN);
+
 	// put mb to done_mb_ring
-	put_done_mem_block(rec->evt.mb);
-	put_done_mem_block(rec->sockcall.mb);
-	put_done_mem_block(rec->ps.mb);
-	put_done_mem_block(rec->jif.mb);
-	put_done_mem_block(rec->mp.mb);
-	put_done_mem_block(rec->ma.mb);
-	put_done_mem_block(rec->ms.mb);
-	put_done_mem_block(rec->siq.mb);
-	put_done_mem_block(rec->ts.mb);
+	#define PUT_DONE_IF_USED(mb) do { if (mb) put_done_mem_block(mb); } while (0)
+	PUT_DONE_IF_USED(rec->evt.mb);
+	PUT_DONE_IF_USED(rec->sockcall.mb);
+	PUT_DONE_IF_USED(rec->ps.mb);
+	PUT_DONE_IF_USED(rec->jif.mb);
+	PUT_DONE_IF_USED(rec->mp.mb);
+	PUT_DONE_IF_USED(rec->ma.mb);
+	PUT_DONE_IF_USED(rec->ms.mb);
+	PUT_DONE_IF_USED(rec->siq.mb);
+	PUT_DONE_IF_USED(rec->ts.mb);
 	for (i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
-		put_done_mem_block(rec->eb[i].mb);
+		PUT_DONE_IF_USED(rec->eb[i].mb);
+	PUT_DONE_IF_USED(rec->ebx.mb);
 	#if ADVANCED_EVENT_ENABLE
-	put_done_mem_block(rec->ae.mb);
+	PUT_DONE_IF_USED(rec->ae.mb);
 	#endif
+	#undef PUT_DONE_IF_USED
+
+	// the FIN mb is the last mb of this connection
+	if (!fin_mb)
+		goto free_slot;
+	fin = (struct DeterRecFin*)fin_mb->data;
+	fin->broken = rec->broken;
+	fin->alert = rec->alert;
+	fin->fin_seq = rec->pkt_idx.fin_seq;
+	fin->n_mb = rec->used_mb;
+	fin->mp_n = rec->mp.n;
+	fin->siq_n = rec->siq.n;
+	fin->n_sockets_allocated = rec->n_sockets_allocated;
+	for (i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		fin->eb_n[i] = rec->eb[i].n;
+	fin_mb->len = 1;
+	put_done_mem_block(fin_mb);
 
-	// remove the recorder from sk
+free_slot:
+	// remove the recorder from sk, and reuse its slot right away: user space has everything it needs in the MemBlock
 	sk->recorder = NULL;
+	deter_free_recorder(rec);
 	printk("[recorder_destruct] sport = %hu, dport = %hu, succeed to destruct a recorder.\n", inet_sk(sk)->inet_sport, inet_sk(sk)->inet_dport);
 }
 
@@ -343,10 +390,12 @@ static void recorder_destruct(struct sock *sk){
 static inline void put_sockcall(struct DeterRecorder *rec, int sc_id, struct deter_rec_sockcall* sc){
 	if (atomic_read(&rec->sockcall_id_mp) != sc_id){
 		u32 cnt = 0;
+		PROF_START(t0);
 		for (;atomic_read(&rec->sockcall_id_mp) != sc_id; cnt++){
 			if ((cnt & 0x0fffffff) == 0)
 				printk("long wait for sockcall_id_mp: %d sc_id %d\n", atomic_read(&rec->sockcall_id_mp), sc_id);
 		}
+		PROF_END(PROF_HOOK_SOCKCALL_WAIT, t0);
 	}
 	push_nbyte(rec, &rec->sockcall.mb, DETER_MEM_BLOCK_TYPE_SOCKCALL, sizeof(struct deter_rec_sockcall), sc);
 	rec->sockcall.n++;
@@ -363,6 +412,7 @@ static u32 new_sendmsg(struct sock *sk, struct msghdr *msg, size_t size){
 	// get sockcall ID
 	sc_id = atomic_add_return(1, &rec->sockcall_id) - 1;
 
+	memset(&sc, 0, sizeof(sc)); // padding and the unused union arms go to the record
 	sc.type = DETER_SOCKCALL_TYPE_SENDMSG;
 	sc.sendmsg.flags = msg->msg_flags;
 	sc.sendmsg.size = size;
@@ -395,6 +445,7 @@ static u32 new_recvmsg(struct sock *sk, struct msghdr *msg, size_t len, int nonb
 	sc_id = atomic_add_return(1, &rec->sockcall_id) - 1;
 
 	// store data for this sockcall
+	memset(&sc, 0, sizeof(sc));
 	sc.type = DETER_SOCKCALL_TYPE_RECVMSG;
 	sc.recvmsg.flags = nonblock | flags;
 	sc.recvmsg.size = len;
@@ -417,6 +468,7 @@ static u32 new_splice_read(struct sock *sk, size_t len, unsigned int flags){
 	sc_id = atomic_add_return(1, &rec->sockcall_id) - 1;
 
 	// store data for this sockcall
+	memset(&sc, 0, sizeof(sc));
 	sc.type = DETER_SOCKCALL_TYPE_SPLICE_READ;
 	sc.splice_read.flags = flags;
 	sc.splice_read.size = len;
@@ -438,6 +490,7 @@ static u32 new_close(struct sock *sk, long timeout){
 	sc_id = atomic_add_return(1, &rec->sockcall_id) - 1;
 
 	// store data for this sockcall
+	memset(&sc, 0, sizeof(sc));
 	sc.type = DETER_SOCKCALL_TYPE_CLOSE;
 	sc.close.timeout = timeout;
 	sc.thread_id = (u64)current;
@@ -458,6 +511,7 @@ static u32 new_setsockopt(struct sock *sk, int level, int optname, char __user *
 	sc_id = atomic_add_return(1, &rec->sockcall_id) - 1;
 
 	// store data for this sockcall
+	memset(&sc, 0, sizeof(sc));
 	sc.type = DETER_SOCKCALL_TYPE_SETSOCKOPT;
 	if ((u32)level > 255 || (u32)optname > 255 || (u32)optlen > 12){ // use u32 so that negative values are also considered
 		sc.setsockopt.level = sc.setsockopt.optname = sc.setsockopt.optlen = 255;
@@ -516,7 +570,7 @@ static inline u16 ps_get_n_normal(u16 x){
 static inline bool ps_normal_not_full(u16 x){
 	return ps_get_n_normal(x) < 0x7fff;
 }
-void mon_net_action(struct sock *sk, struct sk_buff *skb){
+static inline void _mon_net_action(struct sock *sk, struct sk_buff *skb){
 	struct DeterRecorder *rec = (struct DeterRecorder*)sk->recorder;
 	u16 ipid, gap;
 	struct iphdr *iph = ip_hdr(skb);
@@ -577,6 +631,11 @@ void mon_net_action(struct sock *sk, struct sk_buff *skb){
 	}
 	update_pkt_idx(&rec->pkt_idx, ipid);
 }
+void mon_net_action(struct sock *sk, struct sk_buff *skb){
+	PROF_START(t0);
+	_mon_net_action(sk, skb);
+	PROF_END(PROF_HOOK_MON_NET_ACTION, t0);
+}
 
 void record_fin_seq(struct sock *sk){
 	struct DeterRecorder *rec = (struct DeterRecorder*)sk->recorder;
@@ -619,7 +678,7 @@ static inline void record_advanced_event(const struct sock *sk, u8 func_num, u8
 /***********************************************
  * shared variables
  **********************************************/
-static void _read_jiffies(const struct sock *sk, unsigned long v, int id){
+static inline void __read_jiffies(const struct sock *sk, unsigned long v, int id){
 	struct DeterRecorder* rec = sk->recorder;
 	union {
 		u64 u;
@@ -652,6 +711,11 @@ static void _read_jiffies(const struct sock *sk, unsigned long v, int id){
 		rec->jif.idx_delta++;
 	}
 }
+static void _read_jiffies(const struct sock *sk, unsigned long v, int id){
+	PROF_START(t0);
+	__read_jiffies(sk, v, id);
+	PROF_END(PROF_HOOK_READ_JIFFIES, t0);
+}
 static void read_jiffies(const struct sock *sk, unsigned long v, int id){
 	_read_jiffies(sk, v, id + 100);
 }
@@ -728,11 +792,17 @@ static void record_skb_mstamp_get(struct sock *sk, struct skb_mstamp *cl, int lo
 
 static void record_effect_bool(const struct sock *sk, int loc, bool v){
 	struct DeterRecorder *rec = (struct DeterRecorder*)sk->recorder;
+	bool dense = rec->eb_dense & (1u << loc);
 	#if ADVANCED_EVENT_ENABLE
 	if (loc != 0) // loc 0 is not serializable among all events, but just within incoming packets
-		record_advanced_event(sk, -6, loc, 0b0, 1, rec->eb[loc].n); // ebq: type=-6, loc=loc, fmt=0b0, data=eb[loc].n
+		record_advanced_event(sk, -6, loc, 0b0, 1, dense ? rec->eb[loc].n : rec->ebx.n); // ebq: type=-6, loc=loc, fmt=0b0, data=eb[loc].n, or ebx.n if multiplexed
 	#endif
-	push_bit(rec, &rec->eb[loc].mb, DETER_MEM_BLOCK_TYPE_EB(loc), (u8)v);
+	if (dense)
+		push_bit(rec, &rec->eb[loc].mb, DETER_MEM_BLOCK_TYPE_EB(loc), (u8)v);
+	else{
+		push_u8(rec, &rec->ebx.mb, DETER_MEM_BLOCK_TYPE_EBX, get_ebx_entry(loc, (u8)v));
+		rec->ebx.n++;
+	}
 	rec->eb[loc].n++;
 }
 
@@ -4,7 +4,4 @@
 int bind_record_ops(void);
 void unbind_record_ops(void);
 
-extern u32 mon_dstip;
-extern u32 mon_ndstip;
-
 #endif /* _RECORD_OPS_H */
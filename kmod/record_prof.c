@@ -0,0 +1,88 @@
+#include <linux/string.h>
+#include <linux/cpumask.h>
+#include "record_prof.h"
+#include "mem_util.h"
+#include "proc_expose.h"
+#ifdef CONFIG_X86
+#include <asm/tsc.h>
+#endif
+
+// struct name: proc_deter_prof_expose
+INIT_PROC_EXPOSE(deter_prof)
+
+DEFINE_STATIC_KEY_FALSE(deter_prof_enabled);
+struct ProfLayout *prof = NULL;
+
+static inline u32 get_prof_size(void){
+	return sizeof(struct ProfLayout) + nr_cpu_ids * sizeof(struct ProfCpu);
+}
+
+// function for output_func
+static int expose_addr(void *args, char* buf, size_t len){
+	return sprintf(buf, "0x%llx\n", virt_to_phys(prof));
+}
+
+// function for input_func: "1" enables, "0" disables, "reset" clears the histograms
+static int prof_ctrl(void *args, char* buf, size_t len){
+	if (strncmp(buf, "1", 1) == 0){
+		prof->enabled = 1;
+		static_branch_enable(&deter_prof_enabled);
+	}else if (strncmp(buf, "0", 1) == 0){
+		static_branch_disable(&deter_prof_enabled);
+		prof->enabled = 0;
+	}else if (strncmp(buf, "reset", 5) == 0){
+		memset(prof->cpu, 0, nr_cpu_ids * sizeof(struct ProfCpu));
+	}else {
+		printk("[DETER] deter_prof: unknown command\n");
+		return -EINVAL;
+	}
+	return len;
+}
+
+int init_prof(void){
+	int ret;
+	u32 size = get_prof_size();
+	int order = get_page_order(size);
+
+	prof = (struct ProfLayout*) __get_free_pages(GFP_KERNEL, order);
+	if (prof){
+		reserve_pages(virt_to_page(prof), 1<<order);
+	}else {
+		printk("[DETER] Fail to allocate memory for prof\n");
+		return -1;
+	}
+	memset(prof, 0, size);
+	prof->n_cpu = nr_cpu_ids;
+	prof->size = size;
+	#ifdef CONFIG_X86
+	prof->cycle_khz = tsc_khz;
+	#endif
+
+	// expose through proc
+	proc_deter_prof_expose.output_func = expose_addr;
+	proc_deter_prof_expose.input_func = prof_ctrl;
+	ret = proc_expose_start(&proc_deter_prof_expose);
+	if (ret){
+		printk("[DETER] Fail to open proc file for prof\n");
+		unreserve_pages(virt_to_page(prof), 1<<order);
+		free_pages((unsigned long)prof, order);
+		prof = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/* must be called after the record ops are unbound */
+void clear_prof(void){
+	int order;
+	if (!prof)
+		return;
+	proc_expose_stop(&proc_deter_prof_expose);
+	static_branch_disable(&deter_prof_enabled);
+	synchronize_sched(); // wait for hooks that are still in prof_record (which runs with preemption disabled)
+
+	order = get_page_order(get_prof_size());
+	unreserve_pages(virt_to_page(prof), 1<<order);
+	free_pages((unsigned long)prof, order);
+	prof = NULL;
+}
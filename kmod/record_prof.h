@@ -0,0 +1,37 @@
+#ifndef _KMOD__RECORD_PROF_H
+#define _KMOD__RECORD_PROF_H
+
+#include <linux/types.h>
+#include <linux/jump_label.h>
+#include <linux/smp.h>
+#include <asm/timex.h>
+#include "../shared_data_struct/prof.h"
+
+/*
+ * Optional per-hook overhead measurement.
+ * Disabled by default. While disabled, PROF_START/PROF_END cost one patched-out jump each.
+ * Enable/disable/reset by writing 1/0/reset to /proc/deter_prof. user/prof reads and merges the histograms.
+ */
+DECLARE_STATIC_KEY_FALSE(deter_prof_enabled);
+extern struct ProfLayout *prof;
+
+int init_prof(void);
+void clear_prof(void);
+
+static inline void prof_record(u32 hook, u64 cycles){
+	// Counters are not atomic: a hook interrupted by a nested hook on the same CPU may lose a count, which is fine for profiling
+	struct ProfHist *h = &prof->cpu[get_cpu()].hist[hook];
+	h->cnt[get_prof_bucket(cycles)]++;
+	h->sum += cycles;
+	if (cycles > h->max)
+		h->max = cycles;
+	put_cpu();
+}
+
+#define PROF_START(t) u64 t = static_branch_unlikely(&deter_prof_enabled) ? get_cycles() : 0
+#define PROF_END(hook, t) do { \
+	if (static_branch_unlikely(&deter_prof_enabled) && (t)) \
+		prof_record((hook), get_cycles() - (t)); \
+} while (0)
+
+#endif /* _KMOD__RECORD_PROF_H */
@@ -2,4 +2,5 @@
 
 struct record_shmem shmem = {
 	.addr = NULL,
+	.pool = NULL,
 };
@@ -7,6 +7,7 @@
  * addr is by default NULL, and initalized by deter kernel module */
 struct record_shmem{
 	struct SharedMemLayout *addr;
+	struct RecorderPool *pool; // recorder slots, in its own pages
 };
 extern struct record_shmem shmem;
 
@@ -4,11 +4,16 @@
 
 // struct name: proc_deter_expose
 INIT_PROC_EXPOSE(deter)
+// struct name: proc_deter_rec_pool_expose
+INIT_PROC_EXPOSE(deter_rec_pool)
 
 // function for output_func
 static int expose_addr(void *args, char* buf, size_t len){
 	return sprintf(buf, "0x%llx\n", virt_to_phys(shmem.addr));
 }
+static int expose_pool_addr(void *args, char* buf, size_t len){
+	return sprintf(buf, "0x%llx\n", virt_to_phys(shmem.pool));
+}
 
 int share_mem_to_user(void){
 	int ret;
@@ -18,9 +23,17 @@ int share_mem_to_user(void){
 		printk("[DETER] share_mem_to_user: Fail to open proc file\n");
 		return -1;
 	}
+	proc_deter_rec_pool_expose.output_func = expose_pool_addr;
+	ret = proc_expose_start(&proc_deter_rec_pool_expose);
+	if (ret){
+		printk("[DETER] share_mem_to_user: Fail to open proc file for recorder pool\n");
+		proc_expose_stop(&proc_deter_expose);
+		return -1;
+	}
 	return 0;
 }
 
 void stop_share_mem_to_user(void){
+	proc_expose_stop(&proc_deter_rec_pool_expose);
 	proc_expose_stop(&proc_deter_expose);
 }
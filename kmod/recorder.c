@@ -11,6 +11,8 @@
 #include "record_ctrl.h"
 #include "record_ops.h"
 #include "record_user_share.h"
+#include "record_filter.h"
+#include "record_prof.h"
 #include "logger.h"
 
 u64 dstip;
@@ -19,18 +21,40 @@ module_param(dstip, long, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 MODULE_PARM_DESC(dstip, "A dstip to monitor");
 module_param(ndstip, long, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 MODULE_PARM_DESC(ndstip, "A dstip NOT to monitor");
+uint sample_ppm = 1000000;
+uint sample_key = 0;
+module_param(sample_ppm, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(sample_ppm, "Initial sampling rate of matched connections, in parts per million");
+module_param(sample_key, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(sample_key, "Initial key of the sampling hash. Use the same key on both sides");
+uint n_recorder = 512;
+module_param(n_recorder, uint, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(n_recorder, "Number of recorder slots (max concurrent recorded connections), power of 2");
+uint n_mem_block = 0;
+module_param(n_mem_block, uint, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(n_mem_block, "Number of MemBlock shared by all recorders; 0 for DETER_MB_PER_RECORDER per slot, as many as fit");
+uint eb_dense = DETER_EFFECT_BOOL_MUST_DENSE;
+module_param(eb_dense, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+MODULE_PARM_DESC(eb_dense, "Initial mask of effect_bool locations with their own stream; the others share one multiplexed stream");
 
 static int __init record_init(void)
 {
 	printk("dstip to monitor: 0x%08lx\n", dstip);
 	printk("dstip NOT to monitor: 0x%08lx\n", ndstip);
-	mon_dstip = htonl(dstip); // mon_dstip is in record_ops.c
-	mon_ndstip = htonl(ndstip);
+	printk("sample %u ppm, key 0x%08x, eb_dense 0x%05x\n", sample_ppm, sample_key, eb_dense);
 
 	// create record_ctrl data
-	if (create_record_ctrl())
+	if (create_record_ctrl(n_recorder, n_mem_block))
 		goto fail_create_ctrl;
 
+	// create the flow filter, with dstip/ndstip and sampling as initial rules
+	if (record_filter_init(htonl(dstip), htonl(ndstip), sample_ppm, sample_key, eb_dense))
+		goto fail_filter;
+
+	// create the (disabled) overhead histograms
+	if (init_prof())
+		goto fail_prof;
+
 	// expose data to user space
 	if (share_mem_to_user())
 		goto fail_share;
@@ -46,6 +70,10 @@ static int __init record_init(void)
 fail_bind_ops:
 	stop_share_mem_to_user();
 fail_share:
+	clear_prof();
+fail_prof:
+	record_filter_exit();
+fail_filter:
 	delete_record_ctrl();
 fail_create_ctrl:
 	return -1;
@@ -58,6 +86,12 @@ static void __exit record_exit(void)
 
 	// stop exposing data to user space
 	stop_share_mem_to_user();
+
+	// remove the flow filter (after unbind, so no SYN path is using it)
+	record_filter_exit();
+
+	// remove the overhead histograms (after unbind, so no hook is recording)
+	clear_prof();
 	
 	// remove record_ctrl data
 	delete_record_ctrl();
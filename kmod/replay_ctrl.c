@@ -27,12 +27,28 @@ static int expose_addr(void *args, char* buf, size_t len){
 	return sprintf(buf, "0x%llx\n", virt_to_phys(replay_ctrl.addr));
 }
 
+/* the multiplexed effect_bool entries must lie within the buffer user allocated for them */
+static bool valid_ebxq(struct DeterReplayer *r){
+	int i;
+	if (get_deter_replayer_size(r->ebxq.len) > replay_ctrl.size || r->ebxq.t > r->ebxq.len)
+		goto fail;
+	for (i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		if (r->eb_slot[i] == EFFECT_BOOL_SLOT_RUN && (r->ebxq.run_s[i] > r->ebxq.run_t[i] || r->ebxq.run_t[i] > r->ebxq.len))
+			goto fail;
+	return true;
+fail:
+	deter_log("Error: effect_bool entries out of the buffer of %u\n", replay_ctrl.size);
+	return false;
+}
+
 /* proc write callback: 
  * This function should be called when the user finish copy data */
 static int user_copy_finish(void *args, char* buf, size_t len){
 	// if this call conforms to the protocol
 	if (strcmp(buf, "copy finish") != 0)
 		return -1;
+	if (!valid_ebxq(replay_ctrl.addr))
+		return -1;
 	// start the replay
 	if (replay_ops_start(replay_ctrl.addr))
 		return -1;
@@ -37,7 +37,11 @@ void logging_stats(struct DeterReplayer *r){
 	deter_log("maq: h=%u t=%u\n", r->maq.h, r->maq.t);
 	deter_log("msq: h=%u t=%u\n", r->msq.h, r->msq.t);
 	for (i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
-		deter_log("ebq[%d]: h=%u t=%u\n", i, r->ebq[i].h, r->ebq[i].t);
+		if (r->eb_slot[i] == EFFECT_BOOL_SLOT_RUN)
+			deter_log("ebxq run %d: h=%u t=%u\n", i, r->ebxq.run_h[i] - r->ebxq.run_s[i], r->ebxq.run_t[i] - r->ebxq.run_s[i]);
+		else if (r->eb_slot[i] != EFFECT_BOOL_SLOT_MUX)
+			deter_log("ebq[%d]: h=%u t=%u\n", i, r->ebq[r->eb_slot[i]].h, r->ebq[r->eb_slot[i]].t);
+	deter_log("ebxq: h=%u t=%u\n", r->ebxq.h, r->ebxq.t);
 }
 
 /********************************************************
@@ -709,9 +713,56 @@ static void replay_skb_mstamp_get(struct sock *sk, struct skb_mstamp *cl, int lo
 	msq->h++;
 }
 
+/* a sparse loc: the next entry of the multiplexed queue must be for this loc */
+static bool replay_effect_bool_mux(const struct sock *sk, int loc){
+	struct DeterReplayer *r = (struct DeterReplayer*)sk->replayer;
+	struct effect_bool_mux_q *ebxq = &r->ebxq;
+	u8 x;
+	#if ADVANCED_EVENT_ENABLE
+	if (loc != 0)
+		replay_advanced_event(sk, -6, loc, 0b0, 1, ebxq->h);
+	#endif
+	if (ebxq->h >= ebxq->t){
+		deter_log("Warning: more effect_bool %d than recorded\n", loc);
+		return false;
+	}
+	x = r->ebxv[ebxq->h];
+	if (get_ebx_loc(x) != loc){
+		// do not consume, so the recorded entry can still be matched by its own loc
+		deter_log("Warning: effect_bool %d, but %d is recorded next\n", loc, get_ebx_loc(x));
+		return false;
+	}
+	ebxq->h++;
+	return get_ebx_bit(x);
+}
+
+/* a dense loc without a slot: the next entry of its run of the multiplexed queue */
+static bool replay_effect_bool_run(const struct sock *sk, int loc){
+	struct DeterReplayer *r = (struct DeterReplayer*)sk->replayer;
+	struct effect_bool_mux_q *ebxq = &r->ebxq;
+	u32 i = ebxq->run_h[loc];
+	#if ADVANCED_EVENT_ENABLE
+	if (loc != 0)
+		replay_advanced_event(sk, -6, loc, 0b0, 1, i - ebxq->run_s[loc]);
+	#endif
+	if (i >= ebxq->run_t[loc]){
+		deter_log("Warning: more effect_bool %d than recorded\n", loc);
+		// same as a loc with a slot: the last one again
+		return i > ebxq->run_s[loc] && get_ebx_bit(r->ebxv[i - 1]);
+	}
+	ebxq->run_h[loc]++;
+	return get_ebx_bit(r->ebxv[i]);
+}
+
 static bool replay_effect_bool(const struct sock *sk, int loc){
-	struct effect_bool_q *ebq = &((struct DeterReplayer*)sk->replayer)->ebq[loc];
+	struct DeterReplayer *r = (struct DeterReplayer*)sk->replayer;
+	struct effect_bool_q *ebq;
 	u32 idx, bit_idx, arr_idx;
+	if (r->eb_slot[loc] == EFFECT_BOOL_SLOT_MUX)
+		return replay_effect_bool_mux(sk, loc);
+	if (r->eb_slot[loc] == EFFECT_BOOL_SLOT_RUN)
+		return replay_effect_bool_run(sk, loc);
+	ebq = &r->ebq[r->eb_slot[loc]];
 	#if ADVANCED_EVENT_ENABLE
 	if (loc != 0) // loc 0 is not serializable among all events, but just within incoming packets
 		replay_advanced_event(sk, -6, loc, 0b0, 1, ebq->h);
@@ -1017,8 +1068,11 @@ static void initialize_replay(struct DeterReplayer *r){
 	r->msq.h= 0;
 
 	// initialize ebq
-	for (i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+	for (i = 0; i < DETER_EFFECT_BOOL_N_DENSE; i++)
 		r->ebq[i].h = 0;
+	r->ebxq.h = 0;
+	for (i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		r->ebxq.run_h[i] = r->ebxq.run_s[i];
 }
 
 static void finish_sock(struct sock *sk){
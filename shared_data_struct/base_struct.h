@@ -165,6 +165,15 @@ union memory_allocated_rec{
 };
 
 #define DETER_EFFECT_BOOL_N_LOC 17
+#define DETER_EFFECT_BOOL_ALL_DENSE ((1u << DETER_EFFECT_BOOL_N_LOC) - 1)
+#define DETER_EFFECT_BOOL_MUST_DENSE 0x1 // loc 0 is not serializable among all events, so it always has its own stream
+
+/* entry of the multiplexed effect_bool stream, for sparse locations: [loc:7][bit:1] */
+static inline u8 get_ebx_entry(u32 loc, u8 v){
+	return (u8)((loc << 1) | v);
+}
+#define get_ebx_loc(x) ((x) >> 1)
+#define get_ebx_bit(x) ((x) & 1)
 
 /* struct general event (for debug): including locking and reading */
 struct GeneralEvent{
@@ -5,9 +5,30 @@
 #include "tcp_sock_init_data.h"
 #include "mem_block.h"
 
-#define N_MEM_BLOCK 1024
-/* Note: N_RECORDER must be smaller than N_MEM_BLOCK / #MemBlock_per_recorder */
-#define N_RECORDER 16
+/*
+ * The MemBlock pool is sized when the module is loaded (n_mem_block parameter). By default, DETER_MB_PER_RECORDER per
+ * recorder slot, at least MIN_N_MEM_BLOCK, as many as fit the largest contiguous allocation. A recorder takes MemBlocks
+ * from the pool as its streams fill, so this is not a bound on n_recorder: if busy connections still take every
+ * MemBlock, records are dropped (mb_exhausted), never waited for.
+ */
+#define MIN_N_MEM_BLOCK 1024
+#define DETER_MB_PER_RECORDER 8
+
+/*
+ * MemBlock.rec_id = [generation:16][slot:16].
+ * The generation is bumped each time a slot is reused, so blocks of an older connection in the same slot can be told apart.
+ */
+#define REC_SLOT_BITS 16
+#define MAX_N_RECORDER (1u << REC_SLOT_BITS)
+static inline u32 make_rec_id(u32 gen, u32 slot){
+	return (gen << REC_SLOT_BITS) | slot;
+}
+static inline u32 get_rec_slot(u32 rec_id){
+	return rec_id & (MAX_N_RECORDER - 1);
+}
+static inline u32 get_rec_gen(u32 rec_id){
+	return rec_id >> REC_SLOT_BITS;
+}
 
 struct EventState{
 	u32 n;
@@ -66,7 +87,9 @@ struct DeterRecorder{
 	u32 mode;
 	u32 sip, dip;
 	u16 sport, dport;
-	u32 used_mb, dump_mb; // number of MemBlock being used, number of MemBlock being dumped. User space should put this recorder to the free recorder pool when used_mb==dump_mb
+	u32 gen; // generation of this slot, incremented on each reuse
+	u32 rec_id; // make_rec_id(gen, slot), stamped into each MemBlock
+	u32 used_mb; // number of MemBlock used by this connection, including the INIT and FIN blocks
 	struct tcp_sock_init_data init_data;
 	u32 seq; // current seq #
 	atomic_t sockcall_id, sockcall_id_mp; // current socket call ID, and var for multi-producer
@@ -84,7 +107,9 @@ struct DeterRecorder{
 	#if COLLECT_TX_STAMP
 	struct TxstampState ts;
 	#endif
-	struct EffectBoolState eb[DETER_EFFECT_BOOL_N_LOC];
+	u32 eb_dense; // bit i set: effect_bool loc i has its own bit stream eb[i]; otherwise it goes to ebx. Decided when the recorder is created
+	struct EffectBoolState eb[DETER_EFFECT_BOOL_N_LOC]; // eb[i].mb is NULL for sparse loc i
+	struct EffectBoolState ebx; // multiplexed stream of sparse locations, one u8 entry (get_ebx_entry) per read. ebx.mb is NULL if all are dense
 	#if ADVANCED_EVENT_ENABLE
 	struct AdvancedEventState ae;
 	#endif
@@ -102,35 +127,66 @@ struct DeterRecorder{
 #define DETER_MEM_BLOCK_TYPE_SIQ 7
 #define DETER_MEM_BLOCK_TYPE_TS 8
 #define DETER_MEM_BLOCK_TYPE_EB(i) (9 + (i))
+#define DETER_MEM_BLOCK_TYPE_EBX (9 + DETER_EFFECT_BOOL_N_LOC)
 #if ADVANCED_EVENT_ENABLE
-#define DETER_MEM_BLOCK_TYPE_AE (9 + DETER_EFFECT_BOOL_N_LOC)
-#define DETER_MEM_BLOCK_TYPE_TOTAL (9 + DETER_EFFECT_BOOL_N_LOC + 1)
+#define DETER_MEM_BLOCK_TYPE_AE (10 + DETER_EFFECT_BOOL_N_LOC)
+#define DETER_MEM_BLOCK_TYPE_TOTAL (10 + DETER_EFFECT_BOOL_N_LOC + 1)
 #else
-#define DETER_MEM_BLOCK_TYPE_TOTAL (9 + DETER_EFFECT_BOOL_N_LOC)
+#define DETER_MEM_BLOCK_TYPE_TOTAL (10 + DETER_EFFECT_BOOL_N_LOC)
 #endif
+// connection metadata, so user space never reads a DeterRecorder, which is reused as soon as the connection is done
+#define DETER_MEM_BLOCK_TYPE_INIT 0xfe // first block of a connection: one struct DeterRecInit
+#define DETER_MEM_BLOCK_TYPE_FIN 0xff // last block of a connection: one struct DeterRecFin
 
-struct RecorderRing{
-	u32 h, t;
-	u32 v[N_RECORDER];
+struct DeterRecInit{
+	u32 mode;
+	u32 sip, dip;
+	u16 sport, dport;
+	u32 eb_dense;
+	struct tcp_sock_init_data init_data;
+};
+struct DeterRecFin{
+	u32 broken, alert;
+	u32 fin_seq;
+	u32 n_mb; // number of MemBlock of this connection, including INIT and FIN
+	u32 mp_n, siq_n;
+	u32 n_sockets_allocated;
+	u32 eb_n[DETER_EFFECT_BOOL_N_LOC];
+};
+
+/*
+ * Recorder slots. This is a separate region from SharedMemLayout, sized when the module is loaded (n_recorder parameter):
+ *   | struct RecorderPool | v[n_recorder] | pad to 64B | struct DeterRecorder[n_recorder] |
+ * The free slot ring is consumed by new connections and refilled by the kernel when a connection is done,
+ * so user space never hands slots back.
+ */
+struct RecorderPool{
+	u32 n_recorder; // number of slots, power of 2, at most MAX_N_RECORDER
+	u32 size; // total bytes of the region
+	u32 rec_off; // offset of the first DeterRecorder
+	u32 h, t; // free slot ring
+	u32 t_mp; // tail for multi-producer
+	u32 v[0];
 };
-static inline u32 get_rec_ring_idx(u32 i){
-	return i & (N_RECORDER - 1);
+static inline u32 get_rec_pool_rec_off(u32 n_recorder){
+	return (sizeof(struct RecorderPool) + n_recorder * sizeof(u32) + 63) & ~63u;
+}
+static inline u32 get_rec_pool_size(u32 n_recorder){
+	return get_rec_pool_rec_off(n_recorder) + n_recorder * sizeof(struct DeterRecorder);
+}
+static inline struct DeterRecorder* get_pool_recorder(struct RecorderPool *pool, u32 slot){
+	return (struct DeterRecorder*)((u8*)pool + pool->rec_off) + slot;
+}
+static inline u32 get_rec_ring_idx(struct RecorderPool *pool, u32 i){
+	return i & (pool->n_recorder - 1);
 }
 struct DoneMemBlockRing{
 	u32 h, t;
 	u32 t_mp; // tail for multi-producer, used for diff producer (kernel recorder)
-	u32 v[N_MEM_BLOCK];
 };
-static inline u32 get_done_mb_ring_idx(u32 i){
-	return i & (N_MEM_BLOCK - 1);
-}
 struct FreeMemBlockRing{
 	u32 h, t;
-	u32 v[N_MEM_BLOCK];
 };
-static inline u32 get_free_mb_ring_idx(u32 i){
-	return i & (N_MEM_BLOCK - 1);
-}
 
 /*
  * Life time of a MemBlock:
@@ -142,19 +198,24 @@ static inline u32 get_free_mb_ring_idx(u32 i){
  *   Done MemBlock ring <----done a MemBlock (Kernel)-------------|
  *                           a full MemBlock, or the recorder is done (so put all remaining MemBlock)
  *
- * Life time of a recorder:
- *   Free recorder ring --------new sock (Kernel)------------> sock ---> referenced by each MemBlock of this recorder, ++rec.used_mb for each MemBlock (Kernel)
- *            ^                                                                                |
- *            |                                                                                |
- *            |----------------rec.used_mb==rec.dump_mb (user)---------------------------------|
- *                             user ++rec.dump_mb for each MemBlock
- *                             when used_mb==dump_mb, it means this recorder is done
+ * Life time of a recorder slot:
+ *   Free slot ring --------new sock (Kernel)------------> sock, gen++, put an INIT MemBlock
+ *            ^                                             |
+ *            |                                             |
+ *            |--------sock done (Kernel)-------------------| put all MemBlock, then a FIN MemBlock with the counters
+ *   User space rebuilds each connection from its INIT, data and FIN MemBlock, keyed by rec_id.
+ *   A MemBlock whose generation is older than the connection being rebuilt in its slot is stale.
+ */
+/*
+ * The MemBlock region, sized when the module is loaded:
+ *   | struct SharedMemLayout | free ring v[ring_size] | done ring v[ring_size] | pad to MEM_BLOCK_SIZE | struct MemBlock[n_mem_block] |
+ * ring_size is n_mem_block rounded up to a power of 2, so either ring can hold every MemBlock.
  */
 struct SharedMemLayout{
-	// Free recorder ring. Store the index to recorder
-	// Kernel get a new recorder from here upon new sock
-	// User put back a finished recorder here
-	struct RecorderRing free_rec_ring;
+	u32 n_mem_block; // number of MemBlock
+	u32 ring_size; // number of entries of each ring, power of 2
+	u32 size; // total bytes of the region
+	u32 mb_off; // offset of the first MemBlock
 
 	// Free MemBlock ring. Store the index to the MemBlock
 	// Kernel get a new MemBlock when need more space to store runtime data
@@ -165,17 +226,31 @@ struct SharedMemLayout{
 	// Kernel put a done (full or sock finish) MemBlock here
 	// User get a done MemBlock here, copy (dump) it, and put to free MemBlock ring
 	struct DoneMemBlockRing done_mb_ring;
-
-	// recorder buffer
-	// The actual memory space for recorder
-	struct DeterRecorder recorder[N_RECORDER];
-
-	// align to MEM_BLOCK_SIZE; Or align to other size ( >= cache size and <= page size)
-	uint8_t cacheline0[0] __attribute__((aligned(MEM_BLOCK_SIZE)));
-
-	// MemBlock buffer
-	// the actuall memory space for MemBlock
-	struct MemBlock mem_block[N_MEM_BLOCK];
 };
+static inline u32 get_mb_ring_size(u32 n_mem_block){
+	u32 n = 1;
+	while (n < n_mem_block)
+		n <<= 1;
+	return n;
+}
+static inline u32 get_shmem_mb_off(u32 n_mem_block){
+	// align to MEM_BLOCK_SIZE; Or align to other size ( >= cache size and <= page size)
+	return (sizeof(struct SharedMemLayout) + 2 * get_mb_ring_size(n_mem_block) * sizeof(u32) + MEM_BLOCK_SIZE - 1) & ~(MEM_BLOCK_SIZE - 1);
+}
+static inline u64 get_shmem_size(u32 n_mem_block){
+	return get_shmem_mb_off(n_mem_block) + (u64)n_mem_block * sizeof(struct MemBlock);
+}
+static inline u32* get_free_mb_ring(struct SharedMemLayout *l){
+	return (u32*)(l + 1);
+}
+static inline u32* get_done_mb_ring(struct SharedMemLayout *l){
+	return (u32*)(l + 1) + l->ring_size;
+}
+static inline u32 get_mb_ring_idx(struct SharedMemLayout *l, u32 i){
+	return i & (l->ring_size - 1);
+}
+static inline struct MemBlock* get_mem_block(struct SharedMemLayout *l, u32 idx){
+	return (struct MemBlock*)((u8*)l + l->mb_off) + idx;
+}
 
 #endif /* _SHARED_DATA_STRUCT__DETER_RECORDER_H */
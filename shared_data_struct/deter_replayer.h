@@ -58,6 +58,20 @@ struct effect_bool_q{
 };
 #define get_eb_q_idx(i) ((i) & (EFFECT_BOOL_Q_LEN - 1))
 
+/*
+ * Only a few hot locations get their own effect_bool_q; the others share ebxq. Dense locations beyond the slots (all
+ * locations are dense in older records) have no order relative to the others, so each is a run of ebxq of its own,
+ * past the entries in read order. The entries follow struct DeterReplayer, as many as the record has
+ */
+#define DETER_EFFECT_BOOL_N_DENSE 4
+#define EFFECT_BOOL_SLOT_MUX 0xff
+#define EFFECT_BOOL_SLOT_RUN 0xfe
+struct effect_bool_mux_q{
+	u32 h, t; // of the entries in read order
+	u32 run_s[DETER_EFFECT_BOOL_N_LOC], run_h[DETER_EFFECT_BOOL_N_LOC], run_t[DETER_EFFECT_BOOL_N_LOC]; // of each EFFECT_BOOL_SLOT_RUN loc
+	u32 len; // # of entries in DeterReplayer.ebxv
+};
+
 #define SKB_IN_QUEUE_Q_LEN 256
 struct SkbInQueueQ{
 	u32 h, t;
@@ -89,11 +103,19 @@ struct DeterReplayer{
 	struct memory_pressure_q mpq;
 	struct memory_allocated_q maq;
 	struct mstamp_q msq;
-	struct effect_bool_q ebq[DETER_EFFECT_BOOL_N_LOC]; // effect_bool
+	u8 eb_slot[DETER_EFFECT_BOOL_N_LOC]; // index into ebq of each loc, EFFECT_BOOL_SLOT_MUX or EFFECT_BOOL_SLOT_RUN
+	struct effect_bool_q ebq[DETER_EFFECT_BOOL_N_DENSE]; // effect_bool of dense locations
+	struct effect_bool_mux_q ebxq; // effect_bool of the other locations, in read order
 	struct SkbInQueueQ siqq;
 	#if ADVANCED_EVENT_ENABLE
 	struct AdvancedEventQ aeq;
 	#endif
+	u8 ebxv[]; // the entries of ebxq, get_ebx_entry(loc, bit)
 };
 
+/* the shared buffer for a record with n_ebx multiplexed effect_bool entries */
+static inline u64 get_deter_replayer_size(u32 n_ebx){
+	return sizeof(struct DeterReplayer) + n_ebx;
+}
+
 #endif /* _SHARED_DATA_STRUCT__DETER_REPLAYER_H */
@@ -0,0 +1,68 @@
+#ifndef _SHARED_DATA_STRUCT__PROF_H
+#define _SHARED_DATA_STRUCT__PROF_H
+
+/* Hooks of the recorder module whose overhead is measured */
+#define PROF_HOOK_NEW_EVENT 0
+#define PROF_HOOK_MON_NET_ACTION 1
+#define PROF_HOOK_READ_JIFFIES 2
+#define PROF_HOOK_BLOCK_ROLLOVER 3 // push_* found the MemBlock full: put it to done ring and get a new one
+#define PROF_HOOK_PUT_DONE_WAIT 4 // put_done_mem_block waiting for concurrent putters
+#define PROF_HOOK_SOCKCALL_WAIT 5 // put_sockcall waiting for sockcalls with smaller ID
+#define PROF_N_HOOK 6
+
+static inline const char* get_prof_hook_name(u32 hook){
+	switch (hook){
+		case PROF_HOOK_NEW_EVENT: return "new_event";
+		case PROF_HOOK_MON_NET_ACTION: return "mon_net_action";
+		case PROF_HOOK_READ_JIFFIES: return "_read_jiffies";
+		case PROF_HOOK_BLOCK_ROLLOVER: return "push_block_rollover";
+		case PROF_HOOK_PUT_DONE_WAIT: return "put_done_mem_block_wait";
+		case PROF_HOOK_SOCKCALL_WAIT: return "put_sockcall_wait";
+		default: return "unknown";
+	}
+}
+
+/*
+ * Log-linear histogram of cycles.
+ * Values < 2^PROF_SUB_BITS have one bucket each. Above that, each power of 2 is split into 2^PROF_SUB_BITS linear buckets,
+ * so the relative error of a bucket is at most 1/2^PROF_SUB_BITS.
+ */
+#define PROF_SUB_BITS 3
+#define PROF_N_BUCKET 256
+static inline u32 get_prof_bucket(u64 v){
+	u32 e, b;
+	if (v < (1 << PROF_SUB_BITS))
+		return (u32)v;
+	e = 63 - __builtin_clzll(v); // index of the highest bit, >= PROF_SUB_BITS
+	b = ((e - PROF_SUB_BITS + 1) << PROF_SUB_BITS) | (u32)((v >> (e - PROF_SUB_BITS)) & ((1 << PROF_SUB_BITS) - 1));
+	return b < PROF_N_BUCKET ? b : PROF_N_BUCKET - 1;
+}
+/* the smallest value that falls in bucket b */
+static inline u64 get_prof_bucket_low(u32 b){
+	u32 e;
+	if (b < (1 << PROF_SUB_BITS))
+		return b;
+	e = (b >> PROF_SUB_BITS) + PROF_SUB_BITS - 1;
+	return (1ull << e) | ((u64)(b & ((1 << PROF_SUB_BITS) - 1)) << (e - PROF_SUB_BITS));
+}
+
+struct ProfHist{
+	u64 cnt[PROF_N_BUCKET];
+	u64 sum; // sum of cycles
+	u64 max;
+};
+
+/* per-CPU histograms, so the hooks never share a cache line */
+struct ProfCpu{
+	struct ProfHist hist[PROF_N_HOOK];
+} __attribute__((aligned(64)));
+
+struct ProfLayout{
+	u32 n_cpu; // number of entries in cpu[]
+	u32 enabled;
+	u32 cycle_khz; // cycle counter frequency, 0 if unknown
+	u32 size; // total bytes of this layout
+	struct ProfCpu cpu[0] __attribute__((aligned(64)));
+};
+
+#endif /* _SHARED_DATA_STRUCT__PROF_H */
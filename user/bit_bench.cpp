@@ -0,0 +1,162 @@
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include "bit_io.hpp"
+
+using namespace std;
+
+/*
+ * Microbenchmarks of the codes in bit_io.hpp: bits, and ns to write and read, per value, on a few distributions.
+ * Each time is the best of BENCH_RUNS runs, since the machine is rarely quiet.
+ * usage: ./bit_bench [n_value]
+ */
+#define BENCH_RUNS 5
+
+static double now_sec(){
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Code{
+	// write all of v
+	void (*put)(BitWriter &bw, const vector<uint64_t> &v, uint64_t arg);
+	// read v.size() values to v
+	void (*get)(BitReader &br, vector<uint64_t> &v, uint64_t arg);
+};
+
+static void put_fixed(BitWriter &bw, const vector<uint64_t> &v, uint64_t nbit){
+	for (uint64_t x : v)
+		bw.put(x, nbit);
+}
+static void get_fixed(BitReader &br, vector<uint64_t> &v, uint64_t nbit){
+	for (uint64_t &x : v)
+		x = br.get(nbit);
+}
+// the dynamic coding level by level, as before DynLevels
+static void put_dyn_step(BitWriter &bw, const vector<uint64_t> &v, uint64_t step){
+	for (uint64_t x : v)
+		put_dyn(bw, x, step);
+}
+static void get_dyn_step(BitReader &br, vector<uint64_t> &v, uint64_t step){
+	for (uint64_t &x : v)
+		x = get_dyn(br, step);
+}
+static void put_dyn_levels(BitWriter &bw, const vector<uint64_t> &v, uint64_t step){
+	const DynLevels lv = dyn_levels(step);
+	for (uint64_t x : v)
+		put_dyn(bw, x, lv);
+}
+static void get_dyn_levels(BitReader &br, vector<uint64_t> &v, uint64_t step){
+	const DynLevels lv = dyn_levels(step);
+	for (uint64_t &x : v)
+		x = get_dyn(br, lv);
+}
+// DynTable only decodes values of 32 bits
+static void get_dyn_table(BitReader &br, vector<uint64_t> &v, uint64_t step){
+	static DynTable t;
+	static vector<uint32_t> v32;
+	t.init(step);
+	v32.resize(v.size() + 2);
+	t.get_n(br, v32.data(), v.size());
+	for (uint64_t i = 0; i < v.size(); i++)
+		v[i] = v32[i];
+}
+static void put_gamma_all(BitWriter &bw, const vector<uint64_t> &v, uint64_t){
+	for (uint64_t x : v)
+		put_gamma(bw, x);
+}
+static void get_gamma_all(BitReader &br, vector<uint64_t> &v, uint64_t){
+	for (uint64_t &x : v)
+		x = get_gamma(br);
+}
+static void put_delta_all(BitWriter &bw, const vector<uint64_t> &v, uint64_t){
+	for (uint64_t x : v)
+		put_delta(bw, x);
+}
+static void get_delta_all(BitReader &br, vector<uint64_t> &v, uint64_t){
+	for (uint64_t &x : v)
+		x = get_delta(br);
+}
+static void put_rice_all(BitWriter &bw, const vector<uint64_t> &v, uint64_t k){
+	for (uint64_t x : v)
+		put_rice(bw, x, k);
+}
+static void get_rice_all(BitReader &br, vector<uint64_t> &v, uint64_t k){
+	for (uint64_t &x : v)
+		x = get_rice(br, k);
+}
+
+// values >= 1 and < 2^32
+static void gen(const string &dist, uint64_t n, vector<uint64_t> &v){
+	mt19937_64 g(1);
+	v.resize(n);
+	for (uint64_t &x : v){
+		if (dist == "runs") // mostly 1 to 3, as run lengths and index deltas
+			x = 1 + __builtin_ctzll(g() | 1ull << 20);
+		else if (dist == "stamps") // steady deltas with some jumps, as tx stamps in us
+			x = g() % 64 ? 1000 + g() % 50 : 1 + g() % (1 << 24);
+		else
+			x = 1 + (g() >> 32) % 0xfffffffe;
+	}
+}
+
+static void bench(const string &dist, const vector<uint64_t> &v, const char *name, const Code &c, uint64_t arg){
+	vector<uint8_t> buf;
+	vector<uint64_t> dec(v.size());
+	double t_put = 1e30, t_get = 1e30;
+	uint64_t nbit = 0;
+	for (int r = 0; r < BENCH_RUNS; r++){
+		buf.clear();
+		buf.reserve(v.size() * 16);
+		BitWriter bw(buf);
+		double t0 = now_sec();
+		c.put(bw, v, arg);
+		nbit = bw.tell();
+		bw.flush();
+		double t1 = now_sec();
+		buf.resize(buf.size() + DYN_TAB_PAD);
+		BitReader br(buf.data(), buf.size());
+		double t2 = now_sec();
+		c.get(br, dec, arg);
+		double t3 = now_sec();
+		if (dec != v){
+			printf("%s %s: decoded values differ\n", dist.c_str(), name);
+			exit(1);
+		}
+		t_put = min(t_put, t1 - t0);
+		t_get = min(t_get, t3 - t2);
+	}
+	printf("%-8s %-24s %10.2f %10.2f %10.2f\n", dist.c_str(), name, (double)nbit / v.size(), t_put * 1e9 / v.size(), t_get * 1e9 / v.size());
+}
+
+int main(int argc, char **argv){
+	uint64_t n = argc > 1 ? strtoull(argv[1], NULL, 0) : 1 << 20;
+	const Code fixed = {put_fixed, get_fixed}, dyn_step = {put_dyn_step, get_dyn_step},
+		dyn_lv = {put_dyn_levels, get_dyn_levels}, dyn_table = {put_dyn_levels, get_dyn_table},
+		gamma = {put_gamma_all, get_gamma_all}, delta = {put_delta_all, get_delta_all}, rice = {put_rice_all, get_rice_all};
+	const uint64_t steps[] = {0, 0x1f0f0a, 0x2f1f0f070301};
+	vector<uint64_t> v;
+	char name[64];
+	printf("%-8s %-24s %10s %10s %10s\n", "values", "code", "bits", "put ns", "get ns");
+	for (const char *dist : {"runs", "stamps", "wide"}){
+		gen(dist, n, v);
+		uint64_t sum = 0;
+		for (uint64_t x : v)
+			sum += x;
+		bench(dist, v, "fixed 32", fixed, 32);
+		for (uint64_t step : steps){
+			sprintf(name, "dyn %#lx by level", step);
+			bench(dist, v, name, dyn_step, step);
+			sprintf(name, "dyn %#lx levels", step);
+			bench(dist, v, name, dyn_lv, step);
+			sprintf(name, "dyn %#lx DynTable", step);
+			bench(dist, v, name, dyn_table, step);
+		}
+		bench(dist, v, "gamma", gamma, 0);
+		bench(dist, v, "delta", delta, 0);
+		sprintf(name, "rice k=%u", rice_k(sum, n));
+		bench(dist, v, name, rice, rice_k(sum, n));
+	}
+	return 0;
+}
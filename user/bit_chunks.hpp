@@ -0,0 +1,85 @@
+#ifndef _BIT_CHUNKS_HPP
+#define _BIT_CHUNKS_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <cstring>
+
+/*
+ * A bit array in chunks of BIT_CHUNK_BITS bits, each stored as the smallest of four containers, as in Roaring:
+ * its raw words, its non-zero words, the positions of its 1s, or its runs of 1s. A directory entry per chunk finds
+ * any bit in O(1).
+ *
+ * | n_word:32 | n_chunk:32 | BitChunk * n_chunk | containers |
+ * Containers start at multiples of 4 bytes, at off from the end of the directory. Non-zero words follow a mask of
+ * BIT_CHUNK_N_WORD bits telling which words they are. Positions are uint16_t in the chunk, increasing; runs are
+ * (start, length - 1) uint16_t pairs, increasing and not touching. Bursts of random bits in long runs of 0s, common in
+ * effect_bool streams, take non-zero words.
+ * The last chunk has the bits of the words left, so the words round trip as they are (bits past BitArray::n too).
+ */
+#define BIT_CHUNK_BITS 4096
+#define BIT_CHUNK_N_WORD (BIT_CHUNK_BITS / 32)
+
+#define BIT_CHUNK_RAW 0
+#define BIT_CHUNK_POS 1
+#define BIT_CHUNK_RUN 2
+#define BIT_CHUNK_SPARSE 3 // non-zero words
+
+struct BitChunk{
+	uint32_t off;
+	uint16_t type; // BIT_CHUNK_*
+	uint16_t n; // non-zero words, positions or runs
+};
+
+struct BitChunks{
+	const uint8_t *p; // the containers
+	const BitChunk *dir;
+	uint64_t n_word, n_chunk;
+
+	BitChunks() : p(NULL), dir(NULL), n_word(0), n_chunk(0) {}
+	// check the directory of len bytes at buf. Return 0 if the containers it points to are within them
+	int open(const uint8_t *buf, uint64_t len);
+	// bit i, i < n_word * 32
+	int get(uint64_t i) const{
+		const BitChunk &c = dir[i / BIT_CHUNK_BITS];
+		const uint8_t *q = p + c.off;
+		uint32_t b = i % BIT_CHUNK_BITS;
+		if (c.type == BIT_CHUNK_RAW){
+			uint32_t w;
+			memcpy(&w, q + b / 32 * 4, 4);
+			return (w >> (b & 31)) & 1;
+		}
+		if (c.type == BIT_CHUNK_SPARSE){
+			uint32_t m[BIT_CHUNK_N_WORD / 32], j = b / 32, rank = 0, w;
+			memcpy(m, q, sizeof(m));
+			if (!((m[j / 32] >> (j & 31)) & 1))
+				return 0;
+			for (uint32_t k = 0; k < j / 32; k++)
+				rank += __builtin_popcount(m[k]);
+			rank += __builtin_popcount(m[j / 32] & ((1u << (j & 31)) - 1));
+			memcpy(&w, q + sizeof(m) + rank * 4, 4);
+			return (w >> (b & 31)) & 1;
+		}
+		// the last position or run start <= b
+		const uint16_t *x = (const uint16_t*)q;
+		uint32_t k = c.type == BIT_CHUNK_RUN ? 2 : 1, lo = 0, hi = c.n;
+		while (lo < hi){
+			uint32_t mid = (lo + hi) / 2;
+			if (x[mid * k] <= b)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == 0)
+			return 0;
+		lo--;
+		return c.type == BIT_CHUNK_RUN ? b - x[lo * 2] <= x[lo * 2 + 1] : x[lo] == b;
+	}
+	// the raw words, n_word of them. Return -1 on malformed containers
+	int to_raw(uint32_t *w) const;
+};
+
+// the BitChunks of n_word raw words
+void bit_chunks_build(const uint32_t *w, uint64_t n_word, std::vector<uint8_t> &out);
+
+#endif /* _BIT_CHUNKS_HPP */
@@ -0,0 +1,451 @@
+#ifndef _BIT_IO_HPP
+#define _BIT_IO_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <cstring>
+
+/* Bit streams for the codecs. Bits are stored LSB first: the first bit written is bit 0 of byte 0 */
+
+#define BIT_PUT_MAX 64 // bits of one BitWriter::put
+#define BIT_PEEK_MAX 56 // bits of one BitReader::peek after a refill
+
+struct BitWriter{
+	std::vector<uint8_t> &out;
+	uint64_t acc; // pending bits, < 64 of them between calls; written 8 bytes at a time
+	int n;
+
+	BitWriter(std::vector<uint8_t> &_out) : out(_out), acc(0), n(0) {}
+	// write the low nbit bits of v, nbit <= BIT_PUT_MAX
+	void put(uint64_t v, int nbit){
+		v &= nbit < 64 ? (1ull << nbit) - 1 : ~0ull;
+		acc |= v << n;
+		n += nbit;
+		if (n >= 64){
+			size_t o = out.size();
+			out.resize(o + 8);
+			memcpy(&out[o], &acc, 8);
+			n -= 64;
+			acc = n ? v >> (nbit - n) : 0; // the bits of v that did not fit
+		}
+	}
+	// number of bits written, flushed or not
+	uint64_t tell() const{
+		return out.size() * 8 + n;
+	}
+	void flush(){
+		for (; n > 0; n -= 8, acc >>= 8)
+			out.push_back((uint8_t)acc);
+		acc = 0;
+		n = 0;
+	}
+};
+
+struct BitReader{
+	const uint8_t *p, *end;
+	uint64_t acc;
+	int n; // bits in acc
+	int pad; // of the n bits, those past the end of the input (0s)
+	bool overrun; // read past the end; the bits read there are 0
+
+	BitReader(const uint8_t *_p, uint64_t len) : p(_p), end(_p + len), acc(0), n(0), pad(0), overrun(false) {}
+	// fill acc to at least 56 bits, with one unaligned load away from the end of the input
+	void refill(){
+		if (end - p >= 8){
+			uint64_t w;
+			memcpy(&w, p, 8);
+			acc |= w << n;
+			p += (63 - n) >> 3;
+			n |= 56;
+			return;
+		}
+		for (; n <= 56; n += 8){
+			if (p < end)
+				acc |= (uint64_t)*p++ << n;
+			else
+				pad += 8;
+		}
+	}
+	// number of bits read since begin, the start of the input
+	uint64_t tell(const uint8_t *begin) const{
+		return (p - begin) * 8 + pad - n;
+	}
+	// the next nbit bits without consuming them, nbit <= BIT_PEEK_MAX; the caller refills
+	uint64_t peek(int nbit) const{
+		return acc & ((1ull << nbit) - 1);
+	}
+	void skip(int nbit){
+		acc >>= nbit;
+		n -= nbit;
+		if (n < pad)
+			overrun = true;
+	}
+	// read nbit bits, nbit <= 64
+	uint64_t get(int nbit){
+		uint64_t v;
+		if (nbit > 56){
+			v = get(32);
+			return v | (get(nbit - 32) << 32);
+		}
+		if (n < nbit)
+			refill();
+		v = acc & ((1ull << nbit) - 1);
+		acc >>= nbit;
+		n -= nbit;
+		if (n < pad)
+			overrun = true;
+		return v;
+	}
+};
+
+/*
+ * The dynamic coding of nbit_dynamic_coding(x, step), x >= 1.
+ * Each level has w bits and holds 2^w-1 values; the all-ones pattern moves on to the next level.
+ * With step == 0, w = 1, 2, 4, 8, ...; otherwise w is (byte i of step)+1 for level i.
+ * Unlike the estimator, which repeats the last byte of step, the level after the last byte has 64 bits,
+ * so that a value takes few levels.
+ */
+static inline uint32_t dyn_next_w(uint32_t w, uint64_t &step){
+	if (step == 0)
+		return w < 64 ? w * 2 : 64;
+	step >>= 8;
+	return step ? (step & 0xff) + 1 : 64;
+}
+/* nbit_dynamic_coding(x, step) */
+static inline uint64_t dyn_nbit(uint64_t x, uint64_t step){
+	uint32_t w = step ? (step & 0xff) + 1 : 1;
+	uint64_t nbit = 0;
+	for (;;){
+		uint64_t cap = w >= 64 ? ~0ull : (1ull << w) - 1;
+		nbit += w;
+		if (x <= cap)
+			return nbit;
+		x -= cap;
+		w = dyn_next_w(w, step);
+	}
+}
+
+static inline void put_dyn(BitWriter &bw, uint64_t x, uint64_t step){
+	uint32_t w = step ? (step & 0xff) + 1 : 1;
+	for (;;){
+		uint64_t cap = w >= 64 ? ~0ull : (1ull << w) - 1;
+		if (x <= cap){
+			bw.put(x - 1, w);
+			return;
+		}
+		bw.put(cap, w);
+		x -= cap;
+		w = dyn_next_w(w, step);
+	}
+}
+/* get_dyn from a level of w bits, with base values in the levels before */
+static inline uint64_t get_dyn_from(BitReader &br, uint32_t w, uint64_t step, uint64_t base){
+	for (;;){
+		uint64_t cap = w >= 64 ? ~0ull : (1ull << w) - 1;
+		uint64_t v = br.get(w);
+		if (v != cap || w >= 64)
+			return base + v + 1;
+		if (br.overrun)
+			return 0;
+		base += cap;
+		w = dyn_next_w(w, step);
+	}
+}
+static inline uint64_t get_dyn(BitReader &br, uint64_t step){
+	return get_dyn_from(br, step ? (step & 0xff) + 1 : 1, step, 0);
+}
+
+/*
+ * The levels of the dynamic coding of a step: the width of each, the bits of the all-ones patterns before it, and
+ * base, the values taken by the levels before it (capped at 2^64-1). With them, values past the first level find
+ * their level by counting compares (put_dyn) or from the count of 1s their code starts with (get_dyn), without
+ * branches, and a code takes one put. dyn_levels is constexpr, so the tables of the steps known at
+ * compile time (dyn_steps in codec.cpp) are built by the compiler; other steps build theirs once per column.
+ */
+#define DYN_N_LEVEL 10 // at most 8 levels from the bytes of step, then the 64-bit one
+struct DynLevels{
+	uint32_t w[DYN_N_LEVEL];
+	uint32_t pre[DYN_N_LEVEL + 1];
+	uint64_t base[DYN_N_LEVEL + 1];
+};
+// dyn_next_w, unrolled
+constexpr uint32_t dyn_level_w(uint64_t step, uint32_t i){
+	return step == 0 ? (i < 6 ? 1u << i : 64)
+		: i == 0 ? (step & 0xff) + 1
+		: i < 8 && step >> (8 * i) ? ((step >> (8 * i)) & 0xff) + 1 : 64;
+}
+constexpr uint64_t dyn_cap(uint32_t w){
+	return w >= 64 ? ~0ull : (1ull << w) - 1;
+}
+constexpr uint32_t dyn_level_pre(uint64_t step, uint32_t i){
+	return i == 0 ? 0 : dyn_level_pre(step, i - 1) + dyn_level_w(step, i - 1);
+}
+constexpr uint64_t dyn_sat_add(uint64_t a, uint64_t b){
+	return a + b < a ? ~0ull : a + b;
+}
+constexpr uint64_t dyn_level_base(uint64_t step, uint32_t i){
+	return i == 0 ? 0 : dyn_sat_add(dyn_level_base(step, i - 1), dyn_cap(dyn_level_w(step, i - 1)));
+}
+template<uint32_t... I> struct DynSeq{};
+template<uint32_t N, uint32_t... I> struct DynMakeSeq : DynMakeSeq<N - 1, N - 1, I...> {};
+template<uint32_t... I> struct DynMakeSeq<0, I...>{
+	typedef DynSeq<I...> type;
+};
+template<uint32_t... I> constexpr DynLevels dyn_levels(uint64_t step, DynSeq<I...>){
+	return DynLevels{{dyn_level_w(step, I)...}, {dyn_level_pre(step, I)..., dyn_level_pre(step, DYN_N_LEVEL)},
+		{dyn_level_base(step, I)..., ~0ull}};
+}
+constexpr DynLevels dyn_levels(uint64_t step){
+	return dyn_levels(step, DynMakeSeq<DYN_N_LEVEL>::type());
+}
+
+// the level of x >= 1
+static inline uint32_t dyn_level(const DynLevels &lv, uint64_t x){
+	uint32_t l = 0;
+	for (uint32_t i = 1; i < DYN_N_LEVEL; i++)
+		l += x > lv.base[i];
+	return l;
+}
+static inline uint64_t dyn_nbit(uint64_t x, const DynLevels &lv){
+	uint32_t l = dyn_level(lv, x);
+	return lv.pre[l] + lv.w[l];
+}
+static inline void put_dyn(BitWriter &bw, uint64_t x, const DynLevels &lv){
+	if (x <= lv.base[1]){ // most values
+		bw.put(x - 1, lv.w[0]);
+		return;
+	}
+	uint32_t l = dyn_level(lv, x), pre = lv.pre[l], w = lv.w[l];
+	uint64_t v = x - lv.base[l] - 1;
+	if (pre + w <= 64){
+		bw.put(((1ull << pre) - 1) | v << pre, pre + w);
+		return;
+	}
+	for (; pre > 32; pre -= 32)
+		bw.put(~0ull, 32);
+	bw.put((1ull << pre) - 1, pre);
+	bw.put(v, w);
+}
+static inline uint64_t get_dyn(BitReader &br, const DynLevels &lv){
+	if (br.n < 56)
+		br.refill();
+	uint64_t v = br.acc & dyn_cap(lv.w[0]);
+	if (v != dyn_cap(lv.w[0]) && lv.w[0] <= 56){ // most values
+		br.skip(lv.w[0]);
+		return v + 1;
+	}
+	// the levels of all 1s end within the leading 1s
+	uint32_t ones = __builtin_ctzll(~br.acc | 1ull << 63), l = 0;
+	for (uint32_t i = 1; i < DYN_N_LEVEL; i++)
+		l += lv.pre[i] <= ones;
+	if (lv.pre[l + 1] <= 56){
+		v = (br.acc >> lv.pre[l]) & dyn_cap(lv.w[l]);
+		br.skip(lv.pre[l + 1]);
+		return lv.base[l] + v + 1;
+	}
+	// a long code: from level l if its 1s are in the bits refilled, else from the start
+	if (lv.pre[l] > 56)
+		l = 0;
+	br.skip(lv.pre[l]);
+	for (;; l++){
+		uint32_t w = lv.w[l];
+		v = br.get(w);
+		if (v != dyn_cap(w) || w >= 64)
+			return lv.base[l] + v + 1;
+		if (br.overrun)
+			return 0;
+	}
+}
+
+/*
+ * Table decoding of the dynamic coding, several values at a time. The entry of the next DYN_TAB_BIT bits is
+ * nbit | k << 4 | v0 << 8 | v1 << 16 | v2 << 24 for the k (1 to 3) values below 256 whose codes fit in nbit of them,
+ * or nbit | level << 8 when they start a longer code: its first levels take nbit bits, the rest is read from level on.
+ * A stream read this way may read up to DYN_TAB_BIT - 1 bits past its last code, so it is followed by 2 bytes of 0s.
+ */
+#define DYN_TAB_BIT 12
+#define DYN_TAB_PAD 2
+struct DynTable{
+	struct Level{
+		uint64_t base, step;
+		uint32_t w;
+	} lv[DYN_TAB_BIT + 1];
+	uint32_t t[1 << DYN_TAB_BIT];
+
+	/*
+	 * The code starting at bit pos of b: return 1 and its value if it ends within DYN_TAB_BIT bits, else 0.
+	 * Either way, level is the last level looked at, which starts at bit start.
+	 */
+	int code(uint32_t b, uint32_t pos, uint64_t &val, uint32_t &level, uint32_t &start) const{
+		for (level = 0, start = pos; start + lv[level].w <= DYN_TAB_BIT; level++){
+			uint64_t cap = (1ull << lv[level].w) - 1, v = (b >> start) & cap;
+			if (v != cap){
+				val = lv[level].base + v + 1;
+				return 1;
+			}
+			start += lv[level].w;
+		}
+		return 0;
+	}
+	void init(uint64_t step){
+		uint64_t s = step, base = 0;
+		uint32_t w = step ? (step & 0xff) + 1 : 1;
+		for (uint32_t i = 0; i <= DYN_TAB_BIT; i++){
+			lv[i] = (Level){base, s, w};
+			base += w >= 64 ? ~0ull : (1ull << w) - 1;
+			w = dyn_next_w(w, s);
+		}
+		for (uint32_t b = 0; b < (1u << DYN_TAB_BIT); b++){
+			uint32_t pos = 0, k = 0, level, start, x = 0;
+			uint64_t val;
+			for (; k < 3; k++){
+				if (!code(b, pos, val, level, start) || val > 0xff)
+					break;
+				x |= val << (8 + 8 * k);
+				pos = start + lv[level].w;
+			}
+			if (k == 0){
+				code(b, 0, val, level, start);
+				x = level << 8;
+				pos = start;
+			}
+			t[b] = x | k << 4 | pos;
+		}
+	}
+	// one lookup: decode 1 to 3 values to v + i, and advance i. v has room for 2 values past the last one
+	void get_next(BitReader &br, uint32_t *v, uint64_t &i) const{
+		br.refill();
+		uint32_t x = t[br.peek(DYN_TAB_BIT)], k = (x >> 4) & 3;
+		br.skip(x & 0xf);
+		if (k){
+			v[i] = (x >> 8) & 0xff;
+			v[i + 1] = (x >> 16) & 0xff;
+			v[i + 2] = x >> 24;
+			i += k;
+		}else {
+			// through a copy, so that br can stay in registers
+			const Level &l = lv[x >> 8];
+			BitReader c = br;
+			uint64_t y = get_dyn_from(c, l.w, l.step, l.base);
+			br = c;
+			v[i++] = y >> 32 ? 0 : y; // a value above 32 bits decodes to 0
+		}
+	}
+	// decode n values to v, which has room for n + 2
+	void get_n(BitReader &br, uint32_t *v, uint64_t n) const{
+		for (uint64_t i = 0; i < n;)
+			get_next(br, v, i);
+	}
+};
+
+/*
+ * Elias gamma, Elias delta and Golomb-Rice codes, for values with no step to fit.
+ * gamma(x), x >= 1: n 0s, a 1, then the low n bits of x, where n = floor(log2(x)).
+ * delta(x), x >= 1: gamma(n + 1), then the low n bits of x.
+ * rice(x, k): q = x >> k as q 0s and a 1, then the low k bits of x; q >= RICE_ESC is RICE_ESC 0s and x in 64 bits,
+ * so no code is longer than RICE_ESC + 64 bits.
+ * The 0s come first so that decoding counts them with one ctz.
+ */
+#define RICE_ESC 48
+static inline uint64_t gamma_nbit(uint64_t x){
+	return 2 * (63 - __builtin_clzll(x)) + 1;
+}
+static inline void put_gamma(BitWriter &bw, uint64_t x){
+	uint32_t n = 63 - __builtin_clzll(x);
+	if (n < 32){
+		bw.put(x << (n + 1) | 1ull << n, 2 * n + 1); // the top 1 of x is shifted out
+		return;
+	}
+	bw.put(0, n);
+	bw.put(1, 1);
+	bw.put(x, n);
+}
+static inline uint64_t get_gamma(BitReader &br){
+	br.refill();
+	uint32_t z = br.acc ? __builtin_ctzll(br.acc) : 64;
+	if (z < 28){
+		uint64_t v = br.peek(2 * z + 1);
+		br.skip(2 * z + 1);
+		return v >> (z + 1) | 1ull << z;
+	}
+	// a wide value: its 0s may run past the 56 bits refilled, so count them with ctz 56 at a time, then one get
+	for (z = 0; !br.peek(56); z += 56){
+		br.skip(56);
+		if (z >= 64 - 56 || br.overrun){
+			br.overrun = true;
+			return 0;
+		}
+		br.refill();
+	}
+	uint32_t c = __builtin_ctzll(br.acc);
+	z += c;
+	br.skip(c + 1);
+	if (z >= 64 || br.overrun){
+		br.overrun = true;
+		return 0;
+	}
+	return br.get(z) | 1ull << z;
+}
+static inline uint64_t delta_nbit(uint64_t x){
+	uint32_t n = 63 - __builtin_clzll(x);
+	return gamma_nbit(n + 1) + n;
+}
+static inline void put_delta(BitWriter &bw, uint64_t x){
+	uint32_t n = 63 - __builtin_clzll(x);
+	put_gamma(bw, n + 1);
+	bw.put(x, n);
+}
+static inline uint64_t get_delta(BitReader &br){
+	uint64_t n = get_gamma(br) - 1;
+	if (n > 63){
+		br.overrun = true;
+		return 0;
+	}
+	return br.get(n) | 1ull << n;
+}
+static inline uint64_t rice_nbit(uint64_t x, uint32_t k){
+	uint64_t q = x >> k;
+	return q < RICE_ESC ? q + 1 + k : RICE_ESC + 64;
+}
+// k <= 56
+static inline void put_rice(BitWriter &bw, uint64_t x, uint32_t k){
+	uint64_t q = x >> k;
+	if (q >= RICE_ESC){
+		bw.put(0, RICE_ESC);
+		bw.put(x, 64);
+	}else if (q + 1 + k <= 64){
+		bw.put(((x & ((1ull << k) - 1)) << 1 | 1) << q, q + 1 + k);
+	}else {
+		bw.put(1ull << q, q + 1);
+		bw.put(x, k);
+	}
+}
+static inline uint64_t get_rice(BitReader &br, uint32_t k){
+	br.refill();
+	uint32_t z = br.acc ? __builtin_ctzll(br.acc) : 64;
+	if (z >= RICE_ESC){
+		br.skip(RICE_ESC);
+		return br.get(64);
+	}
+	if (z + 1 + k <= 56){
+		uint64_t v = br.peek(z + 1 + k);
+		br.skip(z + 1 + k);
+		return (uint64_t)z << k | v >> (z + 1);
+	}
+	br.skip(z + 1);
+	return (uint64_t)z << k | br.get(k);
+}
+// the k of the Rice code that suits values with this mean
+static inline uint32_t rice_k(uint64_t sum, uint64_t n){
+	uint64_t mean = n ? sum / n : 0;
+	return mean > 1 ? 63 - __builtin_clzll(mean) : 0;
+}
+
+static inline uint64_t zigzag(int64_t x){
+	return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+static inline int64_t unzigzag(uint64_t x){
+	return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+
+#endif /* _BIT_IO_HPP */
@@ -0,0 +1,107 @@
+#ifndef _CODEC_HPP
+#define _CODEC_HPP
+
+#include <stdint.h>
+#include <vector>
+#include "record_file.hpp"
+#include "base_struct.hpp"
+
+/*
+ * Codecs of record file sections. A codec turns the raw bytes of a section (n_elem elements of elem_size bytes)
+ * into the bytes stored on disk, and back. Both sides see the section entry (type, elem_size, n_elem, aux).
+ */
+struct Codec{
+	uint16_t id; // REC_CODEC_*
+	const char *name;
+	// return -1 if the codec does not apply to this section
+	int (*encode)(const RecSection &s, const uint8_t *data, std::vector<uint8_t> &out);
+	// write s.n_elem * s.elem_size bytes to out. Return -1 on malformed input
+	int (*decode)(const RecSection &s, const uint8_t *in, uint64_t len, uint8_t *out);
+	// lossy codecs: whether the decoded bytes are within the error bound of the raw ones. NULL for lossless codecs
+	bool (*check)(const RecSection &s, const uint8_t *raw, const uint8_t *dec);
+};
+
+const Codec* get_codec(uint16_t id);
+const std::vector<const Codec*>& get_all_codecs();
+const char* get_codec_name(uint16_t id);
+
+/*
+ * encode with every codec that applies and keep the smallest; return REC_CODEC_RAW (out untouched) if none beats raw.
+ * prefer is kept instead of the smallest if it is at most 1/CODEC_PREFER_SLACK + CODEC_PREFER_BYTES larger, for a
+ * codec that is worth some bytes, such as bit_chunk which RecordsView reads in place, or stream_vbyte which decodes
+ * about as fast as a copy
+ */
+#define CODEC_PREFER_SLACK 8
+#define CODEC_PREFER_BYTES 64
+uint16_t codec_encode_best(const RecSection &s, const uint8_t *data, std::vector<uint8_t> &out, uint16_t prefer = REC_CODEC_RAW);
+/* encode with codec id only, REC_CODEC_RAW as above */
+uint16_t codec_encode_with(uint16_t id, const RecSection &s, const uint8_t *data, std::vector<uint8_t> &out);
+/* decode the on-disk bytes of section s into out, s.n_elem * s.elem_size bytes */
+int codec_decode(const RecSection &s, const uint8_t *in, uint8_t *out);
+
+/* helpers shared by codecs */
+// the fields of an element as the columns of column codecs, each transformed before coding
+#define COL_RAW 0 // as is
+#define COL_ZIGZAG 1 // a signed field
+#define COL_DELTA 2 // difference to the field of the previous element (mod 2^width), zigzag
+struct Column{
+	uint8_t width; // bytes
+	uint8_t mode; // COL_*
+};
+struct BitWriter;
+struct BitReader;
+void get_columns(const RecSection &s, std::vector<Column> &cols);
+void put_columns_header(BitWriter &bw, const std::vector<Column> &cols);
+// return -1 if the columns do not add up to s.elem_size
+int get_columns_header(BitReader &br, const RecSection &s, std::vector<Column> &cols);
+// the step of the dynamic coding that codes v (values >= 1) in the fewest bits
+uint64_t best_dyn_step(const std::vector<uint64_t> &v);
+// a huffman_prefix column of v.size() values
+int hp_encode_column(BitWriter &bw, const std::vector<uint64_t> &v);
+int hp_decode_column(BitReader &br, std::vector<uint64_t> &v);
+
+/*
+ * Events as runs of event classes. The class of an event is its type with the sockcall index cleared. A run is a
+ * series of events of the same class with consecutive seq, gap the packets before it (seq skipped).
+ * Sockcall indexes are not part of a run: after order_sockcalls each sockcall event takes the next new index. Those
+ * that do not are exceptions, (event index, sockcall index).
+ */
+struct EvtRun{
+	uint32_t cls, len;
+	uint64_t gap;
+	bool operator==(const EvtRun &r) const { return cls == r.cls && len == r.len && gap == r.gap; }
+};
+static inline uint32_t get_evt_class(uint32_t type){
+	return type >= DETER_SOCK_ID_BASE ? ((type - DETER_SOCK_ID_BASE) & ~SC_ID_MASK) + DETER_SOCK_ID_BASE : type;
+}
+// return -1 if seq is not increasing
+int get_evt_runs(const deter_event *e, uint64_t n, std::vector<EvtRun> &runs, std::vector<std::pair<uint64_t, uint32_t> > &exc);
+// the n events of runs and exc (sorted by event index). Return -1 if they are not n events, or an exception is unused
+int put_evt_runs(const std::vector<EvtRun> &runs, const std::vector<std::pair<uint64_t, uint32_t> > &exc, deter_event *e,
+		uint64_t n);
+
+/*
+ * Piecewise-linear fit of non-decreasing timestamps, each within th of its segment's line.
+ * Segment i covers len values from its first one, which is jump past where segment i-1's line gets to;
+ * the k-th value of a segment is its first + (rate * k >> TS_RATE_FRAC).
+ */
+#define TS_RATE_FRAC 16
+struct TsSegment{
+	uint64_t len;
+	uint64_t rate; // per value, fixed point with TS_RATE_FRAC bits
+	int64_t jump;
+};
+void fit_timestamps(const std::vector<uint64_t> &v, uint64_t th, std::vector<TsSegment> &seg);
+
+/* codecs in their own files */
+extern const Codec codec_evt_rle;
+extern const Codec codec_sc_dict;
+extern const Codec codec_sc_shared;
+extern const Codec codec_evt_shared;
+extern const Codec codec_tsq_pwl;
+extern const Codec codec_bit_chunk;
+extern const Codec codec_elias_fano;
+extern const Codec codec_stream_vbyte;
+extern const Codec codec_lz;
+
+#endif /* _CODEC_HPP */
@@ -0,0 +1,155 @@
+#include <cstring>
+#include "codec.hpp"
+#include "bit_chunks.hpp"
+#include "records.hpp"
+
+using namespace std;
+
+static inline uint64_t container_size(const BitChunk &c, uint64_t n_word){
+	if (c.type == BIT_CHUNK_RAW)
+		return n_word * 4;
+	if (c.type == BIT_CHUNK_SPARSE)
+		return BIT_CHUNK_N_WORD / 8 + c.n * 4;
+	return c.n * (c.type == BIT_CHUNK_RUN ? 4 : 2);
+}
+
+int BitChunks::open(const uint8_t *buf, uint64_t len){
+	uint32_t h[2];
+	if (len < sizeof(h))
+		return -1;
+	memcpy(h, buf, sizeof(h));
+	n_word = h[0];
+	n_chunk = h[1];
+	if (n_chunk != (n_word + BIT_CHUNK_N_WORD - 1) / BIT_CHUNK_N_WORD || n_chunk > (len - sizeof(h)) / sizeof(BitChunk))
+		return -1;
+	dir = (const BitChunk*)(buf + sizeof(h));
+	p = buf + sizeof(h) + n_chunk * sizeof(BitChunk);
+	len -= p - buf;
+	for (uint64_t i = 0; i < n_chunk; i++){
+		const BitChunk &c = dir[i];
+		uint64_t words = i + 1 < n_chunk ? BIT_CHUNK_N_WORD : n_word - i * BIT_CHUNK_N_WORD;
+		if (c.type > BIT_CHUNK_SPARSE || c.off % 4 || c.off > len || container_size(c, words) > len - c.off)
+			return -1;
+	}
+	return 0;
+}
+
+int BitChunks::to_raw(uint32_t *w) const{
+	memset(w, 0, n_word * 4);
+	for (uint64_t i = 0; i < n_chunk; i++, w += BIT_CHUNK_N_WORD){
+		const BitChunk &c = dir[i];
+		const uint16_t *x = (const uint16_t*)(p + c.off);
+		uint32_t bits = (i + 1 < n_chunk ? BIT_CHUNK_N_WORD : n_word - i * BIT_CHUNK_N_WORD) * 32, end = 0;
+		if (c.type == BIT_CHUNK_RAW){
+			memcpy(w, x, bits / 8);
+		}else if (c.type == BIT_CHUNK_SPARSE){
+			uint32_t m[BIT_CHUNK_N_WORD / 32], k = 0;
+			memcpy(m, x, sizeof(m));
+			for (uint32_t j = 0; j < BIT_CHUNK_N_WORD; j++)
+				if ((m[j / 32] >> (j & 31)) & 1){
+					if (j >= bits / 32 || k >= c.n)
+						return -1;
+					memcpy(&w[j], (const uint8_t*)x + sizeof(m) + k++ * 4, 4);
+				}
+			if (k != c.n)
+				return -1;
+		}else if (c.type == BIT_CHUNK_POS){
+			for (uint32_t j = 0; j < c.n; end = x[j++] + 1){
+				if (x[j] < end || x[j] >= bits)
+					return -1;
+				w[x[j] >> 5] |= 1u << (x[j] & 31);
+			}
+		}else {
+			for (uint32_t j = 0; j < c.n; j++){
+				uint32_t a = x[j * 2], b = a + x[j * 2 + 1] + 1;
+				if (a < end || b > bits)
+					return -1;
+				for (; a < b && (a & 31); a++)
+					w[a >> 5] |= 1u << (a & 31);
+				for (; a + 32 <= b; a += 32)
+					w[a >> 5] = ~0u;
+				for (; a < b; a++)
+					w[a >> 5] |= 1u << (a & 31);
+				end = b + 1; // runs don't touch
+			}
+		}
+	}
+	return 0;
+}
+
+void bit_chunks_build(const uint32_t *w, uint64_t n_word, vector<uint8_t> &out){
+	uint32_t h[2] = {(uint32_t)n_word, (uint32_t)((n_word + BIT_CHUNK_N_WORD - 1) / BIT_CHUNK_N_WORD)};
+	vector<BitChunk> dir(h[1]);
+	vector<uint8_t> data;
+	vector<uint16_t> pos, run;
+	for (uint64_t i = 0; i < h[1]; i++){
+		const uint32_t *cw = w + i * BIT_CHUNK_N_WORD;
+		uint32_t words = min((uint64_t)BIT_CHUNK_N_WORD, n_word - i * BIT_CHUNK_N_WORD);
+		uint32_t mask[BIT_CHUNK_N_WORD / 32] = {0}, n_nz = 0;
+		pos.clear();
+		run.clear();
+		for (uint32_t j = 0; j < words; j++)
+			if (cw[j]){
+				mask[j / 32] |= 1u << (j & 31);
+				n_nz++;
+			}
+		for (uint32_t j = 0; j < words; j++)
+			for (uint32_t x = cw[j]; x; x &= x - 1){
+				uint16_t b = j * 32 + __builtin_ctz(x);
+				pos.push_back(b);
+				if (run.size() && run[run.size() - 2] + run.back() + 1 == b)
+					run.back()++;
+				else {
+					run.push_back(b);
+					run.push_back(0);
+				}
+			}
+		// the smallest container, the first of equal ones
+		BitChunk &c = dir[i];
+		uint64_t size[4] = {words * 4, pos.size() * 2, run.size() * 2, sizeof(mask) + n_nz * 4};
+		c.off = data.size();
+		c.type = BIT_CHUNK_RAW;
+		for (uint16_t t = BIT_CHUNK_POS; t <= BIT_CHUNK_SPARSE; t++)
+			if (size[t] < size[c.type])
+				c.type = t;
+		if (c.type == BIT_CHUNK_RAW){
+			c.n = 0;
+			data.insert(data.end(), (const uint8_t*)cw, (const uint8_t*)(cw + words));
+		}else if (c.type == BIT_CHUNK_POS){
+			c.n = pos.size();
+			data.insert(data.end(), (const uint8_t*)pos.data(), (const uint8_t*)(pos.data() + pos.size()));
+		}else if (c.type == BIT_CHUNK_RUN){
+			c.n = run.size() / 2;
+			data.insert(data.end(), (const uint8_t*)run.data(), (const uint8_t*)(run.data() + run.size()));
+		}else {
+			c.n = n_nz;
+			data.insert(data.end(), (const uint8_t*)mask, (const uint8_t*)(mask + BIT_CHUNK_N_WORD / 32));
+			for (uint32_t j = 0; j < words; j++)
+				if (cw[j])
+					data.insert(data.end(), (const uint8_t*)(cw + j), (const uint8_t*)(cw + j + 1));
+		}
+		data.resize((data.size() + 3) & ~3ull);
+	}
+	out.insert(out.end(), (const uint8_t*)h, (const uint8_t*)(h + 2));
+	out.insert(out.end(), (const uint8_t*)dir.data(), (const uint8_t*)(dir.data() + dir.size()));
+	out.insert(out.end(), data.begin(), data.end());
+}
+
+/*
+ * bit_chunk: a RAW BitArray as BitChunks. Usually larger than bit_run, but RecordsView reads its bits in place.
+ */
+static int bit_chunk_encode(const RecSection &s, const uint8_t *data, vector<uint8_t> &out){
+	if (!is_bit_array(s.type) || s.aux[1] != BitArray::RAW || s.elem_size != 4 || s.n_elem >= 1ull << 32)
+		return -1;
+	bit_chunks_build((const uint32_t*)data, s.n_elem, out);
+	return 0;
+}
+
+static int bit_chunk_decode(const RecSection &s, const uint8_t *in, uint64_t len, uint8_t *out){
+	BitChunks c;
+	if (s.elem_size != 4 || c.open(in, len) || c.n_word != s.n_elem)
+		return -1;
+	return c.to_raw((uint32_t*)out);
+}
+
+const Codec codec_bit_chunk = {REC_CODEC_BIT_CHUNK, "bit_chunk", bit_chunk_encode, bit_chunk_decode};
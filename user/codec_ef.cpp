@@ -0,0 +1,146 @@
+#include <cstring>
+#include "codec.hpp"
+#include "elias_fano.hpp"
+#include "records.hpp"
+
+using namespace std;
+
+void EliasFano::build(const uint64_t *v, uint64_t _n){
+	n = _n;
+	u = n ? v[n - 1] : 0;
+	l = best_l(n, u);
+	n_lo = lo_words(n, l);
+	n_hi = hi_words(n, u, l);
+	own.assign(n_lo + n_hi, 0);
+	uint64_t *w = own.data();
+	for (uint64_t i = 0; i < n; i++){
+		uint64_t b = i * l, low = v[i] & ((1ull << l) - 1), h = (v[i] >> l) + i;
+		if (l){
+			w[b / 64] |= low << (b % 64);
+			if (b % 64 + l > 64)
+				w[b / 64 + 1] |= low >> (64 - b % 64);
+		}
+		w[n_lo + h / 64] |= 1ull << (h % 64);
+	}
+	lo = w;
+	hi = w + n_lo;
+}
+
+int EliasFano::open(uint64_t _n, uint64_t _u, uint32_t _l, const uint64_t *_lo, const uint64_t *_hi){
+	uint64_t ones = 0;
+	n = _n;
+	u = _u;
+	l = _l;
+	n_lo = lo_words(n, l);
+	n_hi = hi_words(n, u, l);
+	lo = _lo;
+	hi = _hi;
+	own.clear();
+	for (uint64_t w = 0; w < n_hi; w++)
+		ones += __builtin_popcountll(hi[w]);
+	return ones == n ? 0 : -1;
+}
+
+void EliasFano::decode(uint64_t *out) const{
+	// the high parts, then the low parts in a loop of its own, which the compiler can unroll
+	uint64_t i = 0;
+	for (uint64_t w = 0; w < n_hi && i < n; w++)
+		for (uint64_t bits = hi[w]; bits && i < n; bits &= bits - 1, i++)
+			out[i] = (w * 64 + __builtin_ctzll(bits) - i) << l;
+	if (l)
+		for (i = 0; i < n; i++)
+			out[i] |= get_lo(i);
+}
+
+/*
+ * elias_fano: each 4-byte column as an Elias-Fano sequence. A column becomes non-decreasing either by unwrapping
+ * (each value taken as not less than the one before, for seq, tx stamps and sorted indexes) or by a prefix sum (for
+ * columns of deltas, as in jiffies); the one with the smaller range is kept.
+ * All in 8-byte words:
+ * | n_col | per column: | mode | l | base | u | lo words | hi words | |
+ */
+#define EF_UNWRAP 0
+#define EF_PREFIX_SUM 1
+
+static bool ef_applies(const RecSection &s){
+	switch (s.type){
+		case REC_SEC_EVT:
+		case REC_SEC_JIF:
+		case REC_SEC_MSTAMP:
+		case REC_SEC_TSQ:
+			return s.elem_size % 4 == 0;
+	}
+	return is_bit_array(s.type) && s.aux[1] != BitArray::RAW && s.elem_size == 4;
+}
+
+static int ef_encode(const RecSection &s, const uint8_t *data, vector<uint8_t> &out){
+	vector<uint64_t> words, m[2];
+	uint32_t n_col = s.elem_size / 4;
+	if (!ef_applies(s))
+		return -1;
+	words.push_back(n_col);
+	m[0].resize(s.n_elem);
+	m[1].resize(s.n_elem);
+	for (uint32_t c = 0; c < n_col; c++){
+		for (uint64_t i = 0; i < s.n_elem; i++){
+			uint32_t v, prev = 0;
+			memcpy(&v, data + i * s.elem_size + c * 4, 4);
+			if (i)
+				memcpy(&prev, data + (i - 1) * s.elem_size + c * 4, 4);
+			m[EF_UNWRAP][i] = i ? m[EF_UNWRAP][i - 1] + (uint32_t)(v - prev) : v;
+			m[EF_PREFIX_SUM][i] = i ? m[EF_PREFIX_SUM][i - 1] + v : v;
+		}
+		int mode = s.n_elem && m[1].back() - m[1][0] < m[0].back() - m[0][0] ? EF_PREFIX_SUM : EF_UNWRAP;
+		uint64_t base = s.n_elem ? m[mode][0] : 0;
+		for (uint64_t &x : m[mode])
+			x -= base;
+		EliasFano ef;
+		ef.build(m[mode].data(), s.n_elem);
+		words.push_back(mode);
+		words.push_back(ef.l);
+		words.push_back(base);
+		words.push_back(ef.u);
+		words.insert(words.end(), ef.own.begin(), ef.own.end());
+	}
+	out.insert(out.end(), (const uint8_t*)words.data(), (const uint8_t*)(words.data() + words.size()));
+	return 0;
+}
+
+static int ef_decode(const RecSection &s, const uint8_t *in, uint64_t len, uint8_t *out){
+	vector<uint64_t> copy, m(s.n_elem);
+	const uint64_t *w = (const uint64_t*)in, *end;
+	if (len % 8 || s.elem_size % 4 || len < 8)
+		return -1;
+	if ((uintptr_t)in % 8){
+		copy.resize(len / 8);
+		memcpy(copy.data(), in, len);
+		w = copy.data();
+	}
+	end = w + len / 8;
+	if (*w++ != s.elem_size / 4)
+		return -1;
+	for (uint32_t c = 0; c < s.elem_size / 4; c++){
+		if (end - w < 4)
+			return -1;
+		uint64_t mode = w[0], l = w[1], base = w[2], u = w[3];
+		w += 4;
+		// (u >> l) bounds the size of hi, which has to fit in the input
+		if (mode > EF_PREFIX_SUM || l > 63 || (u >> l) > len * 8 || s.n_elem > len * 8)
+			return -1;
+		uint64_t n_lo = EliasFano::lo_words(s.n_elem, l), n_hi = EliasFano::hi_words(s.n_elem, u, l);
+		if (n_lo + n_hi > (uint64_t)(end - w))
+			return -1;
+		EliasFano ef;
+		if (ef.open(s.n_elem, u, l, w, w + n_lo))
+			return -1;
+		w += n_lo + n_hi;
+		ef.decode(m.data());
+		for (uint64_t i = 0; i < s.n_elem; i++){
+			uint32_t v = mode == EF_UNWRAP || i == 0 ? m[i] + base : m[i] - m[i - 1];
+			memcpy(out + i * s.elem_size + c * 4, &v, 4);
+		}
+	}
+	return w == end ? 0 : -1;
+}
+
+const Codec codec_elias_fano = {REC_CODEC_ELIAS_FANO, "elias_fano", ef_encode, ef_decode};
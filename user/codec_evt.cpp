@@ -0,0 +1,403 @@
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include "codec.hpp"
+#include "bit_io.hpp"
+#include "base_struct.hpp"
+#include "shared_dict.hpp"
+
+using namespace std;
+
+/*
+ * evt_rle: the event stream as runs of event classes (get_evt_runs), as estimated by compressed_evt_size.
+ * The packets between locks (seq gaps) are stored as the gap before each run. Sockcall indexes are not stored, but
+ * for exceptions (a sockcall locked again, or an unordered file).
+ *
+ * | n_class:dyn | class:32 * n_class | step_cls:64 | step_len:64 | step_gap:64 |
+ * | n_exc:dyn | (event delta:dyn, idx:32) * n_exc | n_run:dyn | class stream bytes:dyn | length stream bytes:dyn |
+ * | class code:dyn per run | length:dyn per run | gap+1:dyn per run |
+ * The header is padded to whole bytes, each stream is followed by DYN_TAB_PAD bytes of 0s.
+ * Classes are ranked by number of runs. Two runs without a gap between them never have the same class, so the
+ * class code of the second skips the rank of the first.
+ * The decoder reads the three streams side by side, without a branch on the class of a run.
+ */
+#define EVT_RUN_FAST 4
+#define EVT_BLOCK 1024
+
+// decoding state: the tables of the class, length and gap streams, and their values for a block of runs
+struct EvtDecodeBuf{
+	DynTable tab[3];
+	uint32_t v[3][EVT_BLOCK + 2];
+};
+
+int get_evt_runs(const deter_event *e, uint64_t n, vector<EvtRun> &runs, vector<pair<uint64_t, uint32_t> > &exc){
+	uint64_t next_seq = 0;
+	uint32_t next_sc = 0;
+	for (uint64_t i = 0; i < n; i++){
+		uint32_t c = get_evt_class(e[i].type);
+		if (e[i].seq < next_seq)
+			return -1; // not increasing
+		if (e[i].seq == next_seq && runs.size() && runs.back().cls == c)
+			runs.back().len++;
+		else
+			runs.push_back((EvtRun){c, 1, e[i].seq - next_seq});
+		next_seq = (uint64_t)e[i].seq + 1;
+		if (c >= DETER_SOCK_ID_BASE){
+			uint32_t idx = get_sockcall_idx(e[i].type);
+			if (idx != next_sc)
+				exc.push_back(make_pair(i, idx));
+			next_sc = max(next_sc, idx + 1);
+		}
+	}
+	return 0;
+}
+
+int put_evt_runs(const vector<EvtRun> &runs, const vector<pair<uint64_t, uint32_t> > &exc, deter_event *e, uint64_t n){
+	uint64_t i = 0, seq = 0, x = 0;
+	uint32_t next_sc = 0;
+	for (const EvtRun &r : runs){
+		if (r.len == 0 || r.len > n - i || (i && r.gap == 0 && r.cls == get_evt_class(e[i - 1].type)))
+			return -1;
+		seq += r.gap;
+		for (uint64_t end = i + r.len; i < end; i++, seq++){
+			uint32_t idx = next_sc;
+			if (x < exc.size() && exc[x].first == i)
+				idx = exc[x++].second;
+			e[i].seq = seq;
+			e[i].type = r.cls;
+			if (r.cls >= DETER_SOCK_ID_BASE){
+				e[i].type += idx;
+				next_sc = max(next_sc, idx + 1);
+			}
+		}
+	}
+	return i == n && x == exc.size() ? 0 : -1;
+}
+
+static int evt_rle_encode(const RecSection &s, const uint8_t *data, vector<uint8_t> &out){
+	const deter_event *e = (const deter_event*)data;
+	vector<EvtRun> runs;
+	vector<pair<uint64_t, uint32_t> > exc; // (event index, sockcall index)
+	if (s.type != REC_SEC_EVT || s.elem_size != sizeof(deter_event) || get_evt_runs(e, s.n_elem, runs, exc))
+		return -1;
+
+	// rank classes by number of runs
+	unordered_map<uint32_t, uint64_t> cnt;
+	vector<pair<uint64_t, uint32_t> > order;
+	unordered_map<uint32_t, uint32_t> rank;
+	for (auto &r : runs)
+		cnt[r.cls]++;
+	for (auto &it : cnt)
+		order.push_back(make_pair(~it.second, it.first)); // descending count, then class
+	sort(order.begin(), order.end());
+	for (uint32_t i = 0; i < order.size(); i++)
+		rank[order[i].second] = i;
+
+	vector<uint64_t> cls_code(runs.size()), len(runs.size()), gap(runs.size());
+	for (uint64_t i = 0, prev = ~0ull; i < runs.size(); i++){
+		uint32_t r = rank[runs[i].cls];
+		cls_code[i] = r - (runs[i].gap == 0 && r > prev) + 1;
+		len[i] = runs[i].len;
+		gap[i] = runs[i].gap + 1;
+		prev = r;
+		if (gap[i] > UINT32_MAX) // the first event at seq 2^32-1: the decoder reads 32-bit values
+			return -1;
+	}
+	uint64_t step_cls = best_dyn_step(cls_code), step_len = best_dyn_step(len), step_gap = best_dyn_step(gap);
+
+	vector<uint8_t> cls_out, len_out, gap_out;
+	BitWriter cw(cls_out), lw(len_out), gw(gap_out);
+	const DynLevels lv_cls = dyn_levels(step_cls), lv_len = dyn_levels(step_len), lv_gap = dyn_levels(step_gap);
+	for (uint64_t i = 0; i < runs.size(); i++){
+		put_dyn(cw, cls_code[i], lv_cls);
+		put_dyn(lw, len[i], lv_len);
+		put_dyn(gw, gap[i], lv_gap);
+	}
+	cw.flush();
+	lw.flush();
+	gw.flush();
+	cls_out.resize(cls_out.size() + DYN_TAB_PAD);
+	len_out.resize(len_out.size() + DYN_TAB_PAD);
+	gap_out.resize(gap_out.size() + DYN_TAB_PAD);
+
+	BitWriter bw(out);
+	put_dyn(bw, order.size() + 1, 0);
+	for (auto &o : order)
+		bw.put(o.second, 32);
+	bw.put(step_cls, 64);
+	bw.put(step_len, 64);
+	bw.put(step_gap, 64);
+	put_dyn(bw, exc.size() + 1, 0);
+	for (uint64_t i = 0, last = 0; i < exc.size(); i++){
+		put_dyn(bw, exc[i].first - last + 1, 0);
+		bw.put(exc[i].second, 32);
+		last = exc[i].first;
+	}
+	put_dyn(bw, runs.size() + 1, 0);
+	put_dyn(bw, cls_out.size() + 1, 0);
+	put_dyn(bw, len_out.size() + 1, 0);
+	bw.flush();
+	out.insert(out.end(), cls_out.begin(), cls_out.end());
+	out.insert(out.end(), len_out.begin(), len_out.end());
+	out.insert(out.end(), gap_out.begin(), gap_out.end());
+	return 0;
+}
+
+static int evt_rle_decode(const RecSection &s, const uint8_t *in, uint64_t in_len, uint8_t *out){
+	deter_event *e = (deter_event*)out;
+	BitReader br(in, in_len);
+	vector<uint32_t> cls, sc_inc;
+	vector<pair<uint64_t, uint32_t> > exc;
+	uint64_t n_class, n_exc, n_run, step_cls, step_len, step_gap, cls_len, len_len, off;
+	if (s.elem_size != sizeof(deter_event))
+		return -1;
+
+	n_class = get_dyn(br, 0) - 1;
+	if (n_class > s.n_elem)
+		return -1;
+	for (uint64_t i = 0; i < n_class; i++){
+		cls.push_back(br.get(32));
+		sc_inc.push_back(cls.back() >= DETER_SOCK_ID_BASE);
+	}
+	step_cls = br.get(64);
+	step_len = br.get(64);
+	step_gap = br.get(64);
+	n_exc = get_dyn(br, 0) - 1;
+	if (n_exc > s.n_elem)
+		return -1;
+	for (uint64_t i = 0, last = 0; i < n_exc; i++){
+		last += get_dyn(br, 0) - 1;
+		exc.push_back(make_pair(last, (uint32_t)br.get(32)));
+	}
+	exc.push_back(make_pair(~0ull, 0)); // sentinel
+	n_run = get_dyn(br, 0) - 1;
+	cls_len = get_dyn(br, 0) - 1;
+	len_len = get_dyn(br, 0) - 1;
+	if (br.overrun || n_run > s.n_elem)
+		return -1;
+	off = (br.tell(in) + 7) / 8;
+	if (cls_len > in_len - off || len_len > in_len - off - cls_len)
+		return -1;
+
+	// the three streams, decoded a block of runs at a time
+	BitReader br3[3] = {BitReader(in + off, cls_len), BitReader(in + off + cls_len, len_len),
+		BitReader(in + off + cls_len + len_len, in_len - off - cls_len - len_len)};
+	EvtDecodeBuf *b = new EvtDecodeBuf;
+	uint64_t have[3] = {0, 0, 0}; // values in b->v[i]
+	b->tab[0].init(step_cls);
+	b->tab[1].init(step_len);
+	b->tab[2].init(step_gap);
+
+	/*
+	 * Runs are mostly short, so the first EVT_RUN_FAST events of a run are written without branching on the length;
+	 * the events past the run are written again by the next runs.
+	 */
+	int ret = -1;
+	uint64_t n = 0, seq = 0, prev = n_class;
+	uint32_t next_sc = 0;
+	const pair<uint64_t, uint32_t> *x = &exc[0];
+	for (uint64_t i0 = 0; i0 < n_run; i0 += EVT_BLOCK){
+		uint64_t m = min((uint64_t)EVT_BLOCK, n_run - i0);
+		const uint32_t *rank = b->v[0], *len = b->v[1], *gap = b->v[2];
+		// interleaved, for more loads in flight
+		while (have[0] < m || have[1] < m || have[2] < m){
+			if (have[0] < m)
+				b->tab[0].get_next(br3[0], b->v[0], have[0]);
+			if (have[1] < m)
+				b->tab[1].get_next(br3[1], b->v[1], have[1]);
+			if (have[2] < m)
+				b->tab[2].get_next(br3[2], b->v[2], have[2]);
+		}
+		for (uint64_t i = 0; i < m; i++){
+			uint64_t r = rank[i] - 1, n_evt = len[i];
+			// no && or ||: as branches they would be hard to predict
+			r += (gap[i] == 1) & (r >= prev);
+			if ((r >= n_class) | (n_evt == 0) | (gap[i] == 0) | (n_evt > s.n_elem - n))
+				goto out;
+			prev = r;
+			uint32_t c = cls[r], inc = sc_inc[r];
+			seq += gap[i] - 1;
+			if (x->first < n + n_evt || s.n_elem - n < EVT_RUN_FAST){
+				// a run with exceptions, or at the end of the output
+				for (uint64_t end = n + n_evt; n < end; n++, seq++){
+					uint32_t idx = next_sc;
+					if (x->first == n){
+						idx = x->second;
+						x++;
+					}
+					e[n].seq = seq;
+					e[n].type = c + (inc ? idx : 0);
+					next_sc = max(next_sc, (inc ? idx + 1 : 0));
+				}
+				continue;
+			}
+			for (uint32_t j = 0; j < EVT_RUN_FAST; j++){
+				e[n + j].seq = seq + j;
+				e[n + j].type = c + ((next_sc + j) & -inc);
+			}
+			for (uint64_t j = EVT_RUN_FAST; j < n_evt; j++){
+				e[n + j].seq = seq + j;
+				e[n + j].type = c + ((next_sc + j) & -inc);
+			}
+			n += n_evt;
+			seq += n_evt;
+			next_sc += n_evt & -(uint64_t)inc;
+		}
+		// values decoded past the block go to the next one
+		for (int k = 0; k < 3; k++){
+			for (uint64_t i = m; i < have[k]; i++)
+				b->v[k][i - m] = b->v[k][i];
+			have[k] -= m;
+		}
+	}
+	if (n == s.n_elem && x->first == ~0ull && !br3[0].overrun && !br3[1].overrun && !br3[2].overrun)
+		ret = 0;
+out:
+	delete b;
+	return ret;
+}
+
+const Codec codec_evt_rle = {REC_CODEC_EVT_RLE, "evt_rle", evt_rle_encode, evt_rle_decode};
+
+/*
+ * evt_shared: the runs as tokens, each a phrase of the shared dictionary aux[0] (shared_dict.hpp), or a literal run,
+ * the longest phrase that matches first. Classes are coded as their index in the classes of the dictionary, then
+ * in the local classes of the section, which are not in it.
+ *
+ * | n_exc:dyn | (event delta:dyn, idx:32) * n_exc | n_local:dyn | class:32 * n_local |
+ * | step_tok:64 | step_cls:64 | step_len:64 | step_gap:64 | n_tok:dyn | (token:dyn [, literal]) * n_tok |
+ * A token is 1 for a literal (class code:dyn, length:dyn, gap+1:dyn), or 2 + the index of a phrase.
+ */
+static int evt_shared_encode(const RecSection &s, const uint8_t *data, vector<uint8_t> &out){
+	const deter_event *e = (const deter_event*)data;
+	vector<EvtRun> runs;
+	vector<pair<uint64_t, uint32_t> > exc;
+	const SharedDict *d = s.aux[0] ? get_shared_dict(s.aux[0]) : NULL;
+	if (s.type != REC_SEC_EVT || s.elem_size != sizeof(deter_event) || d == NULL || get_evt_runs(e, s.n_elem, runs, exc))
+		return -1;
+
+	vector<uint32_t> local;
+	unordered_map<uint32_t, uint32_t> local_idx;
+	vector<uint64_t> tok, cls_code, len, gap;
+	for (uint64_t i = 0; i < runs.size();){
+		auto ph = d->phrase_by_cls.find(runs[i].cls);
+		uint64_t k = 0;
+		if (ph != d->phrase_by_cls.end())
+			for (uint32_t p : ph->second){
+				const vector<EvtRun> &v = d->phrases[p];
+				if (v.size() <= runs.size() - i && equal(v.begin(), v.end(), runs.begin() + i)){
+					tok.push_back(p + 2);
+					k = v.size();
+					break;
+				}
+			}
+		if (k){
+			i += k;
+			continue;
+		}
+		const EvtRun &r = runs[i++];
+		auto it = d->cls_idx.find(r.cls);
+		uint64_t c;
+		if (it != d->cls_idx.end())
+			c = it->second;
+		else {
+			auto l = local_idx.insert(make_pair(r.cls, (uint32_t)local.size()));
+			if (l.second)
+				local.push_back(r.cls);
+			c = d->cls.size() + l.first->second;
+		}
+		tok.push_back(1);
+		cls_code.push_back(c + 1);
+		len.push_back(r.len);
+		gap.push_back(r.gap + 1);
+	}
+	uint64_t step_tok = best_dyn_step(tok), step_cls = best_dyn_step(cls_code), step_len = best_dyn_step(len),
+		step_gap = best_dyn_step(gap);
+
+	BitWriter bw(out);
+	put_dyn(bw, exc.size() + 1, 0);
+	for (uint64_t i = 0, last = 0; i < exc.size(); i++){
+		put_dyn(bw, exc[i].first - last + 1, 0);
+		bw.put(exc[i].second, 32);
+		last = exc[i].first;
+	}
+	put_dyn(bw, local.size() + 1, 0);
+	for (uint32_t c : local)
+		bw.put(c, 32);
+	bw.put(step_tok, 64);
+	bw.put(step_cls, 64);
+	bw.put(step_len, 64);
+	bw.put(step_gap, 64);
+	put_dyn(bw, tok.size() + 1, 0);
+	const DynLevels lv_tok = dyn_levels(step_tok), lv_cls = dyn_levels(step_cls), lv_len = dyn_levels(step_len),
+		lv_gap = dyn_levels(step_gap);
+	for (uint64_t i = 0, j = 0; i < tok.size(); i++){
+		put_dyn(bw, tok[i], lv_tok);
+		if (tok[i] != 1)
+			continue;
+		put_dyn(bw, cls_code[j], lv_cls);
+		put_dyn(bw, len[j], lv_len);
+		put_dyn(bw, gap[j], lv_gap);
+		j++;
+	}
+	bw.flush();
+	return 0;
+}
+
+static int evt_shared_decode(const RecSection &s, const uint8_t *in, uint64_t in_len, uint8_t *out){
+	BitReader br(in, in_len);
+	vector<pair<uint64_t, uint32_t> > exc;
+	vector<uint32_t> cls;
+	vector<EvtRun> runs;
+	uint64_t n_exc, n_local, n_tok, n = 0;
+	const SharedDict *d = get_shared_dict(s.aux[0]);
+	if (s.elem_size != sizeof(deter_event) || d == NULL)
+		return -1;
+
+	n_exc = get_dyn(br, 0) - 1;
+	if (br.overrun || n_exc > s.n_elem)
+		return -1;
+	for (uint64_t i = 0, last = 0; i < n_exc; i++){
+		last += get_dyn(br, 0) - 1;
+		if (br.overrun || last >= s.n_elem)
+			return -1;
+		exc.push_back(make_pair(last, (uint32_t)br.get(32)));
+	}
+	n_local = get_dyn(br, 0) - 1;
+	if (br.overrun || n_local > s.n_elem)
+		return -1;
+	cls = d->cls;
+	for (uint64_t i = 0; i < n_local; i++)
+		cls.push_back(br.get(32));
+	const DynLevels lv_tok = dyn_levels(br.get(64)), lv_cls = dyn_levels(br.get(64)), lv_len = dyn_levels(br.get(64)),
+		lv_gap = dyn_levels(br.get(64));
+	n_tok = get_dyn(br, 0) - 1;
+	if (br.overrun || n_tok > s.n_elem)
+		return -1;
+	for (uint64_t i = 0; i < n_tok; i++){
+		uint64_t t = get_dyn(br, lv_tok);
+		if (t >= 2 && t - 2 < d->phrases.size()){
+			for (const EvtRun &r : d->phrases[t - 2]){
+				if (r.len > s.n_elem - n)
+					return -1;
+				runs.push_back(r);
+				n += r.len;
+			}
+			continue;
+		}
+		EvtRun r;
+		uint64_t c = get_dyn(br, lv_cls) - 1, l = get_dyn(br, lv_len), g = get_dyn(br, lv_gap);
+		if (br.overrun || t != 1 || c >= cls.size() || l > s.n_elem - n || g == 0)
+			return -1;
+		r.cls = cls[c];
+		r.len = l;
+		r.gap = g - 1;
+		runs.push_back(r);
+		n += l;
+	}
+	if (br.overrun)
+		return -1;
+	return put_evt_runs(runs, exc, (deter_event*)out, s.n_elem);
+}
+
+const Codec codec_evt_shared = {REC_CODEC_EVT_SHARED, "evt_shared", evt_shared_encode, evt_shared_decode};
@@ -0,0 +1,187 @@
+#include <cstring>
+#include <algorithm>
+#include "codec.hpp"
+
+using namespace std;
+
+/*
+ * lz: the bytes of any section as LZ77 sequences, in the block format of LZ4, for sections that no codec of their
+ * own fits (init data, aeq, siqq). A sequence is some literal bytes, then a match: bytes copied from offset back.
+ * | token:8 | [literal length - 15:8*] | literals | offset:16 | [match length - 4 - 15:8*] |
+ * The high 4 bits of the token are the literal length, the low 4 bits the match length - LZ_MIN_MATCH; 15 means it
+ * goes on in bytes, each added, until a byte below 255. The last sequence has literals only, and ends the section.
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+#define LZ_SKIP_SHIFT 6 // after 2^LZ_SKIP_SHIFT positions without a match, step 2 bytes, and so on
+
+static inline uint32_t lz_hash(const uint8_t *p, int bits){
+	uint32_t x;
+	memcpy(&x, p, 4);
+	return (x * 2654435761u) >> (32 - bits);
+}
+
+static inline uint8_t* lz_put_len(uint8_t *o, uint64_t len){
+	for (; len >= 255; len -= 255)
+		*o++ = 255;
+	*o++ = len;
+	return o;
+}
+
+static inline uint8_t* lz_put_seq(uint8_t *o, const uint8_t *lit, uint64_t n_lit, uint32_t offset, uint64_t match){
+	uint64_t m = match ? match - LZ_MIN_MATCH : 0;
+	*o++ = (min(n_lit, (uint64_t)15) << 4) | min(m, (uint64_t)15);
+	if (n_lit >= 15)
+		o = lz_put_len(o, n_lit - 15);
+	memcpy(o, lit, n_lit);
+	o += n_lit;
+	if (match == 0)
+		return o;
+	*o++ = offset;
+	*o++ = offset >> 8;
+	if (m >= 15)
+		o = lz_put_len(o, m - 15);
+	return o;
+}
+
+static inline uint32_t load32(const uint8_t *p){
+	uint32_t x;
+	memcpy(&x, p, 4);
+	return x;
+}
+
+// bytes p and q have in common, up to end
+static inline uint64_t lz_common(const uint8_t *p, const uint8_t *q, const uint8_t *end){
+	const uint8_t *start = p;
+	while (end - p >= 8){
+		uint64_t a, b;
+		memcpy(&a, p, 8);
+		memcpy(&b, q, 8);
+		if (a != b)
+			return p - start + (__builtin_ctzll(a ^ b) >> 3);
+		p += 8;
+		q += 8;
+	}
+	while (p < end && *p == *q){
+		p++;
+		q++;
+	}
+	return p - start;
+}
+
+static int lz_encode(const RecSection &s, const uint8_t *data, vector<uint8_t> &out){
+	uint64_t n = s.n_elem * s.elem_size, start = out.size();
+	const uint8_t *p = data, *lit = data, *end = data + n;
+	uint64_t misses = 0;
+	int bits = 8;
+	// meta is read from every file of a corpus, so it stays in place for the few bytes this would save
+	if (n == 0 || s.type == REC_SEC_META)
+		return -1;
+	// a table about the size of the section, so that small ones do not pay for clearing a large one
+	for (; bits < LZ_HASH_BITS && (1ull << bits) < n; bits++);
+	vector<uint32_t> tab(1 << bits, 0); // position + 1 of the last 4 bytes of each hash
+	// at most all literals, with their length bytes
+	out.resize(start + n + n / 255 + 16);
+	uint8_t *o = &out[start];
+	while (end - p >= LZ_MIN_MATCH){
+		uint32_t x = load32(p), h = (x * 2654435761u) >> (32 - bits), cand = tab[h];
+		tab[h] = p - data + 1;
+		if (cand == 0 || p - data + 1 - cand > LZ_MAX_OFFSET || load32(data + cand - 1) != x){
+			p += 1 + (misses++ >> LZ_SKIP_SHIFT);
+			continue;
+		}
+		const uint8_t *q = data + cand - 1;
+		uint64_t len = LZ_MIN_MATCH + lz_common(p + LZ_MIN_MATCH, q + LZ_MIN_MATCH, end);
+		// extend back over literals
+		while (p > lit && q > data && p[-1] == q[-1]){
+			p--;
+			q--;
+			len++;
+		}
+		o = lz_put_seq(o, lit, p - lit, p - q, len);
+		p += len;
+		lit = p;
+		misses = 0;
+		// the positions inside the match are not hashed, but the one before its end
+		if (end - p >= LZ_MIN_MATCH + 2)
+			tab[lz_hash(p - 2, bits)] = p - 2 - data + 1;
+	}
+	o = lz_put_seq(o, lit, end - lit, 0, 0);
+	out.resize(o - out.data());
+	return 0;
+}
+
+// a length continued in bytes after the 4 bits of the token. Return -1 if it runs past end
+static inline int lz_get_len(const uint8_t *&p, const uint8_t *end, uint64_t &len){
+	uint8_t b;
+	do {
+		if (p == end)
+			return -1;
+		b = *p++;
+		len += b;
+	} while (b == 255);
+	return 0;
+}
+
+static int lz_decode(const RecSection &s, const uint8_t *in, uint64_t len, uint8_t *out){
+	const uint8_t *p = in, *end = in + len;
+	uint8_t *o = out, *o_end = out + s.n_elem * s.elem_size;
+	for (;;){
+		if (p == end)
+			return -1;
+		uint8_t token = *p++;
+		uint64_t n_lit = token >> 4, m = token & 15;
+		/*
+		 * the common sequence, short literals and a short match from 8 bytes back or more, with fixed size copies
+		 * where both sides have room for them
+		 */
+		if (n_lit < 15 && m < 15 && end - p >= 16 + 2 && o_end - o >= 16 + 24){
+			uint64_t offset = p[n_lit] | (p[n_lit + 1] << 8);
+			if (offset >= 8 && offset <= (uint64_t)(o - out) + n_lit){
+				memcpy(o, p, 16);
+				o += n_lit;
+				p += n_lit + 2;
+				const uint8_t *q = o - offset;
+				memcpy(o, q, 8);
+				memcpy(o + 8, q + 8, 8);
+				memcpy(o + 16, q + 16, 8);
+				o += m + LZ_MIN_MATCH;
+				continue;
+			}
+		}
+		if (n_lit == 15 && lz_get_len(p, end, n_lit))
+			return -1;
+		if (n_lit > (uint64_t)(end - p) || n_lit > (uint64_t)(o_end - o))
+			return -1;
+		// whole 16 bytes while both sides have room for them, the common short literals in one go
+		if (n_lit <= 16 && end - p >= 16 && o_end - o >= 16)
+			memcpy(o, p, 16);
+		else
+			memcpy(o, p, n_lit);
+		o += n_lit;
+		p += n_lit;
+		if (o == o_end)
+			return p == end && m == 0 ? 0 : -1; // the last sequence
+		if (end - p < 2)
+			return -1;
+		uint64_t offset = p[0] | (p[1] << 8);
+		p += 2;
+		if (m == 15 && lz_get_len(p, end, m))
+			return -1;
+		m += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (uint64_t)(o - out) || m > (uint64_t)(o_end - o))
+			return -1;
+		const uint8_t *q = o - offset;
+		if (offset >= 8 && o_end - o >= (int64_t)m + 8){
+			// 8 bytes at a time, past the match into the space the next sequences write
+			for (uint64_t k = 0; k < m; k += 8)
+				memcpy(o + k, q + k, 8);
+		}else
+			for (uint64_t k = 0; k < m; k++)
+				o[k] = q[k];
+		o += m;
+	}
+}
+
+const Codec codec_lz = {REC_CODEC_LZ, "lz", lz_encode, lz_decode};
@@ -0,0 +1,200 @@
+#include <cstring>
+#include <unordered_map>
+#include "codec.hpp"
+#include "bit_io.hpp"
+#include "base_struct.hpp"
+#include "shared_dict.hpp"
+
+using namespace std;
+
+/*
+ * sc_dict: the sockcalls as a dictionary of distinct records, and runs of the same record.
+ * Records are compared on the fields of their type and thread_id (sc_key), so the padding of every record must be 0
+ * (sc_is_canonical) for the section to decode to the same bytes; a section of other records is left to other codecs.
+ * A bulk transfer makes the same sendmsg over and over, which is one run: a few bytes for any number of calls.
+ *
+ * | n_dict:dyn | record * n_dict | id_bits:8 | step_len:64 | n_run:dyn | (id:id_bits, len:dyn) * n_run |
+ * The records are stored raw, in order of first use, after the header is padded to whole bytes.
+ */
+struct ScRun{
+	uint32_t id;
+	uint64_t len;
+};
+
+/* the distinct records of the section in order of first use, and the runs of them. -1 if one is not canonical */
+static int get_sc_runs(const RecSection &s, const uint8_t *data, vector<const uint8_t*> &dict, vector<ScRun> &runs){
+	unordered_map<ScKey, uint32_t, ScKeyHash> ids;
+	for (uint64_t i = 0; i < s.n_elem; i++){
+		const uint8_t *r = data + i * s.elem_size;
+		if (i > 0 && memcmp(r, r - s.elem_size, s.elem_size) == 0){
+			runs.back().len++;
+			continue;
+		}
+		deter_rec_sockcall sc;
+		memcpy(&sc, r, sizeof(sc)); // the section need not be aligned
+		if (!sc_is_canonical(sc))
+			return -1;
+		auto it = ids.insert(make_pair(sc_key(sc), (uint32_t)dict.size()));
+		if (it.second)
+			dict.push_back(r);
+		runs.push_back((ScRun){it.first->second, 1});
+	}
+	return 0;
+}
+
+// | id_bits:8 | step_len:64 | n_run:dyn | (id:id_bits, len:dyn) * n_run |
+static void put_sc_runs(BitWriter &bw, uint64_t n_dict, const vector<ScRun> &runs){
+	int id_bits = 0;
+	for (; (1ull << id_bits) < n_dict; id_bits++);
+	vector<uint64_t> len(runs.size());
+	for (uint64_t i = 0; i < runs.size(); i++)
+		len[i] = runs[i].len;
+	uint64_t step_len = best_dyn_step(len);
+
+	bw.put(id_bits, 8);
+	bw.put(step_len, 64);
+	put_dyn(bw, runs.size() + 1, 0);
+	const DynLevels lv = dyn_levels(step_len);
+	for (auto &r : runs){
+		bw.put(r.id, id_bits);
+		put_dyn(bw, r.len, lv);
+	}
+	bw.flush();
+}
+
+// the runs to out, dict[id] the record of id. Return -1 if they are not the n_elem records of s
+static int get_sc_runs(BitReader &br, const RecSection &s, const vector<const uint8_t*> &dict, uint8_t *out){
+	uint64_t n_run, step_len, n = 0;
+	int id_bits = br.get(8);
+	step_len = br.get(64);
+	n_run = get_dyn(br, 0) - 1;
+	if (br.overrun || id_bits > 32 || n_run > s.n_elem)
+		return -1;
+	const DynLevels lv = dyn_levels(step_len);
+	for (uint64_t i = 0; i < n_run; i++){
+		uint64_t id = br.get(id_bits), len = get_dyn(br, lv);
+		if (br.overrun || id >= dict.size() || len == 0 || len > s.n_elem - n)
+			return -1;
+		const uint8_t *r = dict[id];
+		for (uint8_t *o = out + n * s.elem_size, *end = o + len * s.elem_size; o < end; o += s.elem_size)
+			memcpy(o, r, sizeof(deter_rec_sockcall));
+		n += len;
+	}
+	return n == s.n_elem ? 0 : -1;
+}
+
+static bool sc_applies(const RecSection &s){
+	return s.type == REC_SEC_SOCKCALL && s.elem_size == sizeof(deter_rec_sockcall);
+}
+
+static int sc_dict_encode(const RecSection &s, const uint8_t *data, vector<uint8_t> &out){
+	vector<const uint8_t*> dict;
+	vector<ScRun> runs;
+	if (!sc_applies(s) || get_sc_runs(s, data, dict, runs))
+		return -1;
+
+	BitWriter bw(out);
+	put_dyn(bw, dict.size() + 1, 0);
+	bw.flush();
+	for (const uint8_t *r : dict)
+		out.insert(out.end(), r, r + s.elem_size);
+	put_sc_runs(bw, dict.size(), runs);
+	return 0;
+}
+
+static int sc_dict_decode(const RecSection &s, const uint8_t *in, uint64_t in_len, uint8_t *out){
+	BitReader br(in, in_len);
+	uint64_t n_dict, off;
+	vector<const uint8_t*> dict;
+	if (s.elem_size != sizeof(deter_rec_sockcall))
+		return -1;
+
+	n_dict = get_dyn(br, 0) - 1;
+	if (br.overrun || n_dict > s.n_elem)
+		return -1;
+	off = (br.tell(in) + 7) / 8;
+	if (n_dict > (in_len - off) / s.elem_size)
+		return -1;
+	for (uint64_t i = 0; i < n_dict; i++)
+		dict.push_back(in + off + i * s.elem_size);
+	off += n_dict * s.elem_size;
+
+	br = BitReader(in + off, in_len - off);
+	return get_sc_runs(br, s, dict, out);
+}
+
+const Codec codec_sc_dict = {REC_CODEC_SC_DICT, "sc_dict", sc_dict_encode, sc_dict_decode};
+
+/*
+ * sc_shared: sc_dict, but the records that are in the shared dictionary aux[0] (shared_dict.hpp) are stored as
+ * their index in it.
+ * | n_dict:dyn | (shared:1 [, index:bits(n_sc)]) * n_dict | local records | runs as sc_dict |
+ * The local records follow in order after the flags are padded to whole bytes.
+ */
+static int sc_shared_encode(const RecSection &s, const uint8_t *data, vector<uint8_t> &out){
+	vector<const uint8_t*> dict, local;
+	vector<ScRun> runs;
+	const SharedDict *d = s.aux[0] ? get_shared_dict(s.aux[0]) : NULL;
+	if (!sc_applies(s) || d == NULL || d->sc.empty() || get_sc_runs(s, data, dict, runs))
+		return -1;
+
+	int idx_bits = 0;
+	for (; (1ull << idx_bits) < d->sc.size(); idx_bits++);
+	BitWriter bw(out);
+	put_dyn(bw, dict.size() + 1, 0);
+	for (const uint8_t *r : dict){
+		// a dictionary written before the hooks zeroed the records may hold the same fields with other padding
+		deter_rec_sockcall sc;
+		memcpy(&sc, r, sizeof(sc));
+		auto it = d->sc_idx.find(sc_key(sc));
+		bool sh = it != d->sc_idx.end() && memcmp(&d->sc[it->second], r, sizeof(deter_rec_sockcall)) == 0;
+		bw.put(sh, 1);
+		if (sh)
+			bw.put(it->second, idx_bits);
+		else
+			local.push_back(r);
+	}
+	bw.flush();
+	for (const uint8_t *r : local)
+		out.insert(out.end(), r, r + s.elem_size);
+	put_sc_runs(bw, dict.size(), runs);
+	return 0;
+}
+
+static int sc_shared_decode(const RecSection &s, const uint8_t *in, uint64_t in_len, uint8_t *out){
+	BitReader br(in, in_len);
+	uint64_t n_dict, off, n_local = 0;
+	vector<const uint8_t*> dict;
+	vector<bool> shared;
+	const SharedDict *d = get_shared_dict(s.aux[0]);
+	if (s.elem_size != sizeof(deter_rec_sockcall) || d == NULL)
+		return -1;
+
+	int idx_bits = 0;
+	for (; (1ull << idx_bits) < d->sc.size(); idx_bits++);
+	n_dict = get_dyn(br, 0) - 1;
+	if (br.overrun || n_dict > s.n_elem)
+		return -1;
+	for (uint64_t i = 0; i < n_dict; i++){
+		bool sh = br.get(1);
+		uint64_t idx = sh ? br.get(idx_bits) : 0;
+		if (br.overrun || idx >= d->sc.size())
+			return -1;
+		shared.push_back(sh);
+		dict.push_back(sh ? (const uint8_t*)&d->sc[idx] : NULL);
+		n_local += !sh;
+	}
+	off = (br.tell(in) + 7) / 8;
+	if (n_local > (in_len - off) / s.elem_size)
+		return -1;
+	for (uint64_t i = 0; i < n_dict; i++)
+		if (!shared[i]){
+			dict[i] = in + off;
+			off += s.elem_size;
+		}
+
+	br = BitReader(in + off, in_len - off);
+	return get_sc_runs(br, s, dict, out);
+}
+
+const Codec codec_sc_shared = {REC_CODEC_SC_SHARED, "sc_shared", sc_shared_encode, sc_shared_decode};
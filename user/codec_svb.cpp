@@ -0,0 +1,243 @@
+#include <cstring>
+#include <immintrin.h>
+#include "codec.hpp"
+#include "bit_io.hpp"
+#include "records.hpp"
+
+using namespace std;
+
+/*
+ * stream_vbyte: each 4-byte column (transformed as by get_columns) as Stream VByte. Value i takes 1 to 4 bytes,
+ * its length - 1 in 2 bits of control byte i / 4, and the data bytes of all values follow the control bytes, so
+ * the decoder takes 4 values per control byte with one shuffle, looked up by the control byte.
+ * | columns header | per column: | data_len:32 | control bytes ceil(n / 4) | data | |
+ */
+struct SvbTables{
+	uint8_t shuf[256][16]; // for control byte c, byte k of the 4 values takes data byte shuf[c][k], 0xff for 0
+	uint8_t len[256]; // data bytes of the 4 values
+
+	SvbTables(){
+		for (uint32_t c = 0; c < 256; c++){
+			uint32_t off = 0;
+			for (uint32_t j = 0; j < 4; j++){
+				uint32_t l = ((c >> (2 * j)) & 3) + 1;
+				for (uint32_t k = 0; k < 4; k++)
+					shuf[c][j * 4 + k] = k < l ? off + k : 0xff;
+				off += l;
+			}
+			len[c] = off;
+		}
+	}
+};
+
+static const SvbTables& svb_tables(){
+	static const SvbTables t; // thread-safe local static
+	return t;
+}
+
+static inline uint32_t svb_len(uint32_t x){
+	return x < (1u << 8) ? 1 : x < (1u << 16) ? 2 : x < (1u << 24) ? 3 : 4;
+}
+
+static void svb_encode_column(const vector<uint64_t> &v, vector<uint8_t> &out){
+	uint64_t n = v.size(), start = out.size(), data_len = 0;
+	for (uint64_t x : v)
+		data_len += svb_len(x);
+	out.resize(start + 4 + (n + 3) / 4 + data_len, 0);
+	memcpy(&out[start], &data_len, 4);
+	uint8_t *ctrl = &out[start + 4], *data = ctrl + (n + 3) / 4;
+	for (uint64_t i = 0; i < n; i++){
+		uint32_t x = v[i], l = svb_len(x);
+		ctrl[i / 4] |= (l - 1) << (2 * (i % 4));
+		memcpy(data, &x, l);
+		data += l;
+	}
+}
+
+/*
+ * Decode values i to n, value i in ctrl[i / 4], while the data of a whole control byte can be loaded as 16 bytes
+ * before end, and return the next i. Groups are whole 4 values, so out has room for them.
+ */
+__attribute__((target("ssse3")))
+static uint64_t svb_decode_ssse3(const uint8_t *ctrl, const uint8_t *&data, const uint8_t *end, uint64_t i, uint64_t n,
+		uint32_t *out){
+	const SvbTables &t = svb_tables();
+	for (; i + 4 <= n && end - data >= 16; i += 4){
+		uint8_t c = ctrl[i / 4];
+		__m128i d = _mm_loadu_si128((const __m128i*)data);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(d, _mm_loadu_si128((const __m128i*)t.shuf[c])));
+		data += t.len[c];
+	}
+	return i;
+}
+
+// two control bytes per 256-bit shuffle, each lane from its own load
+__attribute__((target("avx2")))
+static uint64_t svb_decode_avx2(const uint8_t *ctrl, const uint8_t *&data, const uint8_t *end, uint64_t i, uint64_t n,
+		uint32_t *out){
+	const SvbTables &t = svb_tables();
+	for (; i + 8 <= n && end - data >= 32; i += 8){
+		uint8_t c0 = ctrl[i / 4], c1 = ctrl[i / 4 + 1];
+		__m256i d = _mm256_loadu2_m128i((const __m128i*)(data + t.len[c0]), (const __m128i*)data);
+		__m256i s = _mm256_loadu2_m128i((const __m128i*)t.shuf[c1], (const __m128i*)t.shuf[c0]);
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_shuffle_epi8(d, s));
+		data += t.len[c0] + t.len[c1];
+	}
+	return i;
+}
+
+// the rest, and all on other CPUs. Return -1 if the data passes end
+static int svb_decode_scalar(const uint8_t *ctrl, const uint8_t *&data, const uint8_t *end, uint64_t i, uint64_t n,
+		uint32_t *out){
+	for (; i < n; i++){
+		uint32_t l = ((ctrl[i / 4] >> (2 * (i % 4))) & 3) + 1, x = 0;
+		if (end - data >= 4){
+			memcpy(&x, data, 4);
+			x &= 0xffffffffu >> (32 - 8 * l);
+		}else if (end - data >= (int64_t)l){
+			for (uint32_t k = 0; k < l; k++)
+				x |= (uint32_t)data[k] << (8 * k);
+		}else
+			return -1;
+		out[i] = x;
+		data += l;
+	}
+	return 0;
+}
+
+#define SVB_SCALAR 0
+#define SVB_SSSE3 1
+#define SVB_AVX2 2
+static int svb_level(){
+	if (__builtin_cpu_supports("avx2"))
+		return SVB_AVX2;
+	return __builtin_cpu_supports("ssse3") ? SVB_SSSE3 : SVB_SCALAR;
+}
+
+/*
+ * Decode values i to n of a column, i a multiple of 4, to out[0, n - i). The control bytes are only checked by
+ * the bounds of data, which the caller checks to end exactly at end.
+ */
+static int svb_decode_values(const uint8_t *ctrl, const uint8_t *&data, const uint8_t *end, uint64_t i, uint64_t n,
+		uint32_t *out){
+	static const int level = svb_level(); // thread-safe local static
+	uint64_t j = 0, m = n - i;
+	ctrl += i / 4;
+	if (level == SVB_AVX2)
+		j = svb_decode_avx2(ctrl, data, end, j, m, out);
+	if (level >= SVB_SSSE3)
+		j = svb_decode_ssse3(ctrl, data, end, j, m, out);
+	return svb_decode_scalar(ctrl, data, end, j, m, out);
+}
+
+static bool svb_applies(const RecSection &s, const vector<Column> &cols){
+	for (auto c : cols)
+		if (c.width != 4)
+			return false;
+	return s.n_elem < (1ull << 32) / 4; // data_len in 32 bits
+}
+
+static int svb_encode(const RecSection &s, const uint8_t *data, vector<uint8_t> &out){
+	vector<Column> cols;
+	vector<uint64_t> v(s.n_elem);
+	get_columns(s, cols);
+	if (!svb_applies(s, cols))
+		return -1;
+	BitWriter bw(out);
+	put_columns_header(bw, cols);
+	bw.flush();
+	for (uint32_t c = 0; c < cols.size(); c++){
+		uint32_t last = 0;
+		for (uint64_t i = 0; i < s.n_elem; i++){
+			uint32_t x;
+			memcpy(&x, data + i * s.elem_size + c * 4, 4);
+			if (cols[c].mode == COL_RAW)
+				v[i] = x;
+			else if (cols[c].mode == COL_ZIGZAG)
+				v[i] = (uint32_t)zigzag((int32_t)x);
+			else {
+				v[i] = (uint32_t)zigzag((int32_t)(x - last));
+				last = x;
+			}
+		}
+		svb_encode_column(v, out);
+	}
+	return 0;
+}
+
+/*
+ * The columns are decoded together, a block of rows at a time to buffers that stay in cache, then interleaved into
+ * the rows of out, so that each row is written once.
+ */
+#define SVB_BLOCK_VALUES 8192
+struct SvbColumn{
+	const uint8_t *ctrl, *data, *end;
+	uint8_t mode;
+	uint32_t last;
+};
+
+// undo the transform of a column in place
+static void svb_untransform(SvbColumn &col, uint32_t *v, uint64_t m){
+	if (col.mode == COL_ZIGZAG)
+		for (uint64_t k = 0; k < m; k++)
+			v[k] = (v[k] >> 1) ^ -(v[k] & 1);
+	else if (col.mode == COL_DELTA){
+		uint32_t last = col.last;
+		for (uint64_t k = 0; k < m; k++)
+			v[k] = last += (v[k] >> 1) ^ -(v[k] & 1);
+		col.last = last;
+	}
+}
+
+static int svb_decode(const RecSection &s, const uint8_t *in, uint64_t len, uint8_t *out){
+	vector<Column> cols;
+	vector<SvbColumn> sc;
+	vector<uint32_t> v;
+	uint64_t n = s.n_elem, n_ctrl = (n + 3) / 4;
+	BitReader br(in, len);
+	if (get_columns_header(br, s, cols) || !svb_applies(s, cols))
+		return -1;
+	uint64_t off = 2 * cols.size() + 1;
+	for (auto c : cols){
+		uint32_t data_len;
+		if (len - off < 4 || len - off - 4 < n_ctrl)
+			return -1;
+		memcpy(&data_len, in + off, 4);
+		if (data_len > len - off - 4 - n_ctrl)
+			return -1;
+		const uint8_t *ctrl = in + off + 4;
+		sc.push_back((SvbColumn){ctrl, ctrl + n_ctrl, ctrl + n_ctrl + data_len, c.mode, 0});
+		off += 4 + n_ctrl + data_len;
+	}
+	if (off != len)
+		return -1;
+	// rows per block, a multiple of 8 for the SIMD decoders
+	uint64_t n_col = sc.size(), block = max((uint64_t)8, SVB_BLOCK_VALUES / n_col / 8 * 8);
+	v.resize(n_col * block);
+	for (uint64_t i = 0; i < n; i += block){
+		uint64_t m = min(block, n - i);
+		for (uint32_t c = 0; c < n_col; c++){
+			if (svb_decode_values(sc[c].ctrl, sc[c].data, sc[c].end, i, i + m, &v[c * block]))
+				return -1;
+			svb_untransform(sc[c], &v[c * block], m);
+		}
+		uint32_t *row = (uint32_t*)(out + i * s.elem_size); // elem_size is n_col * 4
+		if (n_col == 2){
+			const uint32_t *v0 = &v[0], *v1 = &v[block];
+			for (uint64_t k = 0; k < m; k++){
+				row[2 * k] = v0[k];
+				row[2 * k + 1] = v1[k];
+			}
+		}else
+			for (uint64_t k = 0; k < m; k++)
+				for (uint32_t c = 0; c < n_col; c++)
+					row[k * n_col + c] = v[c * block + k];
+	}
+	// all data is used, and the codes past n in the last control byte are 0
+	for (auto &col : sc)
+		if (col.data != col.end || (n % 4 && col.ctrl[n_ctrl - 1] >> (2 * (n % 4))))
+			return -1;
+	return 0;
+}
+
+const Codec codec_stream_vbyte = {REC_CODEC_SVB, "stream_vbyte", svb_encode, svb_decode};
@@ -0,0 +1,296 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <random>
+#include <memory>
+#include <cstdlib>
+#include <unistd.h>
+#include "codec.hpp"
+#include "bit_io.hpp"
+#include "records.hpp"
+#include "shared_dict.hpp"
+
+using namespace std;
+
+/*
+ * Round trips of every codec on edge inputs of each stream: empty, one element, all equal, all bits set, increasing,
+ * small and random values. A codec may refuse a section (encode returns -1), but what it encodes must decode to the
+ * input, or within the bound of a lossy codec. Then each encoding is truncated and bit-flipped: decode must return
+ * -1 or fill its output, never read or write out of bounds (build with make test, which runs it under ASan/UBSan).
+ * usage: ./codec_test [seed]
+ */
+
+struct Input{
+	string name;
+	RecSection s;
+	vector<uint8_t> data;
+};
+
+static mt19937_64 rng;
+static uint64_t n_fail;
+
+static RecSection make_section(uint16_t type, uint32_t elem_size, uint64_t n_elem, uint32_t aux0 = 0, uint32_t aux1 = 0){
+	RecSection s;
+	memset(&s, 0, sizeof(s));
+	s.type = type;
+	s.elem_size = elem_size;
+	s.n_elem = n_elem;
+	s.aux[0] = aux0;
+	s.aux[1] = aux1;
+	return s;
+}
+
+// the elements of the pattern, as fields of width bytes
+static void fill(vector<uint8_t> &d, uint32_t width, const string &pattern){
+	uint64_t last = 0;
+	for (uint64_t off = 0; off + width <= d.size(); off += width){
+		uint64_t x;
+		if (pattern == "equal")
+			x = 0x1234567;
+		else if (pattern == "max")
+			x = ~0ull;
+		else if (pattern == "inc")
+			x = last += rng() % 8;
+		else if (pattern == "small")
+			x = rng() % 3;
+		else
+			x = rng();
+		memcpy(&d[off], &x, width);
+	}
+}
+
+static void add_inputs(vector<Input> &in, uint16_t type, uint32_t elem_size, uint32_t width, uint32_t aux0 = 0){
+	static const char *patterns[] = {"equal", "max", "inc", "small", "random"};
+	static const uint64_t sizes[] = {0, 1, 2, 1000};
+	for (uint64_t n : sizes)
+		for (const char *p : patterns){
+			Input x;
+			x.name = "type " + to_string(type) + " n " + to_string(n) + " " + p;
+			x.s = make_section(type, elem_size, n, aux0);
+			x.data.resize(n * elem_size);
+			fill(x.data, width, p);
+			in.push_back(x);
+			if (n == 0)
+				break;
+		}
+}
+
+// bit arrays: RAW words of n bits, or the sorted indexes of n bits that are 1 (or 0)
+static void add_bit_inputs(vector<Input> &in, uint16_t type){
+	static const uint32_t ns[] = {0, 1, 31, 32, 33, 5000};
+	for (uint32_t n : ns)
+		for (int density = 0; density <= 4; density++){
+			Input x;
+			vector<uint32_t> w((n + 31) / 32, 0), idx;
+			for (uint32_t i = 0; i < n; i++)
+				if (density == 4 || (density && rng() % (1u << (2 * density)) == 0)){
+					w[i >> 5] |= 1u << (i & 31);
+					idx.push_back(i);
+				}
+			x.name = "bits " + to_string(type) + " n " + to_string(n) + " density " + to_string(density);
+			x.s = make_section(type, 4, w.size(), n, BitArray::RAW);
+			x.data.assign((uint8_t*)w.data(), (uint8_t*)(w.data() + w.size()));
+			in.push_back(x);
+			x.name += " index";
+			x.s = make_section(type, 4, idx.size(), n, BitArray::INDEX_ONE);
+			x.data.assign((uint8_t*)idx.data(), (uint8_t*)(idx.data() + idx.size()));
+			in.push_back(x);
+		}
+}
+
+// events: increasing seq, packets and sockcalls in order of their index
+static void add_evt_inputs(vector<Input> &in){
+	static const uint64_t sizes[] = {0, 1, 2, 1000};
+	for (uint64_t n : sizes){
+		Input x;
+		vector<deter_event> e(n);
+		uint32_t seq = 0, sc = 0;
+		for (deter_event &v : e){
+			seq += 1 + (rng() % 4 == 0) * (rng() % 10);
+			v.seq = seq;
+			v.type = rng() % 3 ? EVENT_TYPE_PACKET : DETER_SOCK_ID_BASE + (sc++ | (rng() % 4) << 28);
+		}
+		x.name = "evts n " + to_string(n);
+		x.s = make_section(REC_SEC_EVT, sizeof(deter_event), n);
+		x.data.assign((uint8_t*)e.data(), (uint8_t*)(e.data() + n));
+		in.push_back(x);
+	}
+}
+
+// sockcalls of each type as the hooks write them, a few threads, repeated in runs
+static void add_sc_inputs(vector<Input> &in){
+	static const uint64_t sizes[] = {1, 2, 1000};
+	for (uint64_t n : sizes){
+		Input x;
+		vector<deter_rec_sockcall> v;
+		while (v.size() < n){
+			ScKey k;
+			k.a = rng() % 6 | (rng() % 4 == 0 ? rng() << 8 : 0);
+			k.b = rng() % 3 ? 1u << (rng() % 17) : rng();
+			k.thread_id = rng() % 3;
+			deter_rec_sockcall r = sc_record(k);
+			for (uint64_t len = 1 + rng() % 8 * (rng() % 2); len && v.size() < n; len--)
+				v.push_back(r);
+		}
+		x.name = "sockcalls n " + to_string(n);
+		x.s = make_section(REC_SEC_SOCKCALL, sizeof(deter_rec_sockcall), n);
+		x.data.assign((uint8_t*)v.data(), (uint8_t*)(v.data() + n));
+		in.push_back(x);
+	}
+}
+
+/*
+ * sc_shared and evt_shared code against a dictionary: train one on the events and sockcalls of the inputs, in a
+ * directory of its own, and add a copy of those inputs that refers to it
+ */
+static int add_shared_inputs(vector<Input> &in){
+	char dir[] = "/tmp/codec_test.XXXXXX";
+	vector<vector<deter_rec_sockcall> > scs;
+	vector<vector<deter_event> > evts;
+	SharedDictSet set;
+	SharedDict sd;
+	uint32_t id;
+	if (mkdtemp(dir) == NULL)
+		return -1;
+	for (const Input &x : in)
+		for (int k = 0; k < SHARED_DICT_MIN_FILES; k++)
+			if (x.s.type == REC_SEC_EVT && x.s.elem_size == sizeof(deter_event))
+				evts.push_back(vector<deter_event>((deter_event*)x.data.data(), (deter_event*)x.data.data() + x.s.n_elem));
+			else if (x.s.type == REC_SEC_SOCKCALL && x.s.elem_size == sizeof(deter_rec_sockcall))
+				scs.push_back(vector<deter_rec_sockcall>((deter_rec_sockcall*)x.data.data(),
+						(deter_rec_sockcall*)x.data.data() + x.s.n_elem));
+	sd.mode = 0;
+	sd.port = 1;
+	sd.train(scs, evts);
+	set.add(sd);
+	if (set.save(dir))
+		return -1;
+	id = get_latest_shared_dict((string(dir) + "/x").c_str(), 0, 1);
+	unlink((string(dir) + "/" + SHARED_DICT_FILE).c_str());
+	rmdir(dir);
+	if (id == 0)
+		return -1;
+	for (uint64_t i = 0, n = in.size(); i < n; i++)
+		if (in[i].s.type == REC_SEC_EVT || in[i].s.type == REC_SEC_SOCKCALL){
+			Input x = in[i];
+			x.name += " shared";
+			x.s.aux[0] = id;
+			in.push_back(x);
+		}
+	return 0;
+}
+
+static bool same(const Codec *c, const Input &x, const vector<uint8_t> &dec){
+	if (c->check)
+		return c->check(x.s, x.data.data(), dec.data());
+	return dec == x.data;
+}
+
+// decode enc as section s into a buffer of exactly the size of the output; -1 or 0, without going out of bounds
+static int try_decode(const Codec *c, const RecSection &s, const vector<uint8_t> &enc, vector<uint8_t> &dec){
+	// their own allocations, not NULL even if empty, so any access past them is caught
+	unique_ptr<uint8_t[]> in(new uint8_t[enc.size()]), out(new uint8_t[s.n_elem * s.elem_size]);
+	int ret;
+	if (enc.size())
+		memcpy(in.get(), enc.data(), enc.size());
+	memset(out.get(), 0, s.n_elem * s.elem_size);
+	ret = c->decode(s, in.get(), enc.size(), out.get());
+	dec.assign(out.get(), out.get() + s.n_elem * s.elem_size);
+	return ret;
+}
+
+static void test_codec(const Codec *c, const Input &x, uint64_t &n_coded){
+	vector<uint8_t> enc, dec;
+	if (c->encode(x.s, x.data.data(), enc))
+		return;
+	n_coded++;
+	if (try_decode(c, x.s, enc, dec) || !same(c, x, dec)){
+		printf("FAIL %s: %s does not decode to its input\n", c->name, x.name.c_str());
+		n_fail++;
+		return;
+	}
+	// truncated, then bit-flipped: any result but a crash
+	uint64_t cut[] = {0, enc.size() / 2, enc.size() ? enc.size() - 1 : 0};
+	for (uint64_t len : cut){
+		vector<uint8_t> t(enc.begin(), enc.begin() + len);
+		try_decode(c, x.s, t, dec);
+	}
+	for (int k = 0; k < 32 && enc.size(); k++){
+		vector<uint8_t> f(enc);
+		f[rng() % f.size()] ^= 1 << (rng() % 8);
+		try_decode(c, x.s, f, dec);
+	}
+}
+
+/* gamma and delta codes of values of every width, 1 to 2^64-1, which the codecs rarely reach; then truncated */
+static void test_bit_codes(){
+	vector<uint64_t> v;
+	vector<uint8_t> buf;
+	for (int w = 0; w < 64; w++){
+		v.push_back(1ull << w);
+		v.push_back((1ull << w) | rng() >> (63 - w) >> 1);
+		v.push_back(w == 63 ? ~0ull : (2ull << w) - 1);
+	}
+	for (int code = 0; code < 2; code++){
+		const char *name = code ? "delta" : "gamma";
+		buf.clear();
+		BitWriter bw(buf);
+		for (uint64_t x : v)
+			code ? put_delta(bw, x) : put_gamma(bw, x);
+		bw.flush();
+		BitReader br(buf.data(), buf.size());
+		for (uint64_t x : v)
+			if ((code ? get_delta(br) : get_gamma(br)) != x || br.overrun){
+				printf("FAIL %s: %lu does not decode to itself\n", name, x);
+				n_fail++;
+				break;
+			}
+		BitReader cut(buf.data(), buf.size() - 1);
+		for (uint64_t i = 0; i < v.size(); i++)
+			code ? get_delta(cut) : get_gamma(cut);
+		if (!cut.overrun){
+			printf("FAIL %s: reading past the end of the input is not an overrun\n", name);
+			n_fail++;
+		}
+	}
+}
+
+int main(int argc, char **argv){
+	vector<Input> in;
+	rng.seed(argc > 1 ? strtoull(argv[1], NULL, 0) : 1);
+	add_evt_inputs(in);
+	add_inputs(in, REC_SEC_EVT, sizeof(deter_event), 4);
+	add_sc_inputs(in);
+	add_inputs(in, REC_SEC_SOCKCALL, sizeof(deter_rec_sockcall), 1);
+	add_inputs(in, REC_SEC_PS, sizeof(uint16_t), 2);
+	add_inputs(in, REC_SEC_JIF, sizeof(jiffies_rec), 4);
+	add_inputs(in, REC_SEC_MA, sizeof(memory_allocated_rec), 4);
+	add_inputs(in, REC_SEC_MSTAMP, sizeof(skb_mstamp), 4);
+	add_inputs(in, REC_SEC_SIQQ, 1, 1);
+	add_inputs(in, REC_SEC_EBX, 1, 1);
+	add_inputs(in, REC_SEC_TSQ, 4, 4);
+	add_inputs(in, REC_SEC_TSQ, 4, 4, TSQ_MAX_ERR);
+	add_inputs(in, REC_SEC_META, 12, 4); // a section of no stream
+	add_inputs(in, REC_SEC_META, 3, 1);
+	add_inputs(in, REC_SEC_META, 8, 8);
+	add_bit_inputs(in, REC_SEC_MPQ);
+	add_bit_inputs(in, REC_SEC_EBQ(0));
+	if (add_shared_inputs(in)){
+		printf("Fail to make a shared dictionary\n");
+		return 1;
+	}
+
+	test_bit_codes();
+	for (const Codec *c : get_all_codecs()){
+		uint64_t n_coded = 0;
+		for (const Input &x : in)
+			test_codec(c, x, n_coded);
+		printf("%-16s %4lu of %lu inputs coded\n", c->name, n_coded, in.size());
+	}
+	if (n_fail){
+		printf("%lu failed\n", n_fail);
+		return 1;
+	}
+	printf("all passed\n");
+	return 0;
+}
@@ -0,0 +1,153 @@
+#include <cstring>
+#include "codec.hpp"
+#include "bit_io.hpp"
+
+using namespace std;
+
+typedef unsigned __int128 u128;
+
+/*
+ * The fit of sample_timestamp, on exact bounds: a segment grows while some rate keeps all its values within th.
+ * Value k of a segment starting at s is predicted as v[s] + (q * k >> TS_RATE_FRAC), which is within th of d = v[s+k] - v[s]
+ * for q in [ceil((d - th) << TS_RATE_FRAC / k), floor((((d + th + 1) << TS_RATE_FRAC) - 1) / k)].
+ * Of the rates left, the one closest to the rate of the previous segment is kept, so steady rates repeat.
+ */
+void fit_timestamps(const vector<uint64_t> &v, uint64_t th, vector<TsSegment> &seg){
+	const u128 max_rate = ~0ull;
+	uint64_t s = 0, prev_rate = 0, pred = 0; // pred: where the line of the previous segment gets to at s
+	u128 lo = 0, hi = max_rate;
+	seg.clear();
+	if (v.empty())
+		return;
+	for (uint64_t i = 1; i <= v.size(); i++){
+		if (i < v.size() && v[i] >= v[s]){
+			uint64_t k = i - s, d = v[i] - v[s];
+			u128 lo_i, hi_i;
+			if (d + th < 1ull << (63 - TS_RATE_FRAC)){ // the common case, in 64 bits
+				lo_i = d > th ? (((d - th) << TS_RATE_FRAC) + k - 1) / k : 0;
+				hi_i = (((d + th + 1) << TS_RATE_FRAC) - 1) / k;
+			}else {
+				lo_i = d > th ? ((((u128)d - th) << TS_RATE_FRAC) + k - 1) / k : 0;
+				hi_i = ((((u128)d + th + 1) << TS_RATE_FRAC) - 1) / k;
+			}
+			lo_i = lo_i > lo ? lo_i : lo;
+			hi_i = hi_i < hi ? hi_i : hi;
+			if (lo_i <= hi_i && lo_i <= max_rate){
+				lo = lo_i;
+				hi = hi_i;
+				continue;
+			}
+		}
+		// the segment ends before i
+		uint64_t q = prev_rate < lo ? (uint64_t)lo : prev_rate > hi ? (uint64_t)hi : prev_rate;
+		seg.push_back((TsSegment){i - s, q, (int64_t)(v[s] - pred)});
+		pred = v[s] + (uint64_t)((u128)q * (i - s) >> TS_RATE_FRAC);
+		prev_rate = q;
+		s = i;
+		lo = 0;
+		hi = max_rate;
+	}
+}
+
+/*
+ * tsq_pwl: the tx stamps (ns, wrapping at 32 bits) as the segments of fit_timestamps with th = s.aux[0].
+ * Each decoded stamp is within aux[0] ns of the recorded one; the first stamp of each segment is exact.
+ * The stamps are unwrapped by taking each one as later than the one before.
+ *
+ * | n_seg:dyn | length column | rate column | jump column |
+ * Rates are stored as the zigzag of their difference to the previous rate, jumps as their zigzag.
+ * A column is | 0:1 | step:64 | value+1:dyn * n_seg | or | 1:1 | huffman_prefix column |, whichever is smaller.
+ */
+static void put_tsq_column(BitWriter &bw, const vector<uint64_t> &v){
+	vector<uint64_t> v1(v.size());
+	vector<uint8_t> hp;
+	BitWriter hw(hp);
+	uint64_t dyn_bits = 64, step;
+	for (uint64_t i = 0; i < v.size(); i++)
+		v1[i] = v[i] + 1;
+	step = best_dyn_step(v1);
+	const DynLevels lv = dyn_levels(step);
+	for (uint64_t x : v1)
+		dyn_bits += dyn_nbit(x, lv);
+	if (hp_encode_column(hw, v) == 0 && hw.tell() < dyn_bits){
+		bw.put(1, 1);
+		hp_encode_column(bw, v);
+		return;
+	}
+	bw.put(0, 1);
+	bw.put(step, 64);
+	for (uint64_t x : v1)
+		put_dyn(bw, x, lv);
+}
+
+static int get_tsq_column(BitReader &br, vector<uint64_t> &v){
+	if (br.get(1))
+		return hp_decode_column(br, v);
+	const DynLevels lv = dyn_levels(br.get(64));
+	for (uint64_t i = 0; i < v.size(); i++)
+		v[i] = get_dyn(br, lv) - 1;
+	return br.overrun ? -1 : 0;
+}
+
+static int tsq_pwl_encode(const RecSection &s, const uint8_t *data, vector<uint8_t> &out){
+	const uint32_t *t = (const uint32_t*)data;
+	vector<uint64_t> v(s.n_elem);
+	vector<TsSegment> seg;
+	if (s.type != REC_SEC_TSQ || s.elem_size != sizeof(uint32_t) || s.aux[0] == 0)
+		return -1;
+	for (uint64_t i = 0; i < s.n_elem; i++)
+		v[i] = i ? v[i - 1] + (uint32_t)(t[i] - t[i - 1]) : t[0];
+	fit_timestamps(v, s.aux[0], seg);
+
+	vector<uint64_t> len(seg.size()), rate(seg.size()), jump(seg.size());
+	for (uint64_t i = 0; i < seg.size(); i++){
+		len[i] = seg[i].len - 1;
+		rate[i] = zigzag(seg[i].rate - (i ? seg[i - 1].rate : 0));
+		jump[i] = zigzag(seg[i].jump);
+	}
+	BitWriter bw(out);
+	put_dyn(bw, seg.size() + 1, 0);
+	put_tsq_column(bw, len);
+	put_tsq_column(bw, rate);
+	put_tsq_column(bw, jump);
+	bw.flush();
+	return 0;
+}
+
+static int tsq_pwl_decode(const RecSection &s, const uint8_t *in, uint64_t in_len, uint8_t *out){
+	uint32_t *t = (uint32_t*)out;
+	BitReader br(in, in_len);
+	uint64_t n_seg, n = 0, pred = 0, rate = 0;
+	if (s.elem_size != sizeof(uint32_t))
+		return -1;
+	n_seg = get_dyn(br, 0) - 1;
+	if (br.overrun || n_seg > s.n_elem)
+		return -1;
+	vector<uint64_t> len(n_seg), rate_d(n_seg), jump(n_seg);
+	if (get_tsq_column(br, len) || get_tsq_column(br, rate_d) || get_tsq_column(br, jump))
+		return -1;
+	for (uint64_t i = 0; i < n_seg; i++){
+		uint64_t m = len[i] + 1, first = pred + unzigzag(jump[i]);
+		u128 acc = 0;
+		if (len[i] >= s.n_elem - n)
+			return -1;
+		rate += unzigzag(rate_d[i]);
+		for (uint64_t k = 0; k < m; k++, acc += rate)
+			t[n + k] = first + (uint64_t)(acc >> TS_RATE_FRAC);
+		pred = first + (uint64_t)(acc >> TS_RATE_FRAC);
+		n += m;
+	}
+	return n == s.n_elem ? 0 : -1;
+}
+
+static bool tsq_pwl_check(const RecSection &s, const uint8_t *raw, const uint8_t *dec){
+	const uint32_t *a = (const uint32_t*)raw, *b = (const uint32_t*)dec;
+	for (uint64_t i = 0; i < s.n_elem; i++){
+		int32_t d = (int32_t)(b[i] - a[i]);
+		if ((uint32_t)(d < 0 ? -(int64_t)d : d) > s.aux[0])
+			return false;
+	}
+	return true;
+}
+
+const Codec codec_tsq_pwl = {REC_CODEC_TSQ_PWL, "tsq_pwl", tsq_pwl_encode, tsq_pwl_decode, tsq_pwl_check};
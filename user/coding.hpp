@@ -4,92 +4,143 @@
 #include <stdint.h>
 #include <vector>
 #include <cstdio>
+#include <algorithm>
+#include "bit_io.hpp"
+
+/*
+ * The longest code of huffman() and canonical_codes(). A code is a uint32_t, and the codecs write one with a single
+ * BitWriter::put and look one up with a single BitReader::peek, so it has to fit both.
+ */
+#define HUFFMAN_MAX_NBIT 32
+static_assert(HUFFMAN_MAX_NBIT <= 32 && HUFFMAN_MAX_NBIT <= BIT_PUT_MAX && HUFFMAN_MAX_NBIT <= BIT_PEEK_MAX,
+		"a huffman code is a uint32_t, put and peeked at once");
 
 struct Coding{
 	int nbit;
-	uint32_t c;
-	void add_bit(int bit){
-		c = c | (bit << nbit);
-		nbit++;
-	}
-	void clear(){
-		nbit = 0;
-		c = 0;
-	}
-};
-
-struct Node{
-	union{
-		uint32_t freq;
-		Coding c;
-	};
-	Node *son[2];
+	uint32_t c; // the first bit of the code is bit 0
 };
 
-static void heap_down(std::vector<Node*> &h, int i){
-	Node* x = h[i];
-	while (i * 2 + 1 < h.size()){
-		int j = i * 2 + 1;
-		if (j+1 < h.size() && h[j+1]->freq < h[j]->freq)
-			j++;
-		if (h[j]->freq < x->freq){
-			h[i] = h[j];
-			i = j;
-		}else 
-			break;
+/*
+ * Huffman code lengths of the symbols of freq, none longer than max_len (2^max_len >= the number of symbols), which
+ * is cut to HUFFMAN_MAX_NBIT.
+ * Symbols of frequency 0 get no code (length 0), unless all is set. A single symbol gets length 1.
+ * The lengths come from a plain Huffman tree, built with two queues on the sorted frequencies; only if it is deeper
+ * than max_len, from package-merge, which gives the best lengths within max_len.
+ */
+static void huffman_lengths(const std::vector<uint64_t> &freq, int max_len, std::vector<uint8_t> &len, bool all = false){
+	std::vector<std::pair<uint64_t, uint32_t> > leaf; // (freq, symbol), increasing
+	max_len = std::min(max_len, HUFFMAN_MAX_NBIT);
+	len.assign(freq.size(), 0);
+	for (uint32_t i = 0; i < freq.size(); i++)
+		if (freq[i] || all)
+			leaf.push_back(std::make_pair(freq[i], i));
+	uint32_t n = leaf.size();
+	if (n <= 1){
+		if (n)
+			len[leaf[0].second] = 1;
+		return;
 	}
-	h[i] = x;
-}
+	std::sort(leaf.begin(), leaf.end());
 
-static std::vector<Coding> huffman(std::vector<uint64_t> a){
-	std::vector<Coding> res(a.size());
-	if (a.size() <= 1){
-		if (a.size())
-			res.push_back((Coding){0,0});
-		return res;
+	// Huffman: nodes 0..n-1 are the leaves, n.. the internal nodes, made in increasing weight
+	std::vector<uint64_t> w(2 * n - 1);
+	std::vector<uint32_t> parent(2 * n - 1), depth(2 * n - 1);
+	for (uint32_t i = 0; i < n; i++)
+		w[i] = leaf[i].first;
+	for (uint32_t next = n, a = 0, b = n; next < 2 * n - 1; next++){
+		uint32_t c[2];
+		for (int k = 0; k < 2; k++)
+			c[k] = a < n && (b == next || w[a] <= w[b]) ? a++ : b++;
+		w[next] = w[c[0]] + w[c[1]];
+		parent[c[0]] = parent[c[1]] = next;
+	}
+	int max_depth = 0;
+	depth[2 * n - 2] = 0;
+	for (int i = 2 * n - 3; i >= 0; i--){
+		depth[i] = depth[parent[i]] + 1;
+		if (i < (int)n)
+			max_depth = std::max(max_depth, (int)depth[i]);
 	}
-	std::vector<Node> nodes(a.size() * 2);
-	std::vector<Node*> heap(a.size());
-	for (int i = 0; i < (int)a.size(); i++){
-		nodes[i].freq = a[i];
-		nodes[i].son[0] = nodes[i].son[1] = 0;
-		heap[i] = &nodes[i];
+	if (max_depth <= max_len){
+		for (uint32_t i = 0; i < n; i++)
+			len[leaf[i].second] = depth[i];
+		return;
 	}
 
-	// build binary heap
-	for (int i = (int)a.size()/2 - 1; i >= 0; i--)
-		heap_down(heap, i);
-	// build huffman tree
-	for (int i = (int)a.size() - 1, j = a.size(); i >= 0; i--, j++){
-		// get min
-		Node* min0 = heap[0], *min1;
-		// update heap
-		heap[0] = heap[i];
-		heap.pop_back();
-		heap_down(heap, 0);
-		// get 2nd min
-		min1 = heap[0];
-		// create a new node
-		nodes[j].son[0] = min0;
-		nodes[j].son[1] = min1;
-		nodes[j].freq = min0->freq + min1->freq;
-		// insert the new node to heap
-		heap[0] = &nodes[j];
-		heap_down(heap, 0);
+	/*
+	 * Package-merge: list l (1 to max_len) merges the leaves with the pairs of consecutive items of list l+1, and
+	 * list max_len is the leaves. The first 2n-2 items of list 1 are taken; a pair taken takes its two items of the
+	 * next list, which are the first ones there. The length of a leaf is the number of times it is taken.
+	 * Items are a leaf index, or -1 for a pair.
+	 */
+	std::vector<std::vector<int32_t> > list(max_len + 1);
+	std::vector<uint64_t> lw, pw;
+	for (uint32_t i = 0; i < n; i++){
+		list[max_len].push_back(i);
+		lw.push_back(leaf[i].first);
 	}
+	for (int l = max_len - 1; l >= 1; l--){
+		std::vector<uint64_t> nw;
+		pw.clear();
+		for (uint32_t i = 0; i + 1 < lw.size(); i += 2)
+			pw.push_back(lw[i] + lw[i + 1]);
+		for (uint32_t i = 0, j = 0; i < n || j < pw.size();){
+			if (j >= pw.size() || (i < n && leaf[i].first <= pw[j])){
+				list[l].push_back(i);
+				nw.push_back(leaf[i++].first);
+			}else {
+				list[l].push_back(-1);
+				nw.push_back(pw[j++]);
+			}
+		}
+		lw.swap(nw);
+	}
+	for (uint32_t l = 1, take = 2 * n - 2; l <= (uint32_t)max_len && take; l++){
+		uint32_t pairs = 0;
+		for (uint32_t i = 0; i < take && i < list[l].size(); i++){
+			if (list[l][i] >= 0)
+				len[leaf[list[l][i]].second]++;
+			else
+				pairs++;
+		}
+		take = 2 * pairs;
+	}
+}
 
-	// encode
-	nodes[(int)a.size() * 2 - 2].c.clear();
-	for (int i = (int)a.size() * 2 - 2; i >= 0; i--){
-		if (!nodes[i].son[0])
-			continue;
-		nodes[i].son[0]->c = nodes[i].c;
-		nodes[i].son[0]->c.add_bit(0);
-		nodes[i].son[1]->c = nodes[i].c;
-		nodes[i].son[1]->c.add_bit(1);
+/* canonical codes from code lengths <= HUFFMAN_MAX_NBIT, in the order of (length, symbol). code[i] is MSB first */
+static void canonical_codes(const std::vector<uint8_t> &len, std::vector<uint32_t> &code){
+	uint32_t bl_count[HUFFMAN_MAX_NBIT + 1] = {0}, next_code[HUFFMAN_MAX_NBIT + 1] = {0};
+	for (uint8_t l : len)
+		if (l)
+			bl_count[l]++;
+	for (uint32_t bits = 1, c = 0; bits <= HUFFMAN_MAX_NBIT; bits++){
+		c = (c + bl_count[bits - 1]) << 1;
+		next_code[bits] = c;
 	}
-	for (int i = 0; i < a.size(); i++)
-		res[i] = nodes[i].c;
+	code.assign(len.size(), 0);
+	for (uint32_t i = 0; i < len.size(); i++)
+		if (len[i])
+			code[i] = next_code[len[i]]++;
+}
+
+static inline uint32_t reverse_bits(uint32_t c, int len){
+	uint32_t r = 0;
+	for (int i = 0; i < len; i++, c >>= 1)
+		r = (r << 1) | (c & 1);
+	return r;
+}
+
+/* Huffman codes of all symbols of a, within HUFFMAN_MAX_NBIT bits. A single symbol takes 0 bits */
+static std::vector<Coding> huffman(const std::vector<uint64_t> &a){
+	std::vector<Coding> res(a.size(), (Coding){0, 0});
+	std::vector<uint8_t> len;
+	std::vector<uint32_t> code;
+	if (a.size() <= 1)
+		return res;
+	huffman_lengths(a, HUFFMAN_MAX_NBIT, len, true);
+	canonical_codes(len, code);
+	for (uint32_t i = 0; i < a.size(); i++)
+		res[i] = (Coding){len[i], reverse_bits(code[i], len[i])};
 	return res;
 }
 
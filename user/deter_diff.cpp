@@ -0,0 +1,327 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include "records_view.hpp"
+
+using namespace std;
+
+/*
+ * The differences of two record files, e.g. of a connection and of its replay, stream by stream. A stream is
+ * compared from its start and from its end, DIFF_BLOCK bytes at a time with memcmp and one by one only in the blocks
+ * that differ, so identical regions cost about a memory read. What is reported is the first element that differs
+ * and the elements of each between the common start and the common end, so that an element missing from one is
+ * one difference, not all of those after it. Bit arrays are compared bit by bit at the same index. A section with
+ * the same bytes on disk in both files is not decoded at all. v1 files are read with Records.
+ */
+#define DIFF_BLOCK 4096
+#define NO_DIFF ((uint64_t)-1)
+
+/* a record file to compare */
+struct Trace : RecordsSource{
+	// whether section type has the same bytes on disk in both, so that it is the same without decoding it
+	bool same_on_disk(const Trace &o, uint16_t type) const{
+		if (v1 || o.v1)
+			return false;
+		const RecSection *a = view.find(type), *b = o.view.find(type);
+		if (a == NULL || b == NULL)
+			return a == b;
+		return a->codec == b->codec && a->elem_size == b->elem_size && a->n_elem == b->n_elem && a->length == b->length
+			&& a->aux[0] == b->aux[0] && a->aux[1] == b->aux[1] && a->crc == b->crc
+			&& memcmp(view.base + a->offset, o.view.base + b->offset, a->length) == 0;
+	}
+	// elements of section type, without decoding it
+	uint64_t n_elem(uint16_t type) const{
+		const RecSection *s = view.find(type);
+		return s == NULL ? 0 : is_bit_array(type) ? s->aux[0] : s->n_elem;
+	}
+	// the error in ns allowed to the codec of tsq
+	uint32_t tsq_error() const{
+		const RecSection *s = v1 ? NULL : view.find(REC_SEC_TSQ);
+		return s == NULL ? 0 : s->aux[0];
+	}
+};
+
+/* how a stream of two traces differs */
+struct StreamDiff{
+	uint64_t n[2]; // elements of each
+	// elements: those of each between the common start and the common end. Bits: those that differ, in both
+	uint64_t n_diff[2];
+	uint64_t first; // index of the first difference, in the elements or in the length; NO_DIFF if none
+	bool bits;
+
+	bool differ() const { return first != NO_DIFF; }
+	void end(){
+		if (first == NO_DIFF && n[0] != n[1])
+			first = min(n[0], n[1]);
+	}
+};
+
+// the number of elements of a and b that are eq, from their start (dir 1) or from their end (dir -1), up to max
+template <typename T, typename Eq>
+static uint64_t common_run(Span<T> a, Span<T> b, Eq eq, int dir, uint64_t max){
+	uint64_t step = std::max(DIFF_BLOCK / sizeof(T), (size_t)1), k = 0;
+	for (uint64_t m; k < max; k += m){
+		m = min(step, max - k);
+		// the block of m elements next to the k matched
+		const T *x = dir > 0 ? a.p + k : a.p + a.n - k - m, *y = dir > 0 ? b.p + k : b.p + b.n - k - m;
+		if (memcmp(x, y, m * sizeof(T)) == 0)
+			continue;
+		for (uint64_t j = 0; j < m; j++){
+			uint64_t i = dir > 0 ? j : m - 1 - j;
+			if (!eq(x[i], y[i]))
+				return k + j;
+		}
+	}
+	return k;
+}
+
+// where a and b start to differ, and how many elements of each differ before they are the same up to the end
+template <typename T, typename Eq>
+static StreamDiff diff_stream(Span<T> a, Span<T> b, Eq eq){
+	StreamDiff d = {{a.size(), b.size()}, {0, 0}, NO_DIFF, false};
+	uint64_t n = min(a.size(), b.size()), pre = common_run(a, b, eq, 1, n), suf = common_run(a, b, eq, -1, n - pre);
+	if (pre < n)
+		d.first = pre;
+	d.n_diff[0] = a.size() - pre - suf;
+	d.n_diff[1] = b.size() - pre - suf;
+	d.end();
+	return d;
+}
+
+template <typename T>
+static bool same_bytes(const T &x, const T &y){
+	return memcmp(&x, &y, sizeof(T)) == 0;
+}
+
+template <typename T>
+static StreamDiff diff_stream(Span<T> a, Span<T> b){
+	return diff_stream(a, b, same_bytes<T>);
+}
+
+// the bits of a and b that differ
+static StreamDiff diff_bits(const BitWords &a, const BitWords &b){
+	StreamDiff d = {{a.n, b.n}, {0, 0}, NO_DIFF, true};
+	uint64_t n = min(a.n, b.n), n_word = n / 32, step = DIFF_BLOCK / 4;
+	for (uint64_t i = 0; i < (n + 31) / 32; i += step){
+		uint64_t m = min(step, (n + 31) / 32 - i);
+		if (i + m <= n_word && memcmp(a.w + i, b.w + i, m * 4) == 0)
+			continue;
+		for (uint64_t j = i; j < i + m; j++){
+			// bits past n of the last word are not compared
+			uint32_t x = (a.w[j] ^ b.w[j]) & (j < n_word ? ~0u : (1u << (n & 31)) - 1);
+			if (x == 0)
+				continue;
+			if (d.n_diff[0] == 0)
+				d.first = j * 32 + __builtin_ctz(x);
+			d.n_diff[0] += __builtin_popcount(x);
+		}
+	}
+	d.n_diff[1] = d.n_diff[0];
+	d.end();
+	return d;
+}
+
+static bool same_sockcall(const deter_rec_sockcall &sc1, const deter_rec_sockcall &sc2){
+	if (sc1.type != sc2.type)
+		return false;
+	// thread ids are those of the process that made the calls, and differ in a replay
+	if (sc1.type == DETER_SOCKCALL_TYPE_SENDMSG)
+		return sc1.sendmsg.flags == sc2.sendmsg.flags && sc1.sendmsg.size == sc2.sendmsg.size;
+	if (sc1.type == DETER_SOCKCALL_TYPE_RECVMSG)
+		return sc1.recvmsg.flags == sc2.recvmsg.flags && sc1.recvmsg.size == sc2.recvmsg.size;
+	if (sc1.type == DETER_SOCKCALL_TYPE_CLOSE)
+		return sc1.close.timeout == sc2.close.timeout;
+	if (sc1.type == DETER_SOCKCALL_TYPE_SPLICE_READ)
+		return sc1.splice_read.flags == sc2.splice_read.flags && sc1.splice_read.size == sc2.splice_read.size;
+	if (sc1.type == DETER_SOCKCALL_TYPE_SETSOCKOPT)
+		return sc1.setsockopt.level == sc2.setsockopt.level && sc1.setsockopt.optname == sc2.setsockopt.optname
+			&& sc1.setsockopt.optlen == sc2.setsockopt.optlen
+			&& memcmp(sc1.setsockopt.optval, sc2.setsockopt.optval, min((int)sc1.setsockopt.optlen, 12)) == 0;
+	return same_bytes(sc1, sc2);
+}
+
+static const char* sockcall_str(const deter_rec_sockcall &sc, char *buf){
+	char *p = buf;
+	if (sc.type == DETER_SOCKCALL_TYPE_SENDMSG)
+		sprintf(buf, "sendmsg 0x%x %lu", sc.sendmsg.flags, sc.sendmsg.size);
+	else if (sc.type == DETER_SOCKCALL_TYPE_RECVMSG)
+		sprintf(buf, "recvmsg 0x%x %lu", sc.recvmsg.flags, sc.recvmsg.size);
+	else if (sc.type == DETER_SOCKCALL_TYPE_CLOSE)
+		sprintf(buf, "close %ld", sc.close.timeout);
+	else if (sc.type == DETER_SOCKCALL_TYPE_SPLICE_READ)
+		sprintf(buf, "splice_read 0x%x %lu", sc.splice_read.flags, sc.splice_read.size);
+	else if (sc.type == DETER_SOCKCALL_TYPE_SETSOCKOPT){
+		p += sprintf(p, "setsockopt %hhu %hhu %hhu", sc.setsockopt.level, sc.setsockopt.optname, sc.setsockopt.optlen);
+		for (int j = 0; j < min((int)sc.setsockopt.optlen, 12); j++)
+			p += sprintf(p, " %hhx", sc.setsockopt.optval[j]);
+	}else
+		sprintf(buf, "unknown type %hhu", sc.type);
+	return buf;
+}
+
+/* compares the streams of two traces and prints how they differ */
+struct TraceDiff{
+	const Trace &a, &b;
+	bool verbose; // print the streams that are the same too
+	uint64_t n_differ; // streams and meta fields
+
+	TraceDiff(const Trace &_a, const Trace &_b, bool _verbose) : a(_a), b(_b), verbose(_verbose), n_differ(0) {}
+
+	// print the line of a stream, and return whether it differs
+	bool report(const char *name, const StreamDiff &d){
+		if (!d.differ()){
+			if (verbose)
+				printf("%-18s %12lu same\n", name, d.n[0]);
+			return false;
+		}
+		n_differ++;
+		printf("%-18s %12lu %12lu differ, first at %lu", name, d.n[0], d.n[1], d.first);
+		if (d.first >= min(d.n[0], d.n[1]))
+			printf(", where one ends");
+		if (d.bits)
+			printf("; %lu bits differ\n", d.n_diff[0]);
+		else
+			printf("; %lu | %lu elements up to the common end\n", d.n_diff[0], d.n_diff[1]);
+		return true;
+	}
+	// whether type is the same in both without decoding it; reported if so
+	bool same_on_disk(const char *name, uint16_t type){
+		if (!a.same_on_disk(b, type))
+			return false;
+		uint64_t n = a.n_elem(type);
+		StreamDiff d = {{n, n}, {0, 0}, NO_DIFF, false};
+		report(name, d);
+		return true;
+	}
+	template <typename T, typename Eq>
+	void values(const char *name, Span<T> x, Span<T> y, Eq eq){
+		StreamDiff d = diff_stream(x, y, eq);
+		if (report(name, d) && d.first < min(d.n[0], d.n[1])){
+			uint64_t v[2] = {0, 0};
+			memcpy(&v[0], &x[d.first], sizeof(T));
+			memcpy(&v[1], &y[d.first], sizeof(T));
+			printf("\t%lx | %lx\n", v[0], v[1]);
+		}
+	}
+	template <typename T>
+	void values(const char *name, Span<T> x, Span<T> y){
+		values(name, x, y, same_bytes<T>);
+	}
+	void bits(const char *name, uint16_t type){
+		BitWords x, y;
+		if (same_on_disk(name, type))
+			return;
+		if (a.bits(type, x) || b.bits(type, y)){
+			fprintf(stderr, "%s: bad bit array\n", name);
+			return;
+		}
+		StreamDiff d = diff_bits(x, y);
+		if (report(name, d) && d.first < min(d.n[0], d.n[1]))
+			printf("\t%d | %d\n", x.get(d.first), y.get(d.first));
+	}
+	void meta_field(const char *name, uint64_t x, uint64_t y){
+		if (x != y){
+			n_differ++;
+			printf("%-18s %lx | %lx\n", name, x, y);
+		}
+	}
+	void run();
+};
+
+void TraceDiff::run(){
+	char buf[2][128];
+	const RecMeta &m = a.meta, &n = b.meta;
+	meta_field("mode", m.mode, n.mode);
+	meta_field("broken", m.broken, n.broken);
+	meta_field("alert", m.alert, n.alert);
+	meta_field("sip", m.sip, n.sip);
+	meta_field("dip", m.dip, n.dip);
+	meta_field("sport", m.sport, n.sport);
+	meta_field("dport", m.dport, n.dport);
+	meta_field("fin_seq", m.fin_seq, n.fin_seq);
+	meta_field("sockets_allocated", m.n_sockets_allocated, n.n_sockets_allocated);
+	meta_field("eb_dense", m.eb_dense, n.eb_dense);
+	const tcp_sock_init_data *x = a.init_data(), *y = b.init_data();
+	if ((x == NULL) != (y == NULL) || (x && !same_bytes(*x, *y))){
+		n_differ++;
+		printf("%-18s differ\n", "init_data");
+	}
+
+	if (!same_on_disk("evts", REC_SEC_EVT)){
+		Span<deter_event> e[2] = {a.evts(), b.evts()};
+		StreamDiff d = diff_stream(e[0], e[1]);
+		if (report("evts", d) && d.first < min(d.n[0], d.n[1])){
+			const deter_event &p = e[0][d.first], &q = e[1][d.first];
+			printf("\tseq %u %s | seq %u %s\n", p.seq, get_event_name(p.type, buf[0]), q.seq, get_event_name(q.type, buf[1]));
+		}
+	}
+	if (!same_on_disk("sockcalls", REC_SEC_SOCKCALL)){
+		Span<deter_rec_sockcall> s[2] = {a.sockcalls(), b.sockcalls()};
+		StreamDiff d = diff_stream(s[0], s[1], same_sockcall);
+		if (report("sockcalls", d) && d.first < min(d.n[0], d.n[1]))
+			printf("\t%s | %s\n", sockcall_str(s[0][d.first], buf[0]), sockcall_str(s[1][d.first], buf[1]));
+	}
+	if (!same_on_disk("ps", REC_SEC_PS))
+		values("ps", a.ps(), b.ps());
+	if (!same_on_disk("jiffies", REC_SEC_JIF))
+		values("jiffies", a.jiffies(), b.jiffies());
+	bits("mpq", REC_SEC_MPQ);
+	if (!same_on_disk("memory_allocated", REC_SEC_MA))
+		values("memory_allocated", a.memory_allocated(), b.memory_allocated());
+	if (!same_on_disk("mstamp", REC_SEC_MSTAMP))
+		values("mstamp", a.mstamp(), b.mstamp());
+	if (!same_on_disk("siqq", REC_SEC_SIQQ))
+		values("siqq", a.siqq(), b.siqq());
+	bits("siq", REC_SEC_SIQ);
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++){
+		sprintf(buf[0], "ebq[%d]", i);
+		bits(buf[0], REC_SEC_EBQ(i));
+	}
+	if (!same_on_disk("ebx", REC_SEC_EBX))
+		values("ebx", a.ebx(), b.ebx());
+	// stamps stored by a lossy codec are the same within the error each allows
+	uint64_t err = a.tsq_error() + b.tsq_error();
+	if (!same_on_disk("tsq", REC_SEC_TSQ))
+		values("tsq", a.tsq(), b.tsq(), [err](uint32_t x, uint32_t y){ return (x > y ? x - y : y - x) <= err; });
+}
+
+static double now_sec(){
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv){
+	bool verbose = false;
+	int i = 1;
+	Trace t[2];
+	if (argc > 1 && string(argv[1]) == "-v"){
+		verbose = true;
+		i = 2;
+	}
+	if (argc - i != 2){
+		fprintf(stderr, "usage: ./deter_diff [-v] <record_file> <record_file>\n");
+		fprintf(stderr, "  how the streams of two record files differ, e.g. of a connection and of its replay; with -v, those that do not too\n");
+		fprintf(stderr, "  each stream: the first element that differs, and the elements of each between the common start and end\n");
+		fprintf(stderr, "  sockcalls are compared on their type and fields, not thread_id, which differs in a replay;\n");
+		fprintf(stderr, "  tx stamps within the error of their codec\n");
+		fprintf(stderr, "  exit status: 0 if the same, 1 if not, -1 on error\n");
+		return -1;
+	}
+	double t0 = now_sec();
+	for (int k = 0; k < 2; k++)
+		if (t[k].open(argv[i + k])){
+			fprintf(stderr, "Fail to read %s\n", argv[i + k]);
+			return -1;
+		}
+	TraceDiff d(t[0], t[1], verbose);
+	d.run();
+	if (!t[0].ok() || !t[1].ok()){
+		fprintf(stderr, "Error: corrupt sections, the streams they hold are left out\n");
+		return -1;
+	}
+	if (d.n_differ == 0)
+		printf("same\n");
+	fprintf(stderr, "%.3f s\n", now_sec() - t0);
+	return d.n_differ ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+#include "rec_export.hpp"
+#include "rec_format.hpp"
+
+using namespace std;
+
+static double now_sec(){
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* count, sum, min and max of a column. min and max are of the values xor flip, so that signed ones compare unsigned */
+struct Agg{
+	uint64_t n, sum, min, max;
+
+	Agg() : n(0), sum(0), min(~0ull), max(0) {}
+	void add(uint64_t _n, uint64_t _sum, uint64_t _min, uint64_t _max){
+		n += _n;
+		sum += _sum;
+		min = std::min(min, _min);
+		max = std::max(max, _max);
+	}
+	void add(const Agg &a) { add(a.n, a.sum, a.min, a.max); }
+};
+typedef unordered_map<uint64_t, Agg> AggMap; // by the value of the column grouped by
+
+/*
+ * aggregate x of a block into a, grouped by y if not NULL. A dictionary coded column is scanned by its indexes: x is
+ * counted per index and summed per value of its dictionary, and rows are grouped per index of y, so that the hash map
+ * is touched once per distinct value rather than once per row
+ */
+static void agg_block(const ExportColumn &x, const ExportColumn *y, uint64_t flip, AggMap &a){
+	vector<uint64_t> cnt;
+	vector<Agg> g;
+	uint64_t n = x.size();
+	if (y == NULL && x.coded()){
+		Agg &r = a[0];
+		cnt.assign(x.v.size(), 0);
+		for (uint64_t i = 0; i < n; i++)
+			cnt[x.code[i]]++;
+		for (uint64_t k = 0; k < cnt.size(); k++)
+			if (cnt[k])
+				r.add(cnt[k], cnt[k] * x.v[k], x.v[k] ^ flip, x.v[k] ^ flip);
+	}else if (y == NULL){
+		uint64_t sum = 0, lo = ~0ull, hi = 0;
+		for (uint64_t i = 0; i < n; i++){
+			uint64_t v = x.v[i];
+			sum += v;
+			lo = min(lo, v ^ flip);
+			hi = max(hi, v ^ flip);
+		}
+		if (n)
+			a[0].add(n, sum, lo, hi);
+	}else if (y->coded()){
+		g.assign(y->v.size(), Agg());
+		for (uint64_t i = 0; i < n; i++){
+			uint64_t v = x[i];
+			g[y->code[i]].add(1, v, v ^ flip, v ^ flip);
+		}
+		for (uint64_t k = 0; k < g.size(); k++)
+			if (g[k].n)
+				a[y->v[k]].add(g[k]);
+	}else
+		for (uint64_t i = 0; i < n; i++){
+			uint64_t v = x[i];
+			a[y->v[i]].add(1, v, v ^ flip, v ^ flip);
+		}
+}
+
+static int agg(const char *out, const char *stream, const char *col, const char *by, int n_thread){
+	vector<string> parts;
+	vector<AggMap> part_agg(n_thread);
+	vector<thread> th;
+	atomic<uint64_t> next(0);
+	atomic<int> err(0);
+	bool x_signed = false, y_signed = false;
+	AggMap a;
+	if (list_export_files(out, stream, parts))
+		return -1;
+	if (parts.empty()){
+		fprintf(stderr, "No %s in %s\n", stream, out);
+		return -1;
+	}
+	for (int k = 0; k < n_thread; k++)
+		th.push_back(thread([&, k](){
+			for (uint64_t j; (j = next++) < parts.size() && !err;){
+				ExportFile f;
+				ExportColumn x, y;
+				int c, cy = -1;
+				if (f.open(parts[j])){
+					err = 1;
+					break;
+				}
+				c = f.find(col);
+				if (by)
+					cy = f.find(by);
+				if (c < 0 || (by && cy < 0)){
+					fprintf(stderr, "%s: no column %s\n", parts[j].c_str(), c < 0 ? col : by);
+					err = 1;
+					break;
+				}
+				// the same in every part
+				x_signed = f.signed_cols >> c & 1;
+				y_signed = by && (f.signed_cols >> cy & 1);
+				for (uint64_t b = 0; b < f.n_row.size(); b++){
+					if (f.read_column(b, c, x) || (by && f.read_column(b, cy, y))){
+						fprintf(stderr, "%s: corrupt block %lu\n", parts[j].c_str(), b);
+						err = 1;
+						break;
+					}
+					agg_block(x, by ? &y : NULL, x_signed ? 1ull << 63 : 0, part_agg[k]);
+				}
+			}
+		}));
+	for (thread &t : th)
+		t.join();
+	if (err)
+		return -1;
+	for (AggMap &m : part_agg)
+		for (auto &e : m)
+			a[e.first].add(e.second);
+
+	vector<pair<uint64_t, Agg> > rows(a.begin(), a.end());
+	uint64_t flip = x_signed ? 1ull << 63 : 0, yflip = y_signed ? 1ull << 63 : 0;
+	sort(rows.begin(), rows.end(), [yflip](const pair<uint64_t, Agg> &p, const pair<uint64_t, Agg> &q){
+		return (p.first ^ yflip) < (q.first ^ yflip);
+	});
+	if (by)
+		printf("%20s ", by);
+	printf("%12s %20s %20s %20s %20s\n", "n", "sum", "min", "max", "mean");
+	for (auto &r : rows){
+		const Agg &g = r.second;
+		if (by)
+			printf(y_signed ? "%20ld " : "%20lu ", r.first);
+		if (x_signed)
+			printf("%12lu %20ld %20ld %20ld %20.3f\n", g.n, g.sum, g.min ^ flip, g.max ^ flip, (double)(int64_t)g.sum / g.n);
+		else
+			printf("%12lu %20lu %20lu %20lu %20.3f\n", g.n, g.sum, g.min, g.max, (double)g.sum / g.n);
+	}
+	return 0;
+}
+
+static int columns(const char *out){
+	vector<string> paths, p;
+	if (list_export_files(out, EXPORT_CONN_FILE, paths))
+		return -1;
+	for (int s = 0; s < REC_N_STREAM; s++){
+		if (list_export_files(out, rec_stream_name[s], p))
+			return -1;
+		paths.insert(paths.end(), p.begin(), p.end());
+	}
+	for (const string &path : paths){
+		ExportFile f;
+		uint64_t rows = 0;
+		if (f.open(path))
+			return -1;
+		for (uint64_t n : f.n_row)
+			rows += n;
+		printf("%s: %lu rows, %lu blocks\n", path.c_str(), rows, f.n_row.size());
+		for (uint64_t c = 0; c < f.cols.size(); c++){
+			uint64_t bytes = 0, coded = 0;
+			for (uint64_t b = 0; b < f.n_row.size(); b++){
+				bytes += f.bytes(b, c);
+				coded += f.coded(b, c);
+			}
+			printf("  %-16s %s%lu/%lu blocks dictionary coded, %lu bytes, %.3f per row\n", f.cols[c].c_str(),
+					f.signed_cols >> c & 1 ? "signed, " : "", coded, f.n_row.size(), bytes, rows ? (double)bytes / rows : 0.0);
+		}
+	}
+	return 0;
+}
+
+void print_usage(){
+	fprintf(stderr, "usage: ./deter_export [-j <threads>] <out> export <stream>,... <dir|record_file>...\n");
+	fprintf(stderr, "  export: write the streams of the record files, in directories and their subdirectories, to the new directory out\n");
+	fprintf(stderr, "    by column, with a thread per core by default\n");
+	fprintf(stderr, "usage: ./deter_export <out> columns\n");
+	fprintf(stderr, "  columns: the files of an export, and the size of each column\n");
+	fprintf(stderr, "usage: ./deter_export [-j <threads>] <out> agg <stream> <column> [<column grouped by>]\n");
+	fprintf(stderr, "  agg: count, sum, min, max and mean of a column, e.g. ./deter_export x agg sockcalls size type\n");
+	fprintf(stderr, "  streams: all");
+	for (int s = REC_STREAM_SOCKCALLS; s < REC_N_STREAM; s++)
+		fprintf(stderr, " %s", rec_stream_name[s]);
+	fprintf(stderr, ", and %s for the connections\n", EXPORT_CONN_FILE);
+}
+
+int main(int argc, char **argv){
+	int n_thread, i = parse_n_thread(argc, argv, n_thread);
+	if (i < 0 || argc - i < 2){
+		print_usage();
+		return -1;
+	}
+	const char *out = argv[i];
+	string cmd = argv[i + 1];
+	double t0 = now_sec();
+	if (cmd == "export" && argc - i >= 4){
+		vector<string> files;
+		uint32_t streams;
+		if (parse_rec_streams(argv[i + 2], streams)){
+			fprintf(stderr, "Bad streams %s\n", argv[i + 2]);
+			print_usage();
+			return -1;
+		}
+		for (int k = i + 3; k < argc; k++)
+			list_record_files(argv[k], files);
+		// the connection of a file is its index, the same whatever the order of the directory
+		sort(files.begin(), files.end());
+		if (rec_export(files, streams, out, n_thread))
+			return -1;
+		fprintf(stderr, "%.3f s\n", now_sec() - t0);
+		return 0;
+	}
+	if (cmd == "columns" && argc - i == 2)
+		return columns(out);
+	if (cmd == "agg" && (argc - i == 4 || argc - i == 5)){
+		if (agg(out, argv[i + 2], argv[i + 3], argc - i == 5 ? argv[i + 4] : NULL, n_thread))
+			return -1;
+		fprintf(stderr, "%.3f s\n", now_sec() - t0);
+		return 0;
+	}
+	print_usage();
+	return -1;
+}
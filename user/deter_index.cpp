@@ -0,0 +1,79 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include "records.hpp"
+#include "rec_index.hpp"
+
+using namespace std;
+
+static double now_sec(){
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* ip_str(uint32_t ip, char *buf){
+	sprintf(buf, "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+	return buf;
+}
+
+static void print_rows(const RecIndexRows &r){
+	char ip[2][16], addr[2][24];
+	printf("%-4s %-21s %-21s %6s %5s %10s %14s %14s %12s %10s %10s %14s %s\n", "mode", "src", "dst", "broken", "alert",
+			"fin_seq", "bytes_sent", "bytes_received", "pkt_received", "n_evt", "n_sockcall", "first_jiffies", "file");
+	for (uint64_t i = 0; i < r.size(); i++){
+		sprintf(addr[0], "%s:%lu", ip_str(r.col[IDX_SIP][i], ip[0]), r.col[IDX_SPORT][i]);
+		sprintf(addr[1], "%s:%lu", ip_str(r.col[IDX_DIP][i], ip[1]), r.col[IDX_DPORT][i]);
+		printf("%-4lu %-21s %-21s %6lx %5lx %10lu %14lu %14lu %12lu %10lu %10lu %14lu %s\n", r.col[IDX_MODE][i], addr[0],
+				addr[1], r.col[IDX_BROKEN][i], r.col[IDX_ALERT][i], r.col[IDX_FIN_SEQ][i], r.col[IDX_BYTES_SENT][i],
+				r.col[IDX_BYTES_RECEIVED][i], r.col[IDX_PKT_RECEIVED][i], r.col[IDX_N_EVT][i], r.col[IDX_N_SOCKCALL][i],
+				r.col[IDX_FIRST_JIFFIES][i], r.file[i].c_str());
+	}
+}
+
+void print_usage(){
+	fprintf(stderr, "usage: ./deter_index [-j <threads>] <dir> update\n");
+	fprintf(stderr, "  update: add the record files of dir that are new or changed to its index, with a thread per core by default\n");
+	fprintf(stderr, "usage: ./deter_index <dir> query [<column><op><value>...]\n");
+	fprintf(stderr, "  query: the connections that match all the predicates, op one of = != < <= > >=, e.g.\n");
+	fprintf(stderr, "    ./deter_index log query port=50010 alert!=0 'bytes_sent>1000000000'\n");
+	fprintf(stderr, "  columns:");
+	for (int c = 0; c < IDX_N_NUM; c++)
+		fprintf(stderr, " %s", rec_index_col_name[c]);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv){
+	int n_thread, i = parse_n_thread(argc, argv, n_thread);
+	if (i < 0 || argc - i < 2){
+		print_usage();
+		return -1;
+	}
+	const char *dir = argv[i];
+	string cmd = argv[i + 1];
+	double t0 = now_sec();
+	if (cmd == "update" && argc - i == 2){
+		if (rec_index_update(dir, n_thread))
+			return -1;
+		fprintf(stderr, "%.3f s\n", now_sec() - t0);
+		return 0;
+	}
+	if (cmd == "query"){
+		vector<RecIndexPred> preds;
+		RecIndexRows rows;
+		for (int k = i + 2; k < argc; k++){
+			RecIndexPred p;
+			if (p.parse(argv[k])){
+				fprintf(stderr, "Bad predicate %s\n", argv[k]);
+				print_usage();
+				return -1;
+			}
+			preds.push_back(p);
+		}
+		if (rec_index_query(dir, preds, rows))
+			return -1;
+		print_rows(rows);
+		fprintf(stderr, "%lu rows, %.3f s\n", rows.size(), now_sec() - t0);
+		return 0;
+	}
+	print_usage();
+	return -1;
+}
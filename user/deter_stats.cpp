@@ -0,0 +1,218 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <sys/stat.h>
+#include "records.hpp"
+#include "record_file.hpp"
+
+using namespace std;
+
+/*
+ * The totals of a corpus of record files: the estimated storage of each stream (print_compressed_storage_size), the
+ * bytes each section takes on disk, and the packets and bytes of the connections. Each thread reads its share of the
+ * files into totals of its own, which are added up at the end, so it scales with the cores.
+ * Connections of a host with itself (sip == dip) are left out.
+ * Packets lost are Records::get_pkt_lost: the ip ids skipped going forward between packets received, a gap of g being
+ * g - 1 packets. accounting.py, which this replaces, summed a "drops" line of the reader output, which the reader
+ * no longer printed, so this is not comparable to totals of it. A packet that arrives out of order counts as lost
+ * where its id was skipped; the backward gap when it arrives is not taken off.
+ */
+
+static_assert(sizeof(StorageSize) % 8 == 0, "StorageSize is added up by 8-byte words");
+
+struct SectionTotal{
+	uint64_t n_file, n_elem, raw, disk;
+};
+
+struct CorpusStats{
+	uint64_t n_file, n_broken, n_alert, n_loopback, n_v1, n_fail;
+	uint64_t file_bytes;
+	StorageSize est;
+	map<uint16_t, SectionTotal> sec; // by section type
+	uint64_t pkt_rx, pkt_tx, pkt_lost;
+	uint64_t bytes_sent, bytes_received, transfer;
+
+	CorpusStats(){
+		n_file = n_broken = n_alert = n_loopback = n_v1 = n_fail = file_bytes = 0;
+		pkt_rx = pkt_tx = pkt_lost = bytes_sent = bytes_received = transfer = 0;
+		memset(&est, 0, sizeof(est));
+	}
+	void add(const StorageSize &s){
+		uint64_t *a = (uint64_t*)&est;
+		const uint64_t *b = (const uint64_t*)&s;
+		for (uint64_t i = 0; i < sizeof(s) / 8; i++)
+			a[i] += b[i];
+	}
+	void add(const CorpusStats &c){
+		n_file += c.n_file;
+		n_broken += c.n_broken;
+		n_alert += c.n_alert;
+		n_loopback += c.n_loopback;
+		n_v1 += c.n_v1;
+		n_fail += c.n_fail;
+		file_bytes += c.file_bytes;
+		add(c.est);
+		for (auto &it : c.sec){
+			SectionTotal &t = sec[it.first];
+			t.n_file += it.second.n_file;
+			t.n_elem += it.second.n_elem;
+			t.raw += it.second.raw;
+			t.disk += it.second.disk;
+		}
+		pkt_rx += c.pkt_rx;
+		pkt_tx += c.pkt_tx;
+		pkt_lost += c.pkt_lost;
+		bytes_sent += c.bytes_sent;
+		bytes_received += c.bytes_received;
+		transfer += c.transfer;
+	}
+	int add_file(const char *filename);
+	void print();
+};
+
+int CorpusStats::add_file(const char *filename){
+	Records rec;
+	vector<RecSection> table;
+	StorageSize s;
+	struct stat st;
+	if (rec.read(filename, &table)){
+		fprintf(stderr, "Fail to read %s\n", filename);
+		n_fail++;
+		return -1;
+	}
+	if (rec.sip == rec.dip){
+		n_loopback++;
+		return 0;
+	}
+	n_file++;
+	n_broken += rec.broken != 0;
+	n_alert += rec.alert != 0;
+	if (stat(filename, &st) == 0)
+		file_bytes += st.st_size;
+
+	for (const RecSection &x : table){
+		SectionTotal &t = sec[x.type];
+		t.n_file++;
+		t.n_elem += x.n_elem;
+		t.raw += x.n_elem * x.elem_size;
+		t.disk += x.length;
+	}
+	n_v1 += table.empty();
+
+	rec.get_compressed_storage_size(s);
+	add(s);
+	pkt_rx += rec.get_pkt_received();
+	#if COLLECT_TX_STAMP
+	pkt_tx += rec.tsq.size();
+	#endif
+	pkt_lost += rec.get_pkt_lost();
+	uint64_t sent = rec.get_total_bytes_sent();
+	bytes_sent += sent;
+	bytes_received += rec.get_total_bytes_received();
+	// the sequence number of the fin, counted from the isn, or the bytes written if there was no fin
+	transfer += rec.fin_seq ? rec.fin_seq : sent;
+	return 0;
+}
+
+void CorpusStats::print(){
+	char buf[32];
+	printf("=====records=====\n");
+	printf("records: %lu\n", n_file);
+	printf("broken: %lu\n", n_broken);
+	printf("alert: %lu\n", n_alert);
+	printf("loopback, skipped: %lu\n", n_loopback);
+	printf("v1, no section table: %lu\n", n_v1);
+	printf("failed to read: %lu\n", n_fail);
+	printf("\n");
+
+	printf("=====storage_size=====\n");
+	printf("init_data: %lu\n", est.init_data);
+	printf("\tevts: dynamic: %lu\n", est.evts_dynamic);
+	printf("\tevts: huffman_prefix: %lu\n", est.evts_huffman_prefix);
+	printf("\tevts: huffman_encoding: %lu\n", est.evts_huffman_encoding);
+	printf("evts: %lu\n", est.evts);
+	printf("sockcalls: %lu\n", est.sockcalls);
+	printf("jiffies: %lu\n", est.jiffies);
+	printf("mpq: %lu\n", est.mpq);
+	printf("memory_allocated: %lu\n", est.memory_allocated);
+	printf("\tmstamp size, dynamic: %lu\n", est.mstamp_dynamic);
+	printf("\tmstamp size, huffman_prefix: %lu\n", est.mstamp_huffman_prefix);
+	printf("\tmstamp size, huffman_encoding: %lu\n", est.mstamp_huffman_encoding);
+	printf("mstamp: %lu\n", est.mstamp);
+	printf("siqq: %lu\n", est.siqq);
+	printf("siq: %lu\n", est.siq);
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		printf("ebq[%d]: %lu\n", i, est.ebq[i]);
+	printf("ebx: %lu\n", est.ebx);
+	#if COLLECT_TX_STAMP
+	printf("\ttx_stamp size, sample, dynamic: nSamp: %lu size: %lu\n", est.tx_stamp_n_sample, est.tx_stamp_sample_dynamic);
+	printf("\ttx_stamp size, sample, huffman_prefix: nSamp: %lu size: %lu\n", est.tx_stamp_n_sample, est.tx_stamp_sample_huffman_prefix);
+	printf("\ttx_stamp size, static_prefix: %lu\n", est.tx_stamp_static_prefix);
+	printf("\ttx_stamp size, huffman_prefix: %lu\n", est.tx_stamp_huffman_prefix);
+	printf("\ttx_stamp size, huffman_encoding: %lu\n", est.tx_stamp_huffman_encoding);
+	printf("tx_stamp: %lu\n", est.tx_stamp);
+	#endif
+	printf("compressed total: %lu\n", est.total);
+	printf("\n");
+
+	uint64_t raw = 0, disk = 0;
+	printf("=====sections=====\n");
+	printf("%-18s %10s %14s %14s %14s %8s\n", "section", "files", "n_elem", "raw", "disk", "ratio");
+	for (auto &it : sec){
+		const SectionTotal &t = it.second;
+		printf("%-18s %10lu %14lu %14lu %14lu %8.2f\n", get_section_name(it.first, buf), t.n_file, t.n_elem, t.raw, t.disk,
+				t.disk ? (double)t.raw / t.disk : 0);
+		raw += t.raw;
+		disk += t.disk;
+	}
+	printf("total: raw %lu, sections %lu, files %lu (%.2fx)\n", raw, disk, file_bytes, file_bytes ? (double)raw / file_bytes : 0);
+	printf("\n");
+
+	printf("=====traffic=====\n");
+	printf("packets received: %lu\n", pkt_rx);
+	printf("packets sent: %lu\n", pkt_tx);
+	printf("packets lost: %lu\n", pkt_lost);
+	printf("total bytes sent: %lu\n", bytes_sent);
+	printf("total bytes received: %lu\n", bytes_received);
+	printf("transfer (bytes): %lu\n", transfer);
+}
+
+static double now_sec(){
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv){
+	int n_thread, i = parse_n_thread(argc, argv, n_thread);
+	vector<string> files;
+	if (i < 0 || i >= argc){
+		fprintf(stderr, "usage: ./deter_stats [-j <threads>] <dir|record_file>...\n");
+		fprintf(stderr, "  the totals of the record files, in directories and their subdirectories, with a thread per core by default\n");
+		return -1;
+	}
+	for (; i < argc; i++)
+		list_record_files(argv[i], files);
+
+	double t0 = now_sec();
+	atomic<uint64_t> next(0);
+	vector<CorpusStats> part(n_thread);
+	vector<thread> th;
+	for (int k = 0; k < n_thread; k++)
+		th.push_back(thread([&files, &next, &part, k](){
+			for (uint64_t j; (j = next++) < files.size();)
+				part[k].add_file(files[j].c_str());
+		}));
+	CorpusStats total;
+	for (int k = 0; k < n_thread; k++){
+		th[k].join();
+		total.add(part[k]);
+	}
+	total.print();
+	double t = now_sec() - t0;
+	fprintf(stderr, "%lu files, %d threads, %.2f s, %.0f files/s\n", files.size(), n_thread, t, t > 0 ? files.size() / t : 0);
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef _ELIAS_FANO_HPP
+#define _ELIAS_FANO_HPP
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Elias-Fano coding of n non-decreasing values in [0, u], l < 64: the low l bits of each value packed in lo, and the rest in
+ * unary in hi, value i setting bit (v >> l) + i. About n * (2 + log2(u / n)) bits.
+ * Only the elias_fano codec uses it, to decode whole sequences, so there is no select index for random access.
+ * The words of lo and hi can be in place in a buffer (open) or owned (build).
+ */
+
+struct EliasFano{
+	uint64_t n, u;
+	uint32_t l;
+	const uint64_t *lo, *hi;
+	uint64_t n_lo, n_hi; // words
+	std::vector<uint64_t> own; // lo and hi when built
+
+	EliasFano() : n(0), u(0), l(0), lo(NULL), hi(NULL), n_lo(0), n_hi(0) {}
+	// words of lo and hi for n values in [0, u], with l low bits
+	static uint32_t best_l(uint64_t n, uint64_t u){
+		uint32_t l = 0;
+		for (; n && (u / n) >> (l + 1); l++);
+		return l;
+	}
+	static uint64_t lo_words(uint64_t n, uint32_t l) { return (n * l + 63) / 64; }
+	static uint64_t hi_words(uint64_t n, uint64_t u, uint32_t l) { return (n + (u >> l) + 1 + 63) / 64; }
+
+	void build(const uint64_t *v, uint64_t _n);
+	// use the words at lo and hi as they are. Return -1 if hi does not have n 1s
+	int open(uint64_t _n, uint64_t _u, uint32_t _l, const uint64_t *_lo, const uint64_t *_hi);
+
+	uint64_t get_lo(uint64_t i) const{
+		if (l == 0)
+			return 0;
+		uint64_t b = i * l, w = lo[b / 64] >> (b % 64);
+		if (b % 64 + l > 64)
+			w |= lo[b / 64 + 1] << (64 - b % 64);
+		return w & ((1ull << l) - 1);
+	}
+	// all n values to out
+	void decode(uint64_t *out) const;
+};
+
+#endif /* _ELIAS_FANO_HPP */
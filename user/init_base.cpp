@@ -0,0 +1,157 @@
+#include <cstring>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "init_base.hpp"
+#include "record_file.hpp"
+
+using namespace std;
+
+static_assert(sizeof(tcp_sock_init_data) % 4 == 0, "init data is compared by 4-byte words");
+
+int InitBaseSet::load(const string &dir){
+	RecFileReader r;
+	string path = dir + "/" + INIT_BASE_FILE;
+	FILE *f = fopen(path.c_str(), "r");
+	v.clear();
+	if (f == NULL)
+		return 0;
+	fclose(f);
+	if (r.open(path.c_str()) || r.read_vector(REC_SEC_INIT_BASE, v)){
+		fprintf(stderr, "Fail to read %s\n", path.c_str());
+		v.clear();
+		return -1;
+	}
+	return 0;
+}
+
+int InitBaseSet::save(const string &dir){
+	RecFileWriter w;
+	string path = dir + "/" + INIT_BASE_FILE, tmp = path + ".tmp";
+	// records refer to the old baselines, so the file is replaced whole or not at all
+	if (w.open(tmp.c_str()) || w.add_vector(REC_SEC_INIT_BASE, v) || w.close() || rename(tmp.c_str(), path.c_str())){
+		fprintf(stderr, "Fail to write %s\n", path.c_str());
+		remove(tmp.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+const InitBase* InitBaseSet::find(uint32_t id) const{
+	for (const InitBase &b : v)
+		if (b.id == id)
+			return &b;
+	return NULL;
+}
+
+const InitBase* InitBaseSet::latest(uint32_t mode) const{
+	for (uint64_t i = v.size(); i > 0; i--)
+		if (v[i - 1].mode == mode)
+			return &v[i - 1];
+	return NULL;
+}
+
+const InitBase& InitBaseSet::build(uint32_t mode, const vector<tcp_sock_init_data> &corpus){
+	InitBase b;
+	memset(&b, 0, sizeof(b));
+	b.mode = mode;
+	uint32_t *w = (uint32_t*)&b.d;
+	for (uint32_t k = 0; k < INIT_DATA_WORDS; k++){
+		unordered_map<uint32_t, uint64_t> cnt;
+		uint64_t best = 0;
+		for (const tcp_sock_init_data &d : corpus){
+			uint32_t x;
+			memcpy(&x, (const uint32_t*)&d + k, 4);
+			uint64_t c = ++cnt[x];
+			if (c > best || (c == best && x < w[k])){
+				best = c;
+				w[k] = x;
+			}
+		}
+	}
+	b.id = crc32c(0, &b.d, sizeof(b.d));
+	const InitBase *last = latest(mode);
+	if (last && last->id == b.id)
+		return *last;
+	v.push_back(b);
+	return v.back();
+}
+
+void init_delta_encode(const tcp_sock_init_data &base, const tcp_sock_init_data &d, vector<uint32_t> &out){
+	const uint32_t *bw = (const uint32_t*)&base, *dw = (const uint32_t*)&d;
+	uint64_t start = out.size();
+	out.resize(start + INIT_DELTA_MAP_WORDS, 0);
+	for (uint32_t k = 0; k < INIT_DATA_WORDS; k++){
+		if (bw[k] == dw[k])
+			continue;
+		out[start + k / 32] |= 1u << (k % 32);
+		out.push_back(dw[k]);
+	}
+}
+
+int init_delta_decode(const tcp_sock_init_data &base, const uint32_t *in, uint64_t n, tcp_sock_init_data &d){
+	uint32_t *dw = (uint32_t*)&d;
+	uint64_t j = INIT_DELTA_MAP_WORDS;
+	if (n < INIT_DELTA_MAP_WORDS)
+		return -1;
+	d = base;
+	for (uint32_t k = 0; k < INIT_DATA_WORDS; k++){
+		if (!((in[k / 32] >> (k % 32)) & 1))
+			continue;
+		if (j >= n)
+			return -1;
+		dw[k] = in[j++];
+	}
+	// no bits past the last word, no words past the last bit
+	if (INIT_DATA_WORDS % 32 && in[INIT_DELTA_MAP_WORDS - 1] >> (INIT_DATA_WORDS % 32))
+		return -1;
+	return j == n ? 0 : -1;
+}
+
+/*
+ * the baselines of each directory, loaded on first use and again whenever INIT_BASE_FILE is replaced, since a baseline
+ * may be added while a recorder runs; the file is always replaced by a rename, so its inode and mtime tell
+ */
+struct CachedInitBase{
+	InitBaseSet set;
+	bool loaded;
+	uint64_t ino, mtime;
+	CachedInitBase() : loaded(false), ino(0), mtime(0) {}
+};
+static mutex init_base_lock;
+static map<string, CachedInitBase> init_base_cache;
+
+static int lookup_init_base(const char *filename, bool by_id, uint32_t key, InitBase &b){
+	lock_guard<mutex> g(init_base_lock);
+	string dir = rec_file_dir(filename);
+	CachedInitBase &c = init_base_cache[dir];
+	struct stat st;
+	uint64_t ino = 0, mtime = 0; // 0 for a missing file
+	if (stat((dir + "/" + INIT_BASE_FILE).c_str(), &st) == 0){
+		ino = st.st_ino;
+		mtime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+	}
+	if (!c.loaded || c.ino != ino || c.mtime != mtime){
+		c.loaded = false;
+		if (c.set.load(dir))
+			return -1;
+		c.loaded = true;
+		c.ino = ino;
+		c.mtime = mtime;
+	}
+	const InitBase *p = by_id ? c.set.find(key) : c.set.latest(key);
+	if (p == NULL)
+		return -1;
+	b = *p;
+	return 0;
+}
+
+int get_init_base(const char *filename, uint32_t id, InitBase &b){
+	return lookup_init_base(filename, true, id, b);
+}
+
+int get_latest_init_base(const char *filename, uint32_t mode, InitBase &b){
+	return lookup_init_base(filename, false, mode, b);
+}
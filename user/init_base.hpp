@@ -0,0 +1,53 @@
+#ifndef _INIT_BASE_HPP
+#define _INIT_BASE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "base_struct.hpp"
+
+/*
+ * Baselines of tcp_sock_init_data. Sockets of the same role (Records::mode) differ in a few dozen of the 106 words of
+ * their init data, so a record file may store only the words that differ from the baseline of its role: a bitmap of
+ * the words present, then those words (REC_SEC_INIT_DELTA, aux[0] = the id of the baseline). Bit fields are compared
+ * by the word they are in.
+ * The baselines of a directory of records are in the record file INIT_BASE_FILE of that directory (REC_SEC_INIT_BASE).
+ * A baseline is never changed once written, since records refer to it: a new one is appended, and the last one of a
+ * role is the one new records use. Its id is the CRC32C of its init data.
+ */
+#define INIT_BASE_FILE "init_base"
+#define INIT_DATA_WORDS (sizeof(tcp_sock_init_data) / 4)
+#define INIT_DELTA_MAP_WORDS ((INIT_DATA_WORDS + 31) / 32)
+
+struct InitBase{
+	uint32_t id;
+	uint32_t mode; // the role this is the baseline of
+	tcp_sock_init_data d;
+};
+
+struct InitBaseSet{
+	std::vector<InitBase> v;
+
+	// a missing file is an empty set
+	int load(const std::string &dir);
+	int save(const std::string &dir);
+	const InitBase* find(uint32_t id) const;
+	// the baseline new records of mode use, NULL if none
+	const InitBase* latest(uint32_t mode) const;
+	// the baseline of a corpus of mode: the most frequent value of each word. Appended unless it is already the latest
+	const InitBase& build(uint32_t mode, const std::vector<tcp_sock_init_data> &corpus);
+};
+
+/* the words of d that differ from base, as above */
+void init_delta_encode(const tcp_sock_init_data &base, const tcp_sock_init_data &d, std::vector<uint32_t> &out);
+/* return -1 if the n words at in are not a delta */
+int init_delta_decode(const tcp_sock_init_data &base, const uint32_t *in, uint64_t n, tcp_sock_init_data &d);
+
+/*
+ * The baseline of id (of the latest of mode) in the directory of a record file, from a cache of the baselines of each
+ * directory. Return -1 if there is none.
+ */
+int get_init_base(const char *filename, uint32_t id, InitBase &b);
+int get_latest_init_base(const char *filename, uint32_t mode, InitBase &b);
+
+#endif /* _INIT_BASE_HPP */
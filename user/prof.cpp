@@ -0,0 +1,115 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include "kernel_typedef.hpp"
+#include "../shared_data_struct/prof.h"
+#include "mem_share.hpp"
+
+using namespace std;
+
+#define PROF_PROC_NAME "deter_prof"
+
+/*
+ * Print the per-hook overhead histograms of the recorder module, merged over all CPUs.
+ * Usage: prof [on|off|reset]
+ *   on/off: enable/disable the measurement; reset: clear the histograms
+ */
+
+static int write_proc(const char* cmd){
+	int fd = open("/proc/" PROF_PROC_NAME, O_WRONLY);
+	if (fd == -1){
+		fprintf(stderr, "Fail to open /proc/%s\n", PROF_PROC_NAME);
+		return -1;
+	}
+	int ret = write(fd, cmd, strlen(cmd)) == (ssize_t)strlen(cmd) ? 0 : -1;
+	if (ret)
+		fprintf(stderr, "Fail to write %s to /proc/%s\n", cmd, PROF_PROC_NAME);
+	close(fd);
+	return ret;
+}
+
+/* the largest value in bucket b, so the reported percentile is an upper bound */
+static inline u64 get_bucket_high(u32 b){
+	if (b + 1 >= PROF_N_BUCKET)
+		return get_prof_bucket_low(b);
+	return get_prof_bucket_low(b + 1) - 1;
+}
+
+static u64 get_percentile(const ProfHist &h, u64 n, double p){
+	u64 target = (u64)(n * p);
+	if (target >= n)
+		target = n - 1;
+	u64 acc = 0;
+	for (u32 b = 0; b < PROF_N_BUCKET; b++){
+		acc += h.cnt[b];
+		if (acc > target)
+			return get_bucket_high(b);
+	}
+	return h.max;
+}
+
+int main(int argc, char** argv){
+	if (argc > 1){
+		if (strcmp(argv[1], "on") == 0)
+			return write_proc("1");
+		if (strcmp(argv[1], "off") == 0)
+			return write_proc("0");
+		if (strcmp(argv[1], "reset") == 0)
+			return write_proc("reset");
+		fprintf(stderr, "Usage: %s [on|off|reset]\n", argv[0]);
+		return -1;
+	}
+
+	// map the header first to get the total size
+	KernelMem kmem;
+	if (kmem.map_proc_exposed_mem(PROF_PROC_NAME, sizeof(ProfLayout)))
+		return -1;
+	u32 size = ((ProfLayout*)kmem.buf)->size;
+	kmem.unmap_mem();
+	if (kmem.map_proc_exposed_mem(PROF_PROC_NAME, size))
+		return -1;
+	ProfLayout *prof = (ProfLayout*)kmem.buf;
+
+	// merge over all CPUs
+	ProfHist all[PROF_N_HOOK];
+	memset(all, 0, sizeof(all));
+	for (u32 c = 0; c < prof->n_cpu; c++){
+		for (u32 i = 0; i < PROF_N_HOOK; i++){
+			ProfHist &h = prof->cpu[c].hist[i];
+			for (u32 b = 0; b < PROF_N_BUCKET; b++)
+				all[i].cnt[b] += h.cnt[b];
+			all[i].sum += h.sum;
+			if (h.max > all[i].max)
+				all[i].max = h.max;
+		}
+	}
+
+	double ns_per_cycle = prof->cycle_khz ? 1e6 / prof->cycle_khz : 0;
+	printf("enabled: %u  cpus: %u  cycle_khz: %u\n", prof->enabled, prof->n_cpu, prof->cycle_khz);
+	printf("%-24s %12s %10s %10s %10s %10s %10s %10s\n", "hook (cycles)", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+	for (u32 i = 0; i < PROF_N_HOOK; i++){
+		u64 n = 0;
+		for (u32 b = 0; b < PROF_N_BUCKET; b++)
+			n += all[i].cnt[b];
+		if (n == 0){
+			printf("%-24s %12d\n", get_prof_hook_name(i), 0);
+			continue;
+		}
+		u64 v[6] = {all[i].sum / n, get_percentile(all[i], n, 0.5), get_percentile(all[i], n, 0.9), get_percentile(all[i], n, 0.99), get_percentile(all[i], n, 0.999), all[i].max};
+		printf("%-24s %12lu", get_prof_hook_name(i), n);
+		for (int j = 0; j < 6; j++)
+			printf(" %10lu", v[j]);
+		printf("\n");
+		if (ns_per_cycle > 0){
+			printf("%-24s %12s", "  (ns)", "");
+			for (int j = 0; j < 6; j++)
+				printf(" %10.0lf", v[j] * ns_per_cycle);
+			printf("\n");
+		}
+	}
+
+	kmem.unmap_mem();
+	return 0;
+}
@@ -1,22 +1,298 @@
 #include <string>
+#include <chrono>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "records.hpp"
+#include "records_view.hpp"
+#include "record_file.hpp"
+#include "codec.hpp"
+#include "init_base.hpp"
+#include "shared_dict.hpp"
+#include "rec_index.hpp"
+#include "rec_format.hpp"
 
 using namespace std;
 
+static double now_sec(){
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* the section table: how each stream is stored */
+static int print_sections(const char* filename){
+	RecFileReader r;
+	struct stat st;
+	uint64_t raw = 0;
+	char buf[32];
+	if (r.open(filename) || stat(filename, &st))
+		return -1;
+	printf("%-18s %-16s %10s %12s %12s\n", "section", "codec", "n_elem", "raw", "disk");
+	for (const RecSection &s : r.table){
+		printf("%-18s %-16s %10lu %12lu %12lu\n", get_section_name(s.type, buf), get_codec_name(s.codec), s.n_elem, s.n_elem * s.elem_size, s.length);
+		raw += s.n_elem * s.elem_size;
+	}
+	// the file, with its header, section table and alignment
+	printf("total: raw %lu, file %lu (%.2fx)\n", raw, (uint64_t)st.st_size, st.st_size ? (double)raw / st.st_size : 0);
+	return 0;
+}
+
+/* round trip each section through every codec that applies, with its ratio and speed. The codec in use is marked '*' */
+static int codec_check(const char* filename){
+	RecFileReader r;
+	int ret = 0;
+	char buf[32];
+	if (r.open(filename))
+		return -1;
+	printf("%-18s %-16s %12s %12s %8s %10s %10s\n", "section", "codec", "raw", "encoded", "ratio", "enc MB/s", "dec MB/s");
+	for (const RecSection &s : r.table){
+		vector<uint8_t> raw;
+		if (r.read_section(&s, raw)){
+			ret = -1;
+			continue;
+		}
+		if (raw.empty())
+			continue;
+		for (const Codec *c : get_all_codecs()){
+			vector<uint8_t> enc, dec(raw.size());
+			int n_enc = 0, n_dec = 0, err = 0;
+			double t0 = now_sec(), t1, t2;
+			// repeat for at least 10ms, so small sections are timed too
+			do {
+				enc.clear();
+				err = c->encode(s, raw.data(), enc);
+				n_enc++;
+			} while (!err && (t1 = now_sec()) - t0 < 0.01);
+			if (err)
+				continue;
+			do {
+				err = c->decode(s, enc.data(), enc.size(), dec.data());
+				n_dec++;
+			} while (!err && (t2 = now_sec()) - t1 < 0.01);
+			bool ok = !err && (c->check ? c->check(s, raw.data(), dec.data()) : dec == raw);
+			printf("%-18s %c%-15s %12lu %12lu %8.2f %10.1f %10.1f%s\n", get_section_name(s.type, buf), c->id == s.codec ? '*' : ' ', c->name,
+					raw.size(), enc.size(), (double)raw.size() / enc.size(),
+					raw.size() * n_enc / (t1 - t0) / 1e6, ok ? raw.size() * n_dec / (t2 - t1) / 1e6 : 0, ok ? "" : "  ROUND TRIP FAILED");
+			if (!ok)
+				ret = -1;
+		}
+	}
+	return ret;
+}
+
+/*
+ * build the init data baseline of each role from the v2 record files of dir, and add those that are new to its
+ * INIT_BASE_FILE. Records written to dir afterwards store their init data as a delta to them
+ */
+static int build_init_base(const char* dir){
+	map<uint32_t, vector<tcp_sock_init_data> > corpus; // per mode
+	InitBaseSet set;
+	DIR *d = opendir(dir);
+	struct dirent *e;
+	if (d == NULL || set.load(dir)){
+		fprintf(stderr, "Fail to read %s\n", dir);
+		if (d)
+			closedir(d);
+		return -1;
+	}
+	while ((e = readdir(d)) != NULL){
+		RecordsView view;
+		string path = string(dir) + "/" + e->d_name;
+		if (e->d_name[0] == '.' || string(e->d_name) == INIT_BASE_FILE || string(e->d_name) == SHARED_DICT_FILE
+				|| is_rec_index_file(e->d_name) || view.open(path.c_str()))
+			continue;
+		const tcp_sock_init_data *init = view.init_data();
+		if (init)
+			corpus[view.meta->mode].push_back(*init);
+	}
+	closedir(d);
+	printf("%-6s %8s %10s %10s %12s\n", "mode", "records", "baseline", "words", "bytes/record");
+	for (auto &it : corpus){
+		const InitBase &b = set.build(it.first, it.second);
+		uint64_t words = 0;
+		for (const tcp_sock_init_data &x : it.second){
+			vector<uint32_t> delta;
+			init_delta_encode(b.d, x, delta);
+			words += delta.size() - INIT_DELTA_MAP_WORDS;
+		}
+		printf("%-6u %8lu %10.8x %10.1f %12.1f\n", it.first, it.second.size(), b.id, (double)words / it.second.size(),
+				(double)words * 4 / it.second.size() + INIT_DELTA_MAP_WORDS * 4);
+	}
+	return set.save(dir);
+}
+
+// bytes of the best coding of n elems of a stream, against the shared dictionary dict (0 for none)
+static uint64_t coded_size(uint16_t type, uint32_t elem_size, const void *p, uint64_t n, uint32_t dict){
+	RecSection s;
+	vector<uint8_t> out;
+	memset(&s, 0, sizeof(s));
+	s.type = type;
+	s.elem_size = elem_size;
+	s.n_elem = n;
+	s.aux[0] = dict;
+	codec_encode_best(s, (const uint8_t*)p, out);
+	return n ? min((uint64_t)out.size(), n * elem_size) : 0;
+}
+
+/*
+ * train a shared dictionary for each service (mode and port) of at least SHARED_DICT_MIN_FILES v2 record files of
+ * dir, from a sample of up to TRAIN_DICT_SAMPLE of them, and add those that are new to its SHARED_DICT_FILE.
+ * Records written to dir afterwards code their events and sockcalls against them
+ */
+#define TRAIN_DICT_SAMPLE 256
+struct TrainSet{
+	vector<vector<deter_rec_sockcall> > scs;
+	vector<vector<deter_event> > evts;
+};
+static int train_shared_dict(const char* dir){
+	map<pair<uint32_t, uint32_t>, vector<string> > files; // per (mode, port)
+	SharedDictSet set;
+	DIR *d = opendir(dir);
+	struct dirent *e;
+	if (d == NULL || set.load(dir)){
+		fprintf(stderr, "Fail to read %s\n", dir);
+		if (d)
+			closedir(d);
+		return -1;
+	}
+	while ((e = readdir(d)) != NULL){
+		RecordsView view;
+		string path = string(dir) + "/" + e->d_name;
+		if (e->d_name[0] == '.' || string(e->d_name) == INIT_BASE_FILE || string(e->d_name) == SHARED_DICT_FILE
+				|| is_rec_index_file(e->d_name) || view.open(path.c_str()))
+			continue;
+		const RecMeta *m = view.meta;
+		files[make_pair(m->mode, service_port(m->mode, m->sport, m->dport))].push_back(path);
+	}
+	closedir(d);
+
+	vector<pair<uint32_t, TrainSet> > trained; // (id, sample)
+	printf("%-6s %6s %8s %8s %8s %10s\n", "mode", "port", "records", "sc", "phrases", "dict");
+	for (auto &it : files){
+		TrainSet t;
+		vector<string> &v = it.second;
+		if (v.size() < SHARED_DICT_MIN_FILES)
+			continue;
+		sort(v.begin(), v.end());
+		uint64_t n = min((uint64_t)v.size(), (uint64_t)TRAIN_DICT_SAMPLE);
+		for (uint64_t i = 0; i < n; i++){
+			RecordsView view;
+			if (view.open(v[i * v.size() / n].c_str()))
+				continue;
+			Span<deter_rec_sockcall> sc = view.sockcalls();
+			Span<deter_event> ev = view.evts();
+			if (!view.ok())
+				continue;
+			t.scs.push_back(vector<deter_rec_sockcall>(sc.p, sc.p + sc.n));
+			t.evts.push_back(vector<deter_event>(ev.p, ev.p + ev.n));
+		}
+		SharedDict sd;
+		sd.mode = it.first.first;
+		sd.port = it.first.second;
+		sd.train(t.scs, t.evts);
+		const SharedDict &added = set.add(sd);
+		printf("%-6u %6u %8lu %8lu %8lu %10.8x\n", sd.mode, sd.port, v.size(), sd.sc.size(), sd.phrases.size(), added.id);
+		trained.push_back(make_pair(added.id, t));
+	}
+	if (set.save(dir) || load_shared_dicts((string(dir) + "/" + SHARED_DICT_FILE).c_str()))
+		return -1;
+
+	// what the sample would take against the dictionaries, now loaded from dir
+	printf("%-10s %14s %14s %14s %14s\n", "dict", "evt bytes", "with dict", "sc bytes", "with dict");
+	for (auto &it : trained){
+		uint64_t size[4] = {0, 0, 0, 0};
+		for (uint64_t i = 0; i < it.second.evts.size(); i++){
+			const vector<deter_event> &ev = it.second.evts[i];
+			const vector<deter_rec_sockcall> &sc = it.second.scs[i];
+			size[0] += coded_size(REC_SEC_EVT, sizeof(deter_event), ev.data(), ev.size(), 0);
+			size[1] += coded_size(REC_SEC_EVT, sizeof(deter_event), ev.data(), ev.size(), it.first);
+			size[2] += coded_size(REC_SEC_SOCKCALL, sizeof(deter_rec_sockcall), sc.data(), sc.size(), 0);
+			size[3] += coded_size(REC_SEC_SOCKCALL, sizeof(deter_rec_sockcall), sc.data(), sc.size(), it.first);
+		}
+		printf("%-10.8x %14lu %14lu %14lu %14lu\n", it.first, size[0], size[1], size[2], size[3]);
+	}
+	return 0;
+}
+
 void print_usage(){
-	fprintf(stderr, "usage: ./reader <record_file> [<get_meta>]\n");
+	fprintf(stderr, "usage: ./reader <record_file> [get_meta|meta|sections|codec_check]\n");
+	fprintf(stderr, "  get_meta: storage size and metadata\n");
+	fprintf(stderr, "  meta: metadata only, without loading the whole file\n");
+	fprintf(stderr, "  sections: codec and size of each stream in the file\n");
+	fprintf(stderr, "  codec_check: round trip each stream through every codec, with ratio and speed\n");
+	fprintf(stderr, "usage: ./reader <record_file> dump <text|json|csv> [<stream>,...]\n");
+	fprintf(stderr, "  dump: the streams, all by default; csv takes one. init_data is text only. Streams:");
+	for (int i = 0; i < REC_N_STREAM; i++)
+		fprintf(stderr, " %s", rec_stream_name[i]);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "usage: ./reader <journal> recover\n");
+	fprintf(stderr, "  recover: the record of a journal (" REC_JOURNAL_SUFFIX ") left by a recorder that died, up to its last checkpoint\n");
+	fprintf(stderr, "usage: ./reader <dir> [init_base|train_dict]\n");
+	fprintf(stderr, "  init_base: add the init data baselines of the records in dir, for records written there later\n");
+	fprintf(stderr, "  train_dict: add the shared dictionaries of the services in dir, for records written there later\n");
+}
+
+/* the streams of a record file in fmt */
+static int dump(const char *filename, const char *format, const char *streams){
+	RecFormat fmt;
+	uint32_t s = REC_STREAMS_ALL;
+	Records rec;
+	if (parse_rec_format(format, fmt) || (streams && parse_rec_streams(streams, s))){
+		print_usage();
+		return -1;
+	}
+	if (rec.read(filename)){
+		fprintf(stderr, "Fail to read %s\n", filename);
+		return -1;
+	}
+	return rec_print(rec, stdout, fmt, s);
 }
 
 int main(int argc, char **argv){
+	if (argc >= 4 && argc <= 5 && string(argv[2]) == "dump")
+		return dump(argv[1], argv[3], argc == 5 ? argv[4] : NULL);
 	if (argc != 2 && argc != 3){
 		print_usage();
 		return -1;
 	}
+	if (argc == 3 && string(argv[2]) == "sections")
+		return print_sections(argv[1]);
+	if (argc == 3 && string(argv[2]) == "codec_check")
+		return codec_check(argv[1]);
+	if (argc == 3 && string(argv[2]) == "recover")
+		return recover_journal(argv[1]);
+	if (argc == 3 && string(argv[2]) == "init_base")
+		return build_init_base(argv[1]);
+	if (argc == 3 && string(argv[2]) == "train_dict")
+		return train_shared_dict(argv[1]);
+	if (argc == 3 && string(argv[2]) == "meta"){
+		RecordsView view;
+		int ret = view.open(argv[1]);
+		if (ret == 0){
+			if (view.print_meta()){
+				fprintf(stderr, "Fail to read %s\n", argv[1]);
+				return -1;
+			}
+			return 0;
+		}else if (ret != -2){
+			fprintf(stderr, "Fail to read %s\n", argv[1]);
+			return -1;
+		}
+		// v1 file, fall through to Records
+	}
 	Records rec;
-	rec.read(argv[1]);
+	if (rec.read(argv[1])){
+		fprintf(stderr, "Fail to read %s\n", argv[1]);
+		return -1;
+	}
 	string get_meta = "";
 	if (argc == 3){
 		get_meta = argv[2];
+		if (get_meta == "meta"){
+			rec.print_meta();
+			return 0;
+		}
 		if (get_meta != "get_meta"){
 			print_usage();
 			return -1;
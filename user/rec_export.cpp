@@ -0,0 +1,482 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "rec_export.hpp"
+#include "rec_format.hpp"
+#include "records_view.hpp"
+
+using namespace std;
+
+// the columns of the rows of each stream, and those of them that are signed, a bit each
+static const char *export_cols[REC_N_STREAM] = {
+	NULL, // meta, in EXPORT_CONN_FILE
+	NULL, // init_data
+	"conn,i,type,flags,size,timeout,level,optname,thread",
+	"conn,seq,type",
+	"conn,v",
+	"conn,idx_delta,delta",
+	"conn,i,v",
+	"conn,idx_delta,delta",
+	"conn,n",
+	"conn,stamp_us,stamp_jiffies",
+	"conn,v",
+	"conn,i,v",
+	"conn,v",
+	"conn,loc,i,v",
+	"conn,loc,bit",
+};
+static const uint32_t export_signed[REC_N_STREAM] = {
+	0, 0, (1 << 3) | (1 << 5), 0, 0, 0, 0, 1 << 2, 0, 0, 0, 0, 0, 0, 0
+};
+#define EXPORT_CONN_COLS "conn,mode,sip,sport,dip,dport,broken,alert,fin_seq"
+
+// the distinct values of v, sorted, and the index of the value of each row, if there are at most EXPORT_DICT_MAX
+static bool build_dict(const vector<uint64_t> &v, vector<uint64_t> &dict, vector<uint16_t> &code){
+	const int bits = 17; // twice EXPORT_DICT_MAX slots
+	const uint32_t mask = (1u << bits) - 1;
+	vector<uint64_t> key(1u << bits);
+	vector<int32_t> id(1u << bits, -1);
+	vector<uint32_t> slot(v.size());
+	vector<pair<uint64_t, uint32_t> > kv;
+	uint32_t n = 0;
+	for (uint64_t i = 0; i < v.size(); i++){
+		uint32_t h = (v[i] * 0x9e3779b97f4a7c15ull) >> (64 - bits);
+		while (id[h] >= 0 && key[h] != v[i])
+			h = (h + 1) & mask;
+		if (id[h] < 0){
+			if (n == EXPORT_DICT_MAX)
+				return false;
+			key[h] = v[i];
+			id[h] = n++;
+		}
+		slot[i] = h;
+	}
+	for (uint32_t h = 0; h <= mask; h++)
+		if (id[h] >= 0)
+			kv.push_back(make_pair(key[h], h));
+	sort(kv.begin(), kv.end());
+	dict.resize(kv.size());
+	for (uint32_t k = 0; k < kv.size(); k++){
+		dict[k] = kv[k].first;
+		id[kv[k].second] = k;
+	}
+	code.resize(v.size());
+	for (uint64_t i = 0; i < v.size(); i++)
+		code[i] = id[slot[i]];
+	return true;
+}
+
+static void split(const char *s, vector<string> &out){
+	out.clear();
+	for (const char *e; ; s = e + 1){
+		e = strchr(s, ',');
+		out.push_back(e ? string(s, e - s) : string(s));
+		if (e == NULL)
+			break;
+	}
+}
+
+// NUL terminated
+static void put_strings(const vector<string> &v, vector<uint8_t> &buf){
+	buf.clear();
+	for (const string &x : v){
+		buf.insert(buf.end(), x.begin(), x.end());
+		buf.push_back(0);
+	}
+}
+
+static int get_strings(const vector<uint8_t> &buf, vector<string> &v){
+	v.clear();
+	if (buf.size() && buf.back() != 0)
+		return -1;
+	for (uint64_t i = 0, j; i < buf.size(); i = j + 1){
+		for (j = i; buf[j]; j++);
+		v.push_back(string((const char*)&buf[i], j - i));
+	}
+	return 0;
+}
+
+int ExportWriter::open(const string &_path, const char *_cols, uint32_t _signed_cols){
+	path = _path;
+	signed_cols = _signed_cols;
+	split(_cols, cols);
+	col.assign(cols.size(), vector<uint64_t>());
+	n_row.clear();
+	if (w.open((path + ".tmp").c_str())){
+		fprintf(stderr, "Fail to write %s\n", path.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+int ExportWriter::write_block(){
+	uint32_t b = n_row.size();
+	vector<uint64_t> dict;
+	vector<uint16_t> code;
+	vector<uint8_t> code8;
+	for (uint32_t c = 0; c < col.size(); c++){
+		int err;
+		if (!build_dict(col[c], dict, code))
+			err = w.add_vector(REC_SEC_EXPORT_COL, col[c], c, b);
+		else if (dict.size() <= 256){
+			code8.assign(code.begin(), code.end());
+			err = w.add_vector(REC_SEC_EXPORT_DICT, dict, c, b) || w.add_vector(REC_SEC_EXPORT_COL, code8, c, b);
+		}else
+			err = w.add_vector(REC_SEC_EXPORT_DICT, dict, c, b) || w.add_vector(REC_SEC_EXPORT_COL, code, c, b);
+		if (err){
+			fprintf(stderr, "Fail to write %s\n", path.c_str());
+			return -1;
+		}
+	}
+	n_row.push_back(col[0].size());
+	for (vector<uint64_t> &v : col)
+		v.clear();
+	return 0;
+}
+
+uint64_t ExportWriter::rows() const{
+	uint64_t n = col[0].size();
+	for (uint64_t x : n_row)
+		n += x;
+	return n;
+}
+
+int ExportWriter::close(const vector<string> *files){
+	vector<uint8_t> buf;
+	string tmp = path + ".tmp";
+	if (col[0].size() && write_block())
+		goto fail;
+	put_strings(cols, buf);
+	if (w.add_vector(REC_SEC_EXPORT_NAMES, buf, 0, signed_cols))
+		goto fail;
+	if (files){
+		put_strings(*files, buf);
+		if (w.add_vector(REC_SEC_EXPORT_NAMES, buf, 1))
+			goto fail;
+	}
+	if (w.add_vector(REC_SEC_EXPORT_BLOCK, n_row, cols.size()) || w.close() || rename(tmp.c_str(), path.c_str()))
+		goto fail;
+	return 0;
+fail:
+	fprintf(stderr, "Fail to write %s\n", path.c_str());
+	remove(tmp.c_str());
+	return -1;
+}
+
+int ExportFile::open(const string &path){
+	vector<uint8_t> buf;
+	const RecSection *names = NULL, *blocks;
+	if (r.open(path.c_str()))
+		goto fail;
+	for (const RecSection &x : r.table)
+		if (x.type == REC_SEC_EXPORT_NAMES && x.aux[0] == 0)
+			names = &x;
+	blocks = r.find(REC_SEC_EXPORT_BLOCK);
+	if (names == NULL || blocks == NULL || r.read_section(names, buf) || get_strings(buf, cols)
+			|| r.read_vector(REC_SEC_EXPORT_BLOCK, n_row) || blocks->aux[0] != cols.size() || cols.empty())
+		goto fail;
+	signed_cols = names->aux[1];
+	sec.assign(n_row.size(), vector<const RecSection*>(cols.size(), (const RecSection*)NULL));
+	dict = sec;
+	for (const RecSection &x : r.table){
+		if (x.type != REC_SEC_EXPORT_COL && x.type != REC_SEC_EXPORT_DICT)
+			continue;
+		if (x.aux[0] >= cols.size() || x.aux[1] >= n_row.size())
+			goto fail;
+		(x.type == REC_SEC_EXPORT_COL ? sec : dict)[x.aux[1]][x.aux[0]] = &x;
+	}
+	for (uint64_t b = 0; b < n_row.size(); b++)
+		for (uint64_t c = 0; c < cols.size(); c++){
+			const RecSection *x = sec[b][c], *d = dict[b][c];
+			// values, or indexes of 1 or 2 bytes into a dictionary
+			if (x == NULL || x->n_elem != n_row[b] || (x->elem_size == 8) != (d == NULL)
+					|| (x->elem_size != 8 && x->elem_size != 1 && x->elem_size != 2) || (d && d->elem_size != 8))
+				goto fail;
+		}
+	return 0;
+fail:
+	fprintf(stderr, "Fail to read %s\n", path.c_str());
+	return -1;
+}
+
+int ExportFile::find(const string &name) const{
+	for (uint64_t c = 0; c < cols.size(); c++)
+		if (cols[c] == name)
+			return c;
+	return -1;
+}
+
+int ExportFile::read_column(uint64_t b, int c, ExportColumn &x){
+	const RecSection *s = sec[b][c], *d = dict[b][c];
+	vector<uint8_t> buf;
+	x.code.clear();
+	if (r.read_section(d ? d : s, buf))
+		return -1;
+	x.v.resize(buf.size() / sizeof(uint64_t));
+	memcpy(x.v.data(), buf.data(), buf.size());
+	if (d == NULL)
+		return 0;
+	if (r.read_section(s, buf))
+		return -1;
+	if (s->elem_size == 1)
+		x.code.assign(buf.begin(), buf.end());
+	else {
+		x.code.resize(s->n_elem);
+		memcpy(x.code.data(), buf.data(), buf.size());
+	}
+	// indexes past the dictionary would be read out of bounds
+	for (uint16_t k : x.code)
+		if (k >= x.v.size())
+			return -1;
+	return 0;
+}
+
+int ExportFile::read_files(vector<string> &files){
+	vector<uint8_t> buf;
+	for (const RecSection &x : r.table)
+		if (x.type == REC_SEC_EXPORT_NAMES && x.aux[0] == 1)
+			return r.read_section(&x, buf) || get_strings(buf, files) ? -1 : 0;
+	return -1;
+}
+
+int list_export_files(const char *out, const char *stream, vector<string> &paths){
+	DIR *d = opendir(out);
+	struct dirent *e;
+	string prefix = string(stream) + ".";
+	if (d == NULL){
+		fprintf(stderr, "Fail to read %s\n", out);
+		return -1;
+	}
+	paths.clear();
+	while ((e = readdir(d)) != NULL){
+		string name = e->d_name;
+		if (name == stream || (name.compare(0, prefix.size(), prefix) == 0 && name.size() > prefix.size()
+				&& name.find_first_not_of("0123456789", prefix.size()) == string::npos))
+			paths.push_back(string(out) + "/" + name);
+	}
+	closedir(d);
+	sort(paths.begin(), paths.end());
+	return 0;
+}
+
+// the rows of a bit array, with loc first if it is not -1
+static int export_bits(ExportWriter &w, uint64_t conn, const BitWords &b, int loc){
+	uint64_t row[4] = {conn, (uint64_t)loc};
+	uint64_t *x = loc >= 0 ? row + 2 : row + 1;
+	for (uint64_t i = 0; i < b.n; i++){
+		x[0] = i;
+		x[1] = b.get(i);
+		if (w.push(row))
+			return -1;
+	}
+	return 0;
+}
+
+/* the rows of the stream s of the connection conn, as the columns of export_cols[s] */
+static int export_stream(ExportWriter &w, int s, uint64_t conn, const RecordsSource &src){
+	uint64_t row[9] = {conn};
+	BitWords b;
+	switch (s){
+		case REC_STREAM_SOCKCALLS:{
+			Span<deter_rec_sockcall> sc = src.sockcalls();
+			for (uint64_t i = 0; i < sc.size(); i++){
+				const deter_rec_sockcall &x = sc[i];
+				// sendmsg, recvmsg and splice_read have the same layout
+				bool sized = x.type == DETER_SOCKCALL_TYPE_SENDMSG || x.type == DETER_SOCKCALL_TYPE_RECVMSG
+					|| x.type == DETER_SOCKCALL_TYPE_SPLICE_READ;
+				row[1] = i;
+				row[2] = x.type;
+				row[3] = sized ? (int64_t)x.sendmsg.flags : 0;
+				row[4] = sized ? x.sendmsg.size : 0;
+				row[5] = x.type == DETER_SOCKCALL_TYPE_CLOSE ? (int64_t)x.close.timeout : 0;
+				row[6] = x.type == DETER_SOCKCALL_TYPE_SETSOCKOPT ? x.setsockopt.level : 0;
+				row[7] = x.type == DETER_SOCKCALL_TYPE_SETSOCKOPT ? x.setsockopt.optname : 0;
+				row[8] = x.thread_id;
+				if (w.push(row))
+					return -1;
+			}
+			return 0;
+		}
+		case REC_STREAM_EVTS:
+			for (const deter_event &e : src.evts()){
+				row[1] = e.seq;
+				row[2] = e.type;
+				if (w.push(row))
+					return -1;
+			}
+			return 0;
+		case REC_STREAM_PS:
+			for (uint16_t v : src.ps()){
+				row[1] = v;
+				if (w.push(row))
+					return -1;
+			}
+			return 0;
+		case REC_STREAM_JIFFIES:{
+			Span<jiffies_rec> j = src.jiffies();
+			for (uint64_t i = 0; i < j.size(); i++){
+				row[1] = i ? j[i].idx_delta : 0;
+				row[2] = i ? j[i].jiffies_delta : j[i].init_jiffies;
+				if (w.push(row))
+					return -1;
+			}
+			return 0;
+		}
+		case REC_STREAM_MA:{
+			Span<memory_allocated_rec> m = src.memory_allocated();
+			for (uint64_t i = 0; i < m.size(); i++){
+				row[1] = i ? m[i].idx_delta : 0;
+				row[2] = i ? (int64_t)m[i].v_delta : (int64_t)m[i].init_v;
+				if (w.push(row))
+					return -1;
+			}
+			return 0;
+		}
+		case REC_STREAM_N_SOCKETS_ALLOCATED:
+			row[1] = src.meta.n_sockets_allocated;
+			return w.push(row);
+		case REC_STREAM_MSTAMP:
+			for (const skb_mstamp &m : src.mstamp()){
+				row[1] = m.stamp_us;
+				row[2] = m.stamp_jiffies;
+				if (w.push(row))
+					return -1;
+			}
+			return 0;
+		case REC_STREAM_SIQQ:
+			for (uint8_t v : src.siqq()){
+				row[1] = v;
+				if (w.push(row))
+					return -1;
+			}
+			return 0;
+		case REC_STREAM_TSQ:
+			for (uint32_t v : src.tsq()){
+				row[1] = v;
+				if (w.push(row))
+					return -1;
+			}
+			return 0;
+		case REC_STREAM_EBX:
+			for (uint8_t x : src.ebx()){
+				row[1] = get_ebx_loc(x);
+				row[2] = get_ebx_bit(x);
+				if (w.push(row))
+					return -1;
+			}
+			return 0;
+		case REC_STREAM_MPQ:
+		case REC_STREAM_SIQ:
+			// a malformed array has no rows; the file is counted as corrupt
+			if (src.bits(s == REC_STREAM_MPQ ? REC_SEC_MPQ : REC_SEC_SIQ, b))
+				return 0;
+			return export_bits(w, conn, b, -1);
+		case REC_STREAM_EBQ:
+			for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+				if (src.bits(REC_SEC_EBQ(i), b) == 0 && export_bits(w, conn, b, i))
+					return -1;
+			return 0;
+	}
+	return 0;
+}
+
+// the number of entries of dir other than . and .., -1 if it can't be read
+static int64_t dir_entries(const char *dir){
+	DIR *d = opendir(dir);
+	struct dirent *e;
+	int64_t n = 0;
+	if (d == NULL)
+		return -1;
+	while ((e = readdir(d)) != NULL)
+		n += strcmp(e->d_name, ".") && strcmp(e->d_name, "..");
+	closedir(d);
+	return n;
+}
+
+int rec_export(const vector<string> &files, uint32_t streams, const char *out, int n_thread){
+	vector<RecMeta> meta(files.size());
+	vector<uint8_t> state(files.size()); // 0 not read, 1 exported, 2 exported but with corrupt sections
+	vector<uint64_t> rows(REC_N_STREAM);
+	vector<vector<uint64_t> > part_rows(n_thread, vector<uint64_t>(REC_N_STREAM));
+	vector<string> names;
+	atomic<uint64_t> next(0);
+	atomic<int> err(0);
+	vector<thread> th;
+	ExportWriter conn;
+	uint64_t n_fail = 0, n_corrupt = 0;
+
+	streams &= REC_STREAMS_DATA; // the metadata of each file is in the conn file, and init data is a struct, not rows
+	if (streams == 0){
+		fprintf(stderr, "No stream to export\n");
+		return -1;
+	}
+	if ((mkdir(out, 0755) && errno != EEXIST) || dir_entries(out) != 0){
+		fprintf(stderr, "%s must be a new or empty directory\n", out);
+		return -1;
+	}
+	for (int k = 0; k < n_thread; k++)
+		th.push_back(thread([&, k](){
+			ExportWriter w[REC_N_STREAM]; // opened on the first file the thread reads
+			for (uint64_t j; (j = next++) < files.size() && !err;){
+				RecordsSource src;
+				if (src.open(files[j].c_str()))
+					continue;
+				meta[j] = src.meta;
+				for (int s = 0; s < REC_N_STREAM; s++){
+					if (!(streams >> s & 1))
+						continue;
+					if (w[s].cols.empty() && w[s].open(string(out) + "/" + rec_stream_name[s] + "." + to_string(k), export_cols[s], export_signed[s]))
+						err = 1;
+					else if (export_stream(w[s], s, j, src))
+						err = 1;
+				}
+				state[j] = src.ok() ? 1 : 2;
+			}
+			for (int s = 0; s < REC_N_STREAM; s++)
+				if (!w[s].cols.empty()){
+					part_rows[k][s] = w[s].rows();
+					if (w[s].close())
+						err = 1;
+				}
+		}));
+	for (thread &t : th)
+		t.join();
+	if (err)
+		return -1;
+	for (int k = 0; k < n_thread; k++)
+		for (int s = 0; s < REC_N_STREAM; s++)
+			rows[s] += part_rows[k][s];
+
+	if (conn.open(string(out) + "/" + EXPORT_CONN_FILE, EXPORT_CONN_COLS))
+		return -1;
+	for (uint64_t j = 0; j < files.size(); j++){
+		const RecMeta &m = meta[j];
+		uint64_t row[9] = {j, m.mode, m.sip, m.sport, m.dip, m.dport, m.broken, m.alert, m.fin_seq};
+		if (state[j] == 0){
+			fprintf(stderr, "Fail to read %s\n", files[j].c_str());
+			n_fail++;
+			continue;
+		}
+		if (state[j] == 2){
+			fprintf(stderr, "%s: corrupt sections left out\n", files[j].c_str());
+			n_corrupt++;
+		}
+		if (conn.push(row))
+			return -1;
+		names.push_back(files[j]);
+	}
+	rows[REC_STREAM_META] = names.size();
+	if (conn.close(&names))
+		return -1;
+	printf("%lu files exported, %lu failed, %lu with corrupt sections\n", names.size(), n_fail, n_corrupt);
+	for (int s = 0; s < REC_N_STREAM; s++)
+		if (s == REC_STREAM_META || (streams >> s & 1))
+			printf("%s: %lu rows\n", s == REC_STREAM_META ? EXPORT_CONN_FILE : rec_stream_name[s], rows[s]);
+	return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef _REC_EXPORT_HPP
+#define _REC_EXPORT_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "record_file.hpp"
+
+/*
+ * Export of the streams of a corpus by column, for analytics: a row per element of a stream, as in the JSON of
+ * `reader <file> dump`, with the connection (conn) it is of, in columns of uint64 values. An export is a directory:
+ *   - EXPORT_CONN_FILE: a row per record file, conn, mode, sip, sport, dip, dport, broken, alert, and its name
+ *   - <stream>.<part>: the rows of a stream, a part per thread that wrote them, ordered by conn within a part
+ * Each is a record file whose rows are in blocks of EXPORT_BLOCK_ROWS:
+ *   - a section per column and block (REC_SEC_EXPORT_COL). A column of at most EXPORT_DICT_MAX distinct values in a
+ *     block is dictionary coded: its values, sorted, are in REC_SEC_EXPORT_DICT, and it holds the index of the value
+ *     of each row, in 1 or 2 bytes; otherwise it holds the values. Either is stored with the smallest codec
+ *   - the rows of each block (REC_SEC_EXPORT_BLOCK), and the names of the columns (REC_SEC_EXPORT_NAMES)
+ * so that a scan decodes only the columns it needs, and can aggregate by the indexes of a dictionary coded column.
+ */
+#define EXPORT_CONN_FILE "conn"
+#define EXPORT_BLOCK_ROWS (1 << 20)
+#define EXPORT_DICT_MAX 65536
+
+/* a file of an export, written a block at a time */
+class ExportWriter{
+public:
+	std::vector<std::string> cols;
+
+	int open(const std::string &path, const char *cols, uint32_t signed_cols = 0); // cols comma separated
+	// add a row of a value per column
+	int push(const uint64_t *row){
+		for (uint64_t c = 0; c < col.size(); c++)
+			col[c].push_back(row[c]);
+		return col[0].size() == EXPORT_BLOCK_ROWS ? write_block() : 0;
+	}
+	uint64_t rows() const;
+	int close(const std::vector<std::string> *files = NULL); // with the files of the conn file
+private:
+	RecFileWriter w;
+	std::string path;
+	uint32_t signed_cols;
+	std::vector<std::vector<uint64_t> > col; // of the block being filled
+	std::vector<uint64_t> n_row;
+	int write_block();
+};
+
+/* a column of a block as read */
+struct ExportColumn{
+	std::vector<uint64_t> v; // the values, or if dictionary coded, those of the dictionary
+	std::vector<uint16_t> code; // if dictionary coded, the index of the value of each row
+
+	bool coded() const { return !code.empty(); }
+	uint64_t size() const { return coded() ? code.size() : v.size(); }
+	uint64_t operator[](uint64_t i) const { return coded() ? v[code[i]] : v[i]; }
+};
+
+/* a file of an export, opened to scan its blocks */
+struct ExportFile{
+	RecFileReader r;
+	std::vector<std::string> cols;
+	uint32_t signed_cols;
+	std::vector<uint64_t> n_row; // of each block
+
+	int open(const std::string &path);
+	int find(const std::string &name) const; // the column, -1 if none
+	int read_column(uint64_t b, int c, ExportColumn &x);
+	bool coded(uint64_t b, int c) const { return dict[b][c] != NULL; }
+	uint64_t bytes(uint64_t b, int c) const { return sec[b][c]->length + (dict[b][c] ? dict[b][c]->length : 0); } // on disk
+	int read_files(std::vector<std::string> &files); // of the conn file
+private:
+	std::vector<std::vector<const RecSection*> > sec, dict; // by block, then column
+};
+
+/*
+ * export the streams (a bit each, RecStream) of files to the directory out, which must be empty or new, by n_thread
+ * threads. The connection of a file is its index in files
+ */
+int rec_export(const std::vector<std::string> &files, uint32_t streams, const char *out, int n_thread);
+/* the files of stream in the export out, or of its conn file if stream is EXPORT_CONN_FILE */
+int list_export_files(const char *out, const char *stream, std::vector<std::string> &paths);
+
+#endif /* _REC_EXPORT_HPP */
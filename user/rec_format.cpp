@@ -0,0 +1,545 @@
+#include "rec_format.hpp"
+
+using namespace std;
+
+const char *rec_stream_name[REC_N_STREAM] = {
+	"meta", "init_data", "sockcalls", "evts", "ps", "jiffies", "mpq", "memory_allocated", "n_sockets_allocated",
+	"mstamp", "siqq", "siq", "tsq", "ebq", "ebx"
+};
+
+// the columns of each stream in JSON and CSV
+static const char *rec_stream_cols[REC_N_STREAM] = {
+	"mode,broken,alert,sip,sport,dip,dport,fin_seq,eb_dense,bytes_sent,bytes_received,pkt_received",
+	"",
+	"i,type,flags,size,timeout,level,optname,optval,thread",
+	"seq,type",
+	"v",
+	"idx_delta,delta",
+	"i,v",
+	"idx_delta,delta",
+	"n",
+	"stamp_us,stamp_jiffies",
+	"v",
+	"i,v",
+	"v",
+	"loc,i,v",
+	"loc,bit",
+};
+
+int parse_rec_streams(const char *s, uint32_t &streams){
+	streams = 0;
+	while (*s){
+		const char *e = strchr(s, ',');
+		uint64_t n = e ? e - s : strlen(s);
+		int k;
+		if (n == 3 && strncmp(s, "all", 3) == 0)
+			streams = REC_STREAMS_ALL;
+		else {
+			for (k = 0; k < REC_N_STREAM && (strlen(rec_stream_name[k]) != n || strncmp(s, rec_stream_name[k], n)); k++);
+			if (k == REC_N_STREAM)
+				return -1;
+			streams |= 1u << k;
+		}
+		s += n + (e != NULL);
+	}
+	return streams ? 0 : -1;
+}
+
+int parse_rec_format(const char *s, RecFormat &fmt){
+	if (strcmp(s, "text") == 0)
+		fmt = REC_FMT_TEXT;
+	else if (strcmp(s, "json") == 0)
+		fmt = REC_FMT_JSON;
+	else if (strcmp(s, "csv") == 0)
+		fmt = REC_FMT_CSV;
+	else
+		return -1;
+	return 0;
+}
+
+static const char* sockcall_name(uint8_t type){
+	switch (type){
+		case DETER_SOCKCALL_TYPE_SENDMSG:
+			return "sendmsg";
+		case DETER_SOCKCALL_TYPE_RECVMSG:
+			return "recvmsg";
+		case DETER_SOCKCALL_TYPE_CLOSE:
+			return "close";
+		case DETER_SOCKCALL_TYPE_SPLICE_READ:
+			return "splice_read";
+		case DETER_SOCKCALL_TYPE_SETSOCKOPT:
+			return "setsockopt";
+	}
+	return NULL;
+}
+
+class RecPrinter{
+public:
+	RecPrinter(Records &_r, FILE *_fout, RecFormat _fmt) : r(_r), fout(_fout), o(_fout), fmt(_fmt) {}
+	void print(int stream);
+private:
+	Records &r;
+	FILE *fout;
+	OutBuf o;
+	RecFormat fmt;
+	int stream; // being printed
+	int col; // of the row being printed
+
+	// a row of stream in JSON or CSV: begin(), a value or none() for each column in order, then end()
+	void begin(){
+		if (fmt == REC_FMT_JSON)
+			o.str("{\"stream\":\"").str(rec_stream_name[stream]).chr('"');
+		col = 0;
+	}
+	void key(const char *k){
+		if (fmt == REC_FMT_JSON)
+			o.str(",\"").str(k).str("\":");
+		else if (col++)
+			o.chr(',');
+	}
+	void none(){
+		if (fmt == REC_FMT_CSV && col++)
+			o.chr(',');
+	}
+	void num(const char *k, uint64_t v){
+		key(k);
+		o.u(v);
+	}
+	void snum(const char *k, int64_t v){
+		key(k);
+		o.i(v);
+	}
+	void text(const char *k, const char *v){
+		key(k);
+		if (fmt == REC_FMT_JSON)
+			o.chr('"').str(v).chr('"');
+		else
+			o.str(v);
+	}
+	void end(){
+		if (fmt == REC_FMT_JSON)
+			o.chr('}');
+		o.chr('\n');
+	}
+	void event_name(uint32_t type);
+	void bit_rows(const BitArray &b, int loc);
+	void text_words(const BitArray &b);
+	void meta();
+	void sockcalls();
+	void evts();
+	void ps();
+	void jiffies();
+	void mpq();
+	void memory_allocated();
+	void mstamp();
+	void siqq();
+	void siq();
+	void tsq();
+	void ebq();
+	void ebx();
+};
+
+// as get_event_name
+void RecPrinter::event_name(uint32_t type){
+	switch (type){
+		case EVENT_TYPE_PACKET:
+			o.str("pkt");
+			break;
+		case EVENT_TYPE_TASKLET:
+			o.str("tasklet");
+			break;
+		case EVENT_TYPE_WRITE_TIMEOUT:
+			o.str("write_timeout");
+			break;
+		case EVENT_TYPE_DELACK_TIMEOUT:
+			o.str("delack_timeout");
+			break;
+		case EVENT_TYPE_KEEPALIVE_TIMEOUT:
+			o.str("keepalive_timeout");
+			break;
+		case EVENT_TYPE_FINISH:
+			o.str("finish");
+			break;
+		default:
+			uint32_t idx = (type - DETER_SOCK_ID_BASE) & 0x0fffffff, loc = (type - DETER_SOCK_ID_BASE) >> 28;
+			o.str("sockcall ").u(idx).str(" (").u(loc >> 1).chr(' ').u(loc & 1).chr(')');
+	}
+}
+
+// a row per bit read, with the location of an effect_bool, or loc -1
+void RecPrinter::bit_rows(const BitArray &b, int loc){
+	BitArray x = b;
+	if (x.format != BitArray::RAW){
+		// the indexes back to bits
+		vector<uint32_t> w((x.n + 31) / 32, x.format == BitArray::INDEX_ONE ? 0 : ~0u);
+		for (uint32_t k : x.v)
+			if (k < x.n)
+				w[k >> 5] ^= 1u << (k & 31);
+		x.v = w;
+	}
+	for (uint64_t i = 0; i < x.n && i / 32 < x.v.size(); i++){
+		begin();
+		if (loc >= 0)
+			num("loc", loc);
+		num("i", i);
+		num("v", (x.v[i >> 5] >> (i & 31)) & 1);
+		end();
+	}
+}
+
+// 32 bits of each word a line, as Records::print
+void RecPrinter::text_words(const BitArray &b){
+	for (uint64_t i = 0; i < b.v.size(); i++)
+		o.bits(b.v[i]).chr('\n');
+}
+
+void RecPrinter::meta(){
+	if (fmt == REC_FMT_TEXT){
+		o.flush();
+		r.print_meta(fout);
+		return;
+	}
+	begin();
+	num("mode", r.mode);
+	num("broken", r.broken);
+	num("alert", r.alert);
+	num("sip", r.sip);
+	num("sport", r.sport);
+	num("dip", r.dip);
+	num("dport", r.dport);
+	num("fin_seq", r.fin_seq);
+	num("eb_dense", r.eb_dense);
+	num("bytes_sent", r.get_total_bytes_sent());
+	num("bytes_received", r.get_total_bytes_received());
+	num("pkt_received", r.get_pkt_received());
+	end();
+}
+
+void RecPrinter::sockcalls(){
+	if (fmt == REC_FMT_TEXT)
+		o.u(r.sockcalls.size()).str(" sockcalls\n");
+	for (uint64_t i = 0; i < r.sockcalls.size(); i++){
+		deter_rec_sockcall &sc = r.sockcalls[i];
+		const char *name = sockcall_name(sc.type);
+		if (fmt == REC_FMT_TEXT){
+			o.u(i).chr(' ');
+			if (sc.type == DETER_SOCKCALL_TYPE_SETSOCKOPT && !valid_rec_setsockopt(&sc.setsockopt))
+				o.str("Error: unsupported setsockopt\n");
+			else if (sc.type == DETER_SOCKCALL_TYPE_SETSOCKOPT){
+				o.str("setsockopt: ").u(sc.setsockopt.level).chr(' ').u(sc.setsockopt.optname).chr(' ').u(sc.setsockopt.optlen).chr(' ');
+				for (int j = 0; j < min((int)sc.setsockopt.optlen, 12); j++)
+					o.chr(' ').x(sc.setsockopt.optval[j]);
+				o.str(" thread ").u(sc.thread_id);
+			}else if (sc.type == DETER_SOCKCALL_TYPE_CLOSE)
+				o.str("close: ").i(sc.close.timeout).str(" thread ").u(sc.thread_id);
+			else if (name)
+				// sendmsg, recvmsg and splice_read have the same layout
+				o.str(name).str(": 0x").x((uint32_t)sc.sendmsg.flags).chr(' ').u(sc.sendmsg.size).str(" thread ").u(sc.thread_id);
+			o.chr('\n');
+			continue;
+		}
+		begin();
+		num("i", i);
+		if (name)
+			text("type", name);
+		else
+			num("type", sc.type);
+		if (sc.type == DETER_SOCKCALL_TYPE_SENDMSG || sc.type == DETER_SOCKCALL_TYPE_RECVMSG
+				|| sc.type == DETER_SOCKCALL_TYPE_SPLICE_READ){
+			snum("flags", sc.sendmsg.flags);
+			num("size", sc.sendmsg.size);
+		}else {
+			none();
+			none();
+		}
+		if (sc.type == DETER_SOCKCALL_TYPE_CLOSE)
+			snum("timeout", sc.close.timeout);
+		else
+			none();
+		if (sc.type == DETER_SOCKCALL_TYPE_SETSOCKOPT){
+			num("level", sc.setsockopt.level);
+			num("optname", sc.setsockopt.optname);
+			key("optval");
+			// in hex, a byte per two digits
+			if (fmt == REC_FMT_JSON)
+				o.chr('"');
+			for (int j = 0; j < min((int)sc.setsockopt.optlen, 12); j++)
+				o.x(sc.setsockopt.optval[j], 2);
+			if (fmt == REC_FMT_JSON)
+				o.chr('"');
+		}else {
+			none();
+			none();
+			none();
+		}
+		num("thread", sc.thread_id);
+		end();
+	}
+}
+
+void RecPrinter::evts(){
+	if (fmt != REC_FMT_TEXT){
+		for (deter_event &e : r.evts){
+			begin();
+			num("seq", e.seq);
+			num("type", e.type);
+			end();
+		}
+		return;
+	}
+	o.u(r.evts.size()).str(" events\n");
+	for (deter_event &e : r.evts){
+		o.u(e.seq).chr(' ');
+		event_name(e.type);
+		if (e.type >= DETER_SOCK_ID_BASE && get_sockcall_idx(e.type) < r.sockcalls.size()){
+			uint8_t type = r.sockcalls[get_sockcall_idx(e.type)].type;
+			const char *name = sockcall_name(type);
+			o.chr(' ');
+			if (name)
+				o.str(name);
+			else
+				o.str("unknown sockcall type ").u(type);
+		}
+		o.chr('\n');
+	}
+}
+
+void RecPrinter::ps(){
+	if (fmt != REC_FMT_TEXT){
+		for (uint16_t v : r.ps){
+			begin();
+			num("v", v);
+			end();
+		}
+		return;
+	}
+	o.u(r.ps.size()).str(" pkt_stream\n");
+	for (uint64_t i = 0; i < r.ps.size(); i++){
+		if (r.ps[i] >> 15){
+			if (r.ps[i] == 0xffff){
+				if (++i == r.ps.size())
+					break;
+				o.i((int16_t)r.ps[i]).chr('\n');
+			}
+			if ((r.ps[i] >> 14) & 1)
+				o.chr('-').u(r.ps[i] & 0x3fff).chr('\n');
+			else
+				o.u(r.ps[i] & 0x3fff).chr('\n');
+		}else
+			o.str("1:").u(r.ps[i]).chr('\n');
+	}
+}
+
+void RecPrinter::jiffies(){
+	if (fmt != REC_FMT_TEXT){
+		for (uint64_t i = 0; i < r.jiffies.size(); i++){
+			begin();
+			num("idx_delta", i ? r.jiffies[i].idx_delta : 0);
+			num("delta", i ? r.jiffies[i].jiffies_delta : r.jiffies[i].init_jiffies);
+			end();
+		}
+		return;
+	}
+	o.u(r.jiffies.size()).str(" new jiffies\n");
+	if (r.jiffies.size() > 0){
+		o.str("first: ").u(r.jiffies[0].init_jiffies).chr('\n');
+		for (uint64_t i = 1; i < r.jiffies.size(); i++)
+			o.u(r.jiffies[i].idx_delta).chr(' ').u(r.jiffies[i].jiffies_delta).chr('\n');
+	}
+}
+
+void RecPrinter::mpq(){
+	BitArray &b = r.mpq;
+	if (fmt != REC_FMT_TEXT){
+		bit_rows(b, -1);
+		return;
+	}
+	// as BitArray::print
+	o.str("memory_pressure:\n");
+	if (b.format == BitArray::RAW){
+		o.u(b.n).str(" reads\n");
+		for (uint32_t i = 0, ib = 0; ib < b.n && i < b.v.size(); i++, ib += 32)
+			o.bits(b.v[i], min(b.n - ib, 32u)).chr('\n');
+	}else if (b.format == BitArray::INDEX_ONE || b.format == BitArray::INDEX_ZERO){
+		o.u(b.n).str(" reads, ").u(b.v.size()).str(" '").u(b.format == BitArray::INDEX_ONE).str("' indexes:\n");
+		for (uint32_t k : b.v)
+			o.u(k).chr('\n');
+	}
+}
+
+void RecPrinter::memory_allocated(){
+	if (fmt != REC_FMT_TEXT){
+		for (uint64_t i = 0; i < r.memory_allocated.size(); i++){
+			begin();
+			num("idx_delta", i ? r.memory_allocated[i].idx_delta : 0);
+			snum("delta", i ? r.memory_allocated[i].v_delta : r.memory_allocated[i].init_v);
+			end();
+		}
+		return;
+	}
+	o.u(r.memory_allocated.size()).str(" new values of reading memory_allocated\n");
+	if (r.memory_allocated.size() > 0){
+		o.str("first: ").u(r.memory_allocated[0].init_v).chr('\n');
+		for (uint64_t i = 1; i < r.memory_allocated.size(); i++)
+			o.u(r.memory_allocated[i].idx_delta).chr(' ').i(r.memory_allocated[i].v_delta).chr('\n');
+	}
+}
+
+void RecPrinter::mstamp(){
+	if (fmt == REC_FMT_TEXT)
+		o.u(r.mstamp.size()).str(" skb_mstamp_get:\n");
+	for (skb_mstamp &m : r.mstamp){
+		if (fmt == REC_FMT_TEXT){
+			o.u(m.stamp_us).chr(' ').u(m.stamp_jiffies).chr('\n');
+			continue;
+		}
+		begin();
+		num("stamp_us", m.stamp_us);
+		num("stamp_jiffies", m.stamp_jiffies);
+		end();
+	}
+}
+
+void RecPrinter::siqq(){
+	if (fmt == REC_FMT_TEXT)
+		o.u(r.siqq.size()).str(" skb_still_in_host_queue:\n");
+	for (uint8_t v : r.siqq){
+		if (fmt == REC_FMT_TEXT){
+			o.u(v).chr('\n');
+			continue;
+		}
+		begin();
+		num("v", v);
+		end();
+	}
+}
+
+void RecPrinter::siq(){
+	if (fmt != REC_FMT_TEXT){
+		bit_rows(r.siq, -1);
+		return;
+	}
+	o.str("siq: ").u(r.siq.n).str(" reads ").u(r.siq.v.size()).chr('\n');
+	text_words(r.siq);
+}
+
+void RecPrinter::tsq(){
+	#if COLLECT_TX_STAMP
+	if (fmt == REC_FMT_TEXT)
+		o.u(r.tsq.size()).str(" tsq:\n");
+	for (uint64_t i = 0; i < r.tsq.size(); i++){
+		if (fmt == REC_FMT_TEXT){
+			o.u(r.tsq[i]).chr(' ').u((r.tsq[i] - (i ? r.tsq[i - 1] : 0)) / 1000).chr('\n');
+			continue;
+		}
+		begin();
+		num("v", r.tsq[i]);
+		end();
+	}
+	#endif
+}
+
+void RecPrinter::ebq(){
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++){
+		BitArray &eb = r.ebq[i];
+		if (fmt != REC_FMT_TEXT){
+			bit_rows(eb, i);
+			continue;
+		}
+		o.str("effect_bool ").u(i).str(": ").u(eb.n).str(" reads ").u(eb.v.size()).chr('\n');
+		text_words(eb);
+	}
+}
+
+void RecPrinter::ebx(){
+	if (fmt == REC_FMT_TEXT)
+		o.str("effect_bool mux (dense 0x").x(r.eb_dense, 5).str("): ").u(r.ebx.size()).str(" reads\n");
+	for (uint8_t x : r.ebx){
+		if (fmt == REC_FMT_TEXT){
+			o.u(get_ebx_loc(x)).chr(':').u(get_ebx_bit(x)).chr('\n');
+			continue;
+		}
+		begin();
+		num("loc", get_ebx_loc(x));
+		num("bit", get_ebx_bit(x));
+		end();
+	}
+}
+
+void RecPrinter::print(int s){
+	stream = s;
+	if (fmt == REC_FMT_CSV)
+		o.str(rec_stream_cols[s]).chr('\n');
+	switch (s){
+		case REC_STREAM_META:
+			meta();
+			break;
+		case REC_STREAM_INIT_DATA:
+			if (fmt == REC_FMT_TEXT){
+				o.flush();
+				r.print_init_data(fout);
+			}
+			break;
+		case REC_STREAM_SOCKCALLS:
+			sockcalls();
+			break;
+		case REC_STREAM_EVTS:
+			evts();
+			break;
+		case REC_STREAM_PS:
+			ps();
+			break;
+		case REC_STREAM_JIFFIES:
+			jiffies();
+			break;
+		case REC_STREAM_MPQ:
+			mpq();
+			break;
+		case REC_STREAM_MA:
+			memory_allocated();
+			break;
+		case REC_STREAM_N_SOCKETS_ALLOCATED:
+			if (fmt == REC_FMT_TEXT)
+				o.u(r.n_sockets_allocated).str(" reads to n_sockets_allocated\n");
+			else {
+				begin();
+				num("n", r.n_sockets_allocated);
+				end();
+			}
+			break;
+		case REC_STREAM_MSTAMP:
+			mstamp();
+			break;
+		case REC_STREAM_SIQQ:
+			siqq();
+			break;
+		case REC_STREAM_SIQ:
+			siq();
+			break;
+		case REC_STREAM_TSQ:
+			tsq();
+			break;
+		case REC_STREAM_EBQ:
+			ebq();
+			break;
+		case REC_STREAM_EBX:
+			ebx();
+			break;
+	}
+}
+
+int rec_print(Records &rec, FILE *fout, RecFormat fmt, uint32_t streams){
+	if (fmt == REC_FMT_CSV && (streams & (streams - 1))){
+		fprintf(stderr, "csv: one stream at a time\n");
+		return -1;
+	}
+	if (fmt == REC_FMT_CSV && streams == 1u << REC_STREAM_INIT_DATA){
+		fprintf(stderr, "init_data: text only\n");
+		return -1;
+	}
+	RecPrinter p(rec, fout, fmt);
+	for (int s = 0; s < REC_N_STREAM; s++)
+		if (streams >> s & 1)
+			p.print(s);
+	return 0;
+}
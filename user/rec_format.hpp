@@ -0,0 +1,153 @@
+#ifndef _REC_FORMAT_HPP
+#define _REC_FORMAT_HPP
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "records.hpp"
+
+/*
+ * Output of records as text, JSON lines or CSV. Everything is formatted into a buffer of OUT_BUF_SIZE bytes, written
+ * with one fwrite when full: integers are converted two digits at a time, without stdio, so a dump runs at memory
+ * speed rather than at one fprintf per field.
+ */
+#define OUT_BUF_SIZE (1 << 20)
+#define OUT_MAX_FIELD 64 // room a call needs; longer strings are written directly
+
+class OutBuf{
+public:
+	OutBuf(FILE *_fout) : fout(_fout), buf(OUT_BUF_SIZE), p(buf.data()) {}
+	~OutBuf() { flush(); }
+	void flush(){
+		if (p != buf.data())
+			fwrite(buf.data(), 1, p - buf.data(), fout);
+		p = buf.data();
+	}
+	OutBuf& chr(char c){
+		room();
+		*p++ = c;
+		return *this;
+	}
+	OutBuf& str(const char *s){
+		return str(s, strlen(s));
+	}
+	OutBuf& str(const char *s, uint64_t n){
+		if (n > OUT_MAX_FIELD){
+			flush();
+			fwrite(s, 1, n, fout);
+			return *this;
+		}
+		room();
+		memcpy(p, s, n);
+		p += n;
+		return *this;
+	}
+	OutBuf& u(uint64_t x){
+		room();
+		p = put_u(p, x);
+		return *this;
+	}
+	OutBuf& i(int64_t x){
+		room();
+		if (x < 0){
+			*p++ = '-';
+			p = put_u(p, -(uint64_t)x);
+		}else
+			p = put_u(p, x);
+		return *this;
+	}
+	// in hex, with at least width digits
+	OutBuf& x(uint64_t v, int width = 1){
+		char t[16];
+		int n = 0;
+		room();
+		do {
+			t[n++] = "0123456789abcdef"[v & 15];
+			v >>= 4;
+		} while (v);
+		for (; n < width; width--)
+			*p++ = '0';
+		while (n)
+			*p++ = t[--n];
+		return *this;
+	}
+	// the low n bits of w, lowest first, as '0' and '1'
+	OutBuf& bits(uint32_t w, int n = 32){
+		room();
+		for (int k = 0; k < n; k++, w >>= 1)
+			*p++ = '0' + (w & 1);
+		return *this;
+	}
+private:
+	FILE *fout;
+	std::vector<char> buf;
+	char *p;
+
+	void room(){
+		if (buf.data() + OUT_BUF_SIZE - p < OUT_MAX_FIELD)
+			flush();
+	}
+	static char* put_u(char *o, uint64_t x){
+		static const char digits[201] =
+			"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+			"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+			"8081828384858687888990919293949596979899";
+		char t[20], *q = t + 20;
+		while (x >= 100){
+			q -= 2;
+			memcpy(q, digits + x % 100 * 2, 2);
+			x /= 100;
+		}
+		if (x >= 10){
+			q -= 2;
+			memcpy(q, digits + x * 2, 2);
+		}else
+			*--q = '0' + x;
+		memcpy(o, q, t + 20 - q);
+		return o + (t + 20 - q);
+	}
+};
+
+enum RecFormat{
+	REC_FMT_TEXT, // as Records::print
+	REC_FMT_JSON, // an object per line, with the stream it is of in "stream"
+	REC_FMT_CSV, // of one stream, with a header line
+};
+
+/* the streams rec_print() prints, a bit each */
+enum RecStream{
+	REC_STREAM_META,
+	REC_STREAM_INIT_DATA, // text only
+	REC_STREAM_SOCKCALLS,
+	REC_STREAM_EVTS,
+	REC_STREAM_PS,
+	REC_STREAM_JIFFIES,
+	REC_STREAM_MPQ,
+	REC_STREAM_MA,
+	REC_STREAM_N_SOCKETS_ALLOCATED,
+	REC_STREAM_MSTAMP,
+	REC_STREAM_SIQQ,
+	REC_STREAM_SIQ,
+	REC_STREAM_TSQ,
+	REC_STREAM_EBQ,
+	REC_STREAM_EBX,
+	REC_N_STREAM
+};
+#define REC_STREAMS_ALL ((1u << REC_N_STREAM) - 1)
+// those Records::print prints
+#define REC_STREAMS_DATA (REC_STREAMS_ALL & ~(1u << REC_STREAM_META) & ~(1u << REC_STREAM_INIT_DATA))
+
+extern const char *rec_stream_name[REC_N_STREAM];
+
+/* the streams of a comma separated list of their names, "all" for all. Return -1 if a name is unknown */
+int parse_rec_streams(const char *s, uint32_t &streams);
+int parse_rec_format(const char *s, RecFormat &fmt);
+
+/*
+ * print the streams of rec in fmt. In JSON and CSV, values are as stored: jiffies and memory_allocated as deltas, the
+ * first of them holding the initial value; bit streams a row per bit read. CSV takes one stream
+ */
+int rec_print(Records &rec, FILE *fout, RecFormat fmt, uint32_t streams);
+
+#endif /* _REC_FORMAT_HPP */
@@ -0,0 +1,474 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "rec_index.hpp"
+#include "record_file.hpp"
+#include "records.hpp"
+#include "records_view.hpp"
+#include "init_base.hpp"
+#include "shared_dict.hpp"
+
+using namespace std;
+
+const char *rec_index_col_name[IDX_N_COL] = {
+	"port", "mode", "sip", "dip", "sport", "dport", "broken", "alert", "fin_seq", "bytes_sent", "bytes_received",
+	"pkt_received", "n_evt", "n_sockcall", "first_jiffies", "size", "mtime", "file"
+};
+
+// bytes of each numeric column on disk
+static const uint32_t col_size[IDX_N_NUM] = {4, 4, 4, 4, 4, 4, 4, 4, 4, 8, 8, 8, 8, 8, 8, 8, 8};
+
+void RecIndexRows::push(const uint64_t *v, const string &f){
+	for (int c = 0; c < IDX_N_NUM; c++)
+		col[c].push_back(v[c]);
+	file.push_back(f);
+}
+
+void RecIndexRows::append(const RecIndexRows &r, uint64_t i){
+	for (int c = 0; c < IDX_N_NUM; c++)
+		col[c].push_back(r.col[c][i]);
+	file.push_back(r.file[i]);
+}
+
+void RecIndexRows::sort(){
+	static const int key[] = {IDX_PORT, IDX_MODE, IDX_DIP, IDX_SIP, IDX_DPORT, IDX_SPORT};
+	vector<uint64_t> order(size());
+	RecIndexRows r;
+	for (uint64_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [this](uint64_t a, uint64_t b){
+		for (int c : key)
+			if (col[c][a] != col[c][b])
+				return col[c][a] < col[c][b];
+		return file[a] < file[b];
+	});
+	for (uint64_t i : order)
+		r.append(*this, i);
+	for (int c = 0; c < IDX_N_NUM; c++)
+		col[c].swap(r.col[c]);
+	file.swap(r.file);
+}
+
+int RecIndexPred::parse(const char *s){
+	static const char *ops[] = {"!=", "<=", ">=", "=", "<", ">"}; // the 2-char ones first
+	static const Op op_of[] = {NE, LE, GE, EQ, LT, GT};
+	const char *p = s + strcspn(s, "=!<>");
+	string name(s, p - s);
+	unsigned a, b, c, d;
+	char *end;
+	int k;
+	for (col = 0; col < IDX_N_NUM && name != rec_index_col_name[col]; col++);
+	for (k = 0; k < 6 && strncmp(p, ops[k], strlen(ops[k])); k++);
+	if (col == IDX_N_NUM || k == 6)
+		return -1;
+	op = op_of[k];
+	p += strlen(ops[k]);
+	if ((col == IDX_SIP || col == IDX_DIP) && sscanf(p, "%u.%u.%u.%u%n", &a, &b, &c, &d, &k) == 4 && p[k] == 0){
+		if (a > 255 || b > 255 || c > 255 || d > 255)
+			return -1;
+		v = (a << 24) | (b << 16) | (c << 8) | d;
+		return 0;
+	}
+	if (*p == 0)
+		return -1;
+	v = strtoull(p, &end, 0);
+	return *end ? -1 : 0;
+}
+
+bool RecIndexPred::match(uint64_t x) const{
+	switch (op){
+		case EQ: return x == v;
+		case NE: return x != v;
+		case LT: return x < v;
+		case LE: return x <= v;
+		case GT: return x > v;
+		case GE: return x >= v;
+	}
+	return false;
+}
+
+bool RecIndexPred::may_match(uint64_t min, uint64_t max) const{
+	switch (op){
+		case EQ: return min <= v && v <= max;
+		case NE: return min != v || max != v;
+		case LT: return min < v;
+		case LE: return min <= v;
+		case GT: return max > v;
+		case GE: return max >= v;
+	}
+	return true;
+}
+
+/* a segment of an index, opened to read its blocks */
+struct RecIndexSegment{
+	RecFileReader r;
+	uint32_t first; // the first segment in use when this one was written
+	vector<RecIndexBlock> blocks;
+	vector<vector<const RecSection*> > col; // by block, then column
+
+	int open(const string &path);
+	int read_column(uint64_t b, int c, vector<uint64_t> &v);
+	int read_files(uint64_t b, vector<string> &v);
+};
+
+int RecIndexSegment::open(const string &path){
+	const RecSection *s;
+	if (r.open(path.c_str()) || (s = r.find(REC_SEC_INDEX_BLOCK)) == NULL || r.read_vector(REC_SEC_INDEX_BLOCK, blocks))
+		goto fail;
+	first = s->aux[0];
+	col.assign(blocks.size(), vector<const RecSection*>(IDX_N_COL, (const RecSection*)NULL));
+	for (const RecSection &x : r.table){
+		if (x.type != REC_SEC_INDEX_COL)
+			continue;
+		if (x.aux[0] >= IDX_N_COL || x.aux[1] >= blocks.size())
+			goto fail;
+		col[x.aux[1]][x.aux[0]] = &x;
+	}
+	for (uint64_t b = 0; b < blocks.size(); b++)
+		for (int c = 0; c < IDX_N_COL; c++){
+			const RecSection *x = col[b][c];
+			if (x == NULL || (c < IDX_N_NUM && (x->elem_size != col_size[c] || x->n_elem != blocks[b].n_row)))
+				goto fail;
+		}
+	return 0;
+fail:
+	fprintf(stderr, "Fail to read %s\n", path.c_str());
+	return -1;
+}
+
+int RecIndexSegment::read_column(uint64_t b, int c, vector<uint64_t> &v){
+	const RecSection *s = col[b][c];
+	vector<uint8_t> buf;
+	if (r.read_section(s, buf))
+		return -1;
+	v.assign(s->n_elem, 0);
+	for (uint64_t i = 0; i < s->n_elem; i++)
+		memcpy(&v[i], &buf[i * col_size[c]], col_size[c]);
+	return 0;
+}
+
+int RecIndexSegment::read_files(uint64_t b, vector<string> &v){
+	vector<uint8_t> buf;
+	if (r.read_section(col[b][IDX_FILE], buf) || (buf.size() && buf.back() != 0))
+		return -1;
+	v.clear();
+	for (uint64_t i = 0, j; i < buf.size(); i = j + 1){
+		for (j = i; buf[j]; j++);
+		v.push_back(string((const char*)&buf[i], j - i));
+	}
+	return v.size() == blocks[b].n_row ? 0 : -1;
+}
+
+static string segment_path(const string &dir, uint32_t n){
+	return dir + "/" + REC_INDEX_FILE + "." + to_string(n);
+}
+
+/* the segments of the index of dir in use, by number, and the number of the next one */
+static int list_segments(const string &dir, vector<uint32_t> &segs, uint32_t &next){
+	DIR *d = opendir(dir.c_str());
+	struct dirent *e;
+	string prefix = string(REC_INDEX_FILE) + ".";
+	vector<uint32_t> all;
+	if (d == NULL){
+		fprintf(stderr, "Fail to read %s\n", dir.c_str());
+		return -1;
+	}
+	while ((e = readdir(d)) != NULL){
+		string name = e->d_name;
+		if (name.compare(0, prefix.size(), prefix) || name.size() == prefix.size()
+				|| name.find_first_not_of("0123456789", prefix.size()) != string::npos)
+			continue;
+		all.push_back(strtoul(name.c_str() + prefix.size(), NULL, 10));
+	}
+	closedir(d);
+	sort(all.begin(), all.end());
+	segs.clear();
+	next = all.empty() ? 0 : all.back() + 1;
+	if (all.empty())
+		return 0;
+	// the last one written knows which of the others it replaced
+	RecIndexSegment last;
+	if (last.open(segment_path(dir, all.back())))
+		return -1;
+	for (uint32_t n : all)
+		if (n >= last.first)
+			segs.push_back(n);
+	return 0;
+}
+
+static int write_segment(const string &dir, uint32_t n, uint32_t first, const RecIndexRows &rows){
+	RecFileWriter w;
+	vector<RecIndexBlock> blocks;
+	vector<uint8_t> buf;
+	string path = segment_path(dir, n), tmp = path + ".tmp";
+	if (w.open(tmp.c_str()))
+		goto fail;
+	for (uint64_t start = 0, b = 0; start < rows.size(); start += REC_INDEX_BLOCK_ROWS, b++){
+		RecIndexBlock blk;
+		blk.n_row = min((uint64_t)REC_INDEX_BLOCK_ROWS, rows.size() - start);
+		for (int c = 0; c < IDX_N_NUM; c++){
+			const uint64_t *v = &rows.col[c][start];
+			blk.min[c] = *min_element(v, v + blk.n_row);
+			blk.max[c] = *max_element(v, v + blk.n_row);
+			buf.resize(blk.n_row * col_size[c]);
+			for (uint64_t i = 0; i < blk.n_row; i++)
+				memcpy(&buf[i * col_size[c]], &v[i], col_size[c]);
+			if (w.add_section(REC_SEC_INDEX_COL, col_size[c], buf.data(), blk.n_row, c, b))
+				goto fail;
+		}
+		buf.clear();
+		for (uint64_t i = start; i < start + blk.n_row; i++){
+			buf.insert(buf.end(), rows.file[i].begin(), rows.file[i].end());
+			buf.push_back(0);
+		}
+		if (w.add_vector(REC_SEC_INDEX_COL, buf, IDX_FILE, b))
+			goto fail;
+		blocks.push_back(blk);
+	}
+	if (w.add_vector(REC_SEC_INDEX_BLOCK, blocks, first) || w.close() || rename(tmp.c_str(), path.c_str()))
+		goto fail;
+	return 0;
+fail:
+	fprintf(stderr, "Fail to write %s\n", path.c_str());
+	remove(tmp.c_str());
+	return -1;
+}
+
+/* the row of a record file, but for its size and mtime. Return -1 if it can't be read */
+static int summarize(const string &path, uint64_t *v){
+	RecordsView view;
+	RecMeta m;
+	int ret = view.open(path.c_str());
+	if (ret == 0){
+		const RecSection *e = view.find(REC_SEC_EVT), *sc = view.find(REC_SEC_SOCKCALL);
+		Span<jiffies_rec> jif = view.jiffies();
+		m = *view.meta;
+		v[IDX_BYTES_SENT] = view.get_total_bytes_sent();
+		v[IDX_BYTES_RECEIVED] = view.get_total_bytes_received();
+		v[IDX_PKT_RECEIVED] = view.get_pkt_received();
+		v[IDX_N_EVT] = e ? e->n_elem : 0;
+		v[IDX_N_SOCKCALL] = sc ? sc->n_elem : 0;
+		v[IDX_FIRST_JIFFIES] = jif.empty() ? 0 : jif[0].init_jiffies;
+		if (!view.ok())
+			return -1;
+	}else if (ret == -2){ // v1
+		Records rec;
+		if (rec.read(path.c_str()))
+			return -1;
+		rec.get_meta(m);
+		v[IDX_BYTES_SENT] = rec.get_total_bytes_sent();
+		v[IDX_BYTES_RECEIVED] = rec.get_total_bytes_received();
+		v[IDX_PKT_RECEIVED] = rec.get_pkt_received();
+		v[IDX_N_EVT] = rec.evts.size();
+		v[IDX_N_SOCKCALL] = rec.sockcalls.size();
+		v[IDX_FIRST_JIFFIES] = rec.jiffies.empty() ? 0 : rec.jiffies[0].init_jiffies;
+	}else
+		return -1;
+	v[IDX_PORT] = service_port(m.mode, m.sport, m.dport);
+	v[IDX_MODE] = m.mode;
+	v[IDX_SIP] = m.sip;
+	v[IDX_DIP] = m.dip;
+	v[IDX_SPORT] = m.sport;
+	v[IDX_DPORT] = m.dport;
+	v[IDX_BROKEN] = m.broken;
+	v[IDX_ALERT] = m.alert;
+	v[IDX_FIN_SEQ] = m.fin_seq;
+	return 0;
+}
+
+static bool ends_with(const string &s, const char *suffix){
+	uint64_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+/* a file of the directory to index */
+struct IndexFile{
+	string name;
+	uint64_t size, mtime;
+};
+
+int rec_index_update(const char *_dir, int n_thread){
+	string dir = _dir;
+	vector<uint32_t> segs;
+	uint32_t next;
+	unordered_map<string, pair<uint64_t, uint64_t> > indexed; // file: (size, mtime)
+	unordered_set<string> drop; // indexed files rewritten or removed
+	vector<IndexFile> todo;
+	RecIndexRows rows;
+	uint64_t n_seen = 0, n_added;
+	bool merge;
+	DIR *d;
+	struct dirent *e;
+
+	if (list_segments(dir, segs, next))
+		return -1;
+	for (uint32_t n : segs){
+		RecIndexSegment seg;
+		if (seg.open(segment_path(dir, n)))
+			return -1;
+		for (uint64_t b = 0; b < seg.blocks.size(); b++){
+			vector<uint64_t> size, mtime;
+			vector<string> file;
+			if (seg.read_column(b, IDX_SIZE, size) || seg.read_column(b, IDX_MTIME, mtime) || seg.read_files(b, file)){
+				fprintf(stderr, "Fail to read %s\n", segment_path(dir, n).c_str());
+				return -1;
+			}
+			for (uint64_t i = 0; i < file.size(); i++)
+				indexed[file[i]] = make_pair(size[i], mtime[i]);
+		}
+	}
+
+	if ((d = opendir(dir.c_str())) == NULL){
+		fprintf(stderr, "Fail to read %s\n", dir.c_str());
+		return -1;
+	}
+	while ((e = readdir(d)) != NULL){
+		string name = e->d_name, path = dir + "/" + name;
+		struct stat st;
+		// the baselines, dictionaries and index of the directory, journals of open connections, and files being replaced
+		if (name[0] == '.' || name == INIT_BASE_FILE || name == SHARED_DICT_FILE || is_rec_index_file(name)
+				|| ends_with(name, REC_JOURNAL_SUFFIX) || ends_with(name, ".tmp") || stat(path.c_str(), &st)
+				|| !S_ISREG(st.st_mode))
+			continue;
+		IndexFile f = {name, (uint64_t)st.st_size, st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec};
+		auto it = indexed.find(name);
+		if (it != indexed.end()){
+			n_seen++;
+			if (it->second == make_pair(f.size, f.mtime))
+				continue;
+			drop.insert(name);
+		}
+		todo.push_back(f);
+	}
+	closedir(d);
+	// the files that were removed are those indexed but not seen
+	if (n_seen < indexed.size())
+		for (auto &it : indexed){
+			struct stat st;
+			if (stat((dir + "/" + it.first).c_str(), &st))
+				drop.insert(it.first);
+		}
+
+	// the new files, by n_thread threads
+	vector<uint64_t> v(todo.size() * IDX_N_NUM);
+	vector<char> ok(todo.size());
+	atomic<uint64_t> k(0);
+	vector<thread> th;
+	for (int t = 0; t < n_thread; t++)
+		th.push_back(thread([&](){
+			for (uint64_t i; (i = k++) < todo.size();){
+				uint64_t *row = &v[i * IDX_N_NUM];
+				ok[i] = summarize(dir + "/" + todo[i].name, row) == 0;
+				row[IDX_SIZE] = todo[i].size;
+				row[IDX_MTIME] = todo[i].mtime;
+			}
+		}));
+	for (thread &t : th)
+		t.join();
+	for (uint64_t i = 0; i < todo.size(); i++){
+		if (ok[i])
+			rows.push(&v[i * IDX_N_NUM], todo[i].name);
+		else
+			fprintf(stderr, "Fail to read %s, not indexed\n", (dir + "/" + todo[i].name).c_str());
+	}
+	n_added = rows.size();
+
+	// a new segment of the new rows, or one of all rows that replaces the others
+	merge = drop.size() || segs.size() >= REC_INDEX_MAX_SEGMENTS;
+	if (merge){
+		for (uint32_t n : segs){
+			RecIndexSegment seg;
+			if (seg.open(segment_path(dir, n)))
+				return -1;
+			for (uint64_t b = 0; b < seg.blocks.size(); b++){
+				RecIndexRows r;
+				for (int c = 0; c < IDX_N_NUM; c++)
+					if (seg.read_column(b, c, r.col[c]))
+						goto fail_read;
+				if (seg.read_files(b, r.file))
+					goto fail_read;
+				for (uint64_t i = 0; i < r.size(); i++)
+					if (drop.count(r.file[i]) == 0)
+						rows.append(r, i);
+			}
+			continue;
+fail_read:
+			fprintf(stderr, "Fail to read %s\n", segment_path(dir, n).c_str());
+			return -1;
+		}
+	}
+	if (rows.size() || merge){
+		rows.sort();
+		if (write_segment(dir, next, merge ? next : (segs.empty() ? 0 : segs[0]), rows))
+			return -1;
+		if (merge)
+			for (uint32_t n : segs)
+				remove(segment_path(dir, n).c_str());
+	}
+	printf("%lu files indexed: %lu added, %lu rewritten or removed, %lu failed; %s\n",
+			merge ? rows.size() : indexed.size() + rows.size(), n_added, drop.size(), todo.size() - n_added,
+			merge ? "segments merged" : rows.size() ? "segment added" : "unchanged");
+	return 0;
+}
+
+int rec_index_query(const char *_dir, const vector<RecIndexPred> &preds, RecIndexRows &out){
+	string dir = _dir;
+	vector<uint32_t> segs;
+	uint32_t next;
+	if (list_segments(dir, segs, next))
+		return -1;
+	for (uint32_t n : segs){
+		RecIndexSegment seg;
+		if (seg.open(segment_path(dir, n)))
+			return -1;
+		for (uint64_t b = 0; b < seg.blocks.size(); b++){
+			const RecIndexBlock &blk = seg.blocks[b];
+			vector<uint64_t> v[IDX_N_NUM];
+			vector<string> file;
+			vector<uint32_t> sel;
+			bool skip = false;
+			for (const RecIndexPred &p : preds)
+				skip |= !p.may_match(blk.min[p.col], blk.max[p.col]);
+			if (skip)
+				continue;
+			// the rows that match, narrowed down a column at a time, so that the others are decoded only for a match
+			for (uint32_t i = 0; i < blk.n_row; i++)
+				sel.push_back(i);
+			for (const RecIndexPred &p : preds){
+				uint64_t k = 0;
+				if (v[p.col].empty() && seg.read_column(b, p.col, v[p.col]))
+					goto fail_read;
+				for (uint32_t i : sel)
+					if (p.match(v[p.col][i]))
+						sel[k++] = i;
+				sel.resize(k);
+				if (sel.empty())
+					break;
+			}
+			if (sel.empty())
+				continue;
+			for (int c = 0; c < IDX_N_NUM; c++)
+				if (v[c].empty() && seg.read_column(b, c, v[c]))
+					goto fail_read;
+			if (seg.read_files(b, file))
+				goto fail_read;
+			for (uint32_t i : sel){
+				for (int c = 0; c < IDX_N_NUM; c++)
+					out.col[c].push_back(v[c][i]);
+				out.file.push_back(file[i]);
+			}
+		}
+		continue;
+fail_read:
+		fprintf(stderr, "Fail to read %s\n", segment_path(dir, n).c_str());
+		return -1;
+	}
+	return 0;
+}
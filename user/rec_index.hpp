@@ -0,0 +1,91 @@
+#ifndef _REC_INDEX_HPP
+#define _REC_INDEX_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * The index of a directory of records: a summary row per record file, so that a corpus can be searched without
+ * reading its files. The rows are stored by column in the record files REC_INDEX_FILE.<n> of the directory, the
+ * segments of the index. A segment holds the rows of the files one update added, sorted by service port, mode, dip,
+ * sip, dport, sport and file, in blocks of REC_INDEX_BLOCK_ROWS rows:
+ *   - a section per column and block (REC_SEC_INDEX_COL, aux[0] = column, aux[1] = block). File names are NUL
+ *     terminated, one after the other
+ *   - a table of the blocks (REC_SEC_INDEX_BLOCK, aux[0] = the first segment in use), with the range of each column,
+ *     so that a query decodes only the columns it needs of the blocks that may match
+ * An update adds the files of the directory that are not in the index as a new segment. When there would be more than
+ * REC_INDEX_MAX_SEGMENTS, or a file was rewritten or removed since it was indexed, it writes all rows as one segment
+ * instead, which replaces the others: they are removed once it is in place, and ignored by a query that finds them.
+ */
+#define REC_INDEX_FILE "rec_index"
+#define REC_INDEX_BLOCK_ROWS 16384
+#define REC_INDEX_MAX_SEGMENTS 8
+
+enum RecIndexColumn{
+	IDX_PORT, // service_port()
+	IDX_MODE,
+	IDX_SIP,
+	IDX_DIP,
+	IDX_SPORT,
+	IDX_DPORT,
+	IDX_BROKEN,
+	IDX_ALERT,
+	IDX_FIN_SEQ,
+	IDX_BYTES_SENT,
+	IDX_BYTES_RECEIVED,
+	IDX_PKT_RECEIVED,
+	IDX_N_EVT,
+	IDX_N_SOCKCALL,
+	IDX_FIRST_JIFFIES, // 0 if no jiffies were read
+	IDX_SIZE, // of the file, and its mtime in ns, to tell when it was rewritten
+	IDX_MTIME,
+	IDX_N_NUM, // the numeric columns, then the file name
+	IDX_FILE = IDX_N_NUM,
+	IDX_N_COL
+};
+
+extern const char *rec_index_col_name[IDX_N_COL];
+
+/* rows by column */
+struct RecIndexRows{
+	std::vector<uint64_t> col[IDX_N_NUM];
+	std::vector<std::string> file; // in the directory
+
+	uint64_t size() const { return file.size(); }
+	void push(const uint64_t *v, const std::string &f);
+	void append(const RecIndexRows &r, uint64_t i); // row i of r
+	void sort(); // in the order of a segment
+};
+
+struct RecIndexBlock{
+	uint64_t n_row;
+	uint64_t min[IDX_N_NUM], max[IDX_N_NUM];
+};
+
+/* a predicate on a numeric column: col op v */
+struct RecIndexPred{
+	enum Op{
+		EQ, NE, LT, LE, GT, GE
+	};
+	int col;
+	Op op;
+	uint64_t v;
+
+	// "<column><op><value>", op one of = != < <= > >=. IPs may be dotted. Return -1 if malformed
+	int parse(const char *s);
+	bool match(uint64_t x) const;
+	bool may_match(uint64_t min, uint64_t max) const; // some value in [min, max]
+};
+
+/* whether name is a segment of an index, or one being written */
+static inline bool is_rec_index_file(const std::string &name){
+	return name.compare(0, sizeof(REC_INDEX_FILE) - 1, REC_INDEX_FILE) == 0;
+}
+
+/* add the record files of dir that are new or changed since the last update, summarized by n_thread threads */
+int rec_index_update(const char *dir, int n_thread);
+/* the rows of the index of dir that match all of preds */
+int rec_index_query(const char *dir, const std::vector<RecIndexPred> &preds, RecIndexRows &out);
+
+#endif /* _REC_INDEX_HPP */
@@ -0,0 +1,428 @@
+#include <cstdio>
+#include <cstring>
+#include <nmmintrin.h>
+#include "base_struct.hpp"
+#include "record_file.hpp"
+#include "codec.hpp"
+#include "shared_dict.hpp"
+
+using namespace std;
+
+/* CRC32C (Castagnoli), the polynomial of the SSE4.2 crc32 instruction */
+#define CRC32C_POLY 0x82f63b78
+
+static uint32_t crc32c_table[8][256];
+
+static void init_crc32c_table(){
+	for (uint32_t i = 0; i < 256; i++){
+		uint32_t c = i;
+		for (int j = 0; j < 8; j++)
+			c = (c >> 1) ^ (CRC32C_POLY & (0 - (c & 1)));
+		crc32c_table[0][i] = c;
+	}
+	for (uint32_t i = 0; i < 256; i++)
+		for (int t = 1; t < 8; t++)
+			crc32c_table[t][i] = (crc32c_table[t-1][i] >> 8) ^ crc32c_table[0][crc32c_table[t-1][i] & 0xff];
+}
+
+// slicing-by-8, for CPUs without SSE4.2
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t* p, uint64_t len){
+	for (; len && ((uintptr_t)p & 7); len--)
+		crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xff];
+	for (; len >= 8; len -= 8, p += 8){
+		uint64_t x;
+		memcpy(&x, p, 8);
+		x ^= crc;
+		crc = crc32c_table[7][x & 0xff] ^ crc32c_table[6][(x >> 8) & 0xff]
+			^ crc32c_table[5][(x >> 16) & 0xff] ^ crc32c_table[4][(x >> 24) & 0xff]
+			^ crc32c_table[3][(x >> 32) & 0xff] ^ crc32c_table[2][(x >> 40) & 0xff]
+			^ crc32c_table[1][(x >> 48) & 0xff] ^ crc32c_table[0][x >> 56];
+	}
+	for (; len; len--)
+		crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xff];
+	return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t* p, uint64_t len){
+	uint64_t c = crc;
+	for (; len && ((uintptr_t)p & 7); len--)
+		c = _mm_crc32_u8((uint32_t)c, *p++);
+	// 3 independent streams would hide the 3-cycle latency, but sections are small; this already runs at ~8 B/cycle
+	for (; len >= 8; len -= 8, p += 8)
+		c = _mm_crc32_u64(c, *(const uint64_t*)p);
+	for (; len; len--)
+		c = _mm_crc32_u8((uint32_t)c, *p++);
+	return (uint32_t)c;
+}
+
+static int init_crc32c(){
+	if (__builtin_cpu_supports("sse4.2"))
+		return 1;
+	init_crc32c_table();
+	return 0;
+}
+
+uint32_t crc32c(uint32_t crc, const void* buf, uint64_t len){
+	static const int has_sse42 = init_crc32c(); // thread-safe local static
+	crc = ~crc;
+	if (has_sse42)
+		crc = crc32c_hw(crc, (const uint8_t*)buf, len);
+	else
+		crc = crc32c_sw(crc, (const uint8_t*)buf, len);
+	return ~crc;
+}
+
+const char* get_section_name(uint16_t type, char* buf){
+	switch (type){
+		case REC_SEC_META: return "meta";
+		case REC_SEC_INIT_DATA: return "init_data";
+		case REC_SEC_EVT: return "evts";
+		case REC_SEC_SOCKCALL: return "sockcalls";
+		case REC_SEC_PS: return "ps";
+		case REC_SEC_JIF: return "jiffies";
+		case REC_SEC_MPQ: return "mpq";
+		case REC_SEC_MA: return "memory_allocated";
+		case REC_SEC_MSTAMP: return "mstamp";
+		case REC_SEC_SIQQ: return "siqq";
+		case REC_SEC_SIQ: return "siq";
+		case REC_SEC_TSQ: return "tsq";
+		case REC_SEC_EBX: return "ebx";
+		case REC_SEC_AEQ: return "aeq";
+		case REC_SEC_INIT_DELTA: return "init_delta";
+		case REC_SEC_INIT_BASE: return "init_base";
+		case REC_SEC_SHARED_DICT: return "shared_dict";
+		case REC_SEC_INDEX_COL: return "index_col";
+		case REC_SEC_INDEX_BLOCK: return "index_block";
+		case REC_SEC_EXPORT_COL: return "export_col";
+		case REC_SEC_EXPORT_DICT: return "export_dict";
+		case REC_SEC_EXPORT_BLOCK: return "export_block";
+		case REC_SEC_EXPORT_NAMES: return "export_names";
+	}
+	if (REC_SEC_IS_EBQ(type))
+		sprintf(buf, "ebq[%d]", type - REC_SEC_EBQ(0));
+	else
+		sprintf(buf, "type %hu", type);
+	return buf;
+}
+
+string rec_file_dir(const char *filename){
+	const char *slash = strrchr(filename, '/');
+	if (slash == NULL)
+		return ".";
+	if (slash == filename)
+		return "/";
+	return string(filename, slash - filename);
+}
+
+int rec_file_check_header(const RecFileHeader *hdr, uint64_t file_size){
+	RecFileHeader h = *hdr;
+	if (file_size < sizeof(RecFileHeader) || h.magic != REC_FILE_MAGIC)
+		return -1;
+	if (h.version != REC_FILE_VERSION){
+		fprintf(stderr, "record file version %hu, expect %u\n", h.version, REC_FILE_VERSION);
+		return -1;
+	}
+	h.hdr_crc = 0;
+	if (crc32c(0, &h, sizeof(h)) != hdr->hdr_crc){
+		fprintf(stderr, "record file header CRC mismatch\n");
+		return -1;
+	}
+	if (h.table_off < sizeof(RecFileHeader) || h.table_off > file_size
+			|| file_size - h.table_off < (uint64_t)h.n_section * sizeof(RecSection)){
+		fprintf(stderr, "record file truncated: section table at %lu, file size %lu\n", h.table_off, file_size);
+		return -1;
+	}
+	return 0;
+}
+
+int rec_file_check_table(const RecFileHeader *hdr, const RecSection *table, uint64_t file_size){
+	if (crc32c(0, table, (uint64_t)hdr->n_section * sizeof(RecSection)) != hdr->table_crc){
+		fprintf(stderr, "record file section table CRC mismatch\n");
+		return -1;
+	}
+	for (uint32_t i = 0; i < hdr->n_section; i++){
+		const RecSection &s = table[i];
+		if (s.offset % REC_FILE_ALIGN || s.offset < sizeof(RecFileHeader) || s.offset > hdr->table_off
+				|| hdr->table_off - s.offset < s.length){
+			fprintf(stderr, "record file section %u (type %hu) out of range\n", i, s.type);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int RecFileWriter::open(const char* filename){
+	RecFileHeader hdr;
+	fout = fopen(filename, "w");
+	if (fout == NULL)
+		return -1;
+	// placeholder, rewritten by close()
+	memset(&hdr, 0, sizeof(hdr));
+	if (!fwrite(&hdr, sizeof(hdr), 1, fout))
+		return -1;
+	off = sizeof(hdr);
+	table.clear();
+	journal = false;
+	return 0;
+}
+
+int RecFileWriter::open_journal(const char* filename){
+	fout = fopen(filename, "w");
+	if (fout == NULL)
+		return -1;
+	off = sizeof(RecFileHeader);
+	table.clear();
+	journal = true;
+	last_ckpt = 0;
+	// the header is final from the start
+	if (write_header(REC_JOURNAL_MAGIC, 0))
+		return -1;
+	return 0;
+}
+
+int RecFileWriter::pad_to_align(){
+	static const uint8_t zero[REC_FILE_ALIGN] = {0};
+	uint64_t pad = (REC_FILE_ALIGN - off % REC_FILE_ALIGN) % REC_FILE_ALIGN;
+	if (pad && !fwrite(zero, pad, 1, fout))
+		return -1;
+	off += pad;
+	return 0;
+}
+
+int RecFileWriter::add_section(uint16_t type, uint32_t elem_size, const void* data, uint64_t n_elem, uint32_t aux0, uint32_t aux1){
+	RecSection s;
+	vector<uint8_t> enc;
+	if (pad_to_align())
+		return -1;
+	memset(&s, 0, sizeof(s));
+	s.type = type;
+	s.elem_size = elem_size;
+	s.offset = off;
+	s.n_elem = n_elem;
+	s.aux[0] = aux0;
+	s.aux[1] = aux1;
+	s.codec = REC_CODEC_RAW;
+	if (compress && n_elem > 0 && journal)
+		s.codec = codec_encode_with(REC_CODEC_LZ, s, (const uint8_t*)data, enc);
+	else if (compress && n_elem > 0){
+		// the smallest, or a codec that is worth a few bytes more: see codec_encode_best
+		uint16_t prefer = REC_CODEC_RAW;
+		if (is_bit_array(type)) // RecordsView reads it without decoding
+			prefer = REC_CODEC_BIT_CHUNK;
+		else if (fast_delta && (type == REC_SEC_JIF || type == REC_SEC_MA || type == REC_SEC_MSTAMP))
+			prefer = REC_CODEC_SVB; // decodes about as fast as a copy
+		s.codec = codec_encode_best(s, (const uint8_t*)data, enc, prefer);
+	}
+	if (s.codec != REC_CODEC_RAW)
+		data = enc.data();
+	s.length = s.codec == REC_CODEC_RAW ? elem_size * n_elem : enc.size();
+	s.crc = crc32c(0, data, s.length);
+	if (s.length && !fwrite(data, s.length, 1, fout))
+		return -1;
+	off += s.length;
+	table.push_back(s);
+	return 0;
+}
+
+int RecFileWriter::write_header(uint32_t magic, uint64_t table_off){
+	RecFileHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = magic;
+	hdr.version = REC_FILE_VERSION;
+	hdr.n_section = table.size();
+	hdr.flags = 0;
+	#if COLLECT_TX_STAMP
+	hdr.flags |= REC_FILE_FLAG_TX_STAMP;
+	#endif
+	#if ADVANCED_EVENT_ENABLE
+	hdr.flags |= REC_FILE_FLAG_AE;
+	#endif
+	hdr.n_eb_loc = DETER_EFFECT_BOOL_N_LOC;
+	hdr.table_off = table_off;
+	hdr.table_crc = crc32c(0, table.data(), sizeof(RecSection) * table.size());
+	hdr.hdr_crc = crc32c(0, &hdr, sizeof(hdr));
+	if (fseek(fout, 0, SEEK_SET) || !fwrite(&hdr, sizeof(hdr), 1, fout) || fseek(fout, off, SEEK_SET))
+		return -1;
+	return 0;
+}
+
+int RecFileWriter::checkpoint(){
+	RecCheckpoint c;
+	if (pad_to_align())
+		return -1;
+	memset(&c, 0, sizeof(c));
+	c.magic = REC_CHECKPOINT_MAGIC;
+	c.n_section = table.size();
+	c.prev = last_ckpt;
+	c.table_crc = crc32c(0, table.data(), sizeof(RecSection) * table.size());
+	c.crc = crc32c(0, &c, sizeof(c));
+	if (!fwrite(&c, sizeof(c), 1, fout) || (table.size() && !fwrite(&table[0], sizeof(RecSection) * table.size(), 1, fout))
+			|| fflush(fout))
+		return -1;
+	last_ckpt = off;
+	off += sizeof(c) + sizeof(RecSection) * table.size();
+	// the chunks are on disk and listed there, so a journal holds none of them in memory
+	table.clear();
+	return 0;
+}
+
+int RecFileWriter::close(){
+	int ret = 0;
+	if (journal){
+		if (checkpoint())
+			goto fail_write;
+		goto out;
+	}
+	if (pad_to_align())
+		goto fail_write;
+	if (table.size() && !fwrite(&table[0], sizeof(RecSection) * table.size(), 1, fout))
+		goto fail_write;
+	if (write_header(REC_FILE_MAGIC, off))
+		goto fail_write;
+	goto out;
+fail_write:
+	ret = -1;
+out:
+	if (fclose(fout))
+		ret = -1;
+	fout = NULL;
+	return ret;
+}
+
+int RecFileReader::open(const char* filename){
+	uint64_t file_size;
+	const char *base_name;
+	fin = fopen(filename, "r");
+	if (fin == NULL)
+		return -1;
+	if (fseek(fin, 0, SEEK_END))
+		goto fail_read;
+	file_size = ftell(fin);
+	if (fseek(fin, 0, SEEK_SET) || !fread(&hdr, sizeof(hdr), 1, fin))
+		goto fail_read;
+	if (rec_file_check_header(&hdr, file_size))
+		goto fail_read;
+
+	table.resize(hdr.n_section);
+	if (hdr.n_section){
+		if (fseek(fin, hdr.table_off, SEEK_SET) || !fread(&table[0], sizeof(RecSection) * hdr.n_section, 1, fin))
+			goto fail_read;
+	}
+	if (rec_file_check_table(&hdr, table.data(), file_size))
+		goto fail_read;
+	// the sections may be coded against the shared dictionaries of the directory, but for those themselves
+	base_name = strrchr(filename, '/');
+	if (strcmp(base_name ? base_name + 1 : filename, SHARED_DICT_FILE))
+		load_shared_dicts(filename);
+	return 0;
+fail_read:
+	close();
+	return -1;
+}
+
+/* the checkpoint of a journal at off, if valid, its chunks appended to table */
+static int read_checkpoint(FILE *fin, uint64_t off, uint64_t file_size, vector<RecSection> &table, uint64_t &prev){
+	RecCheckpoint c, h;
+	uint64_t start = table.size();
+	if (off % REC_FILE_ALIGN || off < sizeof(RecFileHeader) || file_size - off < sizeof(c))
+		return -1;
+	if (fseek(fin, off, SEEK_SET) || !fread(&c, sizeof(c), 1, fin))
+		return -1;
+	h = c;
+	h.crc = 0;
+	if (c.magic != REC_CHECKPOINT_MAGIC || crc32c(0, &h, sizeof(h)) != c.crc || c.prev >= off
+			|| c.n_section > (file_size - off - sizeof(c)) / sizeof(RecSection))
+		return -1;
+	table.resize(start + c.n_section);
+	if (c.n_section && !fread(&table[start], sizeof(RecSection) * c.n_section, 1, fin))
+		return -1;
+	if (crc32c(0, &table[start], sizeof(RecSection) * c.n_section) != c.table_crc)
+		return -1;
+	for (uint64_t i = start; i < table.size(); i++){
+		const RecSection &s = table[i];
+		if (s.offset % REC_FILE_ALIGN || s.offset < sizeof(RecFileHeader) || s.offset > off || off - s.offset < s.length)
+			return -1;
+	}
+	prev = c.prev;
+	return 0;
+}
+
+int RecFileReader::open_journal(const char* filename){
+	uint64_t file_size, off, prev = 0;
+	vector<vector<RecSection> > ckpt; // from the last one back
+	RecFileHeader h;
+	fin = fopen(filename, "r");
+	if (fin == NULL)
+		return -1;
+	if (fseek(fin, 0, SEEK_END))
+		goto fail_read;
+	file_size = ftell(fin);
+	if (file_size < sizeof(hdr) || fseek(fin, 0, SEEK_SET) || !fread(&hdr, sizeof(hdr), 1, fin))
+		goto fail_read;
+	h = hdr;
+	h.hdr_crc = 0;
+	if (hdr.magic != REC_JOURNAL_MAGIC || hdr.version != REC_FILE_VERSION || crc32c(0, &h, sizeof(h)) != hdr.hdr_crc)
+		goto fail_read;
+
+	// the last checkpoint: what follows it may be cut anywhere
+	for (off = (file_size - sizeof(RecCheckpoint)) / REC_FILE_ALIGN * REC_FILE_ALIGN; off >= sizeof(hdr); off -= REC_FILE_ALIGN){
+		ckpt.assign(1, vector<RecSection>());
+		if (read_checkpoint(fin, off, file_size, ckpt[0], prev) == 0)
+			break;
+	}
+	if (off < sizeof(hdr)){
+		fprintf(stderr, "%s: no checkpoint\n", filename);
+		goto fail_read;
+	}
+	// and those before it, which must all be valid
+	for (off = prev; off; off = prev){
+		ckpt.push_back(vector<RecSection>());
+		if (read_checkpoint(fin, off, file_size, ckpt.back(), prev)){
+			fprintf(stderr, "%s: bad checkpoint at %lu\n", filename, off);
+			goto fail_read;
+		}
+	}
+	table.clear();
+	for (uint64_t i = ckpt.size(); i > 0; i--)
+		table.insert(table.end(), ckpt[i - 1].begin(), ckpt[i - 1].end());
+	return 0;
+fail_read:
+	close();
+	return -1;
+}
+
+void RecFileReader::close(){
+	if (fin)
+		fclose(fin);
+	fin = NULL;
+}
+
+const RecSection* RecFileReader::find(uint16_t type) const{
+	for (uint32_t i = 0; i < table.size(); i++)
+		if (table[i].type == type)
+			return &table[i];
+	return NULL;
+}
+
+int RecFileReader::read_section(const RecSection *s, vector<uint8_t> &buf){
+	vector<uint8_t> enc(s->length);
+	if (s->length && (fseek(fin, s->offset, SEEK_SET) || !fread(&enc[0], s->length, 1, fin)))
+		return -1;
+	if (crc32c(0, enc.data(), s->length) != s->crc){
+		fprintf(stderr, "record file section type %hu CRC mismatch\n", s->type);
+		return -1;
+	}
+	if (s->codec == REC_CODEC_RAW){
+		if (s->length != s->n_elem * s->elem_size)
+			return -1;
+		buf.swap(enc);
+		return 0;
+	}
+	buf.resize(s->n_elem * s->elem_size);
+	if (codec_decode(*s, enc.data(), buf.data())){
+		fprintf(stderr, "record file section type %hu: fail to decode (%s)\n", s->type, get_codec_name(s->codec));
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,221 @@
+#ifndef _RECORD_FILE_HPP
+#define _RECORD_FILE_HPP
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <string>
+
+/*
+ * Record file v2:
+ *   | RecFileHeader | section | pad | section | pad | ... | RecSection[n_section] |
+ * Each section starts at a multiple of REC_FILE_ALIGN. The section table is written last, so sections can be
+ * written as they are produced, and the header is rewritten once the table is in place.
+ * A v1 file (raw fields back to back) starts with `mode`, which is never REC_FILE_MAGIC.
+ */
+#define REC_FILE_MAGIC 0x52544544 // "DETR" on disk
+#define REC_FILE_VERSION 2
+#define REC_FILE_ALIGN 64
+
+/*
+ * Record journal: the streams of a connection still open, appended as they arrive, so that a long connection does
+ * not hold them in memory, and a recorder that dies loses only what came after the last checkpoint.
+ *   | RecFileHeader (REC_JOURNAL_MAGIC) | chunk | pad | ... | RecCheckpoint | RecSection[n] | pad | chunk | ... |
+ * A chunk is a section holding a part of a stream; the chunks of a stream in file order are the stream. A
+ * checkpoint, aligned like sections, lists the chunks written since the one before it, whose offset it holds, and is
+ * flushed after them. A reader takes the chunks of the last valid checkpoint and of all those before it.
+ * The header is the header of a v2 file, but for the magic, and table_off is 0.
+ */
+#define REC_JOURNAL_MAGIC 0x4a544544 // "DETJ" on disk
+#define REC_CHECKPOINT_MAGIC 0x504b4344 // "DCKP" on disk
+#define REC_JOURNAL_SUFFIX ".part"
+
+struct RecCheckpoint{
+	uint32_t magic;
+	uint32_t n_section; // the chunks since the previous checkpoint, whose RecSection follow
+	uint64_t prev; // offset of the previous checkpoint, 0 for none
+	uint32_t table_crc; // CRC32C of the RecSection that follow
+	uint32_t crc; // CRC32C of this, computed with crc = 0
+	uint64_t reserved;
+};
+
+// build flags the file was written with
+#define REC_FILE_FLAG_TX_STAMP 0x1
+#define REC_FILE_FLAG_AE 0x2
+
+struct RecFileHeader{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t n_section;
+	uint32_t flags; // REC_FILE_FLAG_*
+	uint32_t n_eb_loc; // DETER_EFFECT_BOOL_N_LOC of the writer
+	uint64_t table_off; // offset of the section table
+	uint32_t table_crc; // CRC32C of the section table
+	uint32_t hdr_crc; // CRC32C of this header, computed with hdr_crc = 0
+	uint8_t reserved[32];
+};
+
+/* section types */
+#define REC_SEC_META 1 // one struct RecMeta
+#define REC_SEC_INIT_DATA 2 // one tcp_sock_init_data
+#define REC_SEC_EVT 3
+#define REC_SEC_SOCKCALL 4
+#define REC_SEC_PS 5
+#define REC_SEC_JIF 6
+#define REC_SEC_MPQ 7 // BitArray: aux[0] = n, aux[1] = format; data is BitArray::v
+#define REC_SEC_MA 8
+#define REC_SEC_MSTAMP 9
+#define REC_SEC_SIQQ 10
+#define REC_SEC_SIQ 11 // BitArray
+#define REC_SEC_TSQ 12 // aux[0] = the error in ns allowed to lossy codecs, 0 for none
+#define REC_SEC_EBX 13
+#define REC_SEC_AEQ 14
+#define REC_SEC_INIT_DELTA 15 // init data as a delta to a baseline, instead of REC_SEC_INIT_DATA; aux[0] = baseline id
+#define REC_SEC_INIT_BASE 16 // struct InitBase, in INIT_BASE_FILE only
+#define REC_SEC_SHARED_DICT 17 // a SharedDict, in SHARED_DICT_FILE only; aux[0] = id, aux[1] = version
+#define REC_SEC_INDEX_COL 18 // a column of a block of rows, in an index only; aux[0] = column, aux[1] = block
+#define REC_SEC_INDEX_BLOCK 19 // struct RecIndexBlock, in an index only; aux[0] = the first segment in use
+#define REC_SEC_EXPORT_COL 20 // a column of a block of rows, in an export only; aux[0] = column, aux[1] = block
+#define REC_SEC_EXPORT_DICT 21 // the values a dictionary coded REC_SEC_EXPORT_COL indexes, aux the same
+#define REC_SEC_EXPORT_BLOCK 22 // the rows of each block of an export (uint64_t); aux[0] = columns
+#define REC_SEC_EXPORT_NAMES 23 // NUL terminated; aux[0] = 0: columns, aux[1] = the signed ones, a bit each; 1: files
+#define REC_SEC_EBQ(i) (0x40 + (i)) // BitArray
+#define REC_SEC_IS_EBQ(t) ((t) >= 0x40 && (t) < 0x80)
+
+static inline bool is_bit_array(uint16_t type){
+	return type == REC_SEC_MPQ || type == REC_SEC_SIQ || REC_SEC_IS_EBQ(type);
+}
+
+/* codecs of the on-disk bytes of a section, see codec.hpp */
+#define REC_CODEC_RAW 0
+#define REC_CODEC_DYN 1 // per-field columns, dynamic coding
+#define REC_CODEC_HUFFMAN_PREFIX 2 // per-field columns, huffman coded bit length + bits
+#define REC_CODEC_BIT_RUN 3 // RAW BitArray as dynamic coded run lengths
+#define REC_CODEC_EVT_RLE 4 // evts as runs of event classes
+#define REC_CODEC_SC_DICT 5 // sockcalls as a dictionary of distinct records, ids and run lengths
+#define REC_CODEC_TSQ_PWL 6 // tsq as line segments within aux[0] ns, lossy
+#define REC_CODEC_BIT_CHUNK 7 // RAW BitArray as chunks of raw words, positions or runs; read in place by RecordsView
+#define REC_CODEC_ELIAS_FANO 8 // 4-byte columns made non-decreasing, as Elias-Fano sequences
+#define REC_CODEC_HUFFMAN 9 // huffman_prefix with a header of code lengths only
+#define REC_CODEC_SVB 10 // 4-byte columns as Stream VByte, decoded with SIMD shuffles
+#define REC_CODEC_SC_SHARED 11 // sc_dict with records of the shared dictionary aux[0] by index
+#define REC_CODEC_EVT_SHARED 12 // evts as phrases of the shared dictionary aux[0] and runs
+#define REC_CODEC_LZ 13 // any section as LZ77 sequences, LZ4 block format
+
+struct RecSection{
+	uint16_t type; // REC_SEC_*
+	uint16_t codec; // REC_CODEC_*
+	uint32_t elem_size; // sizeof one element, so a layout mismatch is detected instead of misread
+	uint64_t offset; // from the start of the file, multiple of REC_FILE_ALIGN
+	uint64_t length; // bytes on disk
+	uint64_t n_elem; // number of elements after decoding, so the raw size is n_elem * elem_size
+	uint32_t aux[2]; // section specific
+	uint32_t crc; // CRC32C of the on-disk bytes
+	uint32_t reserved;
+};
+
+/* connection metadata, the scalar fields of Records */
+struct RecMeta{
+	uint32_t mode, broken, alert;
+	uint32_t sip, dip;
+	uint16_t sport, dport;
+	uint32_t fin_seq;
+	uint32_t n_sockets_allocated;
+	uint32_t eb_dense;
+};
+
+uint32_t crc32c(uint32_t crc, const void* buf, uint64_t len);
+const char* get_section_name(uint16_t type, char* buf);
+/* the directory of a record file, "." if none. Files shared by the records of a directory are found there */
+std::string rec_file_dir(const char *filename);
+
+/* check the header and the section table against a file of file_size bytes. Return 0 if valid */
+int rec_file_check_header(const RecFileHeader *hdr, uint64_t file_size);
+int rec_file_check_table(const RecFileHeader *hdr, const RecSection *table, uint64_t file_size);
+
+/* whether the first bytes of a file are a v2 header */
+static inline bool rec_file_is_v2(const void* buf, uint64_t len){
+	return len >= sizeof(uint32_t) && *(const uint32_t*)buf == REC_FILE_MAGIC;
+}
+
+class RecFileWriter{
+public:
+	bool compress; // encode each section with the smallest codec, otherwise store all raw
+	// with compress, encode the delta streams (jiffies, memory_allocated, mstamp) with stream_vbyte if it is within
+	// the bound of codec_encode_best of the smallest
+	bool fast_delta;
+
+	RecFileWriter() : compress(true), fast_delta(false), fout(NULL), off(0), journal(false), last_ckpt(0) {}
+	~RecFileWriter() { if (fout) fclose(fout); }
+	int open(const char* filename);
+	// a journal instead, whose sections are chunks, coded with lz only, as it is written while recording
+	int open_journal(const char* filename);
+	bool is_open() const { return fout != NULL; }
+	int add_section(uint16_t type, uint32_t elem_size, const void* data, uint64_t n_elem, uint32_t aux0 = 0, uint32_t aux1 = 0);
+	template <typename T>
+	int add_vector(uint16_t type, const std::vector<T> &v, uint32_t aux0 = 0, uint32_t aux1 = 0){
+		return add_section(type, sizeof(T), v.data(), v.size(), aux0, aux1);
+	}
+	// a journal: write a checkpoint of the chunks added since the last one, and flush them all to the kernel
+	int checkpoint();
+	int close(); // write the section table and the header; of a journal, the last checkpoint
+private:
+	FILE *fout;
+	uint64_t off; // end of the last section
+	std::vector<RecSection> table; // of a journal, the chunks since the last checkpoint
+	bool journal;
+	uint64_t last_ckpt; // offset of the last checkpoint
+	int pad_to_align();
+	int write_header(uint32_t magic, uint64_t table_off);
+};
+
+class RecFileReader{
+public:
+	RecFileHeader hdr;
+	std::vector<RecSection> table;
+
+	RecFileReader() : fin(NULL) {}
+	~RecFileReader() { close(); }
+	int open(const char* filename); // read and verify the header and the section table
+	// a journal: the chunks up to its last valid checkpoint. Return -1 if it has none
+	int open_journal(const char* filename);
+	void close();
+	const RecSection* find(uint16_t type) const;
+	// read a section, verify its CRC and decode it into buf. Return 0 on success
+	int read_section(const RecSection *s, std::vector<uint8_t> &buf);
+	// read a section of T. A missing section gives an empty vector; a mismatched elem_size is an error
+	template <typename T>
+	int read_vector(uint16_t type, std::vector<T> &v){
+		const RecSection *s = find(type);
+		v.clear();
+		if (s == NULL)
+			return 0;
+		if (s->elem_size != sizeof(T))
+			return -1;
+		std::vector<uint8_t> buf;
+		if (read_section(s, buf))
+			return -1;
+		v.resize(s->n_elem);
+		if (s->n_elem)
+			memcpy(&v[0], &buf[0], s->n_elem * sizeof(T));
+		return 0;
+	}
+	// append the chunks of a stream of T in a journal to v
+	template <typename T>
+	int read_chunks(uint16_t type, std::vector<T> &v){
+		for (const RecSection &s : table){
+			std::vector<uint8_t> buf;
+			if (s.type != type)
+				continue;
+			if (s.elem_size != sizeof(T) || read_section(&s, buf))
+				return -1;
+			v.insert(v.end(), (const T*)buf.data(), (const T*)buf.data() + s.n_elem);
+		}
+		return 0;
+	}
+private:
+	FILE *fin;
+};
+
+#endif /* _RECORD_FILE_HPP */
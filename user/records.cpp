@@ -2,8 +2,18 @@
 #include <unordered_map>
 #include <cmath>
 #include <map>
+#include <thread>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "records.hpp"
 #include "coding.hpp"
+#include "record_file.hpp"
+#include "codec.hpp"
+#include "init_base.hpp"
+#include "shared_dict.hpp"
+#include "rec_format.hpp"
+#include "rec_index.hpp"
 
 using namespace std;
 
@@ -31,9 +41,10 @@ int read_vector(vector<T> &v, FILE *fin){
 }
 
 void Records::transform(){
-	// transform sockcalls
+	// transform sockcalls, with the bytes that are not fields of their type 0 (older kernels left them unset)
 	unordered_map<u64, u64> ids;
 	for (uint32_t i = 0; i < sockcalls.size(); i++){
+		sockcalls[i] = sc_record(sc_key(sockcalls[i]));
 		u64 key = sockcalls[i].thread_id;
 		if (ids.find(key) == ids.end()){ // a new thread
 			sockcalls[i].thread_id = ids.size();
@@ -71,111 +82,288 @@ void Records::order_sockcalls(){
 	}
 }
 
+string Records::file_name() const{
+	char buf[128];
+	sprintf(buf, "%08x:%hu->%08x:%hu", sip, sport, dip, dport);
+	return buf;
+}
+
+void Records::get_meta(RecMeta &meta) const{
+	memset(&meta, 0, sizeof(meta));
+	meta.mode = mode;
+	meta.broken = broken;
+	meta.alert = alert;
+	meta.sip = sip;
+	meta.dip = dip;
+	meta.sport = sport;
+	meta.dport = dport;
+	meta.fin_seq = fin_seq;
+	meta.n_sockets_allocated = n_sockets_allocated;
+	meta.eb_dense = eb_dense;
+}
+
 int Records::dump(const char* filename){
-	int ret;
-	uint32_t len;
-	FILE* fout;
-	if (filename == NULL){
-		char buf[128];
-		sprintf(buf, "%08x:%hu->%08x:%hu", sip, sport, dip, dport);
-		fout = fopen(buf, "w");
-	}else 
-		fout = fopen(filename, "w");
+	RecFileWriter w;
+	RecMeta meta;
+	InitBase base;
+	vector<uint32_t> delta;
+	uint32_t dict;
+	string name = file_name();
+	if (filename == NULL)
+		filename = name.c_str();
+	w.fast_delta = REC_FAST_DELTA;
+	if (w.open(filename))
+		return -1;
 
 	// transform raw data into final format 
 	transform();
 
-	// write mode
-	if (!fwrite(&mode, sizeof(mode), 1, fout))
-		goto fail_write;
-
-	// write broken 
-	if (!fwrite(&broken, sizeof(broken), 1, fout))
-		goto fail_write;
-
-	// write alert
-	if (!fwrite(&alert, sizeof(alert), 1, fout))
-		goto fail_write;
-
-	// write 4 tuples
-	if (!fwrite(&sip, sizeof(sip)+sizeof(dip)+sizeof(sport)+sizeof(dport), 1, fout))
-		goto fail_write;
-
-	// write fin_seq
-	if (!fwrite(&fin_seq, sizeof(fin_seq), 1, fout))
-		goto fail_write;
-
-	// write init_data
-	if (!fwrite(&init_data, sizeof(init_data), 1, fout))
-		goto fail_write;
+	// write metadata
+	get_meta(meta);
+	if (w.add_section(REC_SEC_META, sizeof(meta), &meta, 1))
+		return -1;
+	if (REC_INIT_DELTA && get_latest_init_base(filename, mode, base) == 0)
+		init_delta_encode(base.d, init_data, delta);
+	if (delta.size() && delta.size() * 4 < sizeof(init_data)){
+		if (w.add_vector(REC_SEC_INIT_DELTA, delta, base.id))
+			return -1;
+	}else if (w.add_section(REC_SEC_INIT_DATA, sizeof(init_data), &init_data, 1))
+		return -1;
+
+	// write streams, the events and sockcalls against the shared dictionary of the service, if any
+	dict = get_latest_shared_dict(filename, mode, service_port(mode, sport, dport));
+	if (w.add_vector(REC_SEC_EVT, evts, dict) || w.add_vector(REC_SEC_SOCKCALL, sockcalls, dict) || w.add_vector(REC_SEC_PS, ps)
+			|| w.add_vector(REC_SEC_JIF, jiffies) || w.add_vector(REC_SEC_MPQ, mpq.v, mpq.n, mpq.format)
+			|| w.add_vector(REC_SEC_MA, memory_allocated) || w.add_vector(REC_SEC_MSTAMP, mstamp)
+			|| w.add_vector(REC_SEC_SIQQ, siqq) || w.add_vector(REC_SEC_SIQ, siq.v, siq.n, siq.format))
+		return -1;
+	#if COLLECT_TX_STAMP
+	if (w.add_vector(REC_SEC_TSQ, tsq, TSQ_MAX_ERR))
+		return -1;
+	#endif
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		if (w.add_vector(REC_SEC_EBQ(i), ebq[i].v, ebq[i].n, ebq[i].format))
+			return -1;
+	if (w.add_vector(REC_SEC_EBX, ebx))
+		return -1;
+	#if ADVANCED_EVENT_ENABLE
+	if (w.add_vector(REC_SEC_AEQ, aeq))
+		return -1;
+	#endif
 
-	// write events
-	if (!dump_vector(evts, fout))
-		goto fail_write;
+	return w.close();
+}
 
-	// write sockcalls
-	if (!dump_vector(sockcalls, fout))
-		goto fail_write;
+uint64_t Records::stream_bytes() const{
+	uint64_t n = evts.size() * sizeof(deter_event) + sockcalls.size() * sizeof(deter_rec_sockcall)
+		+ ps.size() * sizeof(uint16_t) + jiffies.size() * sizeof(jiffies_rec) + mpq.v.size() * 4
+		+ memory_allocated.size() * sizeof(memory_allocated_rec) + mstamp.size() * sizeof(skb_mstamp) + siqq.size()
+		+ siq.v.size() * 4 + ebx.size();
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		n += ebq[i].v.size() * 4;
+	#if COLLECT_TX_STAMP
+	n += tsq.size() * 4;
+	#endif
+	#if ADVANCED_EVENT_ENABLE
+	n += aeq.size() * 4;
+	#endif
+	return n;
+}
 
-	// write ps
-	if (!dump_vector(ps, fout))
-		goto fail_write;
+/* append v to a journal as a chunk, and clear it */
+template <typename T>
+static int add_chunk(RecFileWriter &w, uint16_t type, vector<T> &v){
+	if (v.empty())
+		return 0;
+	if (w.add_vector(type, v))
+		return -1;
+	v.clear();
+	return 0;
+}
 
-	// write jiffies_reads
-	if (!dump_vector(jiffies, fout))
-		goto fail_write;
+int Records::journal(RecFileWriter &w){
+	if (!w.is_open()){
+		RecMeta meta;
+		get_meta(meta);
+		if (w.open_journal((file_name() + REC_JOURNAL_SUFFIX).c_str()) || w.add_section(REC_SEC_META, sizeof(meta), &meta, 1)
+				|| w.add_section(REC_SEC_INIT_DATA, sizeof(init_data), &init_data, 1))
+			return -1;
+	}
+	if (add_chunk(w, REC_SEC_EVT, evts) || add_chunk(w, REC_SEC_SOCKCALL, sockcalls) || add_chunk(w, REC_SEC_PS, ps)
+			|| add_chunk(w, REC_SEC_JIF, jiffies) || add_chunk(w, REC_SEC_MPQ, mpq.v)
+			|| add_chunk(w, REC_SEC_MA, memory_allocated) || add_chunk(w, REC_SEC_MSTAMP, mstamp)
+			|| add_chunk(w, REC_SEC_SIQQ, siqq) || add_chunk(w, REC_SEC_SIQ, siq.v) || add_chunk(w, REC_SEC_EBX, ebx))
+		return -1;
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		if (add_chunk(w, REC_SEC_EBQ(i), ebq[i].v))
+			return -1;
+	#if COLLECT_TX_STAMP
+	if (add_chunk(w, REC_SEC_TSQ, tsq))
+		return -1;
+	#endif
+	#if ADVANCED_EVENT_ENABLE
+	if (add_chunk(w, REC_SEC_AEQ, aeq))
+		return -1;
+	#endif
+	return w.checkpoint();
+}
 
-	// write memory_pressures
-	if (!mpq.dump(fout))
-		goto fail_write;
+/* put the chunks of a stream in a journal before v */
+template <typename T>
+static int prepend_chunks(RecFileReader &r, uint16_t type, vector<T> &v){
+	vector<T> c;
+	if (r.read_chunks(type, c))
+		return -1;
+	v.insert(v.begin(), c.begin(), c.end());
+	return 0;
+}
 
-	// write memory_allocated
-	if (!dump_vector(memory_allocated, fout))
-		goto fail_write;
+int Records::read_journal(const char* filename){
+	RecFileReader r;
+	vector<RecMeta> meta;
+	vector<tcp_sock_init_data> init;
+	if (r.open_journal(filename) || r.read_chunks(REC_SEC_META, meta) || r.read_chunks(REC_SEC_INIT_DATA, init)
+			|| meta.size() != 1 || init.size() != 1)
+		return -1;
+	// the fields known when the connection opens; the others come with its end
+	mode = meta[0].mode;
+	sip = meta[0].sip;
+	dip = meta[0].dip;
+	sport = meta[0].sport;
+	dport = meta[0].dport;
+	eb_dense = meta[0].eb_dense;
+	init_data = init[0];
+	if (prepend_chunks(r, REC_SEC_EVT, evts) || prepend_chunks(r, REC_SEC_SOCKCALL, sockcalls) || prepend_chunks(r, REC_SEC_PS, ps)
+			|| prepend_chunks(r, REC_SEC_JIF, jiffies) || prepend_chunks(r, REC_SEC_MPQ, mpq.v)
+			|| prepend_chunks(r, REC_SEC_MA, memory_allocated) || prepend_chunks(r, REC_SEC_MSTAMP, mstamp)
+			|| prepend_chunks(r, REC_SEC_SIQQ, siqq) || prepend_chunks(r, REC_SEC_SIQ, siq.v) || prepend_chunks(r, REC_SEC_EBX, ebx))
+		return -1;
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		if (prepend_chunks(r, REC_SEC_EBQ(i), ebq[i].v))
+			return -1;
+	#if COLLECT_TX_STAMP
+	if (prepend_chunks(r, REC_SEC_TSQ, tsq))
+		return -1;
+	#endif
+	#if ADVANCED_EVENT_ENABLE
+	if (prepend_chunks(r, REC_SEC_AEQ, aeq))
+		return -1;
+	#endif
+	return 0;
+}
 
-	// write n_sockets_allocated
-	if (!fwrite(&n_sockets_allocated, sizeof(n_sockets_allocated), 1, fout))
-		goto fail_write;
+int recover_journal(const char* filename){
+	Records r;
+	uint64_t len = strlen(filename), suffix = strlen(REC_JOURNAL_SUFFIX);
+	if (len <= suffix || strcmp(filename + len - suffix, REC_JOURNAL_SUFFIX) || r.read_journal(filename))
+		return -1;
+	// the end of the connection is lost: the bit arrays are taken whole, and the events only up to the first whose
+	// sockcall is not there, since each stream is cut where its last chunk ended
+	r.broken = 1;
+	for (uint64_t i = 0; i < r.evts.size(); i++)
+		if (r.evts[i].type >= DETER_SOCK_ID_BASE && get_sockcall_idx(r.evts[i].type) >= r.sockcalls.size()){
+			r.evts.resize(i);
+			break;
+		}
+	r.mpq.n = r.mpq.v.size() * 32;
+	r.siq.n = r.siq.v.size() * 32;
+	for (int k = 0; k < DETER_EFFECT_BOOL_N_LOC; k++)
+		r.ebq[k].n = (r.eb_dense >> k) & 1 ? r.ebq[k].v.size() * 32 : 0;
+	if (r.dump(string(filename, len - suffix).c_str()))
+		return -1;
+	return remove(filename) ? -1 : 0;
+}
 
-	// write mstamp
-	if (!dump_vector(mstamp, fout))
-		goto fail_write;
+/* read a BitArray section; a missing one is an empty array */
+static int read_bit_array(RecFileReader &r, uint16_t type, BitArray &b){
+	const RecSection *s = r.find(type);
+	b.clear();
+	if (s == NULL)
+		return 0;
+	if (r.read_vector(type, b.v))
+		return -1;
+	b.n = s->aux[0];
+	b.format = (BitArray::Format)s->aux[1];
+	return 0;
+}
 
-	// write siqq
-	if (!dump_vector(siqq, fout))
-		goto fail_write;
+int Records::read(const char* filename, vector<RecSection> *table){
+	RecFileReader r;
+	vector<RecMeta> meta;
+	vector<tcp_sock_init_data> init;
+	uint32_t magic = 0;
+	FILE* fin = fopen(filename, "r");
+	if (table)
+		table->clear();
+	if (fin == NULL)
+		return -1;
+	if (!fread(&magic, sizeof(magic), 1, fin) || !rec_file_is_v2(&magic, sizeof(magic))){
+		fclose(fin);
+		return read_v1(filename);
+	}
+	fclose(fin);
 
-	// write siq
-	if (!siq.dump(fout))
-		goto fail_write;
+	if (r.open(filename))
+		return -1;
+	if (table)
+		*table = r.table;
+	if (r.read_vector(REC_SEC_META, meta) || meta.size() != 1)
+		return -1;
+	mode = meta[0].mode;
+	broken = meta[0].broken;
+	alert = meta[0].alert;
+	sip = meta[0].sip;
+	dip = meta[0].dip;
+	sport = meta[0].sport;
+	dport = meta[0].dport;
+	fin_seq = meta[0].fin_seq;
+	n_sockets_allocated = meta[0].n_sockets_allocated;
+	eb_dense = meta[0].eb_dense;
+	if (r.find(REC_SEC_INIT_DATA)){
+		if (r.read_vector(REC_SEC_INIT_DATA, init) || init.size() != 1)
+			return -1;
+		init_data = init[0];
+	}else {
+		const RecSection *s = r.find(REC_SEC_INIT_DELTA);
+		vector<uint32_t> delta;
+		InitBase base;
+		if (s == NULL || r.read_vector(REC_SEC_INIT_DELTA, delta))
+			return -1;
+		if (get_init_base(filename, s->aux[0], base)){
+			fprintf(stderr, "%s: no init data baseline %08x in %s\n", filename, s->aux[0], INIT_BASE_FILE);
+			return -1;
+		}
+		if (init_delta_decode(base.d, delta.data(), delta.size(), init_data))
+			return -1;
+	}
 
+	if (r.read_vector(REC_SEC_EVT, evts) || r.read_vector(REC_SEC_SOCKCALL, sockcalls) || r.read_vector(REC_SEC_PS, ps)
+			|| r.read_vector(REC_SEC_JIF, jiffies) || read_bit_array(r, REC_SEC_MPQ, mpq)
+			|| r.read_vector(REC_SEC_MA, memory_allocated) || r.read_vector(REC_SEC_MSTAMP, mstamp)
+			|| r.read_vector(REC_SEC_SIQQ, siqq) || read_bit_array(r, REC_SEC_SIQ, siq))
+		return -1;
 	#if COLLECT_TX_STAMP
-	// write tsq
-	if (!dump_vector(tsq, fout))
-		goto fail_write;
+	if (r.read_vector(REC_SEC_TSQ, tsq))
+		return -1;
 	#endif
-
-	// write effect_bool
+	// effect_bool locations beyond the writer's DETER_EFFECT_BOOL_N_LOC are simply missing, thus empty
 	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
-		if (!ebq[i].dump(fout))
-			goto fail_write;
-
+		if (read_bit_array(r, REC_SEC_EBQ(i), ebq[i]))
+			return -1;
+	if (r.read_vector(REC_SEC_EBX, ebx))
+		return -1;
 	#if ADVANCED_EVENT_ENABLE
-	// write aeq
-	if (!dump_vector(aeq, fout))
-		goto fail_write;
+	if (r.read_vector(REC_SEC_AEQ, aeq))
+		return -1;
 	#endif
-
-	fclose(fout);
 	return 0;
-fail_write:
-	fclose(fout);
-	return -1;
 }
 
-int Records::read(const char* filename){
+/* v1: raw fields back to back, in the order of the build flags of the writer */
+int Records::read_v1(const char* filename){
 	FILE* fin= fopen(filename, "r");
-	uint32_t len;
+	if (fin == NULL)
+		return -1;
 	// read mode
 	if (!fread(&mode, sizeof(mode), 1, fin))
 		goto fail_read;
@@ -257,6 +445,15 @@ int Records::read(const char* filename){
 		goto fail_read;
 	#endif
 
+	// read multiplexed effect_bool. Absent in files recorded before it existed, where all locations are dense
+	if (fread(&eb_dense, sizeof(eb_dense), 1, fin)){
+		if (!read_vector(ebx, fin))
+			goto fail_read;
+	}else {
+		eb_dense = DETER_EFFECT_BOOL_ALL_DENSE;
+		ebx.clear();
+	}
+
 	fclose(fin);
 	return 0;
 fail_read:
@@ -276,6 +473,28 @@ uint64_t Records::get_pkt_received(){
 	return evts.back().seq + 1 - evts.size();
 }
 
+/* the forward gaps of the ip ids of the packets received (ps), as packets that did not arrive */
+uint64_t Records::get_pkt_lost(){
+	uint64_t lost = 0;
+	for (uint64_t i = 0; i < ps.size(); i++){
+		uint16_t gap;
+		if (!(ps[i] >> 15)) // a run of consecutive ids
+			continue;
+		if (ps[i] == 0xffff){
+			if (++i == ps.size())
+				break;
+			gap = ps[i];
+			if (gap > 0x7fff) // backward
+				continue;
+		}else if ((ps[i] >> 14) & 1) // backward
+			continue;
+		else
+			gap = ps[i] & 0x3fff;
+		lost += gap ? gap - 1 : 0; // 0: the same id again
+	}
+	return lost;
+}
+
 uint64_t Records::get_total_bytes_received(){
 	uint64_t total_bytes = 0;
 	for (int i = 0; i < sockcalls.size(); i++){
@@ -295,66 +514,33 @@ uint64_t Records::get_total_bytes_sent(){
 	}
 	return total_bytes;
 }
-uint64_t Records::sample_timestamp(vector<uint64_t> &v, uint64_t th){
+uint64_t Records::sample_timestamp(vector<uint64_t> &v, uint64_t th, StorageSize &s){
 	uint64_t size0 = 0, size1 = 0, size2 = 0, size3 = 0, size4 = 0;
+	vector<TsSegment> seg;
+	fit_timestamps(v, th, seg);
+	s.tx_stamp_n_sample = seg.size();
 	{
-		int nSamp = 1;
-		uint64_t s = 0;
-		double cand_min = 0, cand_max = 1e99;
-		for (int64_t i = 1; i < (int64_t)v.size(); i++){
-			double this_max = double(v[i] + th - v[s]) / (i - s);
-			double this_min = (v[i] - v[s] > th) ? double(v[i] - th - v[s]) / (i - s) : 0;
-			if (this_min <= cand_max && this_max >= cand_min){ // overlap
-				cand_min = cand_min > this_min ? cand_min : this_min;
-				cand_max = cand_max < this_max ? cand_max : this_max;
-			}else { // new sample
-				nSamp++;
-				uint64_t rate = (uint64_t)((cand_max + cand_min) / 2);
-				int64_t delta_t = v[i] - (v[s] + rate * (i - 1 - s));
-				//printf("i= %ld, rate=%lu, delta_t=%ld\n", i, rate, delta_t);
-				uint64_t index_bit = nbit_dynamic_coding(i - s), rate_bit = nbit_dynamic_coding(rate, 0x1f0f0a), delta_bit = nbit_dynamic_coding(abs(delta_t), 0x1f0f0a) + 1;
-				//printf("%lu %lu %lu\n", index_bit, rate_bit, delta_bit);
-				size0 += index_bit + rate_bit + delta_bit;
-				#if 0
-				for (int j = s; j < i; j++)
-					printf("%lu - %lu = %ld\n", v[j], v[s] + rate * (j-s), v[j] - v[s] - rate*(j-s));
-				#endif
-				s = i;
-				cand_min = 0; cand_max = 1e99;
-			}
+		for (auto &x : seg){
+			uint64_t index_bit = nbit_dynamic_coding(x.len), rate_bit = nbit_dynamic_coding(x.rate >> TS_RATE_FRAC, 0x1f0f0a), delta_bit = nbit_dynamic_coding(abs(x.jump), 0x1f0f0a) + 1;
+			size0 += index_bit + rate_bit + delta_bit;
 		}
 		size0 /= 8;
-		printf("\ttx_stamp size, sample, dynamic: nSamp: %d size: %lu\n", nSamp, size0);
+		s.tx_stamp_sample_dynamic = size0;
 	}
 
 	#if 1
 	{
-		int nSamp = 1;
-		uint64_t s = 0;
-		double cand_min = 0, cand_max = 1e99;
 		vector<uint64_t> v_index, v_rate, v_delta;
-		for (int64_t i = 1; i < (int64_t)v.size(); i++){
-			double this_max = double(v[i] + th - v[s]) / (i - s);
-			double this_min = (v[i] - v[s] > th) ? double(v[i] - th - v[s]) / (i - s) : 0;
-			if (this_min <= cand_max && this_max >= cand_min){ // overlap
-				cand_min = cand_min > this_min ? cand_min : this_min;
-				cand_max = cand_max < this_max ? cand_max : this_max;
-			}else { // new sample
-				nSamp++;
-				uint64_t rate = (uint64_t)((cand_max + cand_min) / 2);
-				int64_t delta_t = v[i] - (v[s] + rate * (i - 1 - s));
-				v_index.push_back(i-s);
-				v_rate.push_back(rate);
-				v_delta.push_back(delta_t);
-				s = i;
-				cand_min = 0; cand_max = 1e99;
-			}
+		for (auto &x : seg){
+			v_index.push_back(x.len);
+			v_rate.push_back(x.rate >> TS_RATE_FRAC);
+			v_delta.push_back(x.jump);
 		}
 		size1 = nbit_huffman_prefix_encoding(v_index, 1024);
 		size1 += nbit_huffman_prefix_encoding(v_rate, 1024);
 		size1 += nbit_huffman_prefix_encoding(v_delta, 1024);
 		size1 /= 8;
-		printf("\ttx_stamp size, sample, huffman_prefix: nSamp: %d size: %lu\n", nSamp, size1);
+		s.tx_stamp_sample_huffman_prefix = size1;
 	}
 	#endif
 
@@ -366,7 +552,7 @@ uint64_t Records::sample_timestamp(vector<uint64_t> &v, uint64_t th){
 			//printf("%lu %lu %u\n", v[i], v[i] - v[i-1], nbit);
 		}
 		size2 /= 8;
-		printf("\ttx_stamp size, static_prefix: %lu\n", size2);
+		s.tx_stamp_static_prefix = size2;
 	}
 	
 	// huffman prefix
@@ -375,7 +561,7 @@ uint64_t Records::sample_timestamp(vector<uint64_t> &v, uint64_t th){
 		for (int64_t i = 1; i < (int64_t)v.size(); i++)
 			delta.push_back(v[i] - v[i-1]);
 		size3 = nbit_huffman_prefix_encoding(delta, 1024) / 8;
-		printf("\ttx_stamp size, huffman_prefix: %lu\n", size3);
+		s.tx_stamp_huffman_prefix = size3;
 	}
 
 	// huffman
@@ -384,13 +570,23 @@ uint64_t Records::sample_timestamp(vector<uint64_t> &v, uint64_t th){
 		for (int64_t i = 1; i < (int64_t)v.size(); i++)
 			delta.push_back(v[i] - v[i-1]);
 		size4 = nbit_huffman_encoding(delta, 99999999) / 8;
-		printf("\ttx_stamp size, huffman_encoding: %lu\n", size4);
+		s.tx_stamp_huffman_encoding = size4;
 	}
 	#endif
 
     return 0;
 }
 
+#if COLLECT_TX_STAMP
+static void print_tx_stamp_size(const StorageSize &s){
+	printf("\ttx_stamp size, sample, dynamic: nSamp: %lu size: %lu\n", s.tx_stamp_n_sample, s.tx_stamp_sample_dynamic);
+	printf("\ttx_stamp size, sample, huffman_prefix: nSamp: %lu size: %lu\n", s.tx_stamp_n_sample, s.tx_stamp_sample_huffman_prefix);
+	printf("\ttx_stamp size, static_prefix: %lu\n", s.tx_stamp_static_prefix);
+	printf("\ttx_stamp size, huffman_prefix: %lu\n", s.tx_stamp_huffman_prefix);
+	printf("\ttx_stamp size, huffman_encoding: %lu\n", s.tx_stamp_huffman_encoding);
+}
+#endif
+
 void Records::print_meta(FILE *fout){
 	fprintf(fout, "broken: %x\n", broken);
 	fprintf(fout, "alert: %x\n", alert);
@@ -399,110 +595,14 @@ void Records::print_meta(FILE *fout){
 	fprintf(fout, "fin_seq: %u\n", fin_seq);
 
 	// count total bytes transferred
-	printf("total bytes sent: %lu\n", get_total_bytes_sent());
-	printf("total bytes received: %lu\n", get_total_bytes_received());
+	fprintf(fout, "total bytes sent: %lu\n", get_total_bytes_sent());
+	fprintf(fout, "total bytes received: %lu\n", get_total_bytes_received());
 
 	// count pkt received
-	printf("packets received: %lu\n", get_pkt_received());
+	fprintf(fout, "packets received: %lu\n", get_pkt_received());
 }
 void Records::print(FILE* fout){
-	fprintf(fout, "%lu sockcalls\n", sockcalls.size());
-	for (int i = 0; i < sockcalls.size(); i++){
-		deter_rec_sockcall &sc = sockcalls[i];
-		fprintf(fout, "%d ", i);
-		if (sc.type == DETER_SOCKCALL_TYPE_SENDMSG){
-			fprintf(fout, "sendmsg: 0x%x %lu thread %lu", sc.sendmsg.flags, sc.sendmsg.size, sc.thread_id);
-		}else if (sc.type == DETER_SOCKCALL_TYPE_RECVMSG){
-			fprintf(fout, "recvmsg: 0x%x %lu thread %lu", sc.recvmsg.flags, sc.recvmsg.size, sc.thread_id);
-		}else if (sc.type == DETER_SOCKCALL_TYPE_CLOSE){
-			fprintf(fout, "close: %ld thread %lu", sc.close.timeout, sc.thread_id);
-		}else if (sc.type == DETER_SOCKCALL_TYPE_SPLICE_READ){
-			fprintf(fout, "splice_read: 0x%x %lu thread %lu", sc.splice_read.flags, sc.splice_read.size, sc.thread_id);
-		}else if (sc.type == DETER_SOCKCALL_TYPE_SETSOCKOPT){
-			if (valid_rec_setsockopt(&sc.setsockopt)){
-				fprintf(fout, "setsockopt: %hhu %hhu %hhu ", sc.setsockopt.level, sc.setsockopt.optname, sc.setsockopt.optlen);
-				for (int j = 0; j < sc.setsockopt.optlen; j++)
-					fprintf(fout, " %hhx", sc.setsockopt.optval[j]);
-				fprintf(fout, " thread %lu", sc.thread_id);
-			}else 
-				fprintf(fout, "Error: unsupported setsockopt\n");
-		}
-		fprintf(fout, "\n");
-	}
-	fprintf(fout, "%lu events\n", evts.size());
-	for (int i = 0; i < evts.size(); i++){
-		deter_event &e = evts[i];
-		char buf[32];
-		fprintf(fout, "%u %s", e.seq, get_event_name(e.type, buf));
-		if (e.type >= DETER_SOCK_ID_BASE)
-			fprintf(fout, " %s", get_sockcall_str(&sockcalls[get_sockcall_idx(e.type)], buf));
-
-		fprintf(fout, "\n");
-	}
-
-	fprintf(fout, "%lu pkt_stream\n", ps.size());
-	for (uint32_t i = 0; i < ps.size(); i++){
-		if (ps[i] >> 15){
-			if (ps[i] == 0xffff){
-				i++;
-				fprintf(fout, "%hd\n", ps[i]);
-			}if ((ps[i] >> 14) & 1)
-				fprintf(fout, "-%hu\n", ps[i] & 0x3fff);
-			else
-				fprintf(fout, "%hu\n", ps[i] & 0x3fff);
-		}else
-			fprintf(fout, "1:%hu\n", ps[i]);
-	}
-
-	fprintf(fout, "%lu new jiffies\n", jiffies.size());
-	if (jiffies.size() > 0){
-		fprintf(fout, "first: %lu\n", jiffies[0].init_jiffies);
-		for (int i = 1; i < jiffies.size(); i++)
-			fprintf(fout, "%u %u\n", jiffies[i].idx_delta, jiffies[i].jiffies_delta);
-	}
-
-	fprintf(fout, "memory_pressure:\n");
-	mpq.print(fout);
-
-	fprintf(fout, "%lu new values of reading memory_allocated\n", memory_allocated.size());
-	if (memory_allocated.size() > 0){
-		fprintf(fout, "first: %lu\n", memory_allocated[0].init_v);
-		for (int i = 1; i < memory_allocated.size(); i++)
-			fprintf(fout, "%u %d\n", memory_allocated[i].idx_delta, memory_allocated[i].v_delta);
-	}
-
-	fprintf(fout, "%u reads to n_sockets_allocated\n", n_sockets_allocated);
-
-	fprintf(fout, "%lu skb_mstamp_get:\n", mstamp.size());
-	for (int64_t i = 0; i < mstamp.size(); i++)
-		fprintf(fout, "%u %u\n", mstamp[i].stamp_us, mstamp[i].stamp_jiffies);
-
-	fprintf(fout, "%lu skb_still_in_host_queue:\n", siqq.size());
-	for (int64_t i = 0; i < siqq.size(); i++)
-		fprintf(fout, "%hhu\n", siqq[i]);
-
-	fprintf(fout, "siq: %u reads %lu\n", siq.n, siq.v.size());
-	for (int64_t i = 0; i < siq.v.size(); i++){
-		for (uint32_t j = 0, b = siq.v[i]; j < 32; j++, b>>=1)
-			fprintf(fout, "%u", b&1);
-		fprintf(fout, "\n");
-	}
-
-	#if COLLECT_TX_STAMP
-	fprintf(fout, "%lu tsq:\n", tsq.size());
-	for (int64_t i = 0; i < tsq.size(); i++)
-		fprintf(fout, "%u %u\n", tsq[i], (tsq[i] - (i?tsq[i-1]:0)) / 1000);
-	#endif
-
-	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++){
-		auto &eb = ebq[i];
-		fprintf(fout, "effect_bool %d: %u reads %lu\n", i, eb.n, eb.v.size());
-		for (int j = 0; j < eb.v.size(); j++){
-			for (uint32_t k = 0, b = eb.v[j]; k < 32; k++, b>>=1)
-				fprintf(fout, "%u", b & 1);
-			fprintf(fout, "\n");
-		}
-	}
+	rec_print(*this, fout, REC_FMT_TEXT, REC_STREAMS_DATA);
 
 	#if ADVANCED_EVENT_ENABLE
 	fprintf(fout, "%lu u32 for advanced events\n", aeq.size());
@@ -668,8 +768,10 @@ void Records::clear(){
 	#if COLLECT_TX_STAMP
 	tsq.clear();
 	#endif
+	eb_dense = DETER_EFFECT_BOOL_ALL_DENSE;
 	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
 		ebq[i].clear();
+	ebx.clear();
 	#if ADVANCED_EVENT_ENABLE
 	aeq.clear();
 	#endif
@@ -697,7 +799,7 @@ string get_sockcall_key(deter_rec_sockcall &sc){
 }
 
 #if COLLECT_TX_STAMP
-uint64_t Records::tx_stamp_size(){
+uint64_t Records::tx_stamp_size(StorageSize &s){
 	//return 0;
 	vector<uint64_t> v;
 	uint64_t delta = 0;
@@ -706,7 +808,7 @@ uint64_t Records::tx_stamp_size(){
 			delta += 0x100000000l;
 		v.push_back((x+delta) / 100);
 	}
-	return sample_timestamp(v, 50); // 100-nanosecond
+	return sample_timestamp(v, 50, s); // 100-nanosecond
 }
 #endif
 
@@ -737,15 +839,19 @@ void Records::print_raw_storage_size(){
 		size += ebq[i].raw_storage_size();
 		printf("ebq[%d]: %lu\n", i, ebq[i].raw_storage_size());
 	}
+	size += sizeof(uint8_t) * ebx.size();
+	printf("ebx: %lu\n", sizeof(uint8_t) * ebx.size());
 	#if COLLECT_TX_STAMP
-	this_size = tx_stamp_size();
+	StorageSize ts;
+	this_size = tx_stamp_size(ts);
+	print_tx_stamp_size(ts);
 	size += this_size;
 	printf("tx_stamp: %lu\n", this_size);
 	#endif
 	printf("total: %lu\n", size);
 }
 
-uint64_t Records::compressed_evt_size(){
+uint64_t Records::compressed_evt_size(StorageSize &s){
 	uint64_t this_size;
 	uint64_t this_size1 = 0, this_size2 = 0, this_size3 = 0;
 
@@ -772,13 +878,13 @@ uint64_t Records::compressed_evt_size(){
 		}
 		this_size1 /= 8;
 		this_size = this_size1;
-		printf("\tevts: dynamic: %lu\n", this_size1);
+		s.evts_dynamic = this_size1;
 
 		this_size2 = nbit_huffman_prefix_encoding(lens, 1024) / 8;
-		printf("\tevts: huffman_prefix: %lu\n", this_size2);
+		s.evts_huffman_prefix = this_size2;
 
 		this_size3 = nbit_huffman_encoding(lens, 1024) / 8;
-		printf("\tevts: huffman_encoding: %lu\n", this_size3);
+		s.evts_huffman_encoding = this_size3;
 	}
 	return this_size;
 }
@@ -860,7 +966,7 @@ uint64_t Records::compressed_memory_allocated_size(){
 	return res / 8;
 }
 
-uint64_t Records::compressed_mstamp_size(){
+uint64_t Records::compressed_mstamp_size(StorageSize &s){
 	uint64_t this_size;
 	uint64_t this_size0 = 0, this_size1 = 0, this_size2 = 0;
 	{
@@ -885,7 +991,7 @@ uint64_t Records::compressed_mstamp_size(){
 		us_size = us_bits/8;
 		this_size0 = jiffies_size + us_size + nbit_dynamic_coding(mstamp.size()) / 8;
 		this_size = this_size0;
-		printf("\tmstamp size, dynamic: %lu\n", this_size0);
+		s.mstamp_dynamic = this_size0;
 	}
 
 	// use huffman prefix
@@ -897,7 +1003,7 @@ uint64_t Records::compressed_mstamp_size(){
 		this_size1 += nbit_dynamic_coding(mstamp.size()) / 8;
 		if (this_size1 < this_size)
 			this_size = this_size1;
-		printf("\tmstamp size, huffman_prefix: %lu\n", this_size1);
+		s.mstamp_huffman_prefix = this_size1;
 	}
 
 	// huffman
@@ -911,7 +1017,7 @@ uint64_t Records::compressed_mstamp_size(){
 		if (this_size2 < this_size)
 			this_size = this_size2;
 		#endif
-		printf("\tmstamp size, huffman_encoding: %lu\n", this_size2);
+		s.mstamp_huffman_encoding = this_size2;
 	}
 	return this_size;
 }
@@ -920,69 +1026,115 @@ deter_rec_sockcall* Records::evt_get_sc(deter_event *evt){
 	return &sockcalls[get_sockcall_idx(evt->type)];
 }
 
-void Records::print_compressed_storage_size(){
-	uint64_t size = 0, this_size = 0;
+void Records::get_compressed_storage_size(StorageSize &s){
+	memset(&s, 0, sizeof(s));
 	// On average, there are 23 diff socket variables between two diff sockets (server vs. server or client vs. client)
-	this_size = 23 * 4;
-	size += this_size;
-	printf("init_data: %lu\n", this_size);
-
-	this_size = compressed_evt_size();
-	size += this_size;
-	printf("evts: %lu\n", this_size);
-
-	this_size = compressed_sockcall_size();
-	size += this_size;
-	printf("sockcalls: %lu\n", this_size);
+	s.init_data = 23 * 4;
+	s.evts = compressed_evt_size(s);
+	s.sockcalls = compressed_sockcall_size();
 
 	//size += sizeof(uint32_t) * dpq.size();
 	//printf("dpq: %lu\n", sizeof(uint32_t) * dpq.size());
 
 	{
-		this_size = 64 + nbit_dynamic_coding(jiffies.size());
+		uint64_t this_size = 64 + nbit_dynamic_coding(jiffies.size());
 		for (int i = 1; i < jiffies.size(); i++)
 			this_size += nbit_dynamic_coding(jiffies[i].jiffies_delta) + nbit_dynamic_coding(jiffies[i].idx_delta);
-		this_size /= 8;
+		s.jiffies = this_size / 8;
 	}
-	size += this_size;
-	printf("jiffies: %lu\n",  this_size);
-	size += mpq.raw_storage_size();
-	printf("mpq: %lu\n", mpq.raw_storage_size());
-	{
-		this_size = compressed_memory_allocated_size();
-		size += this_size;
-		printf("memory_allocated: %lu\n", this_size);
-	}
-	{
-		#if 1
-		this_size = compressed_mstamp_size();
-		size += this_size;
-		printf("mstamp: jiffies: %lu us: %lu total: %lu\n", 0l, this_size, this_size);
-		#else
-		printf("mstamp: NOT counted\n");
-		#endif
+	s.mpq = mpq.raw_storage_size();
+	s.memory_allocated = compressed_memory_allocated_size();
+	s.mstamp = compressed_mstamp_size(s);
+	s.siqq = (nbit_dynamic_coding(siqq.size()) + siqq.size()) / 8;
+	s.siq = siq.compressed_storage_size();
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		s.ebq[i] = ebq[i].compressed_storage_size();
+	// 5-bit loc + 1 bit per entry
+	s.ebx = (nbit_dynamic_coding(ebx.size()) + ebx.size() * 6) / 8;
+	#if COLLECT_TX_STAMP
+	s.tx_stamp = tx_stamp_size(s);
+	#endif
+
+	s.total = s.init_data + s.evts + s.sockcalls + s.jiffies + s.mpq + s.memory_allocated + s.mstamp + s.siqq + s.siq + s.ebx
+		+ s.tx_stamp;
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		s.total += s.ebq[i];
+}
+
+void Records::print_compressed_storage_size(){
+	StorageSize s;
+	get_compressed_storage_size(s);
+	printf("init_data: %lu\n", s.init_data);
+	printf("\tevts: dynamic: %lu\n", s.evts_dynamic);
+	printf("\tevts: huffman_prefix: %lu\n", s.evts_huffman_prefix);
+	printf("\tevts: huffman_encoding: %lu\n", s.evts_huffman_encoding);
+	printf("evts: %lu\n", s.evts);
+	printf("sockcalls: %lu\n", s.sockcalls);
+	printf("jiffies: %lu\n",  s.jiffies);
+	printf("mpq: %lu\n", s.mpq);
+	printf("memory_allocated: %lu\n", s.memory_allocated);
+	#if 1
+	printf("\tmstamp size, dynamic: %lu\n", s.mstamp_dynamic);
+	printf("\tmstamp size, huffman_prefix: %lu\n", s.mstamp_huffman_prefix);
+	printf("\tmstamp size, huffman_encoding: %lu\n", s.mstamp_huffman_encoding);
+	printf("mstamp: jiffies: %lu us: %lu total: %lu\n", 0l, s.mstamp, s.mstamp);
+	#else
+	printf("mstamp: NOT counted\n");
+	#endif
+	printf("siqq: %lu\n", s.siqq);
+	printf("siq: %lu\n", s.siq);
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		printf("ebq[%d]: %lu\n", i, s.ebq[i]);
+	printf("ebx: %lu\n", s.ebx);
+	#if COLLECT_TX_STAMP
+	print_tx_stamp_size(s);
+	printf("tx_stamp: %lu\n", s.tx_stamp);
+	#endif
+	printf("compressed total: %lu\n", s.total);
+}
+
+static bool ends_with(const string &s, const char *suffix){
+	uint64_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+int list_record_files(const string &path, vector<string> &files){
+	struct stat st;
+	if (stat(path.c_str(), &st)){
+		fprintf(stderr, "Fail to read %s\n", path.c_str());
+		return -1;
 	}
-	{
-		this_size = (nbit_dynamic_coding(siqq.size()) + siqq.size()) / 8;
-		size += this_size;
-		printf("siqq: %lu\n", this_size);
+	if (!S_ISDIR(st.st_mode)){
+		files.push_back(path);
+		return 0;
 	}
-	{
-		uint64_t sz = siq.compressed_storage_size();
-		size += sz;
-		printf("siq: %lu\n", sz);
+	DIR *d = opendir(path.c_str());
+	struct dirent *e;
+	if (d == NULL){
+		fprintf(stderr, "Fail to read %s\n", path.c_str());
+		return -1;
 	}
-	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++){
-		uint64_t sz = ebq[i].compressed_storage_size();
-		size += sz;
-		printf("ebq[%d]: %lu\n", i, sz);
+	while ((e = readdir(d)) != NULL){
+		string name = e->d_name;
+		// the baselines, dictionaries and index of the directory, journals of open connections, and files being replaced
+		if (name[0] == '.' || name == INIT_BASE_FILE || name == SHARED_DICT_FILE || is_rec_index_file(name)
+				|| ends_with(name, REC_JOURNAL_SUFFIX) || ends_with(name, ".tmp"))
+			continue;
+		if (e->d_type == DT_DIR || e->d_type == DT_UNKNOWN)
+			list_record_files(path + "/" + name, files);
+		else
+			files.push_back(path + "/" + name);
 	}
-	#if COLLECT_TX_STAMP
-	{
-		this_size = tx_stamp_size();
-		size += this_size;
-		printf("tx_stamp: %lu\n", this_size);
+	closedir(d);
+	return 0;
+}
+
+int parse_n_thread(int argc, char **argv, int &n_thread){
+	// hardware_concurrency() is 0 if it can't tell
+	n_thread = max(1u, thread::hardware_concurrency());
+	if (argc > 2 && strcmp(argv[1], "-j") == 0){
+		n_thread = atoi(argv[2]);
+		return n_thread > 0 ? 3 : -1;
 	}
-	#endif
-	printf("compressed total: %lu\n", size);
+	return 1;
 }
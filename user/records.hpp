@@ -8,6 +8,18 @@
 #include <map>
 #include "base_struct.hpp"
 #include "coding.hpp"
+#include "record_file.hpp"
+
+/* the error in ns that lossy codecs may add to the tx stamps in a record file; 0 keeps them exact */
+#define TSQ_MAX_ERR 100
+/*
+ * 1: store jiffies, memory_allocated and mstamp with stream_vbyte, which decodes about as fast as the raw streams are
+ * copied, so replay does not wait on them, when it is at most 1/8 + 64 bytes larger than the smallest codec
+ * (CODEC_PREFER_SLACK in codec.hpp); it is 2 to 4 times larger on the test corpus. 0: always the smallest codec
+ */
+#define REC_FAST_DELTA 1
+/* 1: store init data as a delta to the baseline of its role in the directory of the record file, if any (init_base.hpp) */
+#define REC_INIT_DELTA 1
 
 static uint32_t nbit_dynamic_coding(uint64_t x, uint64_t step = 0){
 	// Dynamically increase the nbits for recording x
@@ -43,7 +55,7 @@ static uint32_t nbit_dynamic_coding(uint64_t x, uint64_t step = 0){
 }
 
 static inline int get_nbit(uint64_t x){
-	return 64 - __builtin_clzl(x);
+	return x ? 64 - __builtin_clzl(x) : 0;
 }
 static uint32_t nbit_static_prefix_encoding(uint64_t x, int prefix_nbit){
 	if (x==0)
@@ -291,6 +303,18 @@ struct BitArray{
 	}
 };
 
+/* the storage of each stream as print_compressed_storage_size estimates it, in bytes */
+struct StorageSize{
+	uint64_t init_data, evts, sockcalls, jiffies, mpq, memory_allocated, mstamp, siqq, siq, ebq[DETER_EFFECT_BOOL_N_LOC], ebx;
+	uint64_t tx_stamp;
+	uint64_t total;
+	// the codings the estimates are chosen from
+	uint64_t evts_dynamic, evts_huffman_prefix, evts_huffman_encoding;
+	uint64_t mstamp_dynamic, mstamp_huffman_prefix, mstamp_huffman_encoding;
+	uint64_t tx_stamp_n_sample, tx_stamp_sample_dynamic, tx_stamp_sample_huffman_prefix, tx_stamp_static_prefix;
+	uint64_t tx_stamp_huffman_prefix, tx_stamp_huffman_encoding;
+};
+
 class Records{
 public:
 	uint32_t mode, broken, alert;
@@ -310,7 +334,9 @@ public:
 	std::vector<skb_mstamp> mstamp;
 	std::vector<uint8_t> siqq;
 	BitArray siq;
+	uint32_t eb_dense; // effect_bool locations recorded in ebq; the others are in ebx
 	BitArray ebq[DETER_EFFECT_BOOL_N_LOC];
+	std::vector<uint8_t> ebx; // multiplexed effect_bool of sparse locations, get_ebx_entry(loc, bit) in read order
 	#if COLLECT_TX_STAMP
 	std::vector<uint32_t> tsq;
 	#endif
@@ -318,29 +344,53 @@ public:
 	std::vector<u32> aeq;
 	#endif
 
-	Records() : broken(0), alert(0), recorder_id(-1), active(0), fin_seq(0) {}
+	Records() : broken(0), alert(0), recorder_id(-1), active(0), fin_seq(0), eb_dense(DETER_EFFECT_BOOL_ALL_DENSE) {}
 	void transform(); // transform raw data to final format
 	void order_sockcalls(); // order sockcalls according to their first appearance in evts
+	std::string file_name() const; // of dump() by default, in the working directory
+	void get_meta(RecMeta &meta) const;
 	int dump(const char* filename = NULL);
-	int read(const char* filename);
+	/*
+	 * append the streams held so far to the journal w (record_file.hpp), opened at file_name() + REC_JOURNAL_SUFFIX
+	 * the first time, then clear them and write a checkpoint
+	 */
+	int journal(RecFileWriter &w);
+	uint64_t stream_bytes() const; // held in the streams
+	// put the streams of a journal before those held, with the fields known when the connection opened
+	int read_journal(const char* filename);
+	// v2, or v1 written before the section table. The section table of a v2 file goes to table if not NULL, empty for v1
+	int read(const char* filename, std::vector<RecSection> *table = NULL);
+	int read_v1(const char* filename);
 	void print_meta(FILE *fout = stdout);
 	void print(FILE* fout = stdout);
 	void print_init_data(FILE* fout = stdout);
 	void clear();
 	uint64_t get_pkt_received();
+	uint64_t get_pkt_lost();
 	uint64_t get_total_bytes_received();
 	uint64_t get_total_bytes_sent();
-	uint64_t sample_timestamp(std::vector<uint64_t> &v, uint64_t th);
+	uint64_t sample_timestamp(std::vector<uint64_t> &v, uint64_t th, StorageSize &s);
 	#if COLLECT_TX_STAMP
-	uint64_t tx_stamp_size();
+	uint64_t tx_stamp_size(StorageSize &s);
 	#endif
 	void print_raw_storage_size();
 	deter_rec_sockcall* evt_get_sc(deter_event *evt);
-	uint64_t compressed_evt_size();
+	uint64_t compressed_evt_size(StorageSize &s);
 	uint64_t compressed_sockcall_size();
 	uint64_t compressed_memory_allocated_size();
-	uint64_t compressed_mstamp_size();
+	uint64_t compressed_mstamp_size(StorageSize &s);
+	void get_compressed_storage_size(StorageSize &s);
 	void print_compressed_storage_size();
 };
 
+/*
+ * the record of a journal left by a recorder that died, next to it without REC_JOURNAL_SUFFIX, and remove the
+ * journal. The end of the connection is lost, so the record is broken
+ */
+int recover_journal(const char* filename);
+/* the record files under path, a file or a directory and its subdirectories */
+int list_record_files(const std::string &path, std::vector<std::string> &files);
+/* the threads of a corpus tool: "-j <n>" if the first arguments, else a thread per core. The index of the next argument, -1 if n is bad */
+int parse_n_thread(int argc, char **argv, int &n_thread);
+
 #endif /* _RECORDS_HPP */
@@ -0,0 +1,273 @@
+#include <cstdio>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "records_view.hpp"
+#include "codec.hpp"
+#include "init_base.hpp"
+#include "shared_dict.hpp"
+
+using namespace std;
+
+int RecordsView::open(const char* filename){
+	struct stat st;
+	int ret = -1;
+	void *p;
+	int fd = ::open(filename, O_RDONLY);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(uint32_t))
+		goto out;
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+		goto out;
+	base = (const uint8_t*)p;
+	size = st.st_size;
+	if (!rec_file_is_v2(base, size)){
+		ret = -2;
+		goto fail_check;
+	}
+	hdr = (const RecFileHeader*)base;
+	if (rec_file_check_header(hdr, size))
+		goto fail_check;
+	table = (const RecSection*)(base + hdr->table_off);
+	if (rec_file_check_table(hdr, table, size))
+		goto fail_check;
+	load_shared_dicts(filename);
+	checked.assign(hdr->n_section, 0);
+	decoded.assign(hdr->n_section, vector<uint8_t>());
+	failed = false;
+	this->filename = filename;
+	init.clear();
+
+	// metadata is always needed
+	meta = (const RecMeta*)get_section(REC_SEC_META, sizeof(RecMeta));
+	if (meta == NULL || find(REC_SEC_META)->n_elem != 1)
+		goto fail_check;
+	ret = 0;
+	goto out;
+fail_check:
+	close();
+out:
+	::close(fd); // the mapping stays valid
+	return ret;
+}
+
+RecordsView& RecordsView::operator=(RecordsView &&x){
+	if (this == &x)
+		return *this;
+	close();
+	base = x.base;
+	size = x.size;
+	hdr = x.hdr;
+	table = x.table;
+	meta = x.meta;
+	checked = move(x.checked);
+	decoded = move(x.decoded);
+	failed = x.failed;
+	filename = move(x.filename);
+	init = move(x.init);
+	x.base = NULL;
+	x.close();
+	return *this;
+}
+
+void RecordsView::close(){
+	if (base)
+		munmap((void*)base, size);
+	base = NULL;
+	size = 0;
+	hdr = NULL;
+	table = NULL;
+	meta = NULL;
+	checked.clear();
+	decoded.clear();
+	init.clear();
+}
+
+const RecSection* RecordsView::find(uint16_t type) const{
+	for (uint32_t i = 0; i < hdr->n_section; i++)
+		if (table[i].type == type)
+			return &table[i];
+	return NULL;
+}
+
+const uint8_t* RecordsView::get_section(uint16_t type, uint32_t elem_size, bool decode) const{
+	const RecSection *s = find(type);
+	uint32_t i;
+	if (s == NULL)
+		return NULL;
+	i = s - table;
+	if (checked[i] == 0){
+		checked[i] = 2;
+		if (s->elem_size != elem_size)
+			fprintf(stderr, "record file section type %hu: element size %u, expect %u\n", s->type, s->elem_size, elem_size);
+		else if (s->codec == REC_CODEC_RAW && s->length != s->n_elem * s->elem_size)
+			fprintf(stderr, "record file section type %hu: bad length\n", s->type);
+		else if (crc32c(0, base + s->offset, s->length) != s->crc)
+			fprintf(stderr, "record file section type %hu CRC mismatch\n", s->type);
+		else
+			checked[i] = s->codec == REC_CODEC_RAW ? 1 : 3;
+	}
+	if (checked[i] == 3 && decode){
+		checked[i] = 2;
+		decoded[i].resize(s->n_elem * s->elem_size);
+		if (codec_decode(*s, base + s->offset, decoded[i].data()) == 0)
+			checked[i] = 1;
+		else
+			fprintf(stderr, "record file section type %hu: fail to decode (%s)\n", s->type, get_codec_name(s->codec));
+	}
+	if (checked[i] == 2){
+		failed = true;
+		return NULL;
+	}
+	return s->codec == REC_CODEC_RAW || !decode ? base + s->offset : decoded[i].data();
+}
+
+BitView RecordsView::get_bit_array(uint16_t type) const{
+	BitView b;
+	const RecSection *s = find(type);
+	if (s == NULL)
+		return b;
+	if (s->codec == REC_CODEC_BIT_CHUNK){
+		const uint8_t *p = get_section(type, sizeof(uint32_t), false);
+		if (p == NULL)
+			return b;
+		if (b.chunks.open(p, s->length) || b.chunks.n_word != s->n_elem || (uint64_t)s->aux[0] > s->n_elem * 32){
+			fprintf(stderr, "record file section type %hu: bad bit_chunk\n", s->type);
+			failed = true;
+			b.chunks = BitChunks();
+			return b;
+		}
+	}else {
+		b.v = get<uint32_t>(type);
+		if (b.v.p == NULL)
+			return b;
+	}
+	b.n = s->aux[0];
+	b.format = (BitArray::Format)s->aux[1];
+	return b;
+}
+
+const tcp_sock_init_data* RecordsView::init_data() const{
+	const RecSection *s = find(REC_SEC_INIT_DELTA);
+	InitBase base;
+	if (s == NULL || find(REC_SEC_INIT_DATA))
+		return (const tcp_sock_init_data*)get_section(REC_SEC_INIT_DATA, sizeof(tcp_sock_init_data));
+	if (init.size())
+		return &init[0];
+	Span<uint32_t> delta = get<uint32_t>(REC_SEC_INIT_DELTA);
+	if (delta.p == NULL)
+		return NULL;
+	init.resize(1);
+	if (get_init_base(filename.c_str(), s->aux[0], base) || init_delta_decode(base.d, delta.p, delta.n, init[0])){
+		fprintf(stderr, "%s: no init data baseline %08x, or a bad delta to it\n", filename.c_str(), s->aux[0]);
+		failed = true;
+		init.clear();
+		return NULL;
+	}
+	return &init[0];
+}
+
+uint64_t RecordsView::get_pkt_received() const{
+	Span<deter_event> e = evts();
+	if (e.empty())
+		return 0;
+	return e.back().seq + 1 - e.size();
+}
+
+uint64_t RecordsView::get_total_bytes_received() const{
+	uint64_t total_bytes = 0;
+	for (const deter_rec_sockcall &sc : sockcalls())
+		if (sc.type == DETER_SOCKCALL_TYPE_RECVMSG)
+			total_bytes += sc.recvmsg.size;
+	return total_bytes;
+}
+
+uint64_t RecordsView::get_total_bytes_sent() const{
+	uint64_t total_bytes = 0;
+	for (const deter_rec_sockcall &sc : sockcalls())
+		if (sc.type == DETER_SOCKCALL_TYPE_SENDMSG)
+			total_bytes += sc.sendmsg.size;
+	return total_bytes;
+}
+
+int RecordsView::print_meta(FILE *fout) const{
+	uint64_t sent = get_total_bytes_sent(), received = get_total_bytes_received(), pkt_received = get_pkt_received();
+	if (!ok())
+		return -1;
+	fprintf(fout, "broken: %x\n", meta->broken);
+	fprintf(fout, "alert: %x\n", meta->alert);
+	fprintf(fout, "mode: %u\n", meta->mode);
+	fprintf(fout, "%08x:%hu %08x:%hu\n", meta->sip, meta->sport, meta->dip, meta->dport);
+	fprintf(fout, "fin_seq: %u\n", meta->fin_seq);
+	fprintf(fout, "total bytes sent: %lu\n", sent);
+	fprintf(fout, "total bytes received: %lu\n", received);
+	fprintf(fout, "packets received: %lu\n", pkt_received);
+	return 0;
+}
+
+void BitWords::from_index(const uint32_t *idx, uint64_t n_idx, int x){
+	own.assign((n + 31) / 32, x ? 0 : ~0u);
+	for (uint64_t i = 0; i < n_idx && idx[i] < n; i++)
+		own[idx[i] >> 5] ^= 1u << (idx[i] & 31);
+	w = own.data();
+}
+
+int BitWords::set(const BitView &b){
+	n = b.n;
+	if (b.chunked()){
+		own.resize(b.chunks.n_word);
+		w = own.data();
+		return b.chunks.to_raw(own.data());
+	}
+	if (b.format == BitArray::RAW){
+		if (b.v.size() < (n + 31) / 32)
+			return -1;
+		w = b.v.p;
+	}else
+		from_index(b.v.p, b.v.size(), b.format == BitArray::INDEX_ONE);
+	return 0;
+}
+
+void BitWords::set(const BitArray &b){
+	n = b.n;
+	if (b.format == BitArray::RAW){
+		n = min(n, (uint64_t)b.v.size() * 32);
+		w = b.v.data();
+	}else
+		from_index(b.v.data(), b.v.size(), b.format == BitArray::INDEX_ONE);
+}
+
+int RecordsSource::open(const char *filename){
+	int ret = view.open(filename);
+	v1 = ret == -2;
+	if (v1){
+		if (rec.read_v1(filename))
+			return -1;
+		rec.get_meta(meta);
+		return 0;
+	}
+	if (ret)
+		return -1;
+	meta = *view.meta;
+	return 0;
+}
+
+Span<uint32_t> RecordsSource::tsq() const{
+	#if COLLECT_TX_STAMP
+	if (v1)
+		return span(rec.tsq);
+	#endif
+	return v1 ? Span<uint32_t>() : view.tsq();
+}
+
+int RecordsSource::bits(uint16_t type, BitWords &b) const{
+	if (v1){
+		b.set(type == REC_SEC_MPQ ? rec.mpq : type == REC_SEC_SIQ ? rec.siq : rec.ebq[type - REC_SEC_EBQ(0)]);
+		return 0;
+	}
+	return b.set(view.get_bit_array(type));
+}
@@ -0,0 +1,155 @@
+#ifndef _RECORDS_VIEW_HPP
+#define _RECORDS_VIEW_HPP
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <utility>
+#include "base_struct.hpp"
+#include "records.hpp"
+#include "record_file.hpp"
+#include "bit_chunks.hpp"
+
+/* a read-only array that does not own its memory */
+template <typename T>
+struct Span{
+	const T *p;
+	uint64_t n;
+
+	Span() : p(NULL), n(0) {}
+	Span(const T *_p, uint64_t _n) : p(_p), n(_n) {}
+	const T* begin() const { return p; }
+	const T* end() const { return p + n; }
+	const T& operator[](uint64_t i) const { return p[i]; }
+	const T& back() const { return p[n - 1]; }
+	uint64_t size() const { return n; }
+	bool empty() const { return n == 0; }
+};
+
+/* a BitArray section, words not copied. A RAW array stored as bit_chunk is read in place, without its words */
+struct BitView{
+	uint32_t n;
+	BitArray::Format format;
+	Span<uint32_t> v; // empty if chunked
+	BitChunks chunks;
+
+	BitView() : n(0), format(BitArray::RAW) {}
+	bool chunked() const { return chunks.p != NULL; }
+	// bit i of a RAW array
+	int get(uint32_t i) const { return chunked() ? chunks.get(i) : (v[i >> 5] >> (i & 31)) & 1; }
+};
+
+/*
+ * Zero-copy view of a v2 record file: the file is mmapped and each stream stored raw is a Span into the mapping.
+ * A stream stored with another codec is decoded once, on first access, into a buffer owned by the view.
+ * The header and the section table are checked on open; the CRC of a section is checked the first time it is accessed,
+ * so a scan that only needs a few sections never touches the pages of the others.
+ * v1 files have no section table and can't be viewed; open() returns -2 for them so the caller can fall back to Records.
+ */
+class RecordsView{
+public:
+	RecordsView() : base(NULL), size(0), hdr(NULL), table(NULL), meta(NULL), failed(false) {}
+	~RecordsView() { close(); }
+	// the mapping is owned, so a view can be moved but not copied
+	RecordsView(const RecordsView&) = delete;
+	RecordsView& operator=(const RecordsView&) = delete;
+	RecordsView(RecordsView &&x) : RecordsView() { *this = std::move(x); }
+	RecordsView& operator=(RecordsView &&x);
+	int open(const char* filename);
+	void close();
+
+	const RecSection* find(uint16_t type) const;
+	// the section as an array of T; an empty Span if it is missing, corrupt or of another element size
+	template <typename T>
+	Span<T> get(uint16_t type) const{
+		const uint8_t *p = get_section(type, sizeof(T));
+		const RecSection *s = find(type);
+		if (p == NULL)
+			return Span<T>();
+		return Span<T>((const T*)p, s->n_elem);
+	}
+	BitView get_bit_array(uint16_t type) const;
+	// whether every section access so far passed its checks
+	bool ok() const { return !failed; }
+
+	Span<deter_event> evts() const { return get<deter_event>(REC_SEC_EVT); }
+	Span<deter_rec_sockcall> sockcalls() const { return get<deter_rec_sockcall>(REC_SEC_SOCKCALL); }
+	Span<uint16_t> ps() const { return get<uint16_t>(REC_SEC_PS); }
+	Span<jiffies_rec> jiffies() const { return get<jiffies_rec>(REC_SEC_JIF); }
+	BitView mpq() const { return get_bit_array(REC_SEC_MPQ); }
+	Span<memory_allocated_rec> memory_allocated() const { return get<memory_allocated_rec>(REC_SEC_MA); }
+	Span<skb_mstamp> mstamp() const { return get<skb_mstamp>(REC_SEC_MSTAMP); }
+	Span<uint8_t> siqq() const { return get<uint8_t>(REC_SEC_SIQQ); }
+	BitView siq() const { return get_bit_array(REC_SEC_SIQ); }
+	Span<uint32_t> tsq() const { return get<uint32_t>(REC_SEC_TSQ); }
+	BitView ebq(int i) const { return get_bit_array(REC_SEC_EBQ(i)); }
+	Span<uint8_t> ebx() const { return get<uint8_t>(REC_SEC_EBX); }
+	// from the baseline in the directory of the file if stored as a delta to it
+	const tcp_sock_init_data* init_data() const;
+
+	// same as the counters of Records
+	uint64_t get_pkt_received() const;
+	uint64_t get_total_bytes_received() const;
+	uint64_t get_total_bytes_sent() const;
+	int print_meta(FILE *fout = stdout) const; // nothing is printed if a section needed is corrupt
+
+	const uint8_t *base; // the mapping
+	uint64_t size;
+	const RecFileHeader *hdr;
+	const RecSection *table;
+	const RecMeta *meta;
+private:
+	mutable std::vector<uint8_t> checked; // per section: 0 not yet, 1 good, 2 bad, 3 good but not decoded yet
+	mutable std::vector<std::vector<uint8_t> > decoded; // per section, for those not stored raw
+	mutable bool failed;
+	std::string filename;
+	mutable std::vector<tcp_sock_init_data> init; // init data decoded from a delta
+	// the decoded section, or with decode false, its bytes on disk
+	const uint8_t* get_section(uint16_t type, uint32_t elem_size, bool decode = true) const;
+};
+
+/* the raw words of a bit array however it is stored, in place if they are stored as they are */
+struct BitWords{
+	const uint32_t *w;
+	uint64_t n; // bits
+	std::vector<uint32_t> own; // the words, if decoded
+
+	BitWords() : w(NULL), n(0) {}
+	int set(const BitView &b); // -1 if malformed
+	void set(const BitArray &b);
+	int get(uint64_t i) const { return (w[i >> 5] >> (i & 31)) & 1; }
+private:
+	// the words of n bits whose indexes of the bits that are x are idx
+	void from_index(const uint32_t *idx, uint64_t n_idx, int x);
+};
+
+template <typename T>
+static inline Span<T> span(const std::vector<T> &v){
+	return Span<T>(v.data(), v.size());
+}
+
+/* the streams of a record file: viewed in place with RecordsView if v2, read into Records if v1 */
+struct RecordsSource{
+	RecordsView view;
+	Records rec; // of a v1 file
+	bool v1;
+	RecMeta meta;
+
+	int open(const char *filename);
+	// whether every stream read so far passed its checks
+	bool ok() const { return v1 || view.ok(); }
+	const tcp_sock_init_data* init_data() const { return v1 ? &rec.init_data : view.init_data(); }
+	Span<deter_event> evts() const { return v1 ? span(rec.evts) : view.evts(); }
+	Span<deter_rec_sockcall> sockcalls() const { return v1 ? span(rec.sockcalls) : view.sockcalls(); }
+	Span<uint16_t> ps() const { return v1 ? span(rec.ps) : view.ps(); }
+	Span<jiffies_rec> jiffies() const { return v1 ? span(rec.jiffies) : view.jiffies(); }
+	Span<memory_allocated_rec> memory_allocated() const { return v1 ? span(rec.memory_allocated) : view.memory_allocated(); }
+	Span<skb_mstamp> mstamp() const { return v1 ? span(rec.mstamp) : view.mstamp(); }
+	Span<uint8_t> siqq() const { return v1 ? span(rec.siqq) : view.siqq(); }
+	Span<uint8_t> ebx() const { return v1 ? span(rec.ebx) : view.ebx(); }
+	Span<uint32_t> tsq() const;
+	// mpq, siq or ebq
+	int bits(uint16_t type, BitWords &b) const;
+};
+
+#endif /* _RECORDS_VIEW_HPP */
@@ -32,9 +32,9 @@ static int write_proc(const string &proc_file_name, char *buf, uint32_t len){
 	}
 }
 
-static int send_buffer_size(const string &proc_file_name){
+static int send_buffer_size(const string &proc_file_name, uint64_t size){
 	char buf[32];
-	sprintf(buf, "%lu", sizeof(DeterReplayer));
+	sprintf(buf, "%lu", size);
 	if (write_proc(proc_file_name, buf, strlen(buf))){
 		fprintf(stderr, "Fail to send buffer_size\n");
 		return -1;
@@ -62,16 +62,22 @@ int main(int argc, char **argv){
 	if (argc == 3)
 		dip = argv[2];
 
-	// setup shared memory
-	send_buffer_size("deter_replay");
+	// read records first: the shared memory is sized from them
+	Replayer r;
+	uint64_t size;
 	KernelMem kmem;
-	if (kmem.map_proc_exposed_mem("deter_replay", sizeof(DeterReplayer)))
+	if (r.read_records(argv[1]) || (size = r.get_buffer_size()) == 0)
+		return -1;
+
+	// setup shared memory
+	if (send_buffer_size("deter_replay", size))
+		return -1;
+	if (kmem.map_proc_exposed_mem("deter_replay", size))
 		return -1;
 
 	// make replayer
-	Replayer r;
 	r.set_addr(kmem.buf);
-	if (r.read_records(argv[1]))
+	if (r.convert_records())
 		goto fail_read_records;
 
 	// ensure we enter dip for client mode
@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -108,17 +109,65 @@ int Replayer::convert_siq(){
 	return 0;
 }
 
+void Replayer::get_eb_dense(vector<int> &dense){
+	// the dense locations read the most get a slot; the others replay from the multiplexed queue
+	dense.clear();
+	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++)
+		if (((rec.eb_dense >> i) & 1) && rec.ebq[i].n > 0)
+			dense.push_back(i);
+	stable_sort(dense.begin(), dense.end(), [this](int a, int b){ return rec.ebq[a].n > rec.ebq[b].n; });
+}
+
+u64 Replayer::get_n_ebx(){
+	vector<int> dense;
+	u64 n = rec.ebx.size();
+	get_eb_dense(dense);
+	for (u32 k = DETER_EFFECT_BOOL_N_DENSE; k < dense.size(); k++)
+		n += rec.ebq[dense[k]].n;
+	return n;
+}
+
 int Replayer::convert_effect_bool(){
+	vector<int> dense;
+	get_eb_dense(dense);
 	for (int i = 0; i < DETER_EFFECT_BOOL_N_LOC; i++){
+		d->eb_slot[i] = EFFECT_BOOL_SLOT_MUX;
+		d->ebxq.run_s[i] = d->ebxq.run_h[i] = d->ebxq.run_t[i] = 0;
+	}
+	for (u32 k = 0; k < dense.size() && k < DETER_EFFECT_BOOL_N_DENSE; k++){
+		int i = dense[k];
 		auto &s = rec.ebq[i];
 		if (s.n > EFFECT_BOOL_Q_LEN){
 			fprintf(stderr, "too many effect_bool %d: %u > %u\n", i, s.n, EFFECT_BOOL_Q_LEN);
 			return -1;
 		}
-		d->ebq[i].h = 0;
-		d->ebq[i].t = s.n;
+		d->eb_slot[i] = k;
+		effect_bool_q &q = d->ebq[k];
+		q.h = 0;
+		q.t = s.n;
 		if (s.v.size() > 0)
-			memcpy(d->ebq[i].v, &s.v[0], sizeof(uint32_t) * s.v.size());
+			memcpy(q.v, &s.v[0], sizeof(uint32_t) * s.v.size());
+	}
+	// the entries in read order, then a run per dense location beyond the slots, in the get_n_ebx() entries past d
+	auto &x = rec.ebx;
+	u64 n = x.size();
+	d->ebxq.h = 0;
+	d->ebxq.t = x.size();
+	d->ebxq.len = get_n_ebx();
+	if (x.size() > 0)
+		memcpy(d->ebxv, &x[0], x.size());
+	for (u32 k = DETER_EFFECT_BOOL_N_DENSE; k < dense.size(); k++){
+		int i = dense[k];
+		auto &s = rec.ebq[i];
+		if (s.v.size() * 32 < s.n){
+			fprintf(stderr, "effect_bool %d: %u reads, but %lu words\n", i, s.n, s.v.size());
+			return -1;
+		}
+		d->eb_slot[i] = EFFECT_BOOL_SLOT_RUN;
+		d->ebxq.run_s[i] = d->ebxq.run_h[i] = n;
+		for (u32 j = 0; j < s.n; j++)
+			d->ebxv[n++] = get_ebx_entry(i, (s.v[j >> 5] >> (j & 31)) & 1);
+		d->ebxq.run_t[i] = n;
 	}
 	return 0;
 }
@@ -146,7 +195,20 @@ int Replayer::read_records(const string &record_file_name){
 
 	// make sure records is in final format
 	rec.transform();
+	return 0;
+}
+
+u64 Replayer::get_buffer_size(){
+	u64 n = get_n_ebx();
+	// the kernel takes the size as a u32
+	if (get_deter_replayer_size(n) > UINT32_MAX){
+		fprintf(stderr, "too many multiplexed effect_bool: %lu\n", n);
+		return 0;
+	}
+	return get_deter_replayer_size(n);
+}
 
+int Replayer::convert_records(){
 	// make d out of rec
 	d->mode = rec.mode;
 	if (rec.mode == 0) // server mode
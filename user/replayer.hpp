@@ -15,6 +15,8 @@ public:
 	Replayer();
 	void set_addr(void *addr){d = (DeterReplayer*)addr;}
 	int read_records(const std::string &record_file_name);
+	u64 get_buffer_size(); // of the DeterReplayer for rec, 0 if too large
+	int convert_records(); // make d out of rec
 	int convert_event();
 	int convert_ps();
 	int convert_jiffies();
@@ -22,6 +24,8 @@ public:
 	int convert_memory_allocated();
 	int convert_mstamp();
 	int convert_siq();
+	void get_eb_dense(std::vector<int> &dense);
+	u64 get_n_ebx();
 	int convert_effect_bool();
 	#if ADVANCED_EVENT_ENABLE
 	int convert_advanced_event();
@@ -2,6 +2,9 @@ source ip_util.sh
 
 dstip=0.0.0.0
 ndstip=0.0.0.0
+sample_ppm=1000000
+sample_key=0
+eb_dense=0x1
 do_tcpdump=0
 n_cpu=1
 while [[ $# -gt 0 ]]
@@ -13,6 +16,9 @@ do
 		echo "options:"
 		echo "-d, --dstip             specify the dstip of the connection to record"
 		echo "-n, --ndstip            specify the dstip NOT to record"
+		echo "-s, --sample            record this many per million matching connections"
+		echo "-k, --key               key of the sampling hash (same on both sides)"
+		echo "-e, --eb-dense          mask of effect_bool locations with their own stream (default 0x1)"
 		echo "-p, --tcpdump           do tcpdump"
 		echo "-c, --cpu               number of cpu"
 		shift
@@ -28,6 +34,21 @@ do
 		shift
 		shift
 	;;
+	-s|--sample)
+		sample_ppm=$2
+		shift
+		shift
+	;;
+	-k|--key)
+		sample_key=$2
+		shift
+		shift
+	;;
+	-e|--eb-dense)
+		eb_dense=$2
+		shift
+		shift
+	;;
 	-p|--tcpdump)
 		do_tcpdump=1
 		shift
@@ -53,7 +74,7 @@ if [ $do_tcpdump -eq 1 ]; then
 fi
 
 cd ../kmod
-sudo insmod deter_recorder.ko dstip=$dstip_int ndstip=$ndstip_int
+sudo insmod deter_recorder.ko dstip=$dstip_int ndstip=$ndstip_int sample_ppm=$sample_ppm sample_key=$sample_key eb_dense=$(($eb_dense))
 
 cd ../user
 sudo ./recorder
@@ -0,0 +1,317 @@
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+#include "shared_dict.hpp"
+#include "record_file.hpp"
+
+using namespace std;
+
+static void put32(vector<uint8_t> &out, uint32_t x){
+	out.insert(out.end(), (const uint8_t*)&x, (const uint8_t*)&x + 4);
+}
+static void put_run(vector<uint8_t> &out, const EvtRun &r){
+	put32(out, r.cls);
+	put32(out, r.len);
+	put32(out, r.gap);
+}
+static void append_run(string &key, const EvtRun &r){
+	uint32_t w[3] = {r.cls, r.len, (uint32_t)r.gap};
+	key.append((const char*)w, sizeof(w));
+}
+
+void SharedDict::serialize(vector<uint8_t> &out) const{
+	put32(out, mode);
+	put32(out, port);
+	put32(out, sc.size());
+	for (const deter_rec_sockcall &r : sc)
+		out.insert(out.end(), (const uint8_t*)&r, (const uint8_t*)(&r + 1));
+	put32(out, cls.size());
+	for (uint32_t c : cls)
+		put32(out, c);
+	put32(out, phrases.size());
+	for (auto &p : phrases){
+		put32(out, p.size());
+		for (const EvtRun &r : p)
+			put_run(out, r);
+	}
+}
+
+// reads 4-byte words from a buffer, and remembers if it ran past the end
+struct WordReader{
+	const uint8_t *p, *end;
+	bool overrun;
+
+	WordReader(const uint8_t *_p, uint64_t len) : p(_p), end(_p + len), overrun(false) {}
+	uint32_t get(){
+		uint32_t x = 0;
+		if (end - p < 4){
+			overrun = true;
+			return 0;
+		}
+		memcpy(&x, p, 4);
+		p += 4;
+		return x;
+	}
+	// a count of items of size bytes each, 0 if they would not fit
+	uint32_t get_count(uint64_t size){
+		uint32_t n = get();
+		if (n > (uint64_t)(end - p) / size){
+			overrun = true;
+			return 0;
+		}
+		return n;
+	}
+};
+
+int SharedDict::parse(const uint8_t *p, uint64_t len){
+	WordReader r(p, len);
+	mode = r.get();
+	port = r.get();
+	sc.resize(r.get_count(sizeof(deter_rec_sockcall)));
+	if (sc.size()){
+		memcpy(&sc[0], r.p, sc.size() * sizeof(deter_rec_sockcall));
+		r.p += sc.size() * sizeof(deter_rec_sockcall);
+	}
+	cls.resize(r.get_count(4));
+	for (uint32_t &c : cls)
+		c = r.get();
+	phrases.resize(r.get_count(4));
+	for (auto &ph : phrases){
+		ph.resize(r.get_count(12));
+		for (EvtRun &x : ph){
+			x.cls = r.get();
+			x.len = r.get();
+			x.gap = r.get();
+		}
+		if (ph.empty())
+			return -1;
+	}
+	if (r.overrun || r.p != r.end)
+		return -1;
+	index();
+	return 0;
+}
+
+void SharedDict::index(){
+	sc_idx.clear();
+	cls_idx.clear();
+	phrase_by_cls.clear();
+	for (uint32_t i = 0; i < sc.size(); i++)
+		sc_idx.insert(make_pair(sc_key(sc[i]), i));
+	for (uint32_t i = 0; i < cls.size(); i++)
+		cls_idx.insert(make_pair(cls[i], i));
+	for (uint32_t i = 0; i < phrases.size(); i++)
+		phrase_by_cls[phrases[i][0].cls].push_back(i);
+	for (auto &it : phrase_by_cls)
+		stable_sort(it.second.begin(), it.second.end(), [this](uint32_t a, uint32_t b){
+			return phrases[a].size() > phrases[b].size();
+		});
+}
+
+/*
+ * Sockcalls and phrases are counted once per file they are in, so that those of the service win over those that
+ * one long connection repeats. Phrases are tried at lengths of powers of 2, and kept by files * (runs - 1), about
+ * the runs they save.
+ */
+void SharedDict::train(const vector<vector<deter_rec_sockcall> > &scs, const vector<vector<deter_event> > &evts){
+	unordered_map<ScKey, pair<uint64_t, uint64_t>, ScKeyHash> sc_cnt; // key: (files, last file + 1)
+	unordered_map<string, pair<uint64_t, uint64_t> > ph_cnt; // the same, by phrase
+	unordered_map<uint32_t, uint64_t> cls_cnt;
+	vector<vector<EvtRun> > runs(evts.size());
+
+	for (uint64_t f = 0; f < scs.size(); f++)
+		for (const deter_rec_sockcall &r : scs[f]){
+			auto &c = sc_cnt[sc_key(r)];
+			if (c.second != f + 1)
+				c = make_pair(c.first + 1, f + 1);
+		}
+	vector<pair<uint64_t, ScKey> > order;
+	for (auto &it : sc_cnt)
+		if (it.second.first >= SHARED_DICT_MIN_FILES)
+			order.push_back(make_pair(~it.second.first, it.first)); // most files first
+	sort(order.begin(), order.end());
+	sc.clear();
+	for (uint64_t i = 0; i < order.size() && i < SHARED_DICT_MAX_SC; i++)
+		sc.push_back(sc_record(order[i].second));
+
+	for (uint64_t f = 0; f < evts.size(); f++){
+		vector<pair<uint64_t, uint32_t> > exc;
+		if (get_evt_runs(evts[f].data(), evts[f].size(), runs[f], exc))
+			runs[f].clear();
+		for (const EvtRun &r : runs[f])
+			cls_cnt[r.cls]++;
+	}
+	vector<pair<uint64_t, uint32_t> > cls_order;
+	for (auto &it : cls_cnt)
+		cls_order.push_back(make_pair(~it.second, it.first));
+	sort(cls_order.begin(), cls_order.end());
+	cls.clear();
+	for (auto &it : cls_order)
+		cls.push_back(it.second);
+
+	for (uint64_t len = SHARED_DICT_PHRASE_LEN; len >= 2; len /= 2)
+		for (uint64_t f = 0; f < runs.size(); f++)
+			for (uint64_t i = 0; i + len <= runs[f].size(); i++){
+				string key;
+				for (uint64_t j = i; j < i + len; j++)
+					append_run(key, runs[f][j]);
+				auto &c = ph_cnt[key];
+				if (c.second != f + 1)
+					c = make_pair(c.first + 1, f + 1);
+			}
+	vector<pair<uint64_t, string> > ph_order;
+	for (auto &it : ph_cnt)
+		if (it.second.first >= SHARED_DICT_MIN_FILES)
+			ph_order.push_back(make_pair(~(it.second.first * (it.first.size() / 12 - 1)), it.first));
+	sort(ph_order.begin(), ph_order.end());
+	phrases.clear();
+	for (uint64_t i = 0; i < ph_order.size() && i < SHARED_DICT_MAX_PHRASE; i++){
+		vector<EvtRun> p;
+		WordReader r((const uint8_t*)ph_order[i].second.data(), ph_order[i].second.size());
+		while (r.p < r.end){
+			EvtRun x;
+			x.cls = r.get();
+			x.len = r.get();
+			x.gap = r.get();
+			p.push_back(x);
+		}
+		phrases.push_back(p);
+	}
+	index();
+}
+
+int SharedDictSet::load(const string &dir){
+	RecFileReader r;
+	string path = dir + "/" + SHARED_DICT_FILE;
+	FILE *f = fopen(path.c_str(), "r");
+	v.clear();
+	if (f == NULL)
+		return 0;
+	fclose(f);
+	if (r.open(path.c_str()))
+		goto fail;
+	for (const RecSection &s : r.table){
+		vector<uint8_t> buf;
+		if (s.type != REC_SEC_SHARED_DICT)
+			continue;
+		if (s.aux[1] != SHARED_DICT_VERSION){
+			fprintf(stderr, "%s: dictionary %08x of version %u, expect %u\n", path.c_str(), s.aux[0], s.aux[1], SHARED_DICT_VERSION);
+			continue;
+		}
+		v.push_back(SharedDict());
+		if (r.read_section(&s, buf) || v.back().parse(buf.data(), buf.size()))
+			goto fail;
+		v.back().id = s.aux[0];
+	}
+	return 0;
+fail:
+	fprintf(stderr, "Fail to read %s\n", path.c_str());
+	v.clear();
+	return -1;
+}
+
+int SharedDictSet::save(const string &dir){
+	RecFileWriter w;
+	string path = dir + "/" + SHARED_DICT_FILE, tmp = path + ".tmp";
+	if (w.open(tmp.c_str()))
+		goto fail;
+	for (const SharedDict &d : v){
+		vector<uint8_t> buf;
+		d.serialize(buf);
+		if (w.add_vector(REC_SEC_SHARED_DICT, buf, d.id, SHARED_DICT_VERSION))
+			goto fail;
+	}
+	// records refer to the old dictionaries, so the file is replaced whole or not at all
+	if (w.close() || rename(tmp.c_str(), path.c_str()))
+		goto fail;
+	return 0;
+fail:
+	fprintf(stderr, "Fail to write %s\n", path.c_str());
+	remove(tmp.c_str());
+	return -1;
+}
+
+const SharedDict* SharedDictSet::find(uint32_t id) const{
+	for (const SharedDict &d : v)
+		if (d.id == id)
+			return &d;
+	return NULL;
+}
+
+const SharedDict* SharedDictSet::latest(uint32_t mode, uint32_t port) const{
+	for (uint64_t i = v.size(); i > 0; i--)
+		if (v[i - 1].mode == mode && v[i - 1].port == port)
+			return &v[i - 1];
+	return NULL;
+}
+
+const SharedDict& SharedDictSet::add(SharedDict &d){
+	vector<uint8_t> buf;
+	d.serialize(buf);
+	d.id = crc32c(0, buf.data(), buf.size());
+	d.id += d.id == 0; // 0 is no dictionary
+	const SharedDict *last = latest(d.mode, d.port);
+	if (last && last->id == d.id)
+		return *last;
+	v.push_back(d);
+	return v.back();
+}
+
+/*
+ * dictionaries by id, which stay in place once loaded, and the sets of the directories they were loaded from. A
+ * directory is loaded again only when its SHARED_DICT_FILE was replaced, as init_base.cpp does with its baselines:
+ * the file is always replaced by a rename, so its inode and mtime tell
+ */
+struct CachedSharedDicts{
+	SharedDictSet set;
+	bool loaded;
+	uint64_t ino, mtime;
+	CachedSharedDicts() : loaded(false), ino(0), mtime(0) {}
+};
+static mutex shared_dict_lock;
+static map<uint32_t, SharedDict> shared_dicts;
+static map<string, CachedSharedDicts> shared_dict_dirs;
+
+// with shared_dict_lock held
+static SharedDictSet* load_dir(const string &dir){
+	CachedSharedDicts &c = shared_dict_dirs[dir];
+	struct stat st;
+	uint64_t ino = 0, mtime = 0; // 0 for a missing file
+	if (stat((dir + "/" + SHARED_DICT_FILE).c_str(), &st) == 0){
+		ino = st.st_ino;
+		mtime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+	}
+	if (c.loaded && c.ino == ino && c.mtime == mtime)
+		return &c.set;
+	c.loaded = false;
+	if (c.set.load(dir))
+		return NULL;
+	c.loaded = true;
+	c.ino = ino;
+	c.mtime = mtime;
+	for (const SharedDict &d : c.set.v)
+		if (shared_dicts.count(d.id) == 0)
+			shared_dicts[d.id] = d;
+	return &c.set;
+}
+
+int load_shared_dicts(const char *filename){
+	lock_guard<mutex> g(shared_dict_lock);
+	return load_dir(rec_file_dir(filename)) ? 0 : -1;
+}
+
+const SharedDict* get_shared_dict(uint32_t id){
+	lock_guard<mutex> g(shared_dict_lock);
+	auto it = shared_dicts.find(id);
+	return it == shared_dicts.end() ? NULL : &it->second;
+}
+
+uint32_t get_latest_shared_dict(const char *filename, uint32_t mode, uint32_t port){
+	lock_guard<mutex> g(shared_dict_lock);
+	SharedDictSet *set = load_dir(rec_file_dir(filename));
+	const SharedDict *d = set ? set->latest(mode, port) : NULL;
+	return d ? d->id : 0;
+}
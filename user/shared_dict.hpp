@@ -0,0 +1,163 @@
+#ifndef _SHARED_DICT_HPP
+#define _SHARED_DICT_HPP
+
+#include <stdint.h>
+#include <cstring>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "codec.hpp"
+
+/*
+ * Dictionaries shared by the records of a service (mode and port: sport of a server, dport of a client), whose
+ * connections repeat the same sockcalls and the same runs of events. sc_shared and evt_shared code a section against
+ * the dictionary whose id is in aux[0] of the section, instead of repeating it in every file.
+ * A dictionary holds the sockcall records found in many files, the event classes by number of runs, and phrases:
+ * series of runs (get_evt_runs) found in many files.
+ * The dictionaries of a directory of records are in the record file SHARED_DICT_FILE of that directory, one
+ * REC_SEC_SHARED_DICT section each (aux[0] = id, aux[1] = SHARED_DICT_VERSION of its layout). They are never changed
+ * once written, since records refer to them: a new one is appended, and the last one of a service is the one new
+ * records use. The id is the CRC32C of the section.
+ */
+#define SHARED_DICT_FILE "shared_dict"
+#define SHARED_DICT_VERSION 1
+#define SHARED_DICT_MAX_SC 4096
+#define SHARED_DICT_MAX_PHRASE 1024
+#define SHARED_DICT_PHRASE_LEN 64 // runs in the longest phrase
+#define SHARED_DICT_MIN_FILES 2 // a sockcall or a phrase is in the dictionary if it is in this many files
+
+/*
+ * A sockcall record by the fields of its type, for the dictionaries: the padding and the bytes past the fields of its
+ * type are not part of it. An unknown type keeps all its bytes.
+ * sc_record gives back the record with all other bytes 0, which is how the hooks and Records::transform leave them.
+ */
+static_assert(sizeof(deter_rec_sockcall) == 24 && offsetof(deter_rec_sockcall, thread_id) == 16,
+		"ScKey holds the 16 bytes of the union of a sockcall, then thread_id");
+struct ScKey{
+	uint64_t a, b, thread_id;
+	bool operator==(const ScKey &k) const{
+		return a == k.a && b == k.b && thread_id == k.thread_id;
+	}
+	bool operator<(const ScKey &k) const{
+		return a != k.a ? a < k.a : b != k.b ? b < k.b : thread_id < k.thread_id;
+	}
+};
+struct ScKeyHash{
+	size_t operator()(const ScKey &k) const{
+		uint64_t h = ((k.a * 0x9e3779b97f4a7c15ull) ^ k.b) * 0x9e3779b97f4a7c15ull;
+		h = (h ^ k.thread_id) * 0x9e3779b97f4a7c15ull;
+		return h ^ (h >> 29);
+	}
+};
+
+static inline ScKey sc_key(const deter_rec_sockcall &r){
+	ScKey k;
+	k.thread_id = r.thread_id;
+	switch (r.type){
+		case DETER_SOCKCALL_TYPE_SENDMSG:
+		case DETER_SOCKCALL_TYPE_RECVMSG:
+		case DETER_SOCKCALL_TYPE_SPLICE_READ: // the same layout as sendmsg
+			k.a = r.type | (uint64_t)(uint32_t)r.sendmsg.flags << 32;
+			k.b = r.sendmsg.size;
+			break;
+		case DETER_SOCKCALL_TYPE_CLOSE:
+			k.a = r.type;
+			k.b = r.close.timeout;
+			break;
+		case DETER_SOCKCALL_TYPE_SETSOCKOPT:
+			k.a = r.type | r.setsockopt.level << 8 | r.setsockopt.optname << 16 | (uint64_t)r.setsockopt.optlen << 24;
+			memcpy((uint8_t*)&k.a + 4, r.setsockopt.optval, 4);
+			memcpy(&k.b, r.setsockopt.optval + 4, 8);
+			break;
+		default:
+			memcpy(&k.a, &r, 8);
+			memcpy(&k.b, (const uint8_t*)&r + 8, 8);
+	}
+	return k;
+}
+
+static inline deter_rec_sockcall sc_record(const ScKey &k){
+	deter_rec_sockcall r;
+	memset(&r, 0, sizeof(r));
+	r.thread_id = k.thread_id;
+	switch ((uint8_t)k.a){
+		case DETER_SOCKCALL_TYPE_SENDMSG:
+		case DETER_SOCKCALL_TYPE_RECVMSG:
+		case DETER_SOCKCALL_TYPE_SPLICE_READ:
+			r.sendmsg.type = k.a;
+			r.sendmsg.flags = k.a >> 32;
+			r.sendmsg.size = k.b;
+			break;
+		case DETER_SOCKCALL_TYPE_CLOSE:
+			r.close.type = k.a;
+			r.close.timeout = k.b;
+			break;
+		case DETER_SOCKCALL_TYPE_SETSOCKOPT:
+			r.setsockopt.type = k.a;
+			r.setsockopt.level = k.a >> 8;
+			r.setsockopt.optname = k.a >> 16;
+			r.setsockopt.optlen = k.a >> 24;
+			memcpy(r.setsockopt.optval, (const uint8_t*)&k.a + 4, 4);
+			memcpy(r.setsockopt.optval + 4, &k.b, 8);
+			break;
+		default:
+			memcpy(&r, &k.a, 8);
+			memcpy((uint8_t*)&r + 8, &k.b, 8);
+	}
+	return r;
+}
+
+// whether r is as sc_record leaves it, so a record of its key decodes to its bytes
+static inline bool sc_is_canonical(const deter_rec_sockcall &r){
+	deter_rec_sockcall c = sc_record(sc_key(r));
+	return memcmp(&c, &r, sizeof(r)) == 0;
+}
+
+struct SharedDict{
+	uint32_t id, mode, port;
+	std::vector<deter_rec_sockcall> sc;
+	std::vector<uint32_t> cls; // event classes, most runs first
+	std::vector<std::vector<EvtRun> > phrases;
+
+	// lookups for the codecs, built by index()
+	std::unordered_map<ScKey, uint32_t, ScKeyHash> sc_idx;
+	std::unordered_map<uint32_t, uint32_t> cls_idx;
+	std::unordered_map<uint32_t, std::vector<uint32_t> > phrase_by_cls; // by the class of their first run, longest first
+
+	// | mode:32 | port:32 | n_sc:32 | sockcall records | n_cls:32 | cls:32 * n_cls | n_phrase:32 |
+	// | (n_run:32, (cls:32, len:32, gap:32) * n_run) * n_phrase |
+	void serialize(std::vector<uint8_t> &out) const;
+	int parse(const uint8_t *p, uint64_t len); // return -1 if malformed
+	void index();
+	// from the sockcalls and events of a sample of records of the service
+	void train(const std::vector<std::vector<deter_rec_sockcall> > &scs, const std::vector<std::vector<deter_event> > &evts);
+};
+
+struct SharedDictSet{
+	std::vector<SharedDict> v;
+
+	// a missing file is an empty set
+	int load(const std::string &dir);
+	int save(const std::string &dir);
+	const SharedDict* find(uint32_t id) const;
+	const SharedDict* latest(uint32_t mode, uint32_t port) const;
+	// append d (id set here) unless it is already the latest of its service. Return the one in the set
+	const SharedDict& add(SharedDict &d);
+};
+
+static inline uint32_t service_port(uint32_t mode, uint16_t sport, uint16_t dport){
+	return mode == 0 ? sport : dport;
+}
+
+/*
+ * The dictionaries of the directories of the record files opened so far, for the codecs, which only see the id.
+ * Opening or writing a record file loads the dictionaries of its directory, again only if SHARED_DICT_FILE changed
+ * since. get_shared_dict never loads: the dictionaries a record refers to are there once its file is opened.
+ */
+int load_shared_dicts(const char *filename);
+const SharedDict* get_shared_dict(uint32_t id);
+// the id of the latest dictionary of the service in the directory of filename, 0 if none
+uint32_t get_latest_shared_dict(const char *filename, uint32_t mode, uint32_t port);
+
+#endif /* _SHARED_DICT_HPP */
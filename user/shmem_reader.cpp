@@ -17,23 +17,38 @@ using namespace std;
 
 #define PAGE_SIZE (4*1024)
 
-vector<Records> res(N_RECORDER);
 SharedMemLayout* shmem;
+RecorderPool* pool;
 
 int main(int argc, char** argv)
 {
+	// map the MemBlock region: header first to get its size
 	KernelMem kmem;
 	if (kmem.map_proc_exposed_mem("deter", sizeof(SharedMemLayout)))
 		return -1;
+	uint32_t shmem_size = ((SharedMemLayout*)kmem.buf)->size;
+	kmem.unmap_mem();
+	if (kmem.map_proc_exposed_mem("deter", shmem_size))
+		return -1;
 	shmem = (SharedMemLayout*)kmem.buf;
 
+	// map the recorder pool: header first to get its size
+	KernelMem pool_mem;
+	if (pool_mem.map_proc_exposed_mem("deter_rec_pool", sizeof(RecorderPool)))
+		return -1;
+	uint32_t pool_size = ((RecorderPool*)pool_mem.buf)->size;
+	pool_mem.unmap_mem();
+	if (pool_mem.map_proc_exposed_mem("deter_rec_pool", pool_size))
+		return -1;
+	pool = (RecorderPool*)pool_mem.buf;
+
 	/* do things on the shmem */
-	printf("free_rec_ring %u %u\n", shmem->free_rec_ring.h, shmem->free_rec_ring.t);
-	printf("free_mb_ring %u %u\n", shmem->free_mb_ring.h, shmem->free_mb_ring.t);
+	printf("free_rec_ring %u %u (%u slots)\n", pool->h, pool->t, pool->n_recorder);
+	printf("free_mb_ring %u %u (%u MemBlock)\n", shmem->free_mb_ring.h, shmem->free_mb_ring.t, shmem->n_mem_block);
 	map<uint32_t, int> cnt;
 	for (uint32_t i = shmem->free_mb_ring.h; i < shmem->free_mb_ring.t; i++){
-		//printf("%u %u\n", i, shmem->free_mb_ring.v[get_free_mb_ring_idx(i)]);
-		cnt[shmem->free_mb_ring.v[get_free_mb_ring_idx(i)]]++;
+		//printf("%u %u\n", i, get_free_mb_ring(shmem)[get_mb_ring_idx(shmem, i)]);
+		cnt[get_free_mb_ring(shmem)[get_mb_ring_idx(shmem, i)]]++;
 	}
 	printf("# diff mb idx in free_mb_ring: %lu\n", cnt.size());
 	printf("\n");
@@ -41,15 +56,20 @@ int main(int argc, char** argv)
 	printf("done_mb_ring %u %u\n", shmem->done_mb_ring.h, shmem->done_mb_ring.t);
 	#if 0
 	for (uint32_t i = shmem->done_mb_ring.h; i < shmem->done_mb_ring.t; i++){
-		printf("%u %u\n", i, shmem->done_mb_ring.v[get_done_mb_ring_idx(i)]);
+		printf("%u %u\n", i, get_done_mb_ring(shmem)[get_mb_ring_idx(shmem, i)]);
 	}
 	#endif
 
-	for (uint32_t i = 0; i < N_RECORDER; i++)
-		printf("rec[%u]: used_mb: %u dump_mb: %u\n", i, shmem->recorder[i].used_mb, shmem->recorder[i].dump_mb);
-	for (uint32_t i = 0; i < 32; i++)
-		printf("mb[%u]: offset: %lu rec_id = %u len = %hu type = %hhu\n", i, (uint64_t)&shmem->mem_block[i] - (uint64_t)shmem, shmem->mem_block[i].rec_id, shmem->mem_block[i].len, shmem->mem_block[i].type);
+	for (uint32_t i = 0; i < pool->n_recorder && i < 32; i++){
+		DeterRecorder *rec = get_pool_recorder(pool, i);
+		printf("rec[%u]: gen: %u used_mb: %u\n", i, rec->gen, rec->used_mb);
+	}
+	for (uint32_t i = 0; i < shmem->n_mem_block && i < 32; i++){
+		MemBlock *mb = get_mem_block(shmem, i);
+		printf("mb[%u]: offset: %lu rec_id = %u len = %hu type = %hhu\n", i, (uint64_t)mb - (uint64_t)shmem, mb->rec_id, mb->len, mb->type);
+	}
 
+	pool_mem.unmap_mem();
 	kmem.unmap_mem();
 
 	return 0;